@@ -0,0 +1,50 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <cstddef>
+#include <vector>
+
+// the block compressed formats: 4x4 texel blocks of 8 (BC1, BC4) or 16 bytes
+enum class BlockFormat
+{
+	BC1,	// RGB, 4 bits per texel (DXT1)
+	BC3,	// RGBA, BC1 color with a BC4 alpha block (DXT5)
+	BC4,	// R, 4 bits per texel (RGTC1)
+	BC5,	// RG, two BC4 blocks (RGTC2)
+	BC7		// RGBA, 8 bits per texel (BPTC); loaded from containers only, not encoded here
+};
+
+/*
+
+	A CPU encoder and decoder of the BC formats, for textures that only exist as PNG or BMP.
+
+	Encode() takes RGBA8 texels (any size: the last blocks of a row or column repeat the edge
+	texels) and returns the blocks row by row, as glCompressedTexImage2D wants them. Rows of
+	blocks are encoded in parallel (ParallelFor). The color endpoints of BC1 and BC3 are fitted
+	along the principal axis of the block and refined once with least squares; the texel to
+	palette distances are computed four texels at a time with SSE2 where it is available.
+
+	Decode() is the reference the PSNR of an encoding is measured with, over the channels the
+	format keeps.
+
+*/
+class BlockCompression
+{
+public:
+	static size_t		BlockSize(BlockFormat format);
+	// the size of the blocks of a width x height image
+	static size_t		ImageSize(BlockFormat format, int width, int height);
+	// the GL internal format; sRGB only exists for the color formats
+	static GLenum		GLFormat(BlockFormat format, bool srgb = false);
+	// the context can sample it (S3TC, RGTC and BPTC)
+	static bool			IsSupported(BlockFormat format);
+	static bool			CanEncode(BlockFormat format) { return format != BlockFormat::BC7; }
+
+	static std::vector<unsigned char>	Encode(const unsigned char* rgba, int width, int height, BlockFormat format);
+	// back to RGBA8: the missing channels are 0, alpha 255
+	static std::vector<unsigned char>	Decode(const unsigned char* blocks, int width, int height, BlockFormat format);
+	// in dB, over the channels format keeps; 99 for identical images
+	static double		PSNR(const unsigned char* rgbaA, const unsigned char* rgbaB, int width, int height, BlockFormat format);
+};
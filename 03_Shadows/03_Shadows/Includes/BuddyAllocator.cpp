@@ -0,0 +1,136 @@
+#include "BuddyAllocator.h"
+
+#include <algorithm>
+#include <cassert>
+
+BuddyAllocator::BuddyAllocator(size_t capacity, size_t minBlock) : m_minBlock(std::max<size_t>(1, minBlock))
+{
+	if (capacity == 0)
+		return;
+
+	const unsigned order = OrderFor(capacity);
+	m_capacity = SizeOf(order);
+	m_free.resize(order + 1);
+	m_free[order].insert(0);
+}
+
+unsigned BuddyAllocator::OrderFor(size_t count) const
+{
+	const size_t blocks = (std::max<size_t>(1, count) + m_minBlock - 1) / m_minBlock;
+
+	unsigned order = 0;
+	while ((size_t(1) << order) < blocks)
+		++order;
+	return order;
+}
+
+size_t BuddyAllocator::Allocate(size_t count)
+{
+	if (m_free.empty())
+		return INVALID;
+
+	const unsigned order = OrderFor(count);
+
+	unsigned k = order;
+	while (k < m_free.size() && m_free[k].empty())
+		++k;
+	if (k >= m_free.size())
+		return INVALID;
+
+	const size_t offset = *m_free[k].begin();
+	m_free[k].erase(m_free[k].begin());
+
+	// split until the block has the right size, the upper halves become free
+	while (k > order)
+	{
+		--k;
+		m_free[k].insert(offset + SizeOf(k));
+	}
+
+	m_blocks[offset] = { order, count };
+	m_allocated += SizeOf(order);
+	m_requested += count;
+	return offset;
+}
+
+void BuddyAllocator::Free(size_t offset)
+{
+	auto it = m_blocks.find(offset);
+	assert(it != m_blocks.end() && "BuddyAllocator::Free: not an allocated block");
+	if (it == m_blocks.end())
+		return;
+
+	unsigned order = it->second.order;
+	m_allocated -= SizeOf(order);
+	m_requested -= it->second.requested;
+	m_blocks.erase(it);
+
+	// merge with the buddy for as long as it is free
+	while (order + 1 < m_free.size())
+	{
+		const size_t buddy = offset ^ SizeOf(order);
+		auto buddyIt = m_free[order].find(buddy);
+		if (buddyIt == m_free[order].end())
+			break;
+
+		m_free[order].erase(buddyIt);
+		offset = std::min(offset, buddy);
+		++order;
+	}
+	m_free[order].insert(offset);
+}
+
+void BuddyAllocator::Grow()
+{
+	if (m_free.empty())
+	{
+		m_capacity = m_minBlock;
+		m_free.resize(1);
+		m_free[0].insert(0);
+		return;
+	}
+
+	const unsigned top = (unsigned)m_free.size() - 1;
+	m_free.resize(top + 2);
+
+	if (m_free[top].count(0) != 0)
+	{
+		// the old range was entirely free: the whole new range is one block
+		m_free[top].erase(0);
+		m_free[top + 1].insert(0);
+	}
+	else
+		m_free[top].insert(m_capacity);
+
+	m_capacity *= 2;
+}
+
+size_t BuddyAllocator::BlockSize(size_t offset) const
+{
+	auto it = m_blocks.find(offset);
+	return it == m_blocks.end() ? 0 : SizeOf(it->second.order);
+}
+
+BuddyAllocator::Stats BuddyAllocator::GetStats() const
+{
+	Stats stats;
+	stats.capacity		= m_capacity;
+	stats.allocated		= m_allocated;
+	stats.requested		= m_requested;
+	stats.freeUnits		= m_capacity - m_allocated;
+	stats.allocations	= m_blocks.size();
+
+	for (unsigned k = 0; k < m_free.size(); ++k)
+	{
+		stats.freeBlocks += m_free[k].size();
+		if (!m_free[k].empty())
+			stats.largestFree = SizeOf(k);
+	}
+	return stats;
+}
+
+double BuddyAllocator::ExternalFragmentation() const
+{
+	const Stats stats = GetStats();
+	return stats.freeUnits == 0 ? 0.0 : 1.0 - double(stats.largestFree) / double(stats.freeUnits);
+}
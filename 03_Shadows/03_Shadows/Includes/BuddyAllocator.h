@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+/*
+
+	Binary buddy allocator over an abstract range of units (bytes, vertices, indices, ...). It only
+	does the bookkeeping, the memory itself lives elsewhere (e.g. in an OpenGL buffer).
+
+	Every block is a power of two multiple of minBlock units and lies at an offset that is a
+	multiple of its size. Freed blocks are merged with their buddy when it is free too. Grow()
+	doubles the range: the old range becomes the left half, the new right half is one free block.
+
+*/
+class BuddyAllocator final
+{
+public:
+	static const size_t INVALID = ~size_t(0);
+
+	struct Stats
+	{
+		size_t capacity{};			// units in the range
+		size_t allocated{};			// units in allocated blocks, including the rounding to powers of two
+		size_t requested{};			// units actually asked for
+		size_t freeUnits{};
+		size_t largestFree{};		// the largest request that can currently be served
+		size_t freeBlocks{};
+		size_t allocations{};
+	};
+
+	// capacity is rounded up to minBlock times a power of two
+	explicit BuddyAllocator(size_t capacity = 0, size_t minBlock = 1);
+
+	size_t	Allocate(size_t count);	// offset of the block or INVALID if no free block is large enough
+	void	Free(size_t offset);
+	void	Grow();
+
+	size_t	Capacity() const { return m_capacity; }
+	size_t	BlockSize(size_t offset) const;
+	Stats	GetStats() const;
+
+	// 1 - largest free block / free units: 0 if every free unit is in one block
+	double	ExternalFragmentation() const;
+
+private:
+	size_t		SizeOf(unsigned order) const { return m_minBlock << order; }
+	unsigned	OrderFor(size_t count) const;
+
+	struct Block
+	{
+		unsigned	order;
+		size_t		requested;
+	};
+
+	size_t	m_minBlock;
+	size_t	m_capacity{};
+	size_t	m_requested{};
+	size_t	m_allocated{};
+
+	std::vector< std::set<size_t> >			m_free;			// free block offsets per order, lowest address first
+	std::unordered_map<size_t, Block>		m_blocks;		// allocated blocks by offset
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <string>
+#include <vector>
+
+#include "BlockCompression.h"
+#include "MipGenerator.h"
+
+/*
+
+	A block compressed 2D texture with its mip levels, as glCompressedTexImage2D takes it
+	(TextureObject::AttachCompressed uploads it).
+
+	Load() reads DDS (with or without the DX10 header) and KTX2 (no supercompression) files of the
+	BC formats in BlockFormat. Cook() makes one from an image SDL_image can decode, PNG or BMP:
+	it filters the mip chain with MipGenerator (in linear space for the color formats, BC1 and
+	BC3), encodes every level with BlockCompression, measures the PSNR of level 0 and saves the
+	result as DDS, which is what LoadOrCook() loads the next time. The PSNR goes into reserved
+	fields of the DDS header, so a texture loaded from the cooked file still has it.
+
+*/
+struct CompressedTexture
+{
+	struct Level
+	{
+		GLsizei						width;
+		GLsizei						height;
+		std::vector<unsigned char>	data;
+	};
+
+	BlockFormat			format = BlockFormat::BC1;
+	bool				srgb = false;
+	std::vector<Level>	levels;		// the largest first
+	double				psnr = 0;	// of level 0 against the image it was cooked from, 0 if unknown
+
+	GLenum	InternalFormat()	const { return BlockCompression::GLFormat(format, srgb); }
+	bool	IsEmpty()			const { return levels.empty(); }
+	size_t	Bytes()				const;	// of every level
+	double	Ratio()				const;	// the RGBA8 size of the same levels to Bytes()
+
+	// by the extension: .dds or .ktx2
+	bool	Load(const std::string& filename);
+	bool	LoadDDS(const std::string& filename);
+	bool	LoadKTX2(const std::string& filename);
+	bool	SaveDDS(const std::string& filename) const;
+
+	// encodes image (with a mip chain if mipmaps) to format and saves it to cooked; empty if image cannot be read
+	static CompressedTexture	Cook(const std::string& image, const std::string& cooked, BlockFormat format, bool mipmaps = true, MipFilter filter = MipFilter::Kaiser);
+	// image with a .dds extension if it was cooked already, otherwise Cook() it now
+	static CompressedTexture	LoadOrCook(const std::string& image, BlockFormat format, bool mipmaps = true, MipFilter filter = MipFilter::Kaiser);
+};
@@ -0,0 +1,372 @@
+#include "FrameGraph.h"
+#include "GLCaps.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	// framebuffers none of the passes asked for in this many frames are deleted
+	const unsigned FRAMEBUFFER_EVICT_FRAMES = 60;
+
+	const char* StatusString(GLenum status)
+	{
+		switch (status)
+		{
+		case GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT:			return "GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT";
+		case GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT:	return "GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT";
+		case GL_FRAMEBUFFER_UNSUPPORTED:					return "GL_FRAMEBUFFER_UNSUPPORTED";
+		default:											return "unknown status";
+		}
+	}
+
+	double Megabytes(GLsizeiptr bytes)
+	{
+		return bytes / 1048576.0;
+	}
+}
+
+//
+// Builder
+//
+
+FrameGraph::Resource FrameGraph::Builder::Create(const char* name, const TextureDesc& desc)
+{
+	ResourceNode node;
+	node.name = name;
+	node.desc = desc;
+	m_graph.m_resources.push_back(node);
+	return Resource(m_graph.m_resources.size() - 1);
+}
+
+FrameGraph::Resource FrameGraph::Builder::Read(Resource resource)
+{
+	m_graph.m_passes[m_pass].reads.push_back(resource);
+	return resource;
+}
+
+FrameGraph::Resource FrameGraph::Builder::Write(Resource resource, GLenum attachment)
+{
+	PassNode& pass = m_graph.m_passes[m_pass];
+	pass.writes.push_back({ resource, attachment });
+
+	ResourceNode& node = m_graph.m_resources[resource];
+	node.writers.push_back(m_pass);
+	if (node.imported)
+		pass.sideEffect = true;
+	return resource;
+}
+
+void FrameGraph::Builder::SideEffect()
+{
+	m_graph.m_passes[m_pass].sideEffect = true;
+}
+
+//
+// FrameGraph
+//
+
+FrameGraph::~FrameGraph()
+{
+	Clear();
+}
+
+void FrameGraph::Reset()
+{
+	m_passes.clear();
+	m_resources.clear();
+	m_stats = Stats();
+	++m_frame;
+	m_pool.NewFrame();
+
+	for (auto it = m_framebuffers.begin(); it != m_framebuffers.end(); )
+	{
+		if (it->lastUsed + FRAMEBUFFER_EVICT_FRAMES < m_frame)
+		{
+			GLState::DeleteFramebuffers(1, &it->framebuffer);
+			it = m_framebuffers.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
+FrameGraph::Resource FrameGraph::ImportBackbuffer(GLsizei width, GLsizei height)
+{
+	ResourceNode node;
+	node.name		= "backbuffer";
+	node.desc		= { GL_RGBA8, width, height };
+	node.imported	= true;
+	m_resources.push_back(node);
+	return Resource(m_resources.size() - 1);
+}
+
+void FrameGraph::AddPass(const char* name, const Setup& setup, const Run& run)
+{
+	PassNode pass;
+	pass.name		= name;
+	pass.run		= run;
+	m_passes.push_back(pass);
+
+	Builder builder(*this, unsigned(m_passes.size() - 1));
+	setup(builder);
+}
+
+void FrameGraph::Compile()
+{
+	Cull();
+	Allocate();
+
+	for (PassNode& pass : m_passes)
+	{
+		if (pass.culled || pass.writes.empty())
+			continue;
+
+		const TextureDesc& desc = m_resources[pass.writes.front().resource].desc;
+		pass.width	= desc.width;
+		pass.height	= desc.height;
+		pass.framebuffer = Framebuffer(pass);
+	}
+	m_stats.framebuffers = unsigned(m_framebuffers.size());
+}
+
+// Reference counting backwards from the results nobody reads: a pass goes when none of its outputs is needed,
+// and then the resources it reads lose a reader.
+void FrameGraph::Cull()
+{
+	std::vector<Resource> unused;
+
+	for (PassNode& pass : m_passes)
+	{
+		pass.outputs = unsigned(pass.writes.size());
+		for (Resource resource : pass.reads)
+			++m_resources[resource].readers;
+	}
+
+	auto cull = [&](PassNode& pass) {
+		pass.culled = true;
+		for (Resource resource : pass.reads)
+			if (--m_resources[resource].readers == 0 && !m_resources[resource].imported)
+				unused.push_back(resource);
+	};
+
+	// the resources first: culling a pass below pushes the ones that lose their last reader
+	for (Resource resource = 0; resource < m_resources.size(); ++resource)
+		if (m_resources[resource].readers == 0 && !m_resources[resource].imported)
+			unused.push_back(resource);
+
+	for (PassNode& pass : m_passes)
+		if (pass.outputs == 0 && !pass.sideEffect)
+			cull(pass);
+
+	while (!unused.empty())
+	{
+		const Resource resource = unused.back();
+		unused.pop_back();
+
+		for (unsigned writer : m_resources[resource].writers)
+		{
+			PassNode& pass = m_passes[writer];
+			if (!pass.culled && --pass.outputs == 0 && !pass.sideEffect)
+				cull(pass);
+		}
+	}
+
+	m_stats.passes = unsigned(m_passes.size());
+	m_stats.culled = unsigned(std::count_if(m_passes.begin(), m_passes.end(), [](const PassNode& pass) { return pass.culled; }));
+}
+
+// Takes the transient textures from the pool in pass order, and gives each back after its last pass,
+// so the ones that come later can get the same texture
+void FrameGraph::Allocate()
+{
+	for (int index = 0; index < int(m_passes.size()); ++index)
+	{
+		const PassNode& pass = m_passes[index];
+		if (pass.culled)
+			continue;
+
+		auto use = [&](Resource resource) {
+			ResourceNode& node = m_resources[resource];
+			if (node.firstPass < 0)
+				node.firstPass = index;
+			node.lastPass = index;
+		};
+		for (Resource resource : pass.reads)
+			use(resource);
+		for (const Attachment& write : pass.writes)
+			use(write.resource);
+	}
+
+	std::vector<unsigned> textures;
+	for (int index = 0; index < int(m_passes.size()); ++index)
+	{
+		for (ResourceNode& node : m_resources)
+			if (!node.imported && node.firstPass == index)
+			{
+				node.target = m_pool.Acquire(node.desc.internalFormat, node.desc.width, node.desc.height);
+
+				const GLsizeiptr bytes = RenderTargetPool::BytesPerTexel(node.target.internalFormat) * node.target.width * node.target.height;
+				++m_stats.transients;
+				m_stats.requestedBytes += bytes;
+				if (std::find(textures.begin(), textures.end(), node.target.id) == textures.end())
+				{
+					textures.push_back(node.target.id);
+					m_stats.allocatedBytes += bytes;
+				}
+			}
+
+		for (ResourceNode& node : m_resources)
+			if (!node.imported && node.lastPass == index)
+				m_pool.Release(node.target);
+	}
+	m_stats.textures = unsigned(textures.size());
+}
+
+GLuint FrameGraph::Framebuffer(const PassNode& pass)
+{
+	std::vector<std::pair<GLenum, unsigned>> attachments;
+	for (const Attachment& write : pass.writes)
+	{
+		const ResourceNode& node = m_resources[write.resource];
+		if (node.imported)
+		{
+			if (pass.writes.size() > 1)
+				std::cerr << "[FrameGraph] " << pass.name << ": the backbuffer cannot be written together with textures" << std::endl;
+			return 0;
+		}
+		attachments.push_back({ write.attachment, node.target.id });
+	}
+
+	for (CachedFramebuffer& cached : m_framebuffers)
+		if (cached.attachments == attachments)
+		{
+			cached.lastUsed = m_frame;
+			return cached.framebuffer;
+		}
+
+	const bool dsa = GLCaps::Get().directStateAccess;
+
+	GLuint framebuffer;
+	if (dsa)
+		glCreateFramebuffers(1, &framebuffer);
+	else
+	{
+		glGenFramebuffers(1, &framebuffer);
+		GLState::BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	}
+
+	std::vector<GLenum> drawBuffers;
+	for (const Attachment& write : pass.writes)
+	{
+		const GLuint texture = m_resources[write.resource].target.texture;
+		if (dsa)
+			glNamedFramebufferTexture(framebuffer, write.attachment, texture, 0);
+		else
+			glFramebufferTexture2D(GL_FRAMEBUFFER, write.attachment, GL_TEXTURE_2D, texture, 0);
+
+		if (write.attachment != GL_DEPTH_ATTACHMENT && write.attachment != GL_STENCIL_ATTACHMENT && write.attachment != GL_DEPTH_STENCIL_ATTACHMENT)
+			drawBuffers.push_back(write.attachment);
+	}
+
+	// without color attachments there is nothing to draw into or read from
+	if (drawBuffers.empty())
+	{
+		if (dsa)
+		{
+			glNamedFramebufferDrawBuffer(framebuffer, GL_NONE);
+			glNamedFramebufferReadBuffer(framebuffer, GL_NONE);
+		}
+		else
+		{
+			glDrawBuffer(GL_NONE);
+			glReadBuffer(GL_NONE);
+		}
+	}
+	else if (dsa)
+		glNamedFramebufferDrawBuffers(framebuffer, GLsizei(drawBuffers.size()), drawBuffers.data());
+	else
+		glDrawBuffers(GLsizei(drawBuffers.size()), drawBuffers.data());
+
+	const GLenum status = dsa ? glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) : glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+		std::cerr << "[FrameGraph] " << pass.name << ": incomplete framebuffer (" << StatusString(status) << ")" << std::endl;
+
+	m_framebuffers.push_back({ attachments, framebuffer, m_frame });
+	return framebuffer;
+}
+
+void FrameGraph::Execute()
+{
+	for (const PassNode& pass : m_passes)
+	{
+		if (pass.culled)
+			continue;
+
+		if (!pass.writes.empty())
+		{
+			GLState::BindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+			GLState::Viewport(0, 0, pass.width, pass.height);
+			m_currentFramebuffer = pass.framebuffer;
+		}
+		if (pass.run)
+			pass.run();
+	}
+	m_currentFramebuffer = 0;
+}
+
+const RenderTargetPool::Target& FrameGraph::GetTarget(Resource resource) const
+{
+	static const RenderTargetPool::Target none;
+	return resource < m_resources.size() ? m_resources[resource].target : none;
+}
+
+std::string FrameGraph::Dump() const
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(1);
+
+	out << m_stats.passes << " passes (" << m_stats.culled << " culled), "
+		<< m_stats.transients << " transient textures in " << m_stats.textures << ": "
+		<< Megabytes(m_stats.allocatedBytes) << " MB instead of " << Megabytes(m_stats.requestedBytes) << " MB, "
+		<< Megabytes(m_stats.SavedBytes()) << " MB saved by aliasing\n";
+
+	for (const PassNode& pass : m_passes)
+	{
+		out << (pass.culled ? "  [culled] " : "  ") << pass.name << ":";
+		for (Resource resource : pass.reads)
+			out << " <" << m_resources[resource].name;
+		for (const Attachment& write : pass.writes)
+			out << " >" << m_resources[write.resource].name;
+		if (!pass.culled && !pass.writes.empty())
+			out << " (framebuffer " << pass.framebuffer << ")";
+		out << "\n";
+	}
+
+	for (const ResourceNode& node : m_resources)
+	{
+		if (node.imported)
+			continue;
+
+		out << "  " << node.name << " " << node.desc.width << "x" << node.desc.height;
+		if (node.firstPass < 0)
+			out << ": unused\n";
+		else
+			out << ": passes " << node.firstPass << "-" << node.lastPass << ", texture " << node.target.texture
+				<< " (" << node.target.width << "x" << node.target.height << ")\n";
+	}
+	return out.str();
+}
+
+void FrameGraph::Clear()
+{
+	for (const CachedFramebuffer& cached : m_framebuffers)
+		GLState::DeleteFramebuffers(1, &cached.framebuffer);
+	m_framebuffers.clear();
+	m_pool.Clear();
+	m_passes.clear();
+	m_resources.clear();
+}
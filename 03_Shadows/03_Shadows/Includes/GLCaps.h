@@ -0,0 +1,37 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+/*
+
+	What the current OpenGL context can do. Queried once, on the first call to Get(), which
+	therefore has to happen after glewInit().
+
+	The wrapper classes pick their code path from here: with directStateAccess they create and
+	edit objects by name, without binding them, otherwise they bind to edit.
+
+*/
+struct GLCaps final
+{
+	GLint	majorVersion{};
+	GLint	minorVersion{};
+
+	bool	bufferStorage{};					// glBufferStorage: GL 4.4 or ARB_buffer_storage
+	bool	directStateAccess{};				// glCreate*, glNamed*, glTexture*: GL 4.5 or ARB_direct_state_access
+	bool	textureStorage{};					// glTexStorage2D: GL 4.2 or ARB_texture_storage
+	bool	samplerObjects{};					// glGenSamplers: GL 3.3 or ARB_sampler_objects
+	bool	parallelShaderCompile{};			// GL_COMPLETION_STATUS_KHR: KHR_parallel_shader_compile
+	bool	programBinary{};					// glProgramBinary: GL 4.1 or ARB_get_program_binary, with a binary format
+	bool	textureCompressionS3TC{};			// BC1-BC3: EXT_texture_compression_s3tc
+	bool	textureCompressionRGTC{};			// BC4, BC5: GL 3.0 or ARB_texture_compression_rgtc
+	bool	textureCompressionBPTC{};			// BC7: GL 4.2 or ARB_texture_compression_bptc
+	float	maxAnisotropy{ 1 };					// 1 if EXT_texture_filter_anisotropic is missing
+	GLint	uniformBufferOffsetAlignment{ 256 };	// glBindBufferRange offsets into GL_UNIFORM_BUFFER
+	GLint	maxUniformBlockSize{ 16384 };
+	GLint	maxArrayTextureLayers{ 256 };			// the layers of a GL_TEXTURE_2D_ARRAY (TextureAtlas)
+
+	static const GLCaps& Get();
+
+	bool	AtLeast(GLint major, GLint minor) const { return majorVersion > major || (majorVersion == major && minorVersion >= minor); }
+};
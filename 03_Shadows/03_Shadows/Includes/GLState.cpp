@@ -0,0 +1,661 @@
+#include "GLState.h"
+#include "PipelineState.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+
+namespace
+{
+	// the value of every shadowed variable that we cannot vouch for
+	const GLint UNKNOWN = -1;
+
+	const GLuint MAX_TEXTURE_UNITS = 32;
+
+	struct Target
+	{
+		GLenum target;
+		GLenum binding;	// the glGet name of what is bound to target
+	};
+
+	const Target BUFFER_TARGETS[] = {
+		{ GL_ARRAY_BUFFER,				GL_ARRAY_BUFFER_BINDING },
+		{ GL_ELEMENT_ARRAY_BUFFER,		GL_ELEMENT_ARRAY_BUFFER_BINDING },
+		{ GL_UNIFORM_BUFFER,			GL_UNIFORM_BUFFER_BINDING },
+		{ GL_PIXEL_PACK_BUFFER,			GL_PIXEL_PACK_BUFFER_BINDING },
+		{ GL_PIXEL_UNPACK_BUFFER,		GL_PIXEL_UNPACK_BUFFER_BINDING },
+		{ GL_COPY_READ_BUFFER,			GL_COPY_READ_BUFFER_BINDING },
+		{ GL_COPY_WRITE_BUFFER,			GL_COPY_WRITE_BUFFER_BINDING },
+		{ GL_DRAW_INDIRECT_BUFFER,		GL_DRAW_INDIRECT_BUFFER_BINDING },
+		{ GL_DISPATCH_INDIRECT_BUFFER,	GL_DISPATCH_INDIRECT_BUFFER_BINDING },
+		{ GL_SHADER_STORAGE_BUFFER,		GL_SHADER_STORAGE_BUFFER_BINDING },
+		{ GL_ATOMIC_COUNTER_BUFFER,		GL_ATOMIC_COUNTER_BUFFER_BINDING },
+		{ GL_QUERY_BUFFER,				GL_QUERY_BUFFER_BINDING },
+		{ GL_TEXTURE_BUFFER,			GL_TEXTURE_BUFFER_BINDING },
+		{ GL_TRANSFORM_FEEDBACK_BUFFER,	GL_TRANSFORM_FEEDBACK_BUFFER_BINDING },
+	};
+	const size_t BUFFER_TARGET_COUNT = sizeof(BUFFER_TARGETS) / sizeof(BUFFER_TARGETS[0]);
+
+	const Target TEXTURE_TARGETS[] = {
+		{ GL_TEXTURE_2D,		GL_TEXTURE_BINDING_2D },
+		{ GL_TEXTURE_CUBE_MAP,	GL_TEXTURE_BINDING_CUBE_MAP },
+		{ GL_TEXTURE_2D_ARRAY,	GL_TEXTURE_BINDING_2D_ARRAY },
+		{ GL_TEXTURE_3D,		GL_TEXTURE_BINDING_3D },
+	};
+	const size_t TEXTURE_TARGET_COUNT = sizeof(TEXTURE_TARGETS) / sizeof(TEXTURE_TARGETS[0]);
+
+	const GLenum CAPABILITIES[] = {
+		GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST, GL_STENCIL_TEST, GL_POLYGON_OFFSET_FILL, GL_FRAMEBUFFER_SRGB
+	};
+	const size_t CAPABILITY_COUNT = sizeof(CAPABILITIES) / sizeof(CAPABILITIES[0]);
+
+	struct State
+	{
+		GLint program;
+		GLint vertexArray;
+		GLint buffers[BUFFER_TARGET_COUNT];
+		GLint activeTexture;
+		GLint textures[MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+		GLint samplers[MAX_TEXTURE_UNITS];
+		GLint drawFramebuffer;
+		GLint readFramebuffer;
+		GLint viewport[4];
+		GLint capabilities[CAPABILITY_COUNT];
+		GLint blendSrc, blendDst;
+		GLint blendEquation;
+		GLint depthMask;
+		GLint depthFunc;
+		GLint cullFace;
+	};
+
+	// indexed binding points of GL_UNIFORM_BUFFER and GL_SHADER_STORAGE_BUFFER
+	const GLuint MAX_INDEXED_BINDINGS = 16;
+
+	struct IndexedBinding
+	{
+		GLint		buffer;
+		GLintptr	offset;
+		GLsizeiptr	size;	// 0 for glBindBufferBase
+	};
+
+	const Target INDEXED_TARGETS[] = {
+		{ GL_UNIFORM_BUFFER,		GL_UNIFORM_BUFFER_BINDING },
+		{ GL_SHADER_STORAGE_BUFFER,	GL_SHADER_STORAGE_BUFFER_BINDING },
+	};
+	const size_t INDEXED_TARGET_COUNT = sizeof(INDEXED_TARGETS) / sizeof(INDEXED_TARGETS[0]);
+
+	State					g_state;
+	IndexedBinding			g_indexed[INDEXED_TARGET_COUNT][MAX_INDEXED_BINDINGS];
+	GLState::Counters		g_currentFrame;
+	GLState::Counters		g_lastFrame;
+	bool					g_validate = false;
+	bool					g_initialized = false;
+	unsigned				g_pipeline = 0;		// Id() of the pipeline applied last, 0 if the state changed since
+
+	void Forget()
+	{
+		GLint* begin = reinterpret_cast<GLint*>(&g_state);
+		std::fill(begin, begin + sizeof(State) / sizeof(GLint), UNKNOWN);
+		for (auto& target : g_indexed)
+			for (IndexedBinding& binding : target)
+				binding = { UNKNOWN, 0, 0 };
+		g_pipeline = 0;
+		g_initialized = true;
+	}
+
+	State& Get()
+	{
+		if (!g_initialized)
+			Forget();
+		return g_state;
+	}
+
+	template <typename T, size_t N>
+	int IndexOf(const T(&table)[N], GLenum target)
+	{
+		for (size_t i = 0; i < N; ++i)
+			if (table[i].target == target)
+				return (int)i;
+		return -1;
+	}
+
+	int CapabilityIndex(GLenum capability)
+	{
+		for (size_t i = 0; i < CAPABILITY_COUNT; ++i)
+			if (CAPABILITIES[i] == capability)
+				return (int)i;
+		return -1;
+	}
+
+	// validation mode: compares the shadowed value with the real one and adopts the latter
+	void Validate(const char* what, GLint& cached, GLint actual)
+	{
+		if (cached != UNKNOWN && cached != actual)
+		{
+			++g_currentFrame.mismatches;
+			std::cerr << "[GLState] stale " << what << ": cached " << cached << ", actual " << actual << std::endl;
+		}
+		cached = actual;
+	}
+
+	void ValidateInteger(const char* what, GLint& cached, GLenum name)
+	{
+		GLint actual = 0;
+		glGetIntegerv(name, &actual);
+		Validate(what, cached, actual);
+	}
+
+	// true if the call has to be issued, the shadowed value is updated in that case
+	bool Changes(GLint& cached, GLint wanted)
+	{
+		if (cached == wanted)
+		{
+			++g_currentFrame.elided;
+			return false;
+		}
+		cached = wanted;
+		++g_currentFrame.issued;
+		return true;
+	}
+
+	// Changes() for state that pipelines cover: the current pipeline no longer matches afterwards
+	bool ChangesPipeline(GLint& cached, GLint wanted)
+	{
+		if (!Changes(cached, wanted))
+			return false;
+		g_pipeline = 0;
+		return true;
+	}
+
+	void Passthrough()
+	{
+		++g_currentFrame.issued;
+	}
+}
+
+void GLState::NewFrame()
+{
+	g_lastFrame = g_currentFrame;
+	g_currentFrame = Counters();
+}
+
+void GLState::Invalidate()
+{
+	Forget();
+}
+
+void GLState::InvalidateDrawState()
+{
+	State& s = Get();
+	s.program = UNKNOWN;
+	s.vertexArray = UNKNOWN;
+	s.buffers[IndexOf(BUFFER_TARGETS, GL_ARRAY_BUFFER)] = UNKNOWN;
+	s.buffers[IndexOf(BUFFER_TARGETS, GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+
+	// the textures are bound on unit 0, or on whichever unit was active
+	for (GLint unit : { GLint(0), s.activeTexture })
+		if (unit >= 0 && unit < GLint(MAX_TEXTURE_UNITS))
+		{
+			std::fill(std::begin(s.textures[unit]), std::end(s.textures[unit]), UNKNOWN);
+			s.samplers[unit] = UNKNOWN;
+		}
+	s.activeTexture = UNKNOWN;
+
+	std::fill(std::begin(s.viewport), std::end(s.viewport), UNKNOWN);
+	std::fill(std::begin(s.capabilities), std::end(s.capabilities), UNKNOWN);
+	s.blendSrc = s.blendDst = s.blendEquation = UNKNOWN;
+	s.depthMask = s.depthFunc = s.cullFace = UNKNOWN;
+	g_pipeline = 0;
+}
+
+const GLState::Counters& GLState::CurrentFrame()
+{
+	return g_currentFrame;
+}
+
+const GLState::Counters& GLState::LastFrame()
+{
+	return g_lastFrame;
+}
+
+void GLState::SetValidation(bool enabled)
+{
+	g_validate = enabled;
+}
+
+bool GLState::IsValidating()
+{
+	return g_validate;
+}
+
+void GLState::CountStall()
+{
+	++g_currentFrame.stalls;
+}
+
+void GLState::CountUniform(bool issued)
+{
+	if (issued)
+		++g_currentFrame.uniformsIssued;
+	else
+		++g_currentFrame.uniformsSkipped;
+}
+
+void GLState::UseProgram(GLuint program)
+{
+	State& s = Get();
+	if (g_validate)
+		ValidateInteger("program", s.program, GL_CURRENT_PROGRAM);
+	if (ChangesPipeline(s.program, (GLint)program))
+		glUseProgram(program);
+}
+
+void GLState::BindVertexArray(GLuint vao)
+{
+	State& s = Get();
+	if (g_validate)
+		ValidateInteger("vertex array", s.vertexArray, GL_VERTEX_ARRAY_BINDING);
+	if (ChangesPipeline(s.vertexArray, (GLint)vao))
+	{
+		glBindVertexArray(vao);
+		// the element array binding belongs to the VAO
+		s.buffers[IndexOf(BUFFER_TARGETS, GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+	}
+}
+
+void GLState::VertexArrayElementBuffer(GLuint vao, GLuint buffer)
+{
+	State& s = Get();
+	Passthrough();
+	glVertexArrayElementBuffer(vao, buffer);
+	if (s.vertexArray == (GLint)vao)
+		s.buffers[IndexOf(BUFFER_TARGETS, GL_ELEMENT_ARRAY_BUFFER)] = (GLint)buffer;
+}
+
+void GLState::BindBuffer(GLenum target, GLuint buffer)
+{
+	State& s = Get();
+	const int i = IndexOf(BUFFER_TARGETS, target);
+	if (i < 0)
+	{
+		Passthrough();
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	if (g_validate)
+		ValidateInteger("buffer binding", s.buffers[i], BUFFER_TARGETS[i].binding);
+	if (Changes(s.buffers[i], (GLint)buffer))
+		glBindBuffer(target, buffer);
+}
+
+void GLState::BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	State& s = Get();
+	const int i = IndexOf(INDEXED_TARGETS, target);
+	if (i < 0 || index >= MAX_INDEXED_BINDINGS)
+	{
+		Passthrough();
+		glBindBufferRange(target, index, buffer, offset, size);
+		const int generic = IndexOf(BUFFER_TARGETS, target);
+		if (generic >= 0)
+			s.buffers[generic] = (GLint)buffer;
+		return;
+	}
+
+	IndexedBinding& cached = g_indexed[i][index];
+	if (g_validate)
+	{
+		GLint actual = 0;
+		glGetIntegeri_v(INDEXED_TARGETS[i].binding, index, &actual);
+		Validate("indexed buffer binding", cached.buffer, actual);
+	}
+
+	if (cached.buffer == (GLint)buffer && cached.offset == offset && cached.size == size)
+	{
+		++g_currentFrame.elided;
+		return;
+	}
+
+	cached = { (GLint)buffer, offset, size };
+	Passthrough();
+	if (size == 0)
+		glBindBufferBase(target, index, buffer);
+	else
+		glBindBufferRange(target, index, buffer, offset, size);
+
+	// both also bind to the generic binding point
+	s.buffers[IndexOf(BUFFER_TARGETS, target)] = (GLint)buffer;
+}
+
+void GLState::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	BindBufferRange(target, index, buffer, 0, 0);
+}
+
+void GLState::ActiveTexture(GLuint unit)
+{
+	State& s = Get();
+	if (g_validate)
+	{
+		GLint actual = 0;
+		glGetIntegerv(GL_ACTIVE_TEXTURE, &actual);
+		Validate("active texture", s.activeTexture, actual - GL_TEXTURE0);
+	}
+	if (Changes(s.activeTexture, (GLint)unit))
+		glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::BindTexture(GLenum target, GLuint texture)
+{
+	State& s = Get();
+	if (s.activeTexture == UNKNOWN || g_validate)
+	{
+		GLint active = 0;
+		glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+		if (g_validate)
+			Validate("active texture", s.activeTexture, active - GL_TEXTURE0);
+		s.activeTexture = active - GL_TEXTURE0;
+	}
+	BindTextureUnit((GLuint)s.activeTexture, target, texture);
+}
+
+void GLState::BindTextureUnit(GLuint unit, GLenum target, GLuint texture)
+{
+	State& s = Get();
+	const int i = IndexOf(TEXTURE_TARGETS, target);
+	if (i < 0 || unit >= MAX_TEXTURE_UNITS)
+	{
+		ActiveTexture(unit);
+		Passthrough();
+		glBindTexture(target, texture);
+		return;
+	}
+
+	if (g_validate)
+	{
+		// texture bindings can only be read back from the active unit
+		glActiveTexture(GL_TEXTURE0 + unit);
+		s.activeTexture = (GLint)unit;
+		ValidateInteger("texture binding", s.textures[unit][i], TEXTURE_TARGETS[i].binding);
+	}
+
+	if (s.textures[unit][i] == (GLint)texture)
+	{
+		++g_currentFrame.elided;
+		return;
+	}
+
+	ActiveTexture(unit);
+	Changes(s.textures[unit][i], (GLint)texture);
+	glBindTexture(target, texture);
+}
+
+void GLState::BindSampler(GLuint unit, GLuint sampler)
+{
+	State& s = Get();
+	if (unit >= MAX_TEXTURE_UNITS)
+	{
+		Passthrough();
+		glBindSampler(unit, sampler);
+		return;
+	}
+
+	if (g_validate)
+	{
+		// like textures, the sampler binding is read back from the active unit
+		glActiveTexture(GL_TEXTURE0 + unit);
+		s.activeTexture = (GLint)unit;
+		ValidateInteger("sampler binding", s.samplers[unit], GL_SAMPLER_BINDING);
+	}
+
+	// glBindSampler takes the unit directly, the active unit stays as it is
+	if (Changes(s.samplers[unit], (GLint)sampler))
+		glBindSampler(unit, sampler);
+}
+
+void GLState::BindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	State& s = Get();
+	if (g_validate)
+	{
+		ValidateInteger("draw framebuffer", s.drawFramebuffer, GL_DRAW_FRAMEBUFFER_BINDING);
+		ValidateInteger("read framebuffer", s.readFramebuffer, GL_READ_FRAMEBUFFER_BINDING);
+	}
+
+	const bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	const bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+
+	if ((!draw || s.drawFramebuffer == (GLint)framebuffer) && (!read || s.readFramebuffer == (GLint)framebuffer))
+	{
+		++g_currentFrame.elided;
+		return;
+	}
+
+	if (draw)
+		s.drawFramebuffer = (GLint)framebuffer;
+	if (read)
+		s.readFramebuffer = (GLint)framebuffer;
+	Passthrough();
+	glBindFramebuffer(target, framebuffer);
+}
+
+void GLState::DeletePrograms(GLsizei n, const GLuint* programs)
+{
+	State& s = Get();
+	for (GLsizei k = 0; k < n; ++k)
+	{
+		// a program in use is only flagged for deletion by OpenGL, don't count on either; a pipeline
+		// applied with it has to bind its replacement (ProgramObject swaps its id on a reload)
+		if (s.program == (GLint)programs[k])
+		{
+			s.program = UNKNOWN;
+			g_pipeline = 0;
+		}
+		glDeleteProgram(programs[k]);
+	}
+}
+
+void GLState::DeleteVertexArrays(GLsizei n, const GLuint* vaos)
+{
+	State& s = Get();
+	for (GLsizei k = 0; k < n; ++k)
+		if (vaos[k] != 0 && s.vertexArray == (GLint)vaos[k])
+		{
+			s.vertexArray = 0;
+			s.buffers[IndexOf(BUFFER_TARGETS, GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+		}
+	glDeleteVertexArrays(n, vaos);
+}
+
+void GLState::DeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+	State& s = Get();
+	for (GLsizei k = 0; k < n; ++k)
+	{
+		for (GLint& bound : s.buffers)
+			if (buffers[k] != 0 && bound == (GLint)buffers[k])
+				bound = 0;
+		for (auto& target : g_indexed)
+			for (IndexedBinding& binding : target)
+				if (buffers[k] != 0 && binding.buffer == (GLint)buffers[k])
+					binding = { 0, 0, 0 };
+	}
+	glDeleteBuffers(n, buffers);
+}
+
+void GLState::DeleteTextures(GLsizei n, const GLuint* textures)
+{
+	State& s = Get();
+	for (GLsizei k = 0; k < n; ++k)
+		for (auto& unit : s.textures)
+			for (GLint& bound : unit)
+				if (textures[k] != 0 && bound == (GLint)textures[k])
+					bound = 0;
+	glDeleteTextures(n, textures);
+}
+
+void GLState::DeleteSamplers(GLsizei n, const GLuint* samplers)
+{
+	State& s = Get();
+	for (GLsizei k = 0; k < n; ++k)
+		for (GLint& bound : s.samplers)
+			if (samplers[k] != 0 && bound == (GLint)samplers[k])
+				bound = 0;
+	glDeleteSamplers(n, samplers);
+}
+
+void GLState::DeleteFramebuffers(GLsizei n, const GLuint* framebuffers)
+{
+	State& s = Get();
+	for (GLsizei k = 0; k < n; ++k)
+	{
+		if (framebuffers[k] != 0 && s.drawFramebuffer == (GLint)framebuffers[k])
+			s.drawFramebuffer = 0;
+		if (framebuffers[k] != 0 && s.readFramebuffer == (GLint)framebuffers[k])
+			s.readFramebuffer = 0;
+	}
+	glDeleteFramebuffers(n, framebuffers);
+}
+
+bool GLState::Apply(const PipelineState& pipeline)
+{
+	const PipelineState::Desc& desc = pipeline.GetDesc();
+	if (desc.program != nullptr && !desc.program->IsReady())
+		return false;
+
+	// in validation mode every setter runs, so that they can check the real state
+	if (pipeline.Id() != 0 && pipeline.Id() == g_pipeline && !g_validate)
+	{
+		++g_currentFrame.elided;
+		return true;
+	}
+
+	if (desc.program != nullptr)
+		UseProgram(*desc.program);
+	if (desc.geometry)
+		BindVertexArray(desc.geometry->VertexArray());
+
+	SetEnabled(GL_CULL_FACE, desc.raster.cull);
+	if (desc.raster.cull)
+		CullFace(desc.raster.cullFace);
+
+	SetEnabled(GL_DEPTH_TEST, desc.depth.test);
+	DepthMask(desc.depth.write ? GL_TRUE : GL_FALSE);
+	if (desc.depth.test)
+		DepthFunc(desc.depth.func);
+
+	SetEnabled(GL_BLEND, desc.blend.enabled);
+	if (desc.blend.enabled)
+	{
+		BlendEquation(desc.blend.equation);
+		BlendFunc(desc.blend.source, desc.blend.destination);
+	}
+
+	g_pipeline = pipeline.Id();
+	return true;
+}
+
+void GLState::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	State& s = Get();
+	if (g_validate)
+	{
+		GLint actual[4] = {};
+		glGetIntegerv(GL_VIEWPORT, actual);
+		for (int i = 0; i < 4; ++i)
+			Validate("viewport", s.viewport[i], actual[i]);
+	}
+
+	if (s.viewport[0] == x && s.viewport[1] == y && s.viewport[2] == width && s.viewport[3] == height)
+	{
+		++g_currentFrame.elided;
+		return;
+	}
+
+	s.viewport[0] = x;
+	s.viewport[1] = y;
+	s.viewport[2] = width;
+	s.viewport[3] = height;
+	Passthrough();
+	glViewport(x, y, width, height);
+}
+
+void GLState::SetEnabled(GLenum capability, bool enabled)
+{
+	State& s = Get();
+	const int i = CapabilityIndex(capability);
+	if (i < 0)
+	{
+		Passthrough();
+		enabled ? glEnable(capability) : glDisable(capability);
+		return;
+	}
+
+	if (g_validate)
+		Validate("capability", s.capabilities[i], glIsEnabled(capability) ? 1 : 0);
+	if (ChangesPipeline(s.capabilities[i], enabled ? 1 : 0))
+		enabled ? glEnable(capability) : glDisable(capability);
+}
+
+void GLState::BlendFunc(GLenum sfactor, GLenum dfactor)
+{
+	State& s = Get();
+	if (g_validate)
+	{
+		ValidateInteger("blend source", s.blendSrc, GL_BLEND_SRC_RGB);
+		ValidateInteger("blend destination", s.blendDst, GL_BLEND_DST_RGB);
+	}
+
+	if (s.blendSrc == (GLint)sfactor && s.blendDst == (GLint)dfactor)
+	{
+		++g_currentFrame.elided;
+		return;
+	}
+
+	s.blendSrc = (GLint)sfactor;
+	s.blendDst = (GLint)dfactor;
+	g_pipeline = 0;
+	Passthrough();
+	glBlendFunc(sfactor, dfactor);
+}
+
+void GLState::BlendEquation(GLenum mode)
+{
+	State& s = Get();
+	if (g_validate)
+		ValidateInteger("blend equation", s.blendEquation, GL_BLEND_EQUATION_RGB);
+	if (ChangesPipeline(s.blendEquation, (GLint)mode))
+		glBlendEquation(mode);
+}
+
+void GLState::DepthMask(GLboolean flag)
+{
+	State& s = Get();
+	if (g_validate)
+	{
+		GLboolean actual = GL_TRUE;
+		glGetBooleanv(GL_DEPTH_WRITEMASK, &actual);
+		Validate("depth mask", s.depthMask, actual ? 1 : 0);
+	}
+	if (ChangesPipeline(s.depthMask, flag ? 1 : 0))
+		glDepthMask(flag);
+}
+
+void GLState::DepthFunc(GLenum func)
+{
+	State& s = Get();
+	if (g_validate)
+		ValidateInteger("depth function", s.depthFunc, GL_DEPTH_FUNC);
+	if (ChangesPipeline(s.depthFunc, (GLint)func))
+		glDepthFunc(func);
+}
+
+void GLState::CullFace(GLenum mode)
+{
+	State& s = Get();
+	if (g_validate)
+		ValidateInteger("cull face", s.cullFace, GL_CULL_FACE_MODE);
+	if (ChangesPipeline(s.cullFace, (GLint)mode))
+		glCullFace(mode);
+}
@@ -0,0 +1,258 @@
+#include "GPUReadback.h"
+#include "GLCaps.h"
+#include "GLState.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	// how long a single glClientWaitSync may block before we check again
+	const GLuint64 WAIT_TIMEOUT_NS = 1000000;
+
+	GLsizeiptr ComponentCount(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_RED: case GL_GREEN: case GL_BLUE: case GL_ALPHA:
+		case GL_RED_INTEGER: case GL_DEPTH_COMPONENT: case GL_STENCIL_INDEX:	return 1;
+		case GL_RG: case GL_RG_INTEGER: case GL_DEPTH_STENCIL:				return 2;
+		case GL_RGB: case GL_BGR: case GL_RGB_INTEGER:						return 3;
+		case GL_RGBA: case GL_BGRA: case GL_RGBA_INTEGER:					return 4;
+		}
+		return 0;
+	}
+
+	GLsizeiptr PixelSize(GLenum format, GLenum type)
+	{
+		switch (type)
+		{
+		case GL_UNSIGNED_BYTE: case GL_BYTE:							return ComponentCount(format);
+		case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT:		return ComponentCount(format) * 2;
+		case GL_UNSIGNED_INT: case GL_INT: case GL_FLOAT:				return ComponentCount(format) * 4;
+		case GL_UNSIGNED_INT_24_8: case GL_UNSIGNED_INT_8_8_8_8:
+		case GL_UNSIGNED_INT_2_10_10_10_REV:							return 4;
+		}
+		return 0;
+	}
+}
+
+GPUReadback::~GPUReadback()
+{
+	for (Slot& slot : m_slots)
+	{
+		if (slot.fence)
+			glDeleteSync(slot.fence);
+		if (slot.buffer)
+			GLState::DeleteBuffers(1, &slot.buffer);
+	}
+}
+
+GPUReadback::Handle GPUReadback::ReadBuffer(GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	if (buffer == 0 || size <= 0)
+		return INVALID_HANDLE;
+
+	const Handle handle = Acquire(size);
+
+	if (GLCaps::Get().directStateAccess)
+		glCopyNamedBufferSubData(buffer, m_slots[handle].buffer, offset, 0, size);
+	else
+	{
+		GLState::BindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, 0, size);
+	}
+
+	Fence(handle);
+	return handle;
+}
+
+GPUReadback::Handle GPUReadback::ReadPixels(GLuint framebuffer, GLenum readBuffer, GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type)
+{
+	const GLsizeiptr size = PixelSize(format, type) * width * height;
+	if (size <= 0)
+	{
+		std::cerr << "[GPUReadback] unsupported pixel format " << format << " / " << type << std::endl;
+		return INVALID_HANDLE;
+	}
+
+	const Handle handle = Acquire(size);
+
+	GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glReadBuffer(readBuffer);
+
+	// with a pack buffer bound, glReadPixels writes to it at the given offset and returns at once
+	// tightly packed rows, as PixelSize() counts them; the caller's alignment is restored afterwards
+	GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, m_slots[handle].buffer);
+	GLint alignment = 4;
+	glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(x, y, width, height, format, type, nullptr);
+	glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+
+	// anything else that reads pixels expects client memory
+	GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	Fence(handle);
+	return handle;
+}
+
+bool GPUReadback::IsReady(Handle handle)
+{
+	if (!IsValid(handle))
+		return false;
+
+	Slot& slot = m_slots[handle];
+	if (slot.state == State::Ready)
+		return true;
+
+	// the first poll also flushes, otherwise the fence might never reach the GPU
+	const GLenum result = glClientWaitSync(slot.fence, slot.flushed ? 0 : GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	slot.flushed = true;
+	if (result == GL_TIMEOUT_EXPIRED || result == GL_WAIT_FAILED)
+		return false;
+
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+	slot.state = State::Ready;
+	return true;
+}
+
+void GPUReadback::Wait(Handle handle)
+{
+	if (!IsValid(handle) || IsReady(handle))
+		return;
+
+	++m_stalls;
+	GLState::CountStall();
+
+	Slot& slot = m_slots[handle];
+	GLenum result;
+	do
+		result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT_NS);
+	while (result == GL_TIMEOUT_EXPIRED);
+
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+	slot.state = State::Ready;
+}
+
+bool GPUReadback::Read(Handle handle, void* data, GLsizeiptr size)
+{
+	if (!IsReady(handle))
+		return false;
+
+	Slot& slot = m_slots[handle];
+	if (size > slot.size)
+		size = slot.size;
+
+	const bool dsa = GLCaps::Get().directStateAccess;
+	if (!dsa)
+		GLState::BindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+
+	const void* mapped = dsa ? glMapNamedBufferRange(slot.buffer, 0, size, GL_MAP_READ_BIT) : glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, GL_MAP_READ_BIT);
+	if (mapped)
+	{
+		std::memcpy(data, mapped, size);
+		if (dsa)
+			glUnmapNamedBuffer(slot.buffer);
+		else
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+	}
+
+	++m_completed;
+	Release(handle);
+	return mapped != nullptr;
+}
+
+void GPUReadback::Release(Handle handle)
+{
+	if (!IsValid(handle))
+		return;
+
+	Slot& slot = m_slots[handle];
+	if (slot.fence)
+		glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+	slot.size = 0;
+	slot.flushed = false;
+	slot.state = State::Free;
+}
+
+GLsizeiptr GPUReadback::Size(Handle handle) const
+{
+	return IsValid(handle) ? m_slots[handle].size : 0;
+}
+
+GPUReadback::Stats GPUReadback::GetStats() const
+{
+	Stats stats;
+	for (const Slot& slot : m_slots)
+	{
+		if (slot.state != State::Free)
+			++stats.pending;
+		stats.stagingBytes += slot.capacity;
+	}
+	stats.completed = m_completed;
+	stats.stalls = m_stalls;
+	return stats;
+}
+
+GPUReadback::Handle GPUReadback::Acquire(GLsizeiptr size)
+{
+	// the smallest free staging buffer that fits, else any free one to grow, else a new one
+	Handle best = INVALID_HANDLE;
+	for (Handle i = 0; i < m_slots.size(); ++i)
+	{
+		const Slot& slot = m_slots[i];
+		if (slot.state != State::Free)
+			continue;
+		if (best == INVALID_HANDLE)
+			best = i;
+		else
+		{
+			const bool fits = slot.capacity >= size, bestFits = m_slots[best].capacity >= size;
+			if ((fits && !bestFits) || (fits == bestFits && (fits ? slot.capacity < m_slots[best].capacity : slot.capacity > m_slots[best].capacity)))
+				best = i;
+		}
+	}
+	if (best == INVALID_HANDLE)
+	{
+		best = (Handle)m_slots.size();
+		m_slots.emplace_back();
+		if (GLCaps::Get().directStateAccess)
+			glCreateBuffers(1, &m_slots[best].buffer);
+		else
+			glGenBuffers(1, &m_slots[best].buffer);
+	}
+
+	Slot& slot = m_slots[best];
+	if (GLCaps::Get().directStateAccess)
+	{
+		if (slot.capacity < size)
+			glNamedBufferData(slot.buffer, size, nullptr, GL_STREAM_READ);
+	}
+	else
+	{
+		GLState::BindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+		if (slot.capacity < size)
+			glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_READ);
+	}
+	if (slot.capacity < size)
+		slot.capacity = size;
+	slot.size = size;
+	slot.state = State::Pending;
+	return best;
+}
+
+void GPUReadback::Fence(Handle handle)
+{
+	Slot& slot = m_slots[handle];
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.flushed = false;
+}
+
+bool GPUReadback::IsValid(Handle handle) const
+{
+	return handle < m_slots.size() && m_slots[handle].state != State::Free;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <vector>
+
+/*
+
+	GPUReadback copies data from the GPU to the CPU without stalling. A request copies the
+	source into a staging buffer on the GPU timeline (glCopyBufferSubData for buffers,
+	glReadPixels into a GL_PIXEL_PACK_BUFFER for framebuffers) and puts a fence after it. The
+	returned handle is polled with IsReady(), typically a frame or two later, and the data is
+	fetched with Read() / Get(). Mapping the staging buffer then costs nothing, the copy is done.
+
+	Wait() blocks until the request completes; if it has to wait, that counts as a stall in
+	GLState, the same as the synchronous read backs of BufferObject.
+
+	Staging buffers are reused: a finished request gives its buffer back to the pool.
+
+*/
+class GPUReadback final
+{
+public:
+	using Handle = unsigned;
+	static const Handle INVALID_HANDLE = ~0u;
+
+	struct Stats
+	{
+		unsigned	pending{};			// requests that are not fetched yet
+		unsigned	completed{};		// fetched in total
+		unsigned	stalls{};			// times Wait() had to block
+		GLsizeiptr	stagingBytes{};		// total size of the staging buffers
+	};
+
+	GPUReadback() = default;
+	~GPUReadback();
+
+	GPUReadback(const GPUReadback&)				= delete;
+	GPUReadback& operator=(const GPUReadback&)	= delete;
+
+	// copies size bytes of buffer from offset
+	Handle	ReadBuffer(GLuint buffer, GLintptr offset, GLsizeiptr size);
+	// reads a rectangle of the readBuffer (GL_COLOR_ATTACHMENTi, GL_BACK, ...) of framebuffer, rows are tightly packed
+	Handle	ReadPixels(GLuint framebuffer, GLenum readBuffer, GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type);
+
+	// never blocks
+	bool	IsReady(Handle handle);
+	// blocks until the request completes
+	void	Wait(Handle handle);
+
+	// copies the result to data (at most size bytes) and releases the handle; false if it is not ready yet
+	bool	Read(Handle handle, void* data, GLsizeiptr size);
+	template <typename T>
+	bool	Get(Handle handle, std::vector<T>& result);
+
+	// drops the request without fetching it
+	void	Release(Handle handle);
+
+	GLsizeiptr	Size(Handle handle) const;
+	Stats		GetStats() const;
+
+private:
+	enum class State { Free, Pending, Ready };
+
+	struct Slot
+	{
+		GLuint		buffer{};
+		GLsizeiptr	capacity{};
+		GLsizeiptr	size{};
+		GLsync		fence{};
+		State		state{ State::Free };
+		bool		flushed{};	// the fence was flushed to the GPU, so waiting on it is safe
+	};
+
+	std::vector<Slot>	m_slots;
+	unsigned			m_completed{};
+	unsigned			m_stalls{};
+
+	// a free slot whose staging buffer holds at least size bytes; without direct state access it is left bound to GL_COPY_WRITE_BUFFER
+	Handle	Acquire(GLsizeiptr size);
+	void	Fence(Handle handle);
+	bool	IsValid(Handle handle) const;
+};
+
+template <typename T>
+bool GPUReadback::Get(Handle handle, std::vector<T>& result)
+{
+	if (!IsReady(handle))
+		return false;
+
+	result.resize(Size(handle) / sizeof(T));
+	return Read(handle, result.data(), result.size() * sizeof(T));
+}
@@ -0,0 +1,286 @@
+#include "GeometryHeap.h"
+#include "GLCaps.h"
+#include "GLState.h"
+
+#include <algorithm>
+
+namespace
+{
+	// the smallest blocks handed out, keeps the free lists short
+	const size_t VERTEX_MIN_BLOCK = 64;
+	const size_t INDEX_MIN_BLOCK = 256;
+
+	bool SameAttribute(const AttributeData& a, const AttributeData& b)
+	{
+		return a.index == b.index && a.size == b.size && a.type == b.type && a.normalized == b.normalized && a.ptr == b.ptr;
+	}
+
+	bool SameFormat(const GeometryHeap::VertexFormat& a, const GeometryHeap::VertexFormat& b)
+	{
+		return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), SameAttribute);
+	}
+
+	struct RegisteredHeap
+	{
+		GLsizei							stride;
+		GeometryHeap::VertexFormat		format;
+		std::weak_ptr<GeometryHeap>		heap;
+	};
+
+	std::vector<RegisteredHeap> g_sharedHeaps;
+
+	GLuint CreateBuffer(size_t bytes)
+	{
+		GLuint buffer = 0;
+		if (GLCaps::Get().directStateAccess)
+		{
+			glCreateBuffers(1, &buffer);
+			glNamedBufferData(buffer, bytes, nullptr, GL_STATIC_DRAW);
+			return buffer;
+		}
+
+		glGenBuffers(1, &buffer);
+		GLState::BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STATIC_DRAW);
+		return buffer;
+	}
+
+	void UploadBuffer(GLuint buffer, size_t offset, size_t bytes, const void* data)
+	{
+		if (GLCaps::Get().directStateAccess)
+		{
+			glNamedBufferSubData(buffer, offset, bytes, data);
+			return;
+		}
+
+		GLState::BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+	}
+
+	void CopyBuffer(GLuint source, GLuint destination, size_t sourceOffset, size_t destinationOffset, size_t bytes)
+	{
+		if (bytes == 0)
+			return;
+
+		if (GLCaps::Get().directStateAccess)
+		{
+			glCopyNamedBufferSubData(source, destination, sourceOffset, destinationOffset, bytes);
+			return;
+		}
+
+		GLState::BindBuffer(GL_COPY_READ_BUFFER, source);
+		GLState::BindBuffer(GL_COPY_WRITE_BUFFER, destination);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, destinationOffset, bytes);
+	}
+}
+
+GeometryHeap::GeometryHeap(GLsizei stride, const VertexFormat& format, size_t initialVertices, size_t initialIndices)
+	: m_stride(stride), m_format(format), m_vertices(initialVertices, VERTEX_MIN_BLOCK), m_indices(initialIndices, INDEX_MIN_BLOCK)
+{
+	if (GLCaps::Get().directStateAccess)
+		glCreateVertexArrays(1, &m_vao);
+	else
+		glGenVertexArrays(1, &m_vao);
+	m_vertexBuffer = CreateBuffer(m_vertices.Capacity() * m_stride);
+	m_indexBuffer = CreateBuffer(m_indices.Capacity() * sizeof(GLuint));
+	SetupVertexArray();
+}
+
+GeometryHeap::~GeometryHeap()
+{
+	GLState::DeleteVertexArrays(1, &m_vao);
+	GLState::DeleteBuffers(1, &m_vertexBuffer);
+	GLState::DeleteBuffers(1, &m_indexBuffer);
+}
+
+std::shared_ptr<GeometryHeap> GeometryHeap::Shared(GLsizei stride, const VertexFormat& format)
+{
+	for (RegisteredHeap& registered : g_sharedHeaps)
+	{
+		if (registered.stride != stride || !SameFormat(registered.format, format))
+			continue;
+
+		std::shared_ptr<GeometryHeap> heap = registered.heap.lock();
+		if (!heap)
+		{
+			heap = std::make_shared<GeometryHeap>(stride, format);
+			registered.heap = heap;
+		}
+		return heap;
+	}
+
+	std::shared_ptr<GeometryHeap> heap = std::make_shared<GeometryHeap>(stride, format);
+	g_sharedHeaps.push_back({ stride, format, heap });
+	return heap;
+}
+
+void GeometryHeap::SetupVertexArray()
+{
+	if (GLCaps::Get().directStateAccess)
+	{
+		for (AttributeData attribute : m_format)
+		{
+			attribute.stride = m_stride;
+			attribute.Apply(m_vao, m_vertexBuffer);
+		}
+		GLState::VertexArrayElementBuffer(m_vao, m_indexBuffer);
+		return;
+	}
+
+	GLState::BindVertexArray(m_vao);
+	GLState::BindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+	for (AttributeData attribute : m_format)
+	{
+		attribute.stride = m_stride;
+		attribute.Apply();
+	}
+	GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+}
+
+void GeometryHeap::Bind() const
+{
+	GLState::BindVertexArray(m_vao);
+}
+
+void GeometryHeap::Draw(Handle handle, GLenum mode) const
+{
+	const Allocation& allocation = Get(handle);
+
+	Bind();
+	glDrawElementsBaseVertex(mode, allocation.indexCount, GL_UNSIGNED_INT, allocation.IndexOffset(), allocation.baseVertex);
+}
+
+GeometryHeap::Handle GeometryHeap::Allocate(const void* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount)
+{
+	const size_t oldVertexCapacity = m_vertices.Capacity();
+	const size_t oldIndexCapacity = m_indices.Capacity();
+
+	auto fits = [&]() {
+		return m_vertices.GetStats().largestFree >= vertexCount && m_indices.GetStats().largestFree >= indexCount;
+	};
+
+	// out of room: compacting is cheaper than growing, if the free space suffices
+	if (!fits() && m_vertices.GetStats().freeUnits >= vertexCount && m_indices.GetStats().freeUnits >= indexCount)
+		Defragment();
+
+	if (!fits())
+	{
+		while (m_vertices.GetStats().largestFree < vertexCount)
+			m_vertices.Grow();
+		while (m_indices.GetStats().largestFree < indexCount)
+			m_indices.Grow();
+
+		// the old contents stay where they are, at the start of the new buffers
+		const GLuint oldVertexBuffer = m_vertexBuffer, oldIndexBuffer = m_indexBuffer;
+		m_vertexBuffer = CreateBuffer(m_vertices.Capacity() * m_stride);
+		m_indexBuffer = CreateBuffer(m_indices.Capacity() * sizeof(GLuint));
+		CopyBuffer(oldVertexBuffer, m_vertexBuffer, 0, 0, oldVertexCapacity * m_stride);
+		CopyBuffer(oldIndexBuffer, m_indexBuffer, 0, 0, oldIndexCapacity * sizeof(GLuint));
+		GLState::DeleteBuffers(1, &oldVertexBuffer);
+		GLState::DeleteBuffers(1, &oldIndexBuffer);
+		SetupVertexArray();
+		++m_grows;
+	}
+
+	Slot slot;
+	slot.vertexBlock = m_vertices.Allocate(vertexCount);
+	slot.indexBlock = m_indices.Allocate(indexCount);
+	slot.allocation.baseVertex = (GLint)slot.vertexBlock;
+	slot.allocation.firstIndex = slot.indexBlock;
+	slot.allocation.vertexCount = vertexCount;
+	slot.allocation.indexCount = (GLsizei)indexCount;
+
+	UploadBuffer(m_vertexBuffer, slot.vertexBlock * m_stride, vertexCount * m_stride, vertices);
+	UploadBuffer(m_indexBuffer, slot.indexBlock * sizeof(GLuint), indexCount * sizeof(GLuint), indices);
+
+	Handle handle;
+	if (!m_freeSlots.empty())
+	{
+		handle = m_freeSlots.back();
+		m_freeSlots.pop_back();
+		m_slots[handle] = slot;
+	}
+	else
+	{
+		handle = (Handle)m_slots.size();
+		m_slots.push_back(slot);
+	}
+	return handle;
+}
+
+void GeometryHeap::Free(Handle handle)
+{
+	if (handle == INVALID_HANDLE || handle >= m_slots.size() || m_slots[handle].vertexBlock == BuddyAllocator::INVALID)
+		return;
+
+	Slot& slot = m_slots[handle];
+	m_vertices.Free(slot.vertexBlock);
+	m_indices.Free(slot.indexBlock);
+	slot = Slot();
+	m_freeSlots.push_back(handle);
+}
+
+void GeometryHeap::Defragment()
+{
+	std::vector<Handle> live;
+	for (Handle h = 0; h < m_slots.size(); ++h)
+		if (m_slots[h].vertexBlock != BuddyAllocator::INVALID)
+			live.push_back(h);
+
+	// Reallocating from the largest block down into empty allocators packs the blocks without holes
+	BuddyAllocator vertices(m_vertices.Capacity(), VERTEX_MIN_BLOCK);
+	BuddyAllocator indices(m_indices.Capacity(), INDEX_MIN_BLOCK);
+	std::vector<Slot> packed(m_slots);
+
+	std::sort(live.begin(), live.end(), [&](Handle a, Handle b) {
+		return m_vertices.BlockSize(m_slots[a].vertexBlock) > m_vertices.BlockSize(m_slots[b].vertexBlock);
+	});
+	for (Handle h : live)
+		packed[h].vertexBlock = vertices.Allocate(m_slots[h].allocation.vertexCount);
+
+	std::sort(live.begin(), live.end(), [&](Handle a, Handle b) {
+		return m_indices.BlockSize(m_slots[a].indexBlock) > m_indices.BlockSize(m_slots[b].indexBlock);
+	});
+	for (Handle h : live)
+		packed[h].indexBlock = indices.Allocate(m_slots[h].allocation.indexCount);
+
+	const GLuint newVertexBuffer = CreateBuffer(vertices.Capacity() * m_stride);
+	const GLuint newIndexBuffer = CreateBuffer(indices.Capacity() * sizeof(GLuint));
+	for (Handle h : live)
+	{
+		const Slot& from = m_slots[h];
+		Slot& to = packed[h];
+
+		CopyBuffer(m_vertexBuffer, newVertexBuffer, from.vertexBlock * m_stride, to.vertexBlock * m_stride, from.allocation.vertexCount * m_stride);
+		CopyBuffer(m_indexBuffer, newIndexBuffer, from.indexBlock * sizeof(GLuint), to.indexBlock * sizeof(GLuint), from.allocation.indexCount * sizeof(GLuint));
+
+		to.allocation.baseVertex = (GLint)to.vertexBlock;
+		to.allocation.firstIndex = to.indexBlock;
+	}
+
+	GLState::DeleteBuffers(1, &m_vertexBuffer);
+	GLState::DeleteBuffers(1, &m_indexBuffer);
+	m_vertexBuffer = newVertexBuffer;
+	m_indexBuffer = newIndexBuffer;
+
+	m_vertices = std::move(vertices);
+	m_indices = std::move(indices);
+	m_slots = std::move(packed);
+
+	SetupVertexArray();
+	++m_defragmentations;
+}
+
+GeometryHeap::Stats GeometryHeap::GetStats() const
+{
+	Stats stats;
+	stats.vertices				= m_vertices.GetStats();
+	stats.indices				= m_indices.GetStats();
+	stats.vertexFragmentation	= m_vertices.ExternalFragmentation();
+	stats.indexFragmentation	= m_indices.ExternalFragmentation();
+	stats.vertexBufferBytes		= m_vertices.Capacity() * m_stride;
+	stats.indexBufferBytes		= m_indices.Capacity() * sizeof(GLuint);
+	stats.defragmentations		= m_defragmentations;
+	stats.grows					= m_grows;
+	return stats;
+}
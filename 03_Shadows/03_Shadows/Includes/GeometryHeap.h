@@ -0,0 +1,105 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <memory>
+#include <vector>
+
+#include "BuddyAllocator.h"
+#include "VertexArrayObject.h"
+
+/*
+
+	GeometryHeap keeps the vertices and indices of many meshes in one large vertex buffer and one
+	large index buffer, sub-allocated with buddy allocators (in vertex and index units). All of it
+	is drawn through a single VAO, so switching from one mesh to the other costs no rebinding:
+	the allocations are addressed with the base vertex and the index offset of the draw call.
+
+	Indices are stored relative to the first vertex of their allocation, hence allocations can be
+	moved around freely: Defragment() compacts them on the GPU (glCopyBufferSubData) and only the
+	offsets behind the handles change. When there is no room, the heap first tries to
+	defragment (if that would help), then doubles the buffers.
+
+	Use Shared() to get the one heap of a vertex format.
+
+*/
+class GeometryHeap final
+{
+public:
+	// attributes of a vertex, AttributeData::ptr being the offset within the vertex
+	using VertexFormat = std::vector<AttributeData>;
+
+	using Handle = unsigned;
+	static const Handle INVALID_HANDLE = ~0u;
+
+	struct Allocation
+	{
+		GLint	baseVertex{};
+		size_t	firstIndex{};		// in indices, not bytes
+		GLsizei	indexCount{};
+		size_t	vertexCount{};
+
+		const void* IndexOffset() const { return (const void*)(firstIndex * sizeof(GLuint)); }
+	};
+
+	struct Stats
+	{
+		BuddyAllocator::Stats	vertices;
+		BuddyAllocator::Stats	indices;
+		double					vertexFragmentation{};	// external fragmentation of the free space
+		double					indexFragmentation{};
+		size_t					vertexBufferBytes{};
+		size_t					indexBufferBytes{};
+		unsigned				defragmentations{};
+		unsigned				grows{};
+	};
+
+	GeometryHeap(GLsizei stride, const VertexFormat& format, size_t initialVertices = 1 << 16, size_t initialIndices = 1 << 18);
+	~GeometryHeap();
+
+	GeometryHeap(const GeometryHeap&)				= delete;
+	GeometryHeap& operator=(const GeometryHeap&)	= delete;
+
+	// the heap of the given vertex format, created on first use and released with its last user
+	static std::shared_ptr<GeometryHeap> Shared(GLsizei stride, const VertexFormat& format);
+
+	Handle	Allocate(const void* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount);
+	void	Free(Handle handle);
+
+	const Allocation& Get(Handle handle) const { return m_slots[handle].allocation; }
+
+	// binds the VAO shared by every allocation
+	void	Bind() const;
+	GLuint	VertexArray() const { return m_vao; }	// the same for the whole life of the heap
+	void	Draw(Handle handle, GLenum mode = GL_TRIANGLES) const;
+
+	void	Defragment();
+	Stats	GetStats() const;
+
+private:
+	struct Slot
+	{
+		Allocation	allocation;
+		size_t		vertexBlock{ BuddyAllocator::INVALID };
+		size_t		indexBlock{ BuddyAllocator::INVALID };
+	};
+
+	void	SetupVertexArray();
+
+	GLsizei					m_stride;
+	VertexFormat			m_format;
+
+	BuddyAllocator			m_vertices;
+	BuddyAllocator			m_indices;
+
+	GLuint					m_vao{};
+	GLuint					m_vertexBuffer{};
+	GLuint					m_indexBuffer{};
+
+	std::vector<Slot>		m_slots;
+	std::vector<Handle>		m_freeSlots;
+
+	unsigned				m_defragmentations{};
+	unsigned				m_grows{};
+};
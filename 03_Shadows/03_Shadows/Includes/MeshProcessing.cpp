@@ -0,0 +1,362 @@
+#include "MeshProcessing.h"
+
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define MESHPROCESSING_SSE2
+#endif
+
+namespace
+{
+	const size_t	TRIANGLES_PER_TASK = 4096;
+	const size_t	VERTICES_PER_TASK = 8192;
+	const unsigned	NO_SPLIT = ~0u;
+
+	// per triangle data shared by the normal generation passes
+	struct Face
+	{
+		glm::vec3	weighted;	// cross product of two edges: its length is twice the area
+		glm::vec3	unit;		// the normalized face normal
+		float		angle[3];	// the angle of the triangle at each of its corners
+	};
+
+	float SafeAcos(float x)
+	{
+		return std::acos(std::max(-1.0f, std::min(1.0f, x)));
+	}
+
+	void ComputeFacesScalar(const std::vector<Mesh::Vertex>& vertices, const std::vector<unsigned int>& indices, size_t first, size_t last, std::vector<Face>& faces)
+	{
+		for (size_t t = first; t < last; ++t)
+		{
+			const glm::vec3& p0 = vertices[indices[3 * t + 0]].position;
+			const glm::vec3& p1 = vertices[indices[3 * t + 1]].position;
+			const glm::vec3& p2 = vertices[indices[3 * t + 2]].position;
+
+			const glm::vec3 e01 = p1 - p0, e02 = p2 - p0, e12 = p2 - p1;
+			const float l01 = glm::length(e01), l02 = glm::length(e02), l12 = glm::length(e12);
+
+			Face& face = faces[t];
+			face.weighted = glm::cross(e01, e02);
+
+			const float area2 = glm::length(face.weighted);
+			face.unit = area2 > 0 ? face.weighted / area2 : glm::vec3(0);
+
+			face.angle[0] = (l01 > 0 && l02 > 0) ? SafeAcos(glm::dot(e01, e02) / (l01 * l02)) : 0.0f;
+			face.angle[1] = (l01 > 0 && l12 > 0) ? SafeAcos(glm::dot(-e01, e12) / (l01 * l12)) : 0.0f;
+			face.angle[2] = (l02 > 0 && l12 > 0) ? SafeAcos(glm::dot(e02, e12) / (l02 * l12)) : 0.0f;
+		}
+	}
+
+#ifdef MESHPROCESSING_SSE2
+	// structure of arrays helpers: one lane per triangle
+	struct Vec3x4 { __m128 x, y, z; };
+
+	inline Vec3x4 Sub(const Vec3x4& a, const Vec3x4& b) { return { _mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z) }; }
+	inline __m128 Dot(const Vec3x4& a, const Vec3x4& b) { return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z)); }
+	inline Vec3x4 Cross(const Vec3x4& a, const Vec3x4& b)
+	{
+		return {
+			_mm_sub_ps(_mm_mul_ps(a.y, b.z), _mm_mul_ps(a.z, b.y)),
+			_mm_sub_ps(_mm_mul_ps(a.z, b.x), _mm_mul_ps(a.x, b.z)),
+			_mm_sub_ps(_mm_mul_ps(a.x, b.y), _mm_mul_ps(a.y, b.x)) };
+	}
+
+	// cosine of the angle between a and b, 1 for degenerate edges (their angle becomes 0)
+	inline __m128 CosAngle(__m128 dotAB, __m128 lenSqA, __m128 lenSqB)
+	{
+		const __m128 denominator = _mm_sqrt_ps(_mm_mul_ps(lenSqA, lenSqB));
+		const __m128 valid = _mm_cmpgt_ps(denominator, _mm_setzero_ps());
+		const __m128 cosine = _mm_div_ps(dotAB, _mm_max_ps(denominator, _mm_set1_ps(1e-30f)));
+		return _mm_or_ps(_mm_and_ps(valid, cosine), _mm_andnot_ps(valid, _mm_set1_ps(1.0f)));
+	}
+
+	inline Vec3x4 Gather(const std::vector<Mesh::Vertex>& vertices, const std::vector<unsigned int>& indices, size_t t, int corner)
+	{
+		const glm::vec3& a = vertices[indices[3 * (t + 0) + corner]].position;
+		const glm::vec3& b = vertices[indices[3 * (t + 1) + corner]].position;
+		const glm::vec3& c = vertices[indices[3 * (t + 2) + corner]].position;
+		const glm::vec3& d = vertices[indices[3 * (t + 3) + corner]].position;
+		return { _mm_setr_ps(a.x, b.x, c.x, d.x), _mm_setr_ps(a.y, b.y, c.y, d.y), _mm_setr_ps(a.z, b.z, c.z, d.z) };
+	}
+
+	void ComputeFaces(const std::vector<Mesh::Vertex>& vertices, const std::vector<unsigned int>& indices, size_t first, size_t last, std::vector<Face>& faces)
+	{
+		size_t t = first;
+		for (; t + 4 <= last; t += 4)
+		{
+			const Vec3x4 p0 = Gather(vertices, indices, t, 0);
+			const Vec3x4 p1 = Gather(vertices, indices, t, 1);
+			const Vec3x4 p2 = Gather(vertices, indices, t, 2);
+
+			const Vec3x4 e01 = Sub(p1, p0), e02 = Sub(p2, p0), e12 = Sub(p2, p1);
+			const __m128 l01 = Dot(e01, e01), l02 = Dot(e02, e02), l12 = Dot(e12, e12);
+
+			const Vec3x4 n = Cross(e01, e02);
+			const __m128 area2 = _mm_sqrt_ps(Dot(n, n));
+			const __m128 nonDegenerate = _mm_cmpgt_ps(area2, _mm_setzero_ps());
+			const __m128 invArea2 = _mm_and_ps(nonDegenerate, _mm_div_ps(_mm_set1_ps(1.0f), _mm_max_ps(area2, _mm_set1_ps(1e-30f))));
+
+			alignas(16) float nx[4], ny[4], nz[4], ux[4], uy[4], uz[4], c0[4], c1[4], c2[4];
+			_mm_store_ps(nx, n.x);
+			_mm_store_ps(ny, n.y);
+			_mm_store_ps(nz, n.z);
+			_mm_store_ps(ux, _mm_mul_ps(n.x, invArea2));
+			_mm_store_ps(uy, _mm_mul_ps(n.y, invArea2));
+			_mm_store_ps(uz, _mm_mul_ps(n.z, invArea2));
+			_mm_store_ps(c0, CosAngle(Dot(e01, e02), l01, l02));
+			_mm_store_ps(c1, CosAngle(_mm_sub_ps(_mm_setzero_ps(), Dot(e01, e12)), l01, l12));
+			_mm_store_ps(c2, CosAngle(Dot(e02, e12), l02, l12));
+
+			for (int lane = 0; lane < 4; ++lane)
+			{
+				Face& face = faces[t + lane];
+				face.weighted = glm::vec3(nx[lane], ny[lane], nz[lane]);
+				face.unit = glm::vec3(ux[lane], uy[lane], uz[lane]);
+				face.angle[0] = SafeAcos(c0[lane]);
+				face.angle[1] = SafeAcos(c1[lane]);
+				face.angle[2] = SafeAcos(c2[lane]);
+			}
+		}
+
+		ComputeFacesScalar(vertices, indices, t, last, faces);
+	}
+#else
+	void ComputeFaces(const std::vector<Mesh::Vertex>& vertices, const std::vector<unsigned int>& indices, size_t first, size_t last, std::vector<Face>& faces)
+	{
+		ComputeFacesScalar(vertices, indices, first, last, faces);
+	}
+#endif
+
+	struct PositionKey
+	{
+		uint32_t x, y, z;
+		bool operator==(const PositionKey& rhs) const { return x == rhs.x && y == rhs.y && z == rhs.z; }
+	};
+
+	struct PositionKeyHash
+	{
+		size_t operator()(const PositionKey& k) const { return (k.x * 73856093u) ^ (k.y * 19349663u) ^ (k.z * 83492791u); }
+	};
+
+	PositionKey MakeKey(const glm::vec3& p)
+	{
+		// +0 turns -0 into 0, so that they weld
+		const float c[3] = { p.x + 0.0f, p.y + 0.0f, p.z + 0.0f };
+		PositionKey key;
+		std::memcpy(&key.x, &c[0], 4);
+		std::memcpy(&key.y, &c[1], 4);
+		std::memcpy(&key.z, &c[2], 4);
+		return key;
+	}
+
+	// vertices that differ only in their texture coordinates still share a position, these are smoothed together
+	std::vector<unsigned> GroupByPosition(const std::vector<Mesh::Vertex>& vertices, size_t& groupCount)
+	{
+		std::unordered_map<PositionKey, unsigned, PositionKeyHash> groups;
+		groups.reserve(vertices.size());
+
+		std::vector<unsigned> groupOf(vertices.size());
+		for (size_t v = 0; v < vertices.size(); ++v)
+			groupOf[v] = groups.emplace(MakeKey(vertices[v].position), (unsigned)groups.size()).first->second;
+
+		groupCount = groups.size();
+		return groupOf;
+	}
+
+	glm::vec3 NormalizeOr(const glm::vec3& v, const glm::vec3& fallback)
+	{
+		const float len = glm::length(v);
+		return len > 0 ? v / len : fallback;
+	}
+}
+
+void MeshProcessing::GenerateNormals(std::vector<Mesh::Vertex>& vertices, std::vector<unsigned int>& indices, float creaseAngleDegrees, const std::vector<bool>& keep)
+{
+	auto isKept = [&](size_t v) { return v < keep.size() && keep[v]; };
+
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	std::vector<Face> faces(triangleCount);
+	ParallelFor(0, triangleCount, TRIANGLES_PER_TASK, [&](size_t first, size_t last) {
+		ComputeFaces(vertices, indices, first, last, faces);
+	});
+
+	size_t groupCount = 0;
+	const std::vector<unsigned> groupOf = GroupByPosition(vertices, groupCount);
+
+	if (creaseAngleDegrees >= 180.0f)
+	{
+		// Everything is smooth: every corner scatters its weighted face normal into its position group
+		std::vector<std::atomic<float>> sums(3 * groupCount);
+		for (std::atomic<float>& s : sums)
+			s.store(0.0f, std::memory_order_relaxed);
+
+		ParallelFor(0, triangleCount, TRIANGLES_PER_TASK, [&](size_t first, size_t last) {
+			for (size_t t = first; t < last; ++t)
+				for (int k = 0; k < 3; ++k)
+				{
+					const unsigned g = groupOf[indices[3 * t + k]];
+					const glm::vec3 contribution = faces[t].weighted * faces[t].angle[k];
+					AtomicAdd(sums[3 * g + 0], contribution.x);
+					AtomicAdd(sums[3 * g + 1], contribution.y);
+					AtomicAdd(sums[3 * g + 2], contribution.z);
+				}
+		});
+
+		ParallelFor(0, vertices.size(), VERTICES_PER_TASK, [&](size_t first, size_t last) {
+			for (size_t v = first; v < last; ++v)
+			{
+				if (isKept(v))
+					continue;
+				const unsigned g = groupOf[v];
+				const glm::vec3 sum(sums[3 * g + 0].load(std::memory_order_relaxed),
+									sums[3 * g + 1].load(std::memory_order_relaxed),
+									sums[3 * g + 2].load(std::memory_order_relaxed));
+				vertices[v].normal = NormalizeOr(sum, glm::vec3(0, 1, 0));
+			}
+		});
+		return;
+	}
+
+	// With a crease angle every corner gathers only from the faces around its position that are
+	// within the crease angle of its own face.
+
+	std::vector<unsigned> groupStart(groupCount + 1, 0);
+	for (unsigned index : indices)
+		++groupStart[groupOf[index] + 1];
+	for (size_t g = 0; g < groupCount; ++g)
+		groupStart[g + 1] += groupStart[g];
+
+	std::vector<unsigned> groupCorners(indices.size());
+	{
+		std::vector<unsigned> fill(groupStart.begin(), groupStart.end() - 1);
+		for (size_t c = 0; c < indices.size(); ++c)
+			groupCorners[fill[groupOf[indices[c]]]++] = (unsigned)c;
+	}
+
+	const float cosCrease = std::cos(glm::radians(creaseAngleDegrees));
+	std::vector<glm::vec3> cornerNormals(indices.size());
+
+	ParallelFor(0, triangleCount, TRIANGLES_PER_TASK, [&](size_t first, size_t last) {
+		for (size_t t = first; t < last; ++t)
+			for (int k = 0; k < 3; ++k)
+			{
+				const unsigned g = groupOf[indices[3 * t + k]];
+				glm::vec3 sum(0);
+				for (unsigned i = groupStart[g]; i < groupStart[g + 1]; ++i)
+				{
+					const unsigned corner = groupCorners[i];
+					const Face& other = faces[corner / 3];
+					if (glm::dot(faces[t].unit, other.unit) >= cosCrease)
+						sum += other.weighted * other.angle[corner % 3];
+				}
+				cornerNormals[3 * t + k] = NormalizeOr(sum, faces[t].unit);
+			}
+	});
+
+	// Corners of the same vertex may have ended up with different normals: split those vertices
+	std::vector<bool>		assigned(vertices.size(), false);
+	std::vector<unsigned>	nextSplit(vertices.size(), NO_SPLIT);
+	for (size_t c = 0; c < indices.size(); ++c)
+	{
+		const unsigned v = indices[c];
+		const glm::vec3& n = cornerNormals[c];
+
+		if (isKept(v))
+			continue;
+		if (!assigned[v])
+		{
+			vertices[v].normal = n;
+			assigned[v] = true;
+			continue;
+		}
+
+		unsigned u = v;
+		while (glm::dot(vertices[u].normal, n) < 0.9999f)
+		{
+			if (nextSplit[u] == NO_SPLIT)
+			{
+				Mesh::Vertex split = vertices[v];
+				split.normal = n;
+				nextSplit[u] = (unsigned)vertices.size();
+				vertices.push_back(split);
+				nextSplit.push_back(NO_SPLIT);
+			}
+			u = nextSplit[u];
+		}
+		indices[c] = u;
+	}
+}
+
+void MeshProcessing::GenerateTangents(std::vector<Mesh::Vertex>& vertices, const std::vector<unsigned int>& indices)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// tangent (xyz) and bitangent (xyz) sums per vertex
+	std::vector<std::atomic<float>> sums(6 * vertices.size());
+	for (std::atomic<float>& s : sums)
+		s.store(0.0f, std::memory_order_relaxed);
+
+	ParallelFor(0, triangleCount, TRIANGLES_PER_TASK, [&](size_t first, size_t last) {
+		for (size_t t = first; t < last; ++t)
+		{
+			const unsigned i0 = indices[3 * t + 0], i1 = indices[3 * t + 1], i2 = indices[3 * t + 2];
+			const Mesh::Vertex& v0 = vertices[i0];
+			const Mesh::Vertex& v1 = vertices[i1];
+			const Mesh::Vertex& v2 = vertices[i2];
+
+			const glm::vec3 e1 = v1.position - v0.position, e2 = v2.position - v0.position;
+			const glm::vec2 d1 = v1.texcoord - v0.texcoord, d2 = v2.texcoord - v0.texcoord;
+
+			const float det = d1.x * d2.y - d2.x * d1.y;
+			if (std::abs(det) < 1e-12f)
+				continue; // no usable texture mapping on this triangle
+
+			const float r = 1.0f / det;
+			const glm::vec3 tangent = (e1 * d2.y - e2 * d1.y) * r;
+			const glm::vec3 bitangent = (e2 * d1.x - e1 * d2.x) * r;
+
+			for (unsigned v : { i0, i1, i2 })
+			{
+				AtomicAdd(sums[6 * v + 0], tangent.x);
+				AtomicAdd(sums[6 * v + 1], tangent.y);
+				AtomicAdd(sums[6 * v + 2], tangent.z);
+				AtomicAdd(sums[6 * v + 3], bitangent.x);
+				AtomicAdd(sums[6 * v + 4], bitangent.y);
+				AtomicAdd(sums[6 * v + 5], bitangent.z);
+			}
+		}
+	});
+
+	ParallelFor(0, vertices.size(), VERTICES_PER_TASK, [&](size_t first, size_t last) {
+		for (size_t v = first; v < last; ++v)
+		{
+			const glm::vec3 n = NormalizeOr(vertices[v].normal, glm::vec3(0, 1, 0));	// the tangent space needs one, even for a zero normal
+			const glm::vec3 t(sums[6 * v + 0].load(std::memory_order_relaxed), sums[6 * v + 1].load(std::memory_order_relaxed), sums[6 * v + 2].load(std::memory_order_relaxed));
+			const glm::vec3 b(sums[6 * v + 3].load(std::memory_order_relaxed), sums[6 * v + 4].load(std::memory_order_relaxed), sums[6 * v + 5].load(std::memory_order_relaxed));
+
+			// Gram-Schmidt against the normal; pick any perpendicular direction if there is no tangent,
+			// or if it is (nearly) parallel to the normal and only rounding noise is left of it
+			const glm::vec3 any = std::abs(n.x) < 0.9f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+			const glm::vec3 projected = t - n * glm::dot(n, t);
+			const float projectedLength = glm::length(projected);
+			const glm::vec3 orthogonal = projectedLength > 1e-4f * glm::length(t) ? projected / projectedLength : glm::normalize(glm::cross(any, n));
+			const float handedness = glm::dot(glm::cross(n, orthogonal), b) < 0.0f ? -1.0f : 1.0f;
+
+			vertices[v].tangent = glm::vec4(orthogonal, handedness);
+		}
+	});
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+#include "Mesh_OGL3.h"
+
+/*
+
+	Load time generation of vertex attributes that the source file did not provide.
+
+	GenerateNormals computes smooth normals weighted by both the area of the triangles and
+	their angle at the vertex. Vertices that share a position are smoothed together, unless the
+	angle between the two faces is larger than the crease angle: in that case the vertex is
+	split, so hard edges stay hard. A crease angle of 180 degrees or more smooths everything.
+	The vertices flagged in keep (normals from the file) are left as they are.
+
+	GenerateTangents computes per-vertex tangents for normal mapping from the texture
+	coordinates. The w component holds the handedness of the tangent frame, so the bitangent
+	is cross(normal, tangent.xyz) * tangent.w.
+
+	Both run over ranges of triangles in parallel, accumulating without locks.
+
+*/
+class MeshProcessing
+{
+public:
+	static void GenerateNormals(std::vector<Mesh::Vertex>& vertices, std::vector<unsigned int>& indices, float creaseAngleDegrees = 180.0f, const std::vector<bool>& keep = {});
+	static void GenerateTangents(std::vector<Mesh::Vertex>& vertices, const std::vector<unsigned int>& indices);
+};
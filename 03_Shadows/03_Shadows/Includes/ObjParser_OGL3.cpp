@@ -4,7 +4,7 @@
 
 using namespace std;
 
-std::unique_ptr<Mesh> ObjParser::parse(const char* fileName)
+std::unique_ptr<Mesh> ObjParser::parse(const char* fileName, float creaseAngleDegrees)
 {
 	ObjParser theParser;
 
@@ -12,7 +12,7 @@ std::unique_ptr<Mesh> ObjParser::parse(const char* fileName)
 	if (!theParser.ifs)
 		throw(EXC_FILENOTFOUND);
 
-	theParser.mesh = new Mesh();
+	theParser.mesh = std::make_unique<Mesh>();
 
 	while(theParser.skipCommentLine()) 
 	{
@@ -22,9 +22,15 @@ std::unique_ptr<Mesh> ObjParser::parse(const char* fileName)
 
 	theParser.ifs.close();
 
+	// fill in the attributes the file did not provide
+	if (theParser.missingNormals)
+		theParser.mesh->generateNormals(creaseAngleDegrees, theParser.hasNormal);
+	if (!theParser.texcoords.empty())
+		theParser.mesh->generateTangents();
+
 	theParser.mesh->initBuffers();
 
-	return std::make_unique<Mesh>(*theParser.mesh);
+	return std::move(theParser.mesh);
 }
 
 bool ObjParser::processLine()
@@ -57,6 +63,7 @@ bool ObjParser::processLine()
 
 		for( unsigned int iFace = 0; iFace < 3; iFace++ )
 		{
+			iTexCoord = iNormal = 0;	// a corner without them
 			ifs >> iPosition;
 			if( '/' == ifs.peek() )
 			{
@@ -94,6 +101,10 @@ void ObjParser::addIndexedVertex(const IndexedVert& vertex)
 			v.texcoord = texcoords[vertex.vt];
 		if (vertex.vn != -1)
 			v.normal = normals[vertex.vn];
+		else
+			missingNormals = true;
+		hasNormal.push_back(vertex.vn != -1);
+		v.tangent = glm::vec4(1, 0, 0, 1);
 		
 		mesh->addVertex(v);
 		mesh->addIndex(nIndexedVerts++);		// 0 based indices
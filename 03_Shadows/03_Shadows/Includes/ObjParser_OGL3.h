@@ -15,7 +15,9 @@
 class ObjParser
 {
 public:
-	static std::unique_ptr<Mesh> parse(const char* fileName);
+	// Normals are generated for the vertices the file gives none (hard edges are kept above
+	// creaseAngleDegrees), tangents whenever it has texture coordinates.
+	static std::unique_ptr<Mesh> parse(const char* fileName, float creaseAngleDegrees = 180.0f);
 
 	enum Exception { EXC_FILENOTFOUND };
 private:
@@ -27,14 +29,14 @@ private:
 		}
 	};
 		
-	ObjParser(void) : mesh(0), nIndexedVerts(0) {}
+	ObjParser(void) : nIndexedVerts(0), missingNormals(false) {}
 
 	bool processLine();
 	bool skipCommentLine();
 	void skipLine();
 	void addIndexedVertex(const IndexedVert& vertex);
 
-	Mesh* mesh;
+	std::unique_ptr<Mesh> mesh;
 	std::ifstream ifs;
 
 	std::vector<glm::vec3> positions;
@@ -43,4 +45,7 @@ private:
 
 	unsigned int nIndexedVerts;
 	std::map<IndexedVert, unsigned int> vertexIndices;
+
+	bool missingNormals;
+	std::vector<bool> hasNormal;	// per vertex of the mesh: its normal is from the file
 };
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+
+	ThreadPool is the set of threads ParallelFor() runs on: one less than the cores, started the
+	first time it is used and kept until the program exits, so a pass costs no thread start.
+
+	A thread that is a worker already (the threads of the pool, and the ones marked with
+	MarkWorkerThread(), e.g. the decoders of TextureStreamer) runs ParallelFor() serially: its
+	siblings keep the cores busy, and nested passes would only oversubscribe them.
+
+*/
+class ThreadPool final
+{
+public:
+	static ThreadPool& Shared();
+
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&)				= delete;
+	ThreadPool& operator=(const ThreadPool&)	= delete;
+
+	// runs task(0) ... task(count - 1) on the threads of the pool and the calling thread; returns when every one ran
+	void	Run(size_t count, const std::function<void(size_t)>& task);
+	size_t	ThreadCount() const { return m_threads.size(); }
+
+	static void	MarkWorkerThread();
+	static bool	IsWorkerThread();
+
+private:
+	struct Job
+	{
+		const std::function<void(size_t)>*	task;
+		size_t		count;
+		size_t		next;		// the first task nobody took yet
+		size_t		done;
+	};
+
+	ThreadPool();
+
+	void	Work();
+	// takes the next task of job and runs it, the lock is released while it runs; false if none is left
+	bool	RunNext(Job& job, std::unique_lock<std::mutex>& lock);
+
+	std::mutex					m_mutex;
+	std::condition_variable		m_wake;			// a job arrived
+	std::condition_variable		m_finished;		// a job is done
+	std::deque<Job*>			m_jobs;			// with tasks nobody took yet
+	bool						m_stop{};
+
+	std::vector<std::thread>	m_threads;
+};
+
+/*
+
+	Splits [begin, end) into contiguous ranges of at least grainSize elements and calls
+	body(rangeBegin, rangeEnd) for each of them on the threads of the ThreadPool. The calling
+	thread processes ranges too. Returns when every range has been processed.
+
+*/
+template <typename F>
+void ParallelFor(size_t begin, size_t end, size_t grainSize, F&& body)
+{
+	if (end <= begin)
+		return;
+
+	const size_t count = end - begin;
+	const size_t threads = ThreadPool::IsWorkerThread() ? 1 : ThreadPool::Shared().ThreadCount() + 1;
+	const size_t rangeCount = std::max<size_t>(1, std::min(threads, count / std::max<size_t>(1, grainSize)));
+
+	if (rangeCount == 1)
+	{
+		body(begin, end);
+		return;
+	}
+
+	const size_t rangeSize = (count + rangeCount - 1) / rangeCount;
+	ThreadPool::Shared().Run(rangeCount, [&](size_t i) {
+		const size_t rangeBegin = begin + i * rangeSize;
+		const size_t rangeEnd = std::min(end, rangeBegin + rangeSize);
+		if (rangeBegin < rangeEnd)
+			body(rangeBegin, rangeEnd);
+	});
+}
+
+// lock-free accumulation into a float that other threads may update concurrently
+inline void AtomicAdd(std::atomic<float>& target, float value)
+{
+	float expected = target.load(std::memory_order_relaxed);
+	while (!target.compare_exchange_weak(expected, expected + value, std::memory_order_relaxed))
+		;
+}
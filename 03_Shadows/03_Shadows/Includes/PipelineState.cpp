@@ -0,0 +1,46 @@
+#include "PipelineState.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	unsigned g_nextId = 1;
+
+	template <size_t N>
+	bool OneOf(GLenum value, const GLenum(&allowed)[N])
+	{
+		return std::find(allowed, allowed + N, value) != allowed + N;
+	}
+
+	const GLenum CULL_FACES[] = { GL_FRONT, GL_BACK, GL_FRONT_AND_BACK };
+	const GLenum DEPTH_FUNCS[] = { GL_NEVER, GL_LESS, GL_EQUAL, GL_LEQUAL, GL_GREATER, GL_NOTEQUAL, GL_GEQUAL, GL_ALWAYS };
+	const GLenum BLEND_EQUATIONS[] = { GL_FUNC_ADD, GL_FUNC_SUBTRACT, GL_FUNC_REVERSE_SUBTRACT, GL_MIN, GL_MAX };
+	const GLenum BLEND_FACTORS[] = {
+		GL_ZERO, GL_ONE, GL_SRC_COLOR, GL_ONE_MINUS_SRC_COLOR, GL_DST_COLOR, GL_ONE_MINUS_DST_COLOR,
+		GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_DST_ALPHA, GL_ONE_MINUS_DST_ALPHA,
+		GL_CONSTANT_COLOR, GL_ONE_MINUS_CONSTANT_COLOR, GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA, GL_SRC_ALPHA_SATURATE
+	};
+
+	bool Check(bool condition, const char* message)
+	{
+		if (!condition)
+			std::cerr << "[PipelineState] " << message << std::endl;
+		return condition;
+	}
+}
+
+PipelineState::PipelineState(const Desc& desc)
+	: m_desc(desc), m_id(g_nextId++)
+{
+	// a link still in progress is not waited for here: GLState::Apply() refuses the pipeline until it is done
+	m_valid = Check(m_desc.program != nullptr && *m_desc.program != 0 && (m_desc.program->IsPending() || m_desc.program->IsReady()), "the program is missing or not linked");
+	m_valid &= Check(OneOf(m_desc.raster.cullFace, CULL_FACES), "invalid cull face");
+	m_valid &= Check(OneOf(m_desc.depth.func, DEPTH_FUNCS), "invalid depth function");
+	m_valid &= Check(OneOf(m_desc.blend.equation, BLEND_EQUATIONS), "invalid blend equation");
+	m_valid &= Check(OneOf(m_desc.blend.source, BLEND_FACTORS) && OneOf(m_desc.blend.destination, BLEND_FACTORS), "invalid blend factor");
+
+	// not an error, but almost certainly not what was meant: without the test OpenGL writes no depth either
+	if (m_desc.depth.write && !m_desc.depth.test)
+		std::cerr << "[PipelineState] depth writes are enabled with the depth test off, nothing will be written" << std::endl;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <memory>
+#include <utility>
+
+#include "ProgramObject.h"
+#include "GeometryHeap.h"
+
+struct RasterState
+{
+	bool	cull{ true };
+	GLenum	cullFace{ GL_BACK };
+};
+
+struct DepthState
+{
+	bool	test{ true };
+	bool	write{ true };
+	GLenum	func{ GL_LESS };
+
+	static DepthState Disabled()	{ return { false, false, GL_LESS }; }
+};
+
+struct BlendState
+{
+	bool	enabled{};
+	GLenum	equation{ GL_FUNC_ADD };
+	GLenum	source{ GL_ONE };
+	GLenum	destination{ GL_ZERO };
+
+	static BlendState Opaque()		{ return {}; }
+	static BlendState Additive()	{ return { true, GL_FUNC_ADD, GL_ONE, GL_ONE }; }
+};
+
+/*
+
+	PipelineState bundles everything a pass sets before its draws: the program, the vertex format
+	and the raster, depth and blend state. It is immutable and checked once, when it is created;
+	GLState::Apply() makes it current, issuing only the calls that change something. Applying
+	the pipeline that is already current costs nothing.
+
+	Passes declare their pipelines once (in Init) instead of switching the state by hand around
+	their draws and switching it back afterwards.
+
+*/
+class PipelineState final
+{
+public:
+	struct Desc
+	{
+		ProgramObject*					program{};	// may still be linking, see GLState::Apply()
+		std::shared_ptr<GeometryHeap>	geometry;	// the vertex format; null for draws without vertex attributes
+		RasterState						raster;
+		DepthState						depth;
+		BlendState						blend;
+
+		// the state left out is the default one
+		Desc() = default;
+		Desc(ProgramObject* program, std::shared_ptr<GeometryHeap> geometry, const RasterState& raster = RasterState(),
+			const DepthState& depth = DepthState(), const BlendState& blend = BlendState())
+			: program(program), geometry(std::move(geometry)), raster(raster), depth(depth), blend(blend) {}
+	};
+
+	PipelineState() = default;
+	explicit PipelineState(const Desc& desc);
+
+	const Desc&	GetDesc()	const { return m_desc; }
+	unsigned	Id()		const { return m_id; }		// unique per created pipeline, 0 for none
+	bool		IsValid()	const { return m_valid; }	// the checks at creation passed (the link of the program is not waited for)
+
+private:
+	Desc		m_desc;
+	unsigned	m_id{};
+	bool		m_valid{};
+};
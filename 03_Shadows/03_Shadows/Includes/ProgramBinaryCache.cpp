@@ -0,0 +1,173 @@
+#include "ProgramBinaryCache.h"
+#include "GLCaps.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	// the start of every entry, before the binary itself
+	struct Header
+	{
+		char			magic[4];
+		std::uint32_t	version;
+		std::uint64_t	key;		// a renamed or copied entry is not loaded for another program
+		std::uint32_t	format;		// of glGetProgramBinary
+		std::uint32_t	length;
+	};
+
+	const char			MAGIC[4] = { 'G', 'L', 'P', 'B' };
+	const std::uint32_t	VERSION = 1;
+
+	std::string					g_directory = "ShaderCache";
+	bool						g_enabled = true;
+	bool						g_directoryCreated = false;
+	ProgramBinaryCache::Stats	g_stats;
+
+	std::string FileName(ProgramBinaryCache::Key key)
+	{
+		char name[17];
+		std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+		return g_directory + "/" + name + ".bin";
+	}
+
+	void MakeDirectory()
+	{
+		if (g_directoryCreated)
+			return;
+#ifdef _WIN32
+		_mkdir(g_directory.c_str());
+#else
+		mkdir(g_directory.c_str(), 0755);
+#endif
+		g_directoryCreated = true;	// or it was there already
+	}
+
+	const char* GLString(GLenum name)
+	{
+		const GLubyte* string = glGetString(name);
+		return string ? reinterpret_cast<const char*>(string) : "";
+	}
+}
+
+void ProgramBinaryCache::SetDirectory(const std::string& directory)
+{
+	g_directory = directory;
+	g_directoryCreated = false;
+}
+
+void ProgramBinaryCache::SetEnabled(bool enabled)
+{
+	g_enabled = enabled;
+}
+
+bool ProgramBinaryCache::IsAvailable()
+{
+	return g_enabled && GLCaps::Get().programBinary;
+}
+
+ProgramBinaryCache::Key ProgramBinaryCache::BeginKey()
+{
+	Key key = 14695981039346656037ull;
+	key = AddToKey(key, GLString(GL_VENDOR));
+	key = AddToKey(key, GLString(GL_RENDERER));
+	key = AddToKey(key, GLString(GL_VERSION));
+	return key;
+}
+
+ProgramBinaryCache::Key ProgramBinaryCache::AddToKey(Key key, const void* data, std::size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (std::size_t i = 0; i < size; ++i)
+		key = (key ^ bytes[i]) * 1099511628211ull;
+	return key;
+}
+
+ProgramBinaryCache::Key ProgramBinaryCache::AddToKey(Key key, const std::string& text)
+{
+	const std::uint64_t length = text.size();
+	key = AddToKey(key, &length, sizeof(length));
+	return AddToKey(key, text.data(), text.size());
+}
+
+bool ProgramBinaryCache::Load(GLuint program, Key key)
+{
+	const auto begin = std::chrono::steady_clock::now();
+	auto finish = [&](bool hit) {
+		++(hit ? g_stats.hits : g_stats.misses);
+		g_stats.loadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		return hit;
+	};
+
+	const std::string fileName = FileName(key);
+	std::ifstream file(fileName, std::ios::binary);
+	if (!file)
+		return finish(false);
+
+	Header header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.key != key)
+		return finish(false);
+
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), binary.size()))
+		return finish(false);	// cut short, Store() will write it again
+	file.close();
+
+	glProgramBinary(program, header.format, binary.data(), GLsizei(binary.size()));
+
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (linked == GL_FALSE)
+	{
+		// keys cover the driver version, but the driver has the last word
+		++g_stats.rejected;
+		std::remove(fileName.c_str());
+		return finish(false);
+	}
+	return finish(true);
+}
+
+void ProgramBinaryCache::Store(GLuint program, Key key)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	Header header;
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version	= VERSION;
+	header.key		= key;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+	header.format	= format;
+	header.length	= std::uint32_t(length);
+
+	MakeDirectory();
+	const std::string fileName = FileName(key);
+	std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+	if (!file.write(reinterpret_cast<const char*>(&header), sizeof(header)) || !file.write(binary.data(), length))
+	{
+		std::cerr << "[ProgramBinaryCache] cannot write " << fileName << std::endl;
+		return;
+	}
+	++g_stats.stored;
+}
+
+const ProgramBinaryCache::Stats& ProgramBinaryCache::GetStats()
+{
+	return g_stats;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+
+	ProgramBinaryCache keeps linked programs on disk, as glGetProgramBinary returns them, so the
+	next launch loads them with glProgramBinary instead of compiling and linking the sources.
+	ProgramObject::Init() goes through it.
+
+	An entry is keyed by a 64 bit FNV-1a hash of everything the binary depends on: the vendor,
+	renderer and version strings of the context (BeginKey()), then the type and source of every
+	stage and the attribute and frag data bindings (AddToKey()). An edited shader or a new driver
+	gives a new key, so a stale entry is never loaded; it is simply not found, and the program is
+	built from source and stored under the new key. A binary the driver refuses anyway
+	(glProgramBinary leaves the program unlinked) is deleted and counts as a miss too.
+
+	The entries are "<directory>/<key>.bin". Nothing is cached without GLCaps::programBinary.
+
+*/
+class ProgramBinaryCache final
+{
+public:
+	using Key = std::uint64_t;
+
+	struct Stats
+	{
+		unsigned	hits{};			// programs loaded from a binary
+		unsigned	misses{};		// programs built from source
+		unsigned	rejected{};		// binaries the driver refused (included in misses)
+		unsigned	stored{};
+		double		loadMs{};		// spent in Load(), hit or miss
+	};
+
+	ProgramBinaryCache() = delete;
+
+	// "ShaderCache" by default, relative to the working directory; created on the first Store()
+	static void		SetDirectory(const std::string& directory);
+	static void		SetEnabled(bool enabled);
+	// enabled, and the context can save programs
+	static bool		IsAvailable();
+
+	// a key made of the vendor, renderer and version strings
+	static Key		BeginKey();
+	static Key		AddToKey(Key key, const void* data, std::size_t size);
+	// the length and the characters, so that ("ab", "c") and ("a", "bc") differ
+	static Key		AddToKey(Key key, const std::string& text);
+
+	// links program from the binary stored under key; false if there is none or it is refused
+	static bool		Load(GLuint program, Key key);
+	// saves the binary of a linked program, which had GL_PROGRAM_BINARY_RETRIEVABLE_HINT set before linking
+	static void		Store(GLuint program, Key key);
+
+	static const Stats&	GetStats();
+};
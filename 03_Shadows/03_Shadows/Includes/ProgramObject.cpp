@@ -1,34 +1,144 @@
 #include "ProgramObject.h"
+#include "GLCaps.h"
+#include "GLState.h"
+#include "ProgramBinaryCache.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	ProgramObject::BuildStats	g_buildStats;
+	Clock::time_point			g_buildStart;
+
+	// every program, for ProgramObject::ReloadFiles()
+	std::vector<ProgramObject*>	g_programs;
+
+	// a pending link completed (or its program was deleted): the wall time ends with the last one
+	void EndBuild()
+	{
+		if (g_buildStats.pending == 0 || --g_buildStats.pending > 0)
+			return;
+
+		g_buildStats.wallMs += std::chrono::duration<double, std::milli>(Clock::now() - g_buildStart).count();
+	}
+
+	// the info log of a program that did not link
+	void PrintLinkLog(GLuint program)
+	{
+		GLint infoLogLength = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
+		GLchar* error = new char[infoLogLength + 1]();
+		glGetProgramInfoLog(program, infoLogLength, nullptr, error);
+		std::cerr << "[Link] Hiba: " << error;
+		delete[] error;
+	}
+
+	// lets the driver use as many compiler threads as it likes
+	void EnableParallelCompile()
+	{
+		static bool enabled = false;
+		if (enabled || !GLCaps::Get().parallelShaderCompile)
+			return;
+		enabled = true;
+#ifdef GL_KHR_parallel_shader_compile
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+#endif
+	}
+
+	// the size of a uniform of type in the client memory SetUniform takes it from; 0 if it is not shadowed
+	GLsizei UniformTypeSize(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_FLOAT: case GL_INT: case GL_UNSIGNED_INT: case GL_BOOL:	return 4;
+		case GL_FLOAT_VEC2: case GL_INT_VEC2: case GL_UNSIGNED_INT_VEC2:	return 8;
+		case GL_FLOAT_VEC3: case GL_INT_VEC3: case GL_UNSIGNED_INT_VEC3:	return 12;
+		case GL_FLOAT_VEC4: case GL_INT_VEC4: case GL_UNSIGNED_INT_VEC4:	return 16;
+		case GL_FLOAT_MAT2:		return 16;
+		case GL_FLOAT_MAT3:		return 36;
+		case GL_FLOAT_MAT4:		return 64;
+		case GL_FLOAT_MAT2x3:	case GL_FLOAT_MAT3x2:	return 24;
+		case GL_FLOAT_MAT2x4:	case GL_FLOAT_MAT4x2:	return 32;
+		case GL_FLOAT_MAT3x4:	case GL_FLOAT_MAT4x3:	return 48;
+		case GL_DOUBLE:			return 8;
+		case GL_DOUBLE_VEC2:	return 16;
+		case GL_DOUBLE_VEC3:	return 24;
+		case GL_DOUBLE_VEC4:	return 32;
+		case GL_DOUBLE_MAT4:	return 128;
+
+		// samplers hold the texture unit, set with glUniform1i
+		case GL_SAMPLER_1D:				case GL_SAMPLER_2D:				case GL_SAMPLER_3D:
+		case GL_SAMPLER_CUBE:			case GL_SAMPLER_2D_SHADOW:		case GL_SAMPLER_CUBE_SHADOW:
+		case GL_SAMPLER_2D_ARRAY:		case GL_SAMPLER_2D_ARRAY_SHADOW:	case GL_SAMPLER_BUFFER:
+		case GL_INT_SAMPLER_2D:			case GL_UNSIGNED_INT_SAMPLER_2D:	case GL_SAMPLER_2D_MULTISAMPLE:
+			return 4;
+
+		default:				return 0;
+		}
+	}
+}
+
 ProgramObject::ProgramObject()
 {
 	m_id = glCreateProgram();
+	g_programs.push_back(this);
 }
 
 
 ProgramObject::~ProgramObject()
 {
+	g_programs.erase(std::remove(g_programs.begin(), g_programs.end(), this), g_programs.end());
+
+	if (IsPending())
+		EndBuild();
+	CancelReload();
 	Clean();
 
 	if (m_id != 0)
-		glDeleteProgram(m_id);
+		GLState::DeletePrograms(1, &m_id);
 }
 
 ProgramObject::ProgramObject(std::initializer_list<ShaderObject> shaderList, std::initializer_list<Binding> attribLocationBindingList, std::initializer_list<Binding> fragDataBindingList)
 {
 	m_id = glCreateProgram();
+	g_programs.push_back(this);
 	Init(shaderList, attribLocationBindingList, fragDataBindingList);
 }
 
 ProgramObject::ProgramObject(ProgramObject && rhs)
 {
+	g_programs.push_back(this);
+
 	m_id = rhs.m_id;
 	m_list_shaders_attached = std::move(rhs.m_list_shaders_attached);
-	m_map_uniform_locations = std::move(rhs.m_map_uniform_locations);
+	m_uniform_locations = std::move(rhs.m_uniform_locations);
+	m_uniform_values = std::move(rhs.m_uniform_values);
+	m_uniform_data = std::move(rhs.m_uniform_data);
+	m_uniform_blocks = std::move(rhs.m_uniform_blocks);
+	m_block_bindings = std::move(rhs.m_block_bindings);
+	m_link_state = rhs.m_link_state;
+	m_store_binary = rhs.m_store_binary;
+	m_binary_key = rhs.m_binary_key;
+	m_stages = std::move(rhs.m_stages);
+	m_attrib_bindings = std::move(rhs.m_attrib_bindings);
+	m_frag_data_bindings = std::move(rhs.m_frag_data_bindings);
+	m_reload_state = rhs.m_reload_state;
+	m_reload_id = rhs.m_reload_id;
+	m_reload_shaders = std::move(rhs.m_reload_shaders);
 
 	rhs.m_id = 0;
+	rhs.m_link_state = LinkState::Unlinked;
+	rhs.m_reload_id = 0;
+	rhs.m_reload_state = ReloadState::Idle;
 }
 
 ProgramObject & ProgramObject::operator=(ProgramObject && rhs)
@@ -36,30 +146,115 @@ ProgramObject & ProgramObject::operator=(ProgramObject && rhs)
 	if (&rhs == this)
 		return *this;
 
+	CancelReload();
+
 	m_id = rhs.m_id;
 	m_list_shaders_attached = std::move(rhs.m_list_shaders_attached);
-	m_map_uniform_locations = std::move(rhs.m_map_uniform_locations);
+	m_uniform_locations = std::move(rhs.m_uniform_locations);
+	m_uniform_values = std::move(rhs.m_uniform_values);
+	m_uniform_data = std::move(rhs.m_uniform_data);
+	m_uniform_blocks = std::move(rhs.m_uniform_blocks);
+	m_block_bindings = std::move(rhs.m_block_bindings);
+	m_link_state = rhs.m_link_state;
+	m_store_binary = rhs.m_store_binary;
+	m_binary_key = rhs.m_binary_key;
+	m_stages = std::move(rhs.m_stages);
+	m_attrib_bindings = std::move(rhs.m_attrib_bindings);
+	m_frag_data_bindings = std::move(rhs.m_frag_data_bindings);
+	m_reload_state = rhs.m_reload_state;
+	m_reload_id = rhs.m_reload_id;
+	m_reload_shaders = std::move(rhs.m_reload_shaders);
 
 	rhs.m_id = 0;
+	rhs.m_link_state = LinkState::Unlinked;
+	rhs.m_reload_id = 0;
+	rhs.m_reload_state = ReloadState::Idle;
 
 	return *this;
 }
 
 bool ProgramObject::Init(std::initializer_list<ShaderObject> shaderList, std::initializer_list<Binding> attribLocationBindingList, std::initializer_list<Binding> fragDataBindingList)
 {
-	if (m_id != 0)
-		Clean();
+	return InitAsync(shaderList, attribLocationBindingList, fragDataBindingList) && Wait();
+}
+
+bool ProgramObject::InitAsync(std::initializer_list<ShaderObject> shaderList, std::initializer_list<Binding> attribLocationBindingList, std::initializer_list<Binding> fragDataBindingList)
+{
+	std::vector<const ShaderObject*> shaders;
+	for (const ShaderObject& shader : shaderList)
+		shaders.push_back(&shader);
+	return InitAsync(shaders, attribLocationBindingList, fragDataBindingList);
+}
+
+bool ProgramObject::InitAsync(const std::vector<const ShaderObject*>& shaderList, const std::vector<Binding>& attribLocationBindingList, const std::vector<Binding>& fragDataBindingList)
+{
+	if (m_id == 0)
+		return false;
 
-	AttachShaders(shaderList);
-	BindAttribLocations(attribLocationBindingList);
-	BindFragDataLocations(fragDataBindingList);
-	return LinkProgram();
+	Wait();		// a link still pending from an earlier Init
+	CancelReload();
+	Clean();
+	EnableParallelCompile();
+
+	// remembered for Reload()
+	m_stages.clear();
+	for (const ShaderObject* shader : shaderList)
+		m_stages.push_back({ shader->Type(), shader->Origin(), shader->Defines(), shader->Files() });
+	m_attrib_bindings.assign(attribLocationBindingList.begin(), attribLocationBindingList.end());
+	m_frag_data_bindings.assign(fragDataBindingList.begin(), fragDataBindingList.end());
+
+	m_store_binary = ProgramBinaryCache::IsAvailable();
+	if (m_store_binary)
+	{
+		m_binary_key = BinaryKey(shaderList, attribLocationBindingList, fragDataBindingList);
+		if (ProgramBinaryCache::Load(m_id, m_binary_key))
+		{
+			m_store_binary = false;
+			AfterLink();
+			return true;	// the shaders were never compiled
+		}
+		glProgramParameteri(m_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	// attaching submits the shaders for compiling; nothing below waits for the driver
+	for (const ShaderObject* shader : shaderList)
+		AttachShader(*shader);
+	for (const Binding& binding : attribLocationBindingList)
+		BindAttribLocation(binding.first, binding.second);
+	for (const Binding& binding : fragDataBindingList)
+		BindFragDataLocation(binding.first, binding.second);
+	SubmitLink();
+	return true;
+}
+
+std::uint64_t ProgramObject::BinaryKey(const std::vector<const ShaderObject*>& shaderList, const std::vector<Binding>& attribLocationBindingList, const std::vector<Binding>& fragDataBindingList)
+{
+	// everything the linked program depends on, see ProgramBinaryCache
+	ProgramBinaryCache::Key key = ProgramBinaryCache::BeginKey();
+	for (const ShaderObject* shader : shaderList)
+	{
+		const GLenum type = shader->Type();
+		key = ProgramBinaryCache::AddToKey(key, &type, sizeof(type));
+		key = ProgramBinaryCache::AddToKey(key, shader->Source());
+	}
+	for (const std::vector<Binding>* list : { &attribLocationBindingList, &fragDataBindingList })
+	{
+		const std::uint64_t count = list->size();
+		key = ProgramBinaryCache::AddToKey(key, &count, sizeof(count));
+		for (const Binding& binding : *list)
+		{
+			key = ProgramBinaryCache::AddToKey(key, &binding.first, sizeof(binding.first));
+			key = ProgramBinaryCache::AddToKey(key, binding.second);
+		}
+	}
+	return key;
 }
 
 void ProgramObject::Clean()
 {
 	for (auto shader : m_list_shaders_attached)
 		glDetachShader(m_id, shader);
+	m_list_shaders_attached.clear();
 }
 
 ProgramObject& ProgramObject::AttachShader(const ShaderObject& shader)
@@ -94,14 +289,14 @@ void ProgramObject::BindAttribLocations(std::initializer_list<std::pair<int, con
 
 void ProgramObject::BindFragDataLocation(int _index, const char * _outVariableName) const
 {
-	glBindAttribLocation(m_id, _index, _outVariableName);
+	glBindFragDataLocation(m_id, _index, _outVariableName);
 }
 
 void ProgramObject::BindFragDataLocations(std::initializer_list<Binding> fragDataBindingList) const
 {
 	for (const auto& binding : fragDataBindingList)
 	{
-		glBindAttribLocation(m_id, binding.first, binding.second);
+		glBindFragDataLocation(m_id, binding.first, binding.second);
 	}
 }
 
@@ -110,68 +305,478 @@ bool ProgramObject::LinkProgram()
 	if (m_id == 0)
 		return false;
 
+	SubmitLink();
+	return Wait();
+}
+
+void ProgramObject::SubmitLink()
+{
+	if (m_link_state != LinkState::Pending && g_buildStats.pending++ == 0)
+		g_buildStart = Clock::now();
+	++g_buildStats.submitted;
+
 	glLinkProgram(m_id);
+	m_link_state = LinkState::Pending;
+}
+
+bool ProgramObject::IsReady()
+{
+	if (m_link_state == LinkState::Pending)
+	{
+		// without the extension there is no asking without waiting: the status query below waits
+		GLint completed = GL_TRUE;
+		if (GLCaps::Get().parallelShaderCompile)
+			glGetProgramiv(m_id, GL_COMPLETION_STATUS_KHR, &completed);
+		if (completed == GL_FALSE)
+			return false;
+
+		CompleteLink();
+	}
+	if (m_reload_state != ReloadState::Idle)
+		UpdateReload();
+	return m_link_state == LinkState::Linked;
+}
 
+bool ProgramObject::Wait()
+{
+	if (m_link_state == LinkState::Pending)
+		CompleteLink();
+	return m_link_state == LinkState::Linked;
+}
+
+bool ProgramObject::CompleteLink()
+{
 	// linkeles ellenorzese
-	GLint infoLogLength = 0, result = 0;
+	GLint result = 0;
 
 	glGetProgramiv(m_id, GL_LINK_STATUS, &result);
-	glGetProgramiv(m_id, GL_INFO_LOG_LENGTH, &infoLogLength);
 	if (GL_FALSE == result)
 	{
-		GLchar* error = new char[infoLogLength];
-		glGetProgramInfoLog(m_id, infoLogLength, nullptr, error);
-		std::cerr << "[Link] Hiba: " << error;
-		delete[] error;
-
+		// the shaders were compiled without looking at the result, their logs come first
+		for (GLuint shader : m_list_shaders_attached)
+			ShaderObject::CheckCompileStatus(shader);
+		PrintLinkLog(m_id);
+
+		m_link_state = LinkState::Failed;
+		m_store_binary = false;
+		++g_buildStats.failed;
+		EndBuild();
 		return false;
 	}
 
+	++g_buildStats.linked;
+	EndBuild();
+
+	if (m_store_binary)
+		ProgramBinaryCache::Store(m_id, m_binary_key);
+	m_store_binary = false;
+
+	AfterLink();
 	return true;
 }
 
-GLint ProgramObject::GetLocation(const char * _uniform)
+void ProgramObject::AfterLink()
+{
+	m_link_state = LinkState::Linked;
+	ReflectUniforms();
+	ReflectUniformBlocks();
+	for (const BlockBinding& binding : m_block_bindings)
+		ApplyBlockBinding(binding);
+}
+
+const ProgramObject::BuildStats& ProgramObject::GetBuildStats()
 {
-	auto loc_it = m_map_uniform_locations.find(_uniform);
-	if (loc_it == m_map_uniform_locations.end())
+	return g_buildStats;
+}
+
+bool ProgramObject::Reload()
+{
+	if (m_id == 0 || m_stages.empty())
+		return false;
+
+	CancelReload();		// files that changed again before the last reload was done
+	m_reload_shaders.reserve(m_stages.size());
+	for (const Stage& stage : m_stages)
+		m_reload_shaders.emplace_back(stage.type, stage.origin, stage.defines);	// read on worker threads, see ShaderObject
+	m_reload_state = ReloadState::Loading;
+	return true;
+}
+
+void ProgramObject::UpdateReload()
+{
+	if (m_reload_state == ReloadState::Loading)
+	{
+		// the program of InitAsync() first, m_store_binary and m_binary_key are its until then
+		if (m_link_state == LinkState::Pending)
+			return;
+		for (const ShaderObject& shader : m_reload_shaders)
+			if (!shader.IsLoaded())
+				return;
+
+		m_reload_id = glCreateProgram();
+
+		std::vector<const ShaderObject*> shaderList;
+		for (const ShaderObject& shader : m_reload_shaders)
+			shaderList.push_back(&shader);
+		std::vector<Binding> attribLocationBindingList, fragDataBindingList;
+		for (const auto& binding : m_attrib_bindings)
+			attribLocationBindingList.push_back({ binding.first, binding.second.c_str() });
+		for (const auto& binding : m_frag_data_bindings)
+			fragDataBindingList.push_back({ binding.first, binding.second.c_str() });
+
+		// the next launch finds the edited program in the cache
+		m_store_binary = ProgramBinaryCache::IsAvailable();
+		if (m_store_binary)
+		{
+			m_binary_key = BinaryKey(shaderList, attribLocationBindingList, fragDataBindingList);
+			glProgramParameteri(m_reload_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+
+		for (const ShaderObject* shader : shaderList)
+			glAttachShader(m_reload_id, *shader);
+		for (const Binding& binding : attribLocationBindingList)
+			glBindAttribLocation(m_reload_id, binding.first, binding.second);
+		for (const Binding& binding : fragDataBindingList)
+			glBindFragDataLocation(m_reload_id, binding.first, binding.second);
+		glLinkProgram(m_reload_id);
+
+		m_reload_state = ReloadState::Linking;
+		return;	// without KHR_parallel_shader_compile the status is not asked before the next call, the driver may be done by then
+	}
+
+	if (m_reload_state == ReloadState::Linking)
 	{
-		GLint my_loc = glGetUniformLocation(m_id, _uniform);
-		m_map_uniform_locations[_uniform] = my_loc;
-		return my_loc;
+		GLint completed = GL_TRUE;
+		if (GLCaps::Get().parallelShaderCompile)
+			glGetProgramiv(m_reload_id, GL_COMPLETION_STATUS_KHR, &completed);
+		if (completed == GL_TRUE)
+			CompleteReload();
 	}
+}
+
+void ProgramObject::CompleteReload()
+{
+	GLint result = GL_FALSE;
+	glGetProgramiv(m_reload_id, GL_LINK_STATUS, &result);
+	if (result == GL_FALSE)
+	{
+		for (const ShaderObject& shader : m_reload_shaders)
+			ShaderObject::CheckCompileStatus(shader);
+		PrintLinkLog(m_reload_id);
+		std::cerr << "[Reload] program " << m_id << " keeps its old shaders" << std::endl;
+
+		m_store_binary = false;
+		CancelReload();
+		return;
+	}
+
+	// the switch: from here on the new program is used, its uniforms and blocks are looked up again
+	Clean();
+	GLState::DeletePrograms(1, &m_id);
+	m_id = m_reload_id;
+	m_reload_id = 0;
+	for (size_t i = 0; i < m_reload_shaders.size(); ++i)
+	{
+		m_list_shaders_attached.push_back(m_reload_shaders[i]);
+		m_stages[i].files = m_reload_shaders[i].Files();	// the includes may have changed
+	}
+	m_reload_shaders.clear();
+	m_reload_state = ReloadState::Idle;
+
+	if (m_store_binary)
+		ProgramBinaryCache::Store(m_id, m_binary_key);
+	m_store_binary = false;
+
+	AfterLink();
+	++g_buildStats.reloaded;
+}
+
+void ProgramObject::CancelReload()
+{
+	if (m_reload_id != 0)
+		GLState::DeletePrograms(1, &m_reload_id);
+	m_reload_id = 0;
+	m_reload_shaders.clear();
+	m_reload_state = ReloadState::Idle;
+}
+
+bool ProgramObject::UsesFile(const std::string& _file) const
+{
+	for (const Stage& stage : m_stages)
+		if (std::find(stage.files.begin(), stage.files.end(), _file) != stage.files.end())
+			return true;
+	return false;
+}
+
+void ProgramObject::ReloadFiles(const std::vector<std::string>& _files)
+{
+	for (ProgramObject* program : g_programs)
+		if (std::any_of(_files.begin(), _files.end(), [program](const std::string& file) { return program->UsesFile(file); }))
+			program->Reload();	// once, however many of its files changed
+}
+
+void ProgramObject::ReflectUniforms()
+{
+	m_uniform_locations.clear();
+	m_uniform_values.clear();
+	m_uniform_data.clear();
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(m_id, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(m_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	std::vector<GLchar> name(maxLength + 1);
+	for (GLint i = 0; i < count; ++i)
+	{
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(m_id, i, GLsizei(name.size()), &length, &size, &type, name.data());
+
+		const GLint location = glGetUniformLocation(m_id, name.data());
+		if (location < 0)
+			continue; // a member of a uniform block
+
+		m_uniform_locations.push_back({ UniformKey::Hash(name.data(), length), location });
+
+		// a single value has a shadow copy; arrays do not, their elements can be set both one by one and together
+		const GLsizei typeSize = UniformTypeSize(type);
+		if (size == 1 && typeSize > 0)
+		{
+			m_uniform_values.push_back({ location, GLsizei(m_uniform_data.size()), typeSize, false, true });
+			m_uniform_data.resize(m_uniform_data.size() + typeSize);
+		}
+
+		// arrays are reported as "name[0]": also register "name" and every element
+		std::string base(name.data(), length);
+		if (base.size() < 3 || base.compare(base.size() - 3, 3, "[0]") != 0)
+			continue;
+		base.resize(base.size() - 3);
+		m_uniform_locations.push_back({ UniformKey::Hash(base.data(), base.size()), location });
+		for (GLint element = 1; element < size; ++element)
+		{
+			const std::string elementName = base + "[" + std::to_string(element) + "]";
+			m_uniform_locations.push_back({ UniformKey::Hash(elementName.data(), elementName.size()), glGetUniformLocation(m_id, elementName.c_str()) });
+		}
+	}
+
+	std::sort(m_uniform_locations.begin(), m_uniform_locations.end(), [](const UniformLocation& a, const UniformLocation& b) { return a.hash < b.hash; });
+	std::sort(m_uniform_values.begin(), m_uniform_values.end(), [](const UniformValue& a, const UniformValue& b) { return a.location < b.location; });
+
+	// two names with the same hash: one of them would silently set the other
+	for (size_t i = 1; i < m_uniform_locations.size(); ++i)
+		if (m_uniform_locations[i].hash == m_uniform_locations[i - 1].hash)
+			std::cerr << "[Link] uniform name hash collision in program " << m_id << ", locations "
+				<< m_uniform_locations[i - 1].location << " and " << m_uniform_locations[i].location << std::endl;
+}
+
+void ProgramObject::ReflectUniformBlocks()
+{
+	m_uniform_blocks.clear();
+
+	GLint count = 0, maxLength = 0, maxUniformLength = 0;
+	glGetProgramiv(m_id, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	glGetProgramiv(m_id, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+	glGetProgramiv(m_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxUniformLength);
+
+	std::vector<GLchar> name(maxLength + 1), memberName(maxUniformLength + 1);
+	for (GLint block = 0; block < count; ++block)
+	{
+		GLsizei length = 0;
+		glGetActiveUniformBlockName(m_id, block, GLsizei(name.size()), &length, name.data());
+
+		UniformBlockLayout layout{ UniformKey::Hash(name.data(), length), 0, {} };
+		glGetActiveUniformBlockiv(m_id, block, GL_UNIFORM_BLOCK_DATA_SIZE, &layout.dataSize);
+
+		GLint memberCount = 0;
+		glGetActiveUniformBlockiv(m_id, block, GL_UNIFORM_BLOCK_ACTIVE_UNIFORMS, &memberCount);
+		std::vector<GLint> indices(memberCount), offsets(memberCount);
+		glGetActiveUniformBlockiv(m_id, block, GL_UNIFORM_BLOCK_ACTIVE_UNIFORM_INDICES, indices.data());
+		glGetActiveUniformsiv(m_id, memberCount, reinterpret_cast<const GLuint*>(indices.data()), GL_UNIFORM_OFFSET, offsets.data());
+
+		const std::string prefix = std::string(name.data(), length) + ".";
+		for (GLint member = 0; member < memberCount; ++member)
+		{
+			GLsizei memberLength = 0;
+			glGetActiveUniformName(m_id, indices[member], GLsizei(memberName.size()), &memberLength, memberName.data());
+
+			// the members of an instanced block are "Block.member", arrays are "member[0]"
+			std::string key(memberName.data(), memberLength);
+			if (key.compare(0, prefix.size(), prefix) == 0)
+				key.erase(0, prefix.size());
+			if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0)
+				key.resize(key.size() - 3);
+			layout.members.push_back({ UniformKey::Hash(key.data(), key.size()), offsets[member] });
+		}
+		std::sort(layout.members.begin(), layout.members.end(), [](const UniformLocation& a, const UniformLocation& b) { return a.hash < b.hash; });
+
+		m_uniform_blocks.push_back(std::move(layout));
+	}
+}
+
+bool ProgramObject::CheckUniformBlock(const char* _block, const UniformBlockMember* _members, size_t _count, size_t _size) const
+{
+	const std::uint32_t hash = UniformKey(_block).hash;
+	auto block = std::find_if(m_uniform_blocks.begin(), m_uniform_blocks.end(), [hash](const UniformBlockLayout& layout) { return layout.hash == hash; });
+	if (block == m_uniform_blocks.end())
+	{
+		std::cerr << "[UniformBlock] program " << m_id << " has no active uniform block " << _block << std::endl;
+		return false;
+	}
+
+	bool matches = true;
+	if (size_t(block->dataSize) > _size)
+	{
+		std::cerr << "[UniformBlock] " << _block << " takes " << block->dataSize << " bytes in program " << m_id
+			<< ", the struct has " << _size << std::endl;
+		matches = false;
+	}
+
+	for (size_t i = 0; i < _count; ++i)
+	{
+		const std::uint32_t memberHash = UniformKey(_members[i].name).hash;
+		auto member = std::lower_bound(block->members.begin(), block->members.end(), memberHash,
+			[](const UniformLocation& entry, std::uint32_t hash) { return entry.hash < hash; });
+		if (member == block->members.end() || member->hash != memberHash)
+			continue; // not used by the program, the linker dropped it
+
+		if (size_t(member->location) != _members[i].offset)
+		{
+			std::cerr << "[UniformBlock] " << _block << "." << _members[i].name << " is at offset " << member->location
+				<< " in program " << m_id << ", at " << _members[i].offset << " in the struct" << std::endl;
+			matches = false;
+		}
+	}
+	return matches;
+}
+
+GLint ProgramObject::GetLocation(UniformKey _uniform) const
+{
+	auto it = std::lower_bound(m_uniform_locations.begin(), m_uniform_locations.end(), _uniform.hash,
+		[](const UniformLocation& entry, std::uint32_t hash) { return entry.hash < hash; });
+	if (it == m_uniform_locations.end() || it->hash != _uniform.hash)
+		return -1; // not active, like glGetUniformLocation would say
+	return it->location;
+}
+
+bool ProgramObject::ShadowUniform(GLint _location, const void* _data, GLsizei _size)
+{
+	if (_location < 0)
+		return false; // OpenGL would ignore it anyway
+
+	auto it = std::lower_bound(m_uniform_values.begin(), m_uniform_values.end(), _location,
+		[](const UniformValue& value, GLint location) { return value.location < location; });
+	if (it == m_uniform_values.end() || it->location != _location || !it->shadowed || it->size != _size)
+	{
+		GLState::CountUniform(true);
+		return true;
+	}
+
+	unsigned char* shadow = m_uniform_data.data() + it->offset;
+	if (it->known && std::memcmp(shadow, _data, _size) == 0)
+	{
+		GLState::CountUniform(false);
+		return false;
+	}
+
+	std::memcpy(shadow, _data, _size);
+	it->known = true;
+	GLState::CountUniform(true);
+	return true;
+}
+
+void ProgramObject::SetUniformShadowing(UniformKey _uniform, bool _enabled)
+{
+	const GLint location = GetLocation(_uniform);
+	for (UniformValue& value : m_uniform_values)
+		if (value.location == location)
+		{
+			value.shadowed	= _enabled;
+			value.known		= false;
+		}
+}
+
+void ProgramObject::SetUniformBlockBinding(const char* _block, GLuint _binding)
+{
+	AddBlockBinding({ _block, _binding, nullptr, 0, 0 });
+}
+
+bool ProgramObject::AddBlockBinding(const BlockBinding& _binding)
+{
+	auto it = std::find_if(m_block_bindings.begin(), m_block_bindings.end(), [&](const BlockBinding& binding) { return binding.name == _binding.name; });
+	if (it != m_block_bindings.end())
+		*it = _binding;
 	else
-		return loc_it->second;
+		m_block_bindings.push_back(_binding);
+
+	// a pending link applies it when it completes
+	return m_link_state != LinkState::Linked || ApplyBlockBinding(_binding);
+}
+
+bool ProgramObject::ApplyBlockBinding(const BlockBinding& _binding) const
+{
+	GLuint index = glGetUniformBlockIndex(m_id, _binding.name.c_str());
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(m_id, index, _binding.binding);
+
+	return _binding.members == nullptr || CheckUniformBlock(_binding.name.c_str(), _binding.members, _binding.count, _binding.size);
 }
 
 void ProgramObject::Use() const
 {
-	glUseProgram(m_id);
+	GLState::UseProgram(m_id);
 }
 
 void ProgramObject::Unuse() const
 {
-	glUseProgram(0);
+	GLState::UseProgram(0);
 }
 
-void ProgramObject::SetTexture(const char* _uniform, int _sampler, GLuint _textureID)
+void ProgramObject::SetTexture(UniformKey _uniform, int _sampler, GLuint _textureID)
 {
-	glActiveTexture(GL_TEXTURE0 + _sampler);
-	glBindTexture(GL_TEXTURE_2D, _textureID);
-	glUniform1i(GetLocation(_uniform), _sampler);
+	GLState::BindTextureUnit(_sampler, GL_TEXTURE_2D, _textureID);
+	if (GLCaps::Get().samplerObjects)
+		GLState::BindSampler(_sampler, 0);
+	SetUniform(_uniform, GLint(_sampler));
+}
+
+void ProgramObject::SetTexture(UniformKey _uniform, int _sampler, GLuint _textureID, const SamplerDesc& _samplerDesc)
+{
+	GLState::BindTextureUnit(_sampler, GL_TEXTURE_2D, _textureID);
+	if (GLCaps::Get().samplerObjects)
+		SamplerCache::Bind(_sampler, _samplerDesc);
+	else
+	{
+		GLState::ActiveTexture(_sampler);
+		SamplerCache::ApplyToTexture(_samplerDesc);
+	}
+	SetUniform(_uniform, GLint(_sampler));
+}
+
+void ProgramObject::SetTextureArray(UniformKey _uniform, int _sampler, GLuint _textureID, const SamplerDesc& _samplerDesc)
+{
+	GLState::BindTextureUnit(_sampler, GL_TEXTURE_2D_ARRAY, _textureID);
+	if (GLCaps::Get().samplerObjects)
+		SamplerCache::Bind(_sampler, _samplerDesc);
+	else
+	{
+		GLState::ActiveTexture(_sampler);
+		SamplerCache::ApplyToTexture(_samplerDesc, GL_TEXTURE_2D_ARRAY);
+	}
+	SetUniform(_uniform, GLint(_sampler));
 }
 
-void ProgramObject::SetCubeTexture(const char* _uniform, int _sampler, GLuint _textureID)
+void ProgramObject::SetCubeTexture(UniformKey _uniform, int _sampler, GLuint _textureID)
 {
-	glActiveTexture(GL_TEXTURE0 + _sampler);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, _textureID);
-	glUniform1i(GetLocation(_uniform), _sampler);
+	GLState::BindTextureUnit(_sampler, GL_TEXTURE_CUBE_MAP, _textureID);
+	SetUniform(_uniform, GLint(_sampler));
 }
 GLint ProgramObject::GLResolveUniformLocation(GLint _uniform) 
 { 
 	return _uniform; 
 }
 
-GLint ProgramObject::GLResolveUniformLocation(const char* _uniform) 
+GLint ProgramObject::GLResolveUniformLocation(UniformKey _uniform) 
 { 
 	return GetLocation(_uniform); 
 }
@@ -4,6 +4,8 @@
 #include <GL/gl.h>
 
 #include "ShaderObject.h"
+#include "SamplerCache.h"
+#include "UniformBlock.h"
 
 #include <unordered_map>
 #include <list>
@@ -11,9 +13,46 @@
 #include <vector>
 #include <array>
 
+#include <cstddef>
+#include <cstdint>
 #include <initializer_list>
 #include <utility>
 
+/*
+
+	The name of a uniform with its 32 bit FNV-1a hash; ProgramObject looks the locations up by
+	the hash. Written as "MVP"_uniform, the hash is a constant expression: bind it to a
+	static constexpr UniformKey to be sure it is computed by the compiler. Plain strings
+	convert implicitly and are hashed where they are used.
+
+*/
+struct UniformKey
+{
+	std::uint32_t	hash;
+	const char*		name;	// for messages only
+
+	constexpr UniformKey(const char* _name) : hash(Hash(_name, Length(_name))), name(_name) {}
+	constexpr UniformKey(const char* _name, std::size_t _length) : hash(Hash(_name, _length)), name(_name) {}
+
+	static constexpr std::uint32_t Hash(const char* _str, std::size_t _length)
+	{
+		std::uint32_t hash = 2166136261u;
+		for (std::size_t i = 0; i < _length; ++i)
+			hash = (hash ^ static_cast<unsigned char>(_str[i])) * 16777619u;
+		return hash;
+	}
+
+	static constexpr std::size_t Length(const char* _str)
+	{
+		std::size_t length = 0;
+		while (_str[length] != '\0')
+			++length;
+		return length;
+	}
+};
+
+constexpr UniformKey operator"" _uniform(const char* str, std::size_t len) { return UniformKey(str, len); }
+
 class ProgramObject final
 {
 public:
@@ -32,7 +71,14 @@ public:
 
 	operator unsigned int() const { return m_id; }
 
+	// links the shaders, or loads the program from ProgramBinaryCache if it was linked the same way before
 	bool Init(std::initializer_list<ShaderObject>, std::initializer_list< Binding > = {}, std::initializer_list< Binding > = {});
+	// the same without waiting for the driver: the shaders are submitted for compiling and the program for
+	// linking, and IsReady() tells when it can be used. With KHR_parallel_shader_compile the driver works on
+	// them on its own threads meanwhile. False only if the program object is missing.
+	bool InitAsync(std::initializer_list<ShaderObject>, std::initializer_list< Binding > = {}, std::initializer_list< Binding > = {});
+	// the same with a shader list built at run time (see ProgramPermutations)
+	bool InitAsync(const std::vector<const ShaderObject*>&, const std::vector< Binding >& = {}, const std::vector< Binding >& = {});
 	void Clean();
 
 	ProgramObject& AttachShader(const ShaderObject&);
@@ -46,24 +92,175 @@ public:
 
 	bool LinkProgram();
 
-	void SetTexture(const char* _uniform, int _sampler, GLuint _textureID);
-	void SetCubeTexture(const char* _uniform, int _sampler, GLuint _textureID);
+	// linked and usable; polls a pending link without waiting for it (with KHR_parallel_shader_compile)
+	bool IsReady();
+	// the link is submitted but has not been seen completing yet
+	bool IsPending() const { return m_link_state == LinkState::Pending; }
+	// waits for a pending link; true if the program is linked
+	bool Wait();
+
+	// the programs of InitAsync() and LinkProgram(), from the first submit to the last completion
+	struct BuildStats
+	{
+		unsigned	submitted{};
+		unsigned	linked{};
+		unsigned	failed{};
+		unsigned	pending{};
+		double		wallMs{};		// while at least one link was pending: overlapping builds count once
+		unsigned	reloaded{};		// switched to the program of a Reload()
+	};
+	static const BuildStats& GetBuildStats();
+
+	// builds the program again from the files of InitAsync() (they may have been edited since), without
+	// waiting for anything: IsReady() moves the rebuild along every time it is called, and the program
+	// switches to the new one only if it links, so the old one is drawn with until then, and for good if
+	// the new one fails. The switch reflects the uniforms again and applies the block bindings; the values
+	// of other uniforms are lost with the old program. False if the program was not built by InitAsync().
+	bool Reload();
+	bool IsReloading() const { return m_reload_state != ReloadState::Idle; }
+	// one of the shaders was read from _file, or included it
+	bool UsesFile(const std::string& _file) const;
+	// Reload() for every program that uses one of _files (see ShaderWatcher)
+	static void ReloadFiles(const std::vector<std::string>& _files);
+
+	// samples with the parameters of the texture itself
+	void SetTexture(UniformKey _uniform, int _sampler, GLuint _textureID);
+	// samples through the cached sampler object of _samplerDesc
+	void SetTexture(UniformKey _uniform, int _sampler, GLuint _textureID, const SamplerDesc& _samplerDesc);
+	void SetCubeTexture(UniformKey _uniform, int _sampler, GLuint _textureID);
+	// a GL_TEXTURE_2D_ARRAY (TextureAtlas), through the cached sampler object of _samplerDesc
+	void SetTextureArray(UniformKey _uniform, int _sampler, GLuint _textureID, const SamplerDesc& _samplerDesc);
 
+	// _uniform is a location, a UniformKey or a name. The program remembers the values it was
+	// given (non-array uniforms only) and skips the GL call when the value is the same, so the
+	// program must be in use, and its uniforms must not be set around this class.
 	template<typename U, typename T>
 	void SetUniform(U _uniform, const T& pArr);
+	// shadowing is on by default; off saves the compare and the copy for a uniform that changes on every call
+	void SetUniformShadowing(UniformKey _uniform, bool _enabled);
 
-	GLint	GetLocation(const char* _uniform);
+	// from the table built at link time: no allocation, no GL call; -1 for uniforms the program does not use
+	GLint	GetLocation(UniformKey _uniform) const;
+
+	// connects a uniform block of the program to an indexed GL_UNIFORM_BUFFER binding point;
+	// remembered, and applied again after every link
+	void	SetUniformBlockBinding(const char* _block, GLuint _binding);
+	// the same for a block uploaded from a Block struct (see UniformBlock.h): its layout is checked
+	// against std140 at compile time and against the block of the linked program here (or when a
+	// pending link completes, which reports a mismatch but cannot return it)
+	template<typename Block>
+	bool	SetUniformBlock(const char* _block, GLuint _binding);
 
 	void Use() const;
 	void Unuse() const;
 private:
+	struct UniformLocation
+	{
+		std::uint32_t	hash;
+		GLint			location;
+	};
+
+	enum class LinkState
+	{
+		Unlinked,
+		Pending,
+		Linked,
+		Failed
+	};
+
+	enum class ReloadState
+	{
+		Idle,
+		Loading,	// the files are being read
+		Linking		// the new program is being compiled and linked
+	};
+
+	// a shader of InitAsync(), as Reload() creates it again
+	struct Stage
+	{
+		GLenum						type;
+		std::string					origin;		// the file name, or the source
+		ShaderDefines				defines;
+		std::vector< std::string >	files;		// the file and its includes
+	};
+
+	// a block binding to apply after a link; members is null for a plain SetUniformBlockBinding()
+	struct BlockBinding
+	{
+		std::string					name;
+		GLuint						binding;
+		const UniformBlockMember*	members;
+		size_t						count;
+		size_t						size;
+	};
+
+	// an active uniform block as the linker laid it out
+	struct UniformBlockLayout
+	{
+		std::uint32_t					hash;		// of the block name
+		GLint							dataSize;
+		std::vector< UniformLocation >	members;	// hash of the member name and its offset, sorted by hash
+	};
+
+	// the last value set through SetUniform, in m_uniform_data
+	struct UniformValue
+	{
+		GLint			location;
+		GLsizei			offset;
+		GLsizei			size;
+		bool			known;		// set since the last link
+		bool			shadowed;
+	};
+
 	GLuint m_id;
+	LinkState m_link_state = LinkState::Unlinked;
+	bool m_store_binary = false;		// the pending link goes to ProgramBinaryCache under m_binary_key
+	std::uint64_t m_binary_key = 0;
 
-	std::unordered_map< std::string, GLint >	m_map_uniform_locations;
+	std::vector< UniformLocation >				m_uniform_locations;	// every active uniform (and array element), sorted by hash
+	std::vector< UniformValue >					m_uniform_values;		// sorted by location
+	std::vector< unsigned char >				m_uniform_data;
+	std::vector< UniformBlockLayout >			m_uniform_blocks;
+	std::vector< BlockBinding >					m_block_bindings;
 	std::vector< GLuint >						m_list_shaders_attached;
 
+	// what InitAsync() built the program from, for Reload()
+	std::vector< Stage >						m_stages;
+	std::vector< std::pair<int, std::string> >	m_attrib_bindings;
+	std::vector< std::pair<int, std::string> >	m_frag_data_bindings;
+
+	ReloadState m_reload_state = ReloadState::Idle;
+	GLuint m_reload_id = 0;						// the program Reload() builds, swapped with m_id when it links
+	std::vector< ShaderObject >					m_reload_shaders;
+
+	// the ProgramBinaryCache key of a program built from these
+	static std::uint64_t BinaryKey(const std::vector<const ShaderObject*>&, const std::vector< Binding >&, const std::vector< Binding >&);
+
+	// glLinkProgram without looking at the result
+	void SubmitLink();
+	// takes Reload() one step further, if it can without waiting
+	void UpdateReload();
+	// m_reload_id is linked, or failed: swaps it in, or drops it
+	void CompleteReload();
+	void CancelReload();
+	// the link is done: checks it, stores the binary, then AfterLink()
+	bool CompleteLink();
+	// reflects the program and applies m_block_bindings
+	void AfterLink();
+	bool ApplyBlockBinding(const BlockBinding& _binding) const;
+	// remembers _binding (replacing the one of the same block) and applies it if the program is linked
+	bool AddBlockBinding(const BlockBinding& _binding);
+	// fills m_uniform_locations and m_uniform_values after a successful link
+	void ReflectUniforms();
+	// fills m_uniform_blocks after a successful link
+	void ReflectUniformBlocks();
+	// compares the members of a struct with the offsets in m_uniform_blocks, reports the differences
+	bool CheckUniformBlock(const char* _block, const UniformBlockMember* _members, size_t _count, size_t _size) const;
+	// true if _data has to be uploaded to _location; remembers it in that case
+	bool ShadowUniform(GLint _location, const void* _data, GLsizei _size);
+
 	GLint GLResolveUniformLocation(GLint _uniform);
-	GLint GLResolveUniformLocation(const char* _uniform);
+	GLint GLResolveUniformLocation(UniformKey _uniform);
 };
 
 #include "ProgramObject.inl"
\ No newline at end of file
@@ -14,9 +14,23 @@ void ProgramObject::SetUniform(U _uniform, const T& pArr)
 	using PrimitiveType = typename GLExtractPrimitiveType<ElementType>::primitive_type;
 	constexpr std::pair<size_t, size_t> componentCount = ComponentCount<ElementType>();
 
+	const GLint location = GLResolveUniformLocation(_uniform);
+	const PrimitiveType* data = (const PrimitiveType*)PointerToStart(pArr);
+	if (!ShadowUniform(location, data, ContainerSizeInBytes(pArr)))
+		return; // the program has this value already
+
 	CallSetter<PrimitiveType, componentCount.first, componentCount.second>(
-			GLResolveUniformLocation(_uniform),
+			location,
 			ContainerLength(pArr),
-			(const PrimitiveType*)PointerToStart(pArr)
+			data
 		);
+}
+
+template<typename Block>
+bool ProgramObject::SetUniformBlock(const char* _block, GLuint _binding)
+{
+	static_assert(MatchesStd140(Block::UniformBlockMembers()), "the members of the struct are not where std140 puts them, add padding");
+
+	static constexpr auto members = Block::UniformBlockMembers();
+	return AddBlockBinding({ _block, _binding, members.data(), members.size(), sizeof(Block) });
 }
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "ProgramPermutations.h"
+
+#include <algorithm>
+#include <sstream>
+
+ProgramPermutations::ProgramPermutations(std::initializer_list<Stage> stages, std::initializer_list<ProgramObject::Binding> attribLocations,
+	std::initializer_list<ProgramObject::Binding> fragDataLocations)
+	: m_stages(stages)
+{
+	// the names first: the bindings keep pointers into m_names, it must not grow after them
+	for (const ProgramObject::Binding& binding : attribLocations)
+		m_names.push_back(binding.second);
+	for (const ProgramObject::Binding& binding : fragDataLocations)
+		m_names.push_back(binding.second);
+
+	size_t name = 0;
+	for (const ProgramObject::Binding& binding : attribLocations)
+		m_attribLocations.push_back({ binding.first, m_names[name++].c_str() });
+	for (const ProgramObject::Binding& binding : fragDataLocations)
+		m_fragDataLocations.push_back({ binding.first, m_names[name++].c_str() });
+}
+
+void ProgramPermutations::SetSetup(const Setup& setup)
+{
+	m_setup = setup;
+	if (m_setup)
+		for (auto& program : m_programs)
+			m_setup(*program.second);
+}
+
+ProgramObject& ProgramPermutations::Get(const ShaderDefines& defines)
+{
+	const ShaderDefines key = Canonical(defines);
+	auto it = m_programs.find(key);
+	if (it != m_programs.end())
+		return *it->second;
+
+	// the files of all stages are read at the same time, see ShaderObject
+	std::vector<ShaderObject> shaders;
+	shaders.reserve(m_stages.size());
+	for (const Stage& stage : m_stages)
+		shaders.emplace_back(stage.first, stage.second, key);
+
+	std::vector<const ShaderObject*> shaderList;
+	for (const ShaderObject& shader : shaders)
+		shaderList.push_back(&shader);
+
+	std::unique_ptr<ProgramObject> program(new ProgramObject());
+	program->InitAsync(shaderList, m_attribLocations, m_fragDataLocations);
+	if (m_setup)
+		m_setup(*program);
+
+	return *(m_programs[key] = std::move(program));
+}
+
+std::string ProgramPermutations::Dump() const
+{
+	std::ostringstream out;
+	for (const auto& program : m_programs)
+	{
+		out << (program.second->IsPending() ? "  [compiling] " : "  ");
+		if (program.first.empty())
+			out << "(no defines)";
+		for (const auto& define : program.first)
+			out << define.first << (define.second.empty() ? "" : "=") << define.second << " ";
+		out << "\n";
+	}
+	return out.str();
+}
+
+ShaderDefines ProgramPermutations::Canonical(const ShaderDefines& defines)
+{
+	ShaderDefines sorted = defines;
+	std::stable_sort(sorted.begin(), sorted.end(), [](const ShaderDefines::value_type& a, const ShaderDefines::value_type& b) { return a.first < b.first; });
+	// the last one of a name wins, as it would with #define
+	auto last = std::unique(sorted.rbegin(), sorted.rend(), [](const ShaderDefines::value_type& a, const ShaderDefines::value_type& b) { return a.first == b.first; });
+	sorted.erase(sorted.begin(), last.base());
+	return sorted;
+}
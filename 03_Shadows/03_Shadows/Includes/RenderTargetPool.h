@@ -0,0 +1,115 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <vector>
+
+/*
+
+	RenderTargetPool hands out single level 2D textures to render into. The sizes are rounded up
+	to a bucket (256 pixels by default), so a target is usually bigger than asked for: the caller
+	renders into the lower left width x height corner of it, and reads it with texelFetch or with
+	the texture coordinates scaled by Target::ScaleX() and ScaleY().
+
+	Released targets are kept and handed out again:
+	- a target of the same format and bucket is reused right away,
+	- growing past the bucket allocates a new target at once,
+	- shrinking keeps using the bigger targets, until the smaller size was asked for in every
+	  frame for a while (stableFrames). Dragging the window border therefore does not allocate
+	  anything until the size settles.
+	Targets nobody acquired for evictFrames frames are deleted in NewFrame().
+
+	A released target keeps its contents until somebody acquires it again, and it is not deleted
+	in the frame it was released, so it is fine to display it after Release().
+
+*/
+class RenderTargetPool final
+{
+public:
+	struct Target
+	{
+		GLuint		texture{};
+		unsigned	id{};			// unique within the pool, unlike texture names that OpenGL reuses
+		GLenum		internalFormat{};
+		GLsizei		width{};		// the size of the texture
+		GLsizei		height{};
+		GLsizei		usedWidth{};	// the size that was asked for
+		GLsizei		usedHeight{};
+
+		explicit operator bool() const { return texture != 0; }
+		// the texture coordinates of the upper right corner of the used part
+		float	ScaleX() const { return width  ? usedWidth  / float(width)  : 1.0f; }
+		float	ScaleY() const { return height ? usedHeight / float(height) : 1.0f; }
+	};
+
+	struct Stats
+	{
+		unsigned	targets{};			// textures owned by the pool
+		unsigned	inUse{};
+		GLsizeiptr	bytes{};			// estimated video memory of all the targets
+		GLsizeiptr	bytesInUse{};
+		float		occupancy{ 1 };		// the part of the acquired texels that is actually rendered to
+		unsigned	allocations{};		// in total
+		unsigned	reuses{};
+		unsigned	oversized{};		// reuses that were bigger than the bucket asked for
+		unsigned	evictions{};
+	};
+
+	explicit RenderTargetPool(GLsizei bucket = 256, unsigned stableFrames = 30, unsigned evictFrames = 120);
+	~RenderTargetPool();
+
+	RenderTargetPool(const RenderTargetPool&)				= delete;
+	RenderTargetPool& operator=(const RenderTargetPool&)	= delete;
+
+	// once per frame, before the first Acquire()
+	void	NewFrame();
+
+	// a target of internalFormat of at least width x height
+	Target	Acquire(GLenum internalFormat, GLsizei width, GLsizei height);
+	void	Release(const Target& target);
+	// deletes every target; they must not be in use
+	void	Clear();
+
+	Stats	GetStats() const;
+
+	static GLsizei		RoundUp(GLsizei size, GLsizei bucket);
+	// an estimate, the driver may pad
+	static GLsizeiptr	BytesPerTexel(GLenum internalFormat);
+
+private:
+	struct Entry
+	{
+		Target		target;
+		bool		inUse{};
+		unsigned	lastUsed{};
+	};
+
+	// sizes asked for, to tell a size that settled from one that is just passing by
+	struct Request
+	{
+		GLenum		internalFormat;
+		GLsizei		width;			// rounded to the bucket
+		GLsizei		height;
+		unsigned	firstFrame;		// asked for in every frame since
+		unsigned	lastFrame;
+	};
+
+	std::vector<Entry>		m_entries;
+	std::vector<Request>	m_requests;
+
+	GLsizei		m_bucket;
+	unsigned	m_stableFrames;
+	unsigned	m_evictFrames;
+	unsigned	m_frame{};
+	unsigned	m_nextId{ 1 };
+
+	unsigned	m_allocations{};
+	unsigned	m_reuses{};
+	unsigned	m_oversized{};
+	unsigned	m_evictions{};
+
+	// true if the bucket was asked for in each of the last m_stableFrames frames
+	bool	Track(GLenum internalFormat, GLsizei width, GLsizei height);
+	Target	Create(GLenum internalFormat, GLsizei width, GLsizei height);
+};
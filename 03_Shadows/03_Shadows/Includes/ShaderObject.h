@@ -3,16 +3,40 @@
 #include <GL/glew.h>
 #include <GL/gl.h>
 
+#include <future>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "GLconversions.hpp"
 
+// the permutation keys of a shader: a "#define name value" line each, value may be empty
+using ShaderDefines = std::vector< std::pair<std::string, std::string> >;
+
+/*
+
+	A shader stage. Constructed from a file name (or from the source itself, if no such file
+	exists) it reads the file on a worker thread and keeps the source: it is compiled when its id
+	is first asked for, i.e. when a ProgramObject attaches it. A program loaded from
+	ProgramBinaryCache never asks, so its shaders are never compiled. FromFile() and FromMemory()
+	compile right away.
+
+	The lazy compile does not query GL_COMPILE_STATUS, which would wait for the driver's compiler:
+	the program reports the compile errors if its link fails (see ProgramObject::InitAsync).
+
+	Files are preprocessed before OpenGL sees them:
+	- #include "file" lines are replaced by the file, relative to the directory of the including
+	  one; every file is included once. #line directives keep the line numbers of the compile
+	  errors right, with the index of the file in Files() as the source string number.
+	- the defines given to the constructor are inserted right after #version, so a shader can
+	  leave out (#ifdef) what a permutation does not need instead of branching on a uniform.
+
+*/
 class ShaderObject final
 {
 public:
 	ShaderObject(GLenum pType);
-	ShaderObject(GLenum pType, const std::string&);
+	ShaderObject(GLenum pType, const std::string&, const ShaderDefines& pDefines = {});
 	ShaderObject(const TypeSourcePair& pInfo) : ShaderObject(pInfo.first, pInfo.second) {}
 
 	~ShaderObject();
@@ -23,12 +47,45 @@ public:
 	ShaderObject(ShaderObject&&);
 	ShaderObject& operator=(ShaderObject&&);
 
-	operator unsigned int() const { return m_id; }
+	// submits the source given to the constructor for compiling on the first call
+	operator unsigned int() const;
 
 	bool FromFile(GLenum _shaderType, const char* _filename);
 	bool FromMemory(GLenum _shaderType, const std::string& _source);
+
+	GLenum				Type()		const { return m_type; }
+	// the GLSL source after preprocessing, also the part of the ProgramBinaryCache key that stands for this stage; waits for the file
+	const std::string&	Source()	const;
+	// the file and the files it included, in the order of their source string numbers; waits for the file
+	const std::vector<std::string>&	Files()	const;
+	// what was given to the constructor: the file name (or the source) and the defines, see ProgramObject::Reload
+	const std::string&	Origin()	const { return m_origin; }
+	const ShaderDefines&	Defines()	const { return m_defines; }
+	// the file has been read: Source() and Files() do not wait
+	bool				IsLoaded()	const;
+
+	// prints the info log if shader _shaderObject did not compile; waits for the compiler
+	static bool		CheckCompileStatus(GLuint _shaderObject);
 private:
-	GLuint	CompileShaderFromMemory(const GLuint _shaderObject, const std::string& _source);
+	struct Loaded
+	{
+		std::string					source;
+		std::vector<std::string>	files;
+	};
+
+	// reads _filename with its includes
+	static bool		LoadFile(const char* _filename, std::string& _source, std::vector<std::string>& _files);
+	static void		InsertDefines(std::string& _source, const ShaderDefines& _defines);
+	static GLuint	CompileShaderFromMemory(const GLuint _shaderObject, const std::string& _source);
+	// the result of m_loading, if it has not been taken yet
+	void			TakeLoaded() const;
 
-	GLuint	m_id;
+	GLenum							m_type;
+	std::string						m_origin;
+	ShaderDefines					m_defines;
+	mutable std::string				m_source;
+	mutable std::vector<std::string>	m_files;
+	mutable std::future<Loaded>		m_loading;	// the worker reading the file given to the constructor
+	mutable GLuint					m_id;
+	mutable bool					m_pending;	// m_source is waiting to be compiled
 };
\ No newline at end of file
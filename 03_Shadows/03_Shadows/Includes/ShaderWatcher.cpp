@@ -0,0 +1,127 @@
+#include "ShaderWatcher.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
+#ifdef __linux__
+
+ShaderWatcher::~ShaderWatcher()
+{
+	if (m_inotify >= 0)
+		close(m_inotify);
+}
+
+bool ShaderWatcher::Watch(const std::string& directory)
+{
+	m_directory = directory;
+	while (!m_directory.empty() && (m_directory.back() == '/' || m_directory.back() == '\\'))
+		m_directory.pop_back();
+
+	if (m_inotify < 0)
+		m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_inotify < 0 || inotify_add_watch(m_inotify, m_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+	{
+		std::cerr << "[ShaderWatcher] cannot watch " << m_directory << std::endl;
+		return false;
+	}
+	return true;
+}
+
+std::vector<std::string> ShaderWatcher::Poll()
+{
+	std::vector<std::string> files;
+	if (m_inotify < 0)
+		return files;
+
+	// the events come whole, a name at most NAME_MAX long after each
+	alignas(inotify_event) char buffer[4096];
+	for (;;)
+	{
+		const ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+		if (length <= 0)
+			break; // EAGAIN: nothing more for now
+
+		for (ssize_t offset = 0; offset < length; )
+		{
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+
+			if (event->len == 0 || (event->mask & IN_ISDIR))
+				continue;
+			const std::string file = m_directory + "/" + event->name;
+			if (std::find(files.begin(), files.end(), file) == files.end())
+				files.push_back(file);
+		}
+	}
+	return files;
+}
+
+#else
+
+ShaderWatcher::~ShaderWatcher()
+{
+}
+
+bool ShaderWatcher::Watch(const std::string& directory)
+{
+	m_directory = directory;
+	while (!m_directory.empty() && (m_directory.back() == '/' || m_directory.back() == '\\'))
+		m_directory.pop_back();
+
+	m_modified.clear();
+	m_lastPoll = std::chrono::steady_clock::time_point();
+	Poll();		// the times to compare with; nothing has changed yet
+#ifdef _WIN32
+	return true;
+#else
+	std::cerr << "[ShaderWatcher] watching files is not implemented on this platform" << std::endl;
+	return false;
+#endif
+}
+
+std::vector<std::string> ShaderWatcher::Poll()
+{
+	std::vector<std::string> files;
+#ifdef _WIN32
+	const auto now = std::chrono::steady_clock::now();
+	if (now - m_lastPoll < std::chrono::milliseconds(500))
+		return files;
+	const bool first = m_modified.empty();
+	m_lastPoll = now;
+
+	_finddata64_t data;
+	const intptr_t handle = _findfirst64((m_directory + "/*").c_str(), &data);
+	if (handle == -1)
+		return files;
+	do
+	{
+		if (data.attrib & _A_SUBDIR)
+			continue;
+
+		const std::string file = m_directory + "/" + data.name;
+		auto it = m_modified.find(file);
+		if (it == m_modified.end())
+		{
+			m_modified[file] = data.time_write;
+			if (!first)
+				files.push_back(file);	// a new file
+		}
+		else if (it->second != data.time_write)
+		{
+			it->second = data.time_write;
+			files.push_back(file);
+		}
+	} while (_findnext64(handle, &data) == 0);
+	_findclose(handle);
+#endif
+	return files;
+}
+
+#endif
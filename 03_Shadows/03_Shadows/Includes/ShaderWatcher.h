@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+
+	Tells which files of a directory were written since the last look, for reloading shaders while
+	the application runs:
+
+		watcher.Watch("Shaders");
+		...
+		ProgramObject::ReloadFiles(watcher.Poll());	// once per frame
+
+	Poll() never waits. On Linux it reads the pending inotify events of the directory (a file
+	closed after writing, or renamed into it, as editors that save through a temporary file do).
+	On Windows it compares the modification times of the files, at most twice a second. Other
+	platforms report nothing.
+
+	The files are "<directory>/<name>", the way ShaderObject names the files it reads when the
+	directory is given the same way.
+
+*/
+class ShaderWatcher final
+{
+public:
+	ShaderWatcher() = default;
+	~ShaderWatcher();
+
+	ShaderWatcher(const ShaderWatcher&)				= delete;
+	ShaderWatcher& operator=(const ShaderWatcher&)	= delete;
+
+	// false if the directory cannot be watched
+	bool						Watch(const std::string& directory);
+	// the files written since the last call, each once
+	std::vector<std::string>	Poll();
+
+private:
+	std::string		m_directory;
+#ifdef __linux__
+	int				m_inotify = -1;
+#else
+	std::map<std::string, long long>			m_modified;		// the last write time of every file
+	std::chrono::steady_clock::time_point		m_lastPoll;
+#endif
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <vector>
+#include <functional>
+#include <glm/glm.hpp>
+
+#include "Mesh_OGL3.h"
+
+/*
+
+	StaticBatch collects objects that never move, pre-transforms their geometry into world space
+	at load time and merges them per material into one allocation of SharedHeap(), the geometry
+	heap of every StaticBatch: its vertices are the ones of Mesh with the material index at
+	location MATERIAL_ATTRIBUTE (4). Each material is then drawn with a single call, while the
+	world-space bounds of the individual objects are kept so that they can still be frustum culled.
+
+	Usage: Add(...) every static object, then Build() once. Objects added after Build() are
+	only taken into account after the next Build().
+
+	A material with an index (an entry of a material table the shader reads, e.g. the regions of
+	a TextureAtlas) is batched by its texture and Kd alone: the materials indexed into the same
+	texture array with the same Kd are drawn with one call, and the index goes with the vertices
+	(MATERIAL_ATTRIBUTE).
+
+*/
+class StaticBatch final
+{
+public:
+	struct Material
+	{
+		glm::vec4	Kd{ 1 };
+		GLuint		texture{};	// for the draw callback to bind: a texture name, or a handle it resolves (TextureStreamer)
+		GLint		index{ -1 };	// into the material table of the shader; -1 if it has none
+
+		bool operator==(const Material& rhs) const { return Kd == rhs.Kd && texture == rhs.texture && index == rhs.index; }
+	};
+
+	// the vertices of the batches: the ones of Mesh, with the table index of their material
+	struct Vertex
+	{
+		Mesh::Vertex	mesh;
+		GLfloat			material;
+	};
+	static const GLuint MATERIAL_ATTRIBUTE = 4;
+
+	// the geometry heap of the batches, with the vertex format above
+	static std::shared_ptr<GeometryHeap> SharedHeap();
+
+	struct Bounds
+	{
+		glm::vec3 min{ 0 };
+		glm::vec3 max{ 0 };
+	};
+
+	StaticBatch() = default;
+	~StaticBatch();
+
+	StaticBatch(const StaticBatch&)				= delete;
+	StaticBatch& operator=(const StaticBatch&)	= delete;
+
+	void Add(const Mesh& mesh, const glm::mat4& world, const Material& material);
+	void Add(const std::vector<Mesh::Vertex>& vertices, const std::vector<GLuint>& indices, const glm::mat4& world, const Material& material);
+
+	// uploads the merged geometry; the CPU side copies are kept until Clean(), for the next Build()
+	void Build();
+	void Clean();
+
+	// Draws every batch with at most one draw call. setMaterial is invoked once per batch before
+	// its draw, so the caller can upload Kd, bind the texture, etc. (the index is the one of the
+	// first object of a batch of indexed materials). The geometry is already in world space, hence the
+	// caller has to use an identity world matrix.
+	void Draw(const glm::mat4& viewProj, const std::function<void(const Material&)>& setMaterial);
+
+	size_t BatchCount()		const { return m_batches.size(); }
+	// the distinct materials added: each would be a batch (and a texture bind) without the indices
+	size_t MaterialCount()	const { return m_materials.size(); }
+	size_t ObjectCount()	const { return m_objectCount; }
+	size_t CulledCount()	const { return m_culledLastDraw; }
+
+private:
+	struct Object
+	{
+		Bounds		bounds;
+		GLsizei		indexCount{};
+		size_t		firstIndex{};
+	};
+
+	struct Batch
+	{
+		Material					material;
+		std::vector<Vertex>			vertices;
+		std::vector<GLuint>			indices;
+		std::vector<Object>			objects;
+
+		GeometryHeap::Handle		allocation{ GeometryHeap::INVALID_HANDLE };
+
+		// scratch arrays for glMultiDrawElementsBaseVertex, kept to avoid per frame allocations
+		std::vector<GLsizei>		drawCounts;
+		std::vector<const void*>	drawOffsets;
+		std::vector<GLint>			drawBaseVertices;
+	};
+
+	Batch& FindOrCreateBatch(const Material& material);
+
+	std::shared_ptr<GeometryHeap>	m_heap;
+	std::vector<Batch>	m_batches;
+	std::vector<Material>	m_materials;
+	size_t				m_objectCount{};
+	size_t				m_culledLastDraw{};
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "MipGenerator.h"
+
+/*
+
+	TextureAtlas packs the material textures of a scene into the layers of one GL_TEXTURE_2D_ARRAY,
+	so that the draws of different materials need no texture bind between them (StaticBatch merges
+	the materials that have a table index into one batch).
+
+	Every texture is converted to RGBA8 and put into a layer of layerSize x layerSize:
+	- a texture of exactly that size takes a whole layer, with its own mip chain (Kaiser)
+	- the other ones are packed into shared layers with a skyline packer. Each gets a gutter of
+	  padding texels around it that repeats the texture (so GL_REPEAT style tiling with fract()
+	  filters across its edges) and starts at a multiple of padding; the mip levels of these
+	  layers are box filtered, so down to log2(padding) no level mixes texels of two textures.
+	  Region::maxLod is that level: the shader clamps the level of detail of the region to it.
+	- a texture bigger than a layer is replaced by the first of its mip levels that fits.
+
+		TextureAtlas::Handle wood = atlas.Add("Assets/wood.png");	// Add() every texture,
+		...
+		atlas.Build();											// then Build() once
+		const TextureAtlas::Region& region = atlas.Get(wood);	// layer and rectangle, for the material table
+
+	In the shader: uv = region.rect.xy + fract(texcoord) * region.rect.zw, sampled from the layer
+	at the level of detail of texcoord * region.rect.zw (the derivatives of the unwrapped
+	coordinates: fract() jumps at the seams), clamped to maxLod.
+
+*/
+class TextureAtlas final
+{
+public:
+	using Handle = unsigned;
+	static const Handle INVALID_HANDLE = ~0u;
+
+	struct Region
+	{
+		GLint		layer{};
+		glm::vec4	rect{ 0, 0, 1, 1 };	// xy: the corner in the layer, zw: the size, in texture coordinates
+		float		maxLod{};			// the finest level that does not mix in the neighbours
+	};
+
+	struct Stats
+	{
+		unsigned	textures{};
+		unsigned	fullLayers{};		// textures of the size of a layer
+		unsigned	packedLayers{};		// layers shared by the smaller textures
+		unsigned	shrunk{};			// textures bigger than a layer
+		float		packedUsage{};		// the part of the packed layers covered by textures and their gutters
+		size_t		bytes{};
+	};
+
+	// layerSize: the width and the height of the layers; padding: the gutter of the packed textures, a power of two
+	explicit TextureAtlas(GLsizei layerSize = 1024, GLsizei padding = 16);
+	~TextureAtlas();
+
+	TextureAtlas(const TextureAtlas&)				= delete;
+	TextureAtlas& operator=(const TextureAtlas&)	= delete;
+
+	// loads filename now; INVALID_HANDLE if it cannot be read
+	Handle	Add(const std::string& filename);
+	Handle	Add(MipLevel image);
+
+	// packs the textures and uploads them; the images are released afterwards
+	bool	Build();
+	void	Clean();
+
+	// valid after Build()
+	const Region&	Get(Handle handle) const { return m_regions[handle]; }
+	GLuint			Texture() const { return m_texture; }
+	GLsizei			LayerSize() const { return m_layerSize; }
+	const Stats&	GetStats() const { return m_stats; }
+
+private:
+	GLsizei					m_layerSize;
+	GLsizei					m_padding;
+	std::vector<MipLevel>	m_images;		// until Build()
+	std::vector<Region>		m_regions;
+	GLuint					m_texture{};
+	Stats					m_stats;
+
+	// the storage of the array, levels x layers of m_layerSize
+	void	CreateStorage(GLsizei levels, GLsizei layers);
+	void	UploadLayer(GLint layer, const std::vector<MipLevel>& levels);
+};
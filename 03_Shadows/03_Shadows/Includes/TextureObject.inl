@@ -5,19 +5,31 @@
 #include <SDL.h>
 #include <SDL_image.h>
 
+#include <iostream>
+
 template<TextureType type>
 inline TextureObject<type>::TextureObject()
 {
-	glGenTextures(1, &m_id);
+	Create();
 }
 
 template<TextureType type>
 inline TextureObject<type>::TextureObject(const std::string &s)
 {
-	glGenTextures(1, &m_id);
+	Create();
 	AttachFromFile(s);
 }
 
+template<TextureType type>
+inline void TextureObject<type>::Create()
+{
+	if (GLCaps::Get().directStateAccess)
+		glCreateTextures(static_cast<GLenum>(type), 1, &m_id);
+	else
+		glGenTextures(1, &m_id);
+	m_immutable = false;
+}
+
 template<TextureType type>
 inline TextureObject<type>::~TextureObject()
 {
@@ -31,6 +43,7 @@ inline TextureObject<type>::TextureObject(TextureObject && rhs)
 		return;
 
 	m_id = rhs.m_id;
+	m_immutable = rhs.m_immutable;
 	rhs.m_id = 0;
 }
 
@@ -41,6 +54,7 @@ inline TextureObject<type> & TextureObject<type>::operator=(TextureObject && rhs
 		return *this;
 
 	m_id = rhs.m_id;
+	m_immutable = rhs.m_immutable;
 	rhs.m_id = 0;
 
 	return *this;
@@ -56,6 +70,18 @@ inline TextureObject<type>& TextureObject<type>::operator=(const std::string & s
 template<TextureType type>
 inline void TextureObject<type>::AttachFromFile(const std::string& filename, bool generateMipMap, GLuint role)
 {
+	const size_t dot = filename.find_last_of('.');
+	const std::string extension = dot == std::string::npos ? std::string() : filename.substr(dot + 1);
+	if (extension == "dds" || extension == "DDS" || extension == "ktx2" || extension == "KTX2")
+	{
+		CompressedTexture compressed;
+		if (!compressed.Load(filename))
+			std::cerr << "[AttachFromFile] Error loading compressed texture file " << filename << std::endl;
+		else
+			AttachCompressed(compressed);
+		return;
+	}
+
 	SDL_Surface* loaded_img = IMG_Load(filename.c_str());
 
 	int img_mode = 0;
@@ -78,27 +104,122 @@ inline void TextureObject<type>::AttachFromFile(const std::string& filename, boo
 		img_mode = GL_RGB;
 #endif
 
-	glBindTexture(static_cast<GLenum>(type), m_id);
-	glTexImage2D(
-		static_cast<GLenum>(type),	// the binding point that holds the texture
-		0,							// level-of-detail
-		GL_RGB,						// texture's internal format (GPU side)
-		loaded_img->w,				// width
-		loaded_img->h,				// height
-		0,							// must be 0 ( https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glTexImage2D.xhtml )
-		img_mode,					// source (CPU side) format
-		GL_UNSIGNED_BYTE,			// data type of the pixel data (CPU side)
-		loaded_img->pixels);		// pointer to the data
+	// the mip chain is filtered on the CPU, gamma correct, instead of glGenerateMipmap after the upload
+	const std::vector<MipLevel> mips = generateMipMap ? MipGenerator::Generate(MipGenerator::FromSurface(loaded_img)) : std::vector<MipLevel>();
+	if (!mips.empty())
+		img_mode = GL_RGBA;
+	const void* pixels = mips.empty() ? loaded_img->pixels : mips[0].rgba.data();
 
-	if (generateMipMap)
-		glGenerateMipmap(static_cast<GLenum>(type));
+	// the exact size of the source, the GPU would store GL_RGB with whatever precision it likes
+	const GLenum internalFormat = loaded_img->format->BytesPerPixel == 4 || !mips.empty() ? GL_RGBA8 : GL_RGB8;
+	const GLsizei levels = mips.empty() ? 1 : GLsizei(mips.size());
+	const bool dsa = GLCaps::Get().directStateAccess;
+	const bool immutable = dsa || GLCaps::Get().textureStorage;
 
-	glTexParameteri(static_cast<GLenum>(type), GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(static_cast<GLenum>(type), GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// immutable storage is allocated once: loading another image needs a new texture object
+	if (immutable && m_immutable)
+	{
+		Clean();
+		Create();
+	}
+
+	if (dsa)
+	{
+		glTextureStorage2D(m_id, levels, internalFormat, loaded_img->w, loaded_img->h);
+		glTextureSubImage2D(m_id, 0, 0, 0, loaded_img->w, loaded_img->h, img_mode, GL_UNSIGNED_BYTE, pixels);
+		for (GLsizei level = 1; level < levels; ++level)
+			glTextureSubImage2D(m_id, level, 0, 0, mips[level].width, mips[level].height, GL_RGBA, GL_UNSIGNED_BYTE, mips[level].rgba.data());
+	}
+	else
+	{
+		GLState::BindTexture(static_cast<GLenum>(type), m_id);
+		if (immutable)
+		{
+			glTexStorage2D(static_cast<GLenum>(type), levels, internalFormat, loaded_img->w, loaded_img->h);
+			glTexSubImage2D(static_cast<GLenum>(type), 0, 0, 0, loaded_img->w, loaded_img->h, img_mode, GL_UNSIGNED_BYTE, pixels);
+			for (GLsizei level = 1; level < levels; ++level)
+				glTexSubImage2D(static_cast<GLenum>(type), level, 0, 0, mips[level].width, mips[level].height, GL_RGBA, GL_UNSIGNED_BYTE, mips[level].rgba.data());
+		}
+		else
+		{
+			glTexImage2D(
+				static_cast<GLenum>(type),	// the binding point that holds the texture
+				0,							// level-of-detail
+				internalFormat,				// texture's internal format (GPU side)
+				loaded_img->w,				// width
+				loaded_img->h,				// height
+				0,							// must be 0 ( https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glTexImage2D.xhtml )
+				img_mode,					// source (CPU side) format
+				GL_UNSIGNED_BYTE,			// data type of the pixel data (CPU side)
+				pixels);					// pointer to the data
+			for (GLsizei level = 1; level < levels; ++level)
+				glTexImage2D(static_cast<GLenum>(type), level, internalFormat, mips[level].width, mips[level].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, mips[level].rgba.data());
+
+			// immutable textures get this from their level count
+			glTexParameteri(static_cast<GLenum>(type), GL_TEXTURE_MAX_LEVEL, levels - 1);
+		}
+	}
+	m_immutable = immutable;
+
+	// filtering and wrapping come from the sampler bound with the texture (SamplerCache)
 
 	SDL_FreeSurface(loaded_img);
 }
 
+template<TextureType type>
+inline bool TextureObject<type>::AttachCompressed(const CompressedTexture& texture)
+{
+	if (texture.IsEmpty())
+		return false;
+	if (!BlockCompression::IsSupported(texture.format))
+	{
+		std::cerr << "[AttachCompressed] the context cannot sample this block compressed format" << std::endl;
+		return false;
+	}
+
+	const GLenum internalFormat = texture.InternalFormat();
+	const GLsizei levels = GLsizei(texture.levels.size());
+	const bool dsa = GLCaps::Get().directStateAccess;
+	const bool immutable = dsa || GLCaps::Get().textureStorage;
+
+	if (immutable && m_immutable)
+	{
+		Clean();
+		Create();
+	}
+
+	// the blocks come from client memory
+	GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (dsa)
+	{
+		glTextureStorage2D(m_id, levels, internalFormat, texture.levels[0].width, texture.levels[0].height);
+		for (GLsizei level = 0; level < levels; ++level)
+		{
+			const CompressedTexture::Level& l = texture.levels[level];
+			glCompressedTextureSubImage2D(m_id, level, 0, 0, l.width, l.height, internalFormat, GLsizei(l.data.size()), l.data.data());
+		}
+	}
+	else
+	{
+		GLState::BindTexture(static_cast<GLenum>(type), m_id);
+		if (immutable)
+			glTexStorage2D(static_cast<GLenum>(type), levels, internalFormat, texture.levels[0].width, texture.levels[0].height);
+		for (GLsizei level = 0; level < levels; ++level)
+		{
+			const CompressedTexture::Level& l = texture.levels[level];
+			if (immutable)
+				glCompressedTexSubImage2D(static_cast<GLenum>(type), level, 0, 0, l.width, l.height, internalFormat, GLsizei(l.data.size()), l.data.data());
+			else
+				glCompressedTexImage2D(static_cast<GLenum>(type), level, internalFormat, l.width, l.height, 0, GLsizei(l.data.size()), l.data.data());
+		}
+		if (!immutable)
+			glTexParameteri(static_cast<GLenum>(type), GL_TEXTURE_MAX_LEVEL, levels - 1);
+	}
+	m_immutable = immutable;
+	return true;
+}
+
 template<TextureType type>
 inline void TextureObject<type>::FromFile(const std::string& s)
 {
@@ -110,7 +231,7 @@ inline void TextureObject<type>::Clean()
 {
 	if (m_id != 0)
 	{
-		glDeleteTextures(1, &m_id);
+		GLState::DeleteTextures(1, &m_id);
 		m_id = 0;
 	}
 }
@@ -0,0 +1,356 @@
+#include "TextureStreamer.h"
+#include "GLCaps.h"
+#include "GLState.h"
+#include "Parallel.h"
+#include "TextureObject.h"
+#include "gCamera.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	// RGBA8 rows are 4 byte aligned, which is the default GL_UNPACK_ALIGNMENT
+	GLsizeiptr RowPitch(const MipLevel& level)
+	{
+		return GLsizeiptr(level.width) * 4;
+	}
+
+	size_t LevelBytes(const MipLevel& level)
+	{
+		return size_t(RowPitch(level)) * level.height;
+	}
+}
+
+TextureStreamer::TextureStreamer(GLsizeiptr budget, unsigned workers, size_t residentBudget)
+	: m_ring(budget), m_budget(budget)
+{
+	m_stats.residentBudget = residentBudget;
+
+	// the placeholder is uploaded from client memory
+	GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	const unsigned char grey[4] = { 128, 128, 128, 255 };
+	if (GLCaps::Get().directStateAccess)
+	{
+		glCreateTextures(GL_TEXTURE_2D, 1, &m_placeholder);
+		glTextureStorage2D(m_placeholder, 1, GL_RGBA8, 1, 1);
+		glTextureSubImage2D(m_placeholder, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	}
+	else
+	{
+		glGenTextures(1, &m_placeholder);
+		GLState::BindTexture(GL_TEXTURE_2D, m_placeholder);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	}
+
+	if (workers == 0)
+		workers = std::min(4u, std::max(1u, std::thread::hardware_concurrency()) - 1);
+	for (unsigned i = 0; i < std::max(1u, workers); ++i)
+		m_workers.emplace_back(&TextureStreamer::Work, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+		m_jobs.clear();
+	}
+	m_wake.notify_all();
+	for (std::thread& worker : m_workers)
+		worker.join();
+
+	for (Texture& texture : m_textures)
+		if (texture.id != 0)
+			GLState::DeleteTextures(1, &texture.id);
+	GLState::DeleteTextures(1, &m_placeholder);
+}
+
+TextureStreamer::Handle TextureStreamer::Request(const std::string& filename, bool generateMipMap)
+{
+	const Handle handle = Handle(m_textures.size());
+	m_textures.push_back({ filename, generateMipMap, State::Decoding, 0, {}, 0, -1, 0, 0, FLT_MAX, 0, false });
+	++m_stats.requested;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back({ handle, filename, generateMipMap });
+	}
+	m_wake.notify_one();
+	return handle;
+}
+
+GLuint TextureStreamer::Get(Handle handle) const
+{
+	return IsResident(handle) ? m_textures[handle].id : m_placeholder;
+}
+
+bool TextureStreamer::IsResident(Handle handle) const
+{
+	return handle < m_textures.size() && m_textures[handle].state == State::Resident;
+}
+
+void TextureStreamer::Require(Handle handle, float uvPerPixel)
+{
+	if (handle >= m_textures.size())
+		return;
+
+	Texture& texture = m_textures[handle];
+	texture.managed = true;
+	texture.uvPerPixel = std::min(texture.uvPerPixel, uvPerPixel);
+	texture.lastUsed = m_frame;
+}
+
+void TextureStreamer::Require(Handle handle, gCamera& camera, const glm::vec3& center, float radius, float uvPerWorldUnit, int viewportHeight)
+{
+	// the nearest point of the surface decides; a world unit there is proj[1][1] * H / (2 d) pixels high
+	const float distance = std::max(0.01f, glm::length(camera.GetEye() - center) - radius);
+	const float pixelsPerWorldUnit = camera.GetProj()[1][1] * float(std::max(1, viewportHeight)) / (2.0f * distance);
+	Require(handle, uvPerWorldUnit / pixelsPerWorldUnit);
+}
+
+void TextureStreamer::Work()
+{
+	// the workers decode different textures side by side: the filtering of one runs serially
+	ThreadPool::MarkWorkerThread();
+
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+			if (m_stop)
+				return;
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+
+		// the slow part, with no lock and no GL
+		MipLevel image = MipGenerator::FromFile(job.filename);
+		std::vector<MipLevel> levels;
+		if (!image.rgba.empty())
+			levels = job.generateMipMap ? MipGenerator::Generate(image) : std::vector<MipLevel>{ std::move(image) };
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_decoded.push_back({ job.handle, std::move(levels) });
+	}
+}
+
+void TextureStreamer::Update()
+{
+	m_ring.BeginFrame();
+	m_stats.uploadsLastFrame		= 0;
+	m_stats.evictionsLastFrame		= 0;
+	m_stats.evictedBytesLastFrame	= 0;
+	m_stats.starved					= 0;
+
+	std::vector<Decoded> decoded;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		decoded.swap(m_decoded);
+	}
+	for (Decoded& result : decoded)
+	{
+		Texture& texture = m_textures[result.handle];
+		if (result.levels.empty() || RowPitch(result.levels[0]) > m_budget)
+		{
+			if (result.levels.empty())
+				std::cerr << "[TextureStreamer] Error loading image file " << texture.filename << std::endl;
+			else
+				std::cerr << "[TextureStreamer] a row of " << texture.filename << " is over the budget of a frame" << std::endl;
+			texture.state = State::Failed;
+			++m_stats.failed;
+			continue;
+		}
+		texture.levels = std::move(result.levels);
+		texture.residentBase = int(texture.levels.size());
+		texture.state = State::Uploading;
+	}
+
+	// the level each texture needs, from the Require() calls of the last frame
+	std::vector<Texture*> wanting;
+	for (Texture& texture : m_textures)
+	{
+		if (texture.levels.empty())
+			continue;
+
+		const MipLevel& base = texture.levels[0];
+		const int tail = TailLevel(texture);
+		if (!texture.managed)
+			texture.requiredLevel = 0;
+		else if (texture.lastUsed != m_frame)
+			texture.requiredLevel = tail;	// not drawn: only the tail has to stay
+		else
+		{
+			const float texelsPerPixel = texture.uvPerPixel * float(std::max(base.width, base.height));
+			texture.requiredLevel = std::min(tail, std::max(0, int(std::floor(std::log2(std::max(texelsPerPixel, 1.0f))))));
+		}
+		texture.uvPerPixel = FLT_MAX;
+
+		// a level that is not needed any more is dropped half uploaded
+		if (texture.uploading >= 0 && texture.uploading < texture.requiredLevel)
+		{
+			m_stats.residentBytes -= LevelBytes(texture.levels[texture.uploading]);
+			SpecifyLevel(texture, texture.uploading, 0, 0);
+			texture.uploading = -1;
+		}
+		if (texture.residentBase > texture.requiredLevel)
+			wanting.push_back(&texture);
+	}
+	++m_frame;
+
+	// a lowered budget is met by the levels nobody needs
+	MakeRoom(0, nullptr);
+
+	// the smallest missing levels first: many textures get sharper for the bytes of one big level
+	std::stable_sort(wanting.begin(), wanting.end(), [](const Texture* a, const Texture* b) {
+		return LevelBytes(a->levels[a->residentBase - 1]) < LevelBytes(b->levels[b->residentBase - 1]);
+	});
+
+	if (!wanting.empty())
+	{
+		GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_ring.Buffer());
+		bool spent = false;
+		for (size_t i = 0; i < wanting.size() && !spent; ++i)
+		{
+			Texture& texture = *wanting[i];
+			while (texture.residentBase > texture.requiredLevel)
+			{
+				const int level = texture.residentBase - 1;
+				if (texture.uploading != level)
+				{
+					// the tail goes in whatever the budget, every texture keeps it
+					const size_t bytes = LevelBytes(texture.levels[level]);
+					if (level < TailLevel(texture) && !MakeRoom(bytes, &texture))
+					{
+						++m_stats.starved;
+						break;
+					}
+					SpecifyLevel(texture, level, texture.levels[level].width, texture.levels[level].height);
+					texture.uploading = level;
+					texture.nextRow = 0;
+					m_stats.residentBytes += bytes;
+				}
+				if (!UploadRows(texture))
+				{
+					spent = true;
+					break;
+				}
+			}
+		}
+	}
+	// the other uploads (TextureObject) pass client memory
+	GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	m_ring.EndFrame();
+	m_stats.bytesLastFrame = m_ring.BytesLastFrame();
+}
+
+int TextureStreamer::TailLevel(const Texture& texture) const
+{
+	int level = 0;
+	while (level + 1 < int(texture.levels.size()) && std::max(texture.levels[level].width, texture.levels[level].height) > TAIL_SIZE)
+		++level;
+	return level;
+}
+
+bool TextureStreamer::MakeRoom(size_t bytes, const Texture* except)
+{
+	while (m_stats.residentBytes + bytes > m_stats.residentBudget)
+	{
+		// the least recently used texture with a level finer than it needs, the biggest level on a tie
+		Texture* victim = nullptr;
+		for (Texture& texture : m_textures)
+		{
+			if (&texture == except || texture.levels.empty() || texture.residentBase >= texture.requiredLevel)
+				continue;
+			if (victim == nullptr || texture.lastUsed < victim->lastUsed
+				|| (texture.lastUsed == victim->lastUsed && LevelBytes(texture.levels[texture.residentBase]) > LevelBytes(victim->levels[victim->residentBase])))
+				victim = &texture;
+		}
+		if (victim == nullptr)
+			return false;
+		Evict(*victim);
+	}
+	return true;
+}
+
+void TextureStreamer::Evict(Texture& texture)
+{
+	const int level = texture.residentBase++;
+	const size_t bytes = LevelBytes(texture.levels[level]);
+
+	// the texture stops sampling the level before it loses its storage
+	GLState::BindTexture(GL_TEXTURE_2D, texture.id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.residentBase);
+	SpecifyLevel(texture, level, 0, 0);
+
+	m_stats.residentBytes -= bytes;
+	m_stats.evictedBytesLastFrame += bytes;
+	++m_stats.evictionsLastFrame;
+}
+
+void TextureStreamer::SpecifyLevel(Texture& texture, int level, GLsizei width, GLsizei height)
+{
+	// mutable storage, level by level: DSA has no glTextureImage2D, so the texture is bound
+	if (texture.id == 0)
+	{
+		glGenTextures(1, &texture.id);
+		GLState::BindTexture(GL_TEXTURE_2D, texture.id);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, GLint(texture.levels.size()) - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(texture.levels.size()) - 1);
+	}
+	GLState::BindTexture(GL_TEXTURE_2D, texture.id);
+
+	// no data: the rows come from the unpack buffer later, so no pointer (an offset into it) is given
+	GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_ring.Buffer());
+}
+
+bool TextureStreamer::UploadRows(Texture& texture)
+{
+	const MipLevel& image = texture.levels[texture.uploading];
+	const GLsizeiptr pitch = RowPitch(image);
+	const int rows = int(std::min<GLsizeiptr>(image.height - texture.nextRow, m_ring.Available(4) / pitch));
+	if (rows <= 0)
+		return false;	// the budget of the frame is spent
+
+	const StreamRingBuffer::Chunk chunk = m_ring.Allocate(rows * pitch, 4);
+	// the rows are tightly packed, one copy does
+	std::memcpy(chunk.data, image.rgba.data() + GLsizeiptr(texture.nextRow) * pitch, size_t(rows * pitch));
+	m_ring.Commit(chunk);
+
+	// the pointer is an offset into the bound unpack buffer
+	const void* offset = reinterpret_cast<const void*>(chunk.offset);
+	if (GLCaps::Get().directStateAccess)
+		glTextureSubImage2D(texture.id, texture.uploading, 0, texture.nextRow, image.width, rows, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+	else
+	{
+		GLState::BindTexture(GL_TEXTURE_2D, texture.id);
+		glTexSubImage2D(GL_TEXTURE_2D, texture.uploading, 0, texture.nextRow, image.width, rows, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+	}
+	++m_stats.uploadsLastFrame;
+
+	texture.nextRow += rows;
+	if (texture.nextRow == image.height)
+	{
+		// the level is complete: sampled from now on
+		texture.residentBase = texture.uploading;
+		texture.uploading = -1;
+		texture.nextRow = 0;
+		GLState::BindTexture(GL_TEXTURE_2D, texture.id);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.residentBase);
+		if (texture.state != State::Resident)
+		{
+			texture.state = State::Resident;
+			++m_stats.resident;
+		}
+	}
+	return true;
+}
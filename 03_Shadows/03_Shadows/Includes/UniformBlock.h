@@ -0,0 +1,88 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+
+/*
+
+	A C++ struct that is uploaded as a std140 uniform block lists its members, in the order of
+	the block in the shader, with a static UniformBlockMembers():
+
+		struct PerObject
+		{
+			glm::mat4 MVP;
+			glm::vec3 eye_pos;	float _pad0;	// padding is not listed
+			glm::vec4 Kd;
+
+			static constexpr std::array<UniformBlockMember, 3> UniformBlockMembers()
+			{
+				return {{ UNIFORM_BLOCK_MEMBER(PerObject, MVP), UNIFORM_BLOCK_MEMBER(PerObject, eye_pos), UNIFORM_BLOCK_MEMBER(PerObject, Kd) }};
+			}
+		};
+
+	MatchesStd140() lays the listed members out by the std140 rules and compares the offsets with
+	the ones of the struct; ProgramObject::SetUniformBlock() static_asserts it, then compares the
+	offsets with the ones the linker gave the block in the program.
+
+	Std140<T> knows the scalars, the vectors, mat2x4 like matrices and arrays of 16 byte
+	elements: the types whose C++ memory is the same as their std140 memory. The rest (a glm::vec3
+	array, glm::mat3) does not compile; write them as vec4s.
+
+*/
+template <typename T>
+struct Std140;
+
+template <std::size_t Alignment, std::size_t Size>
+struct Std140Type
+{
+	static constexpr std::size_t alignment	= Alignment;
+	static constexpr std::size_t size		= Size;
+};
+
+template <> struct Std140<float>			: Std140Type<4, 4> {};
+template <> struct Std140<int>				: Std140Type<4, 4> {};
+template <> struct Std140<unsigned>			: Std140Type<4, 4> {};
+template <> struct Std140<glm::vec2>		: Std140Type<8, 8> {};
+template <> struct Std140<glm::ivec2>		: Std140Type<8, 8> {};
+template <> struct Std140<glm::vec3>		: Std140Type<16, 12> {};
+template <> struct Std140<glm::ivec3>		: Std140Type<16, 12> {};
+template <> struct Std140<glm::vec4>		: Std140Type<16, 16> {};
+template <> struct Std140<glm::ivec4>		: Std140Type<16, 16> {};
+template <> struct Std140<glm::mat2x4>		: Std140Type<16, 32> {};
+template <> struct Std140<glm::mat3x4>		: Std140Type<16, 48> {};
+template <> struct Std140<glm::mat4>		: Std140Type<16, 64> {};
+
+// the elements of an array are 16 byte aligned, so a C++ array only matches if they are 16 bytes apart already
+template <typename T, std::size_t N>
+struct Std140<T[N]> : Std140Type<16, N * sizeof(T)>
+{
+	static_assert(Std140<T>::size % 16 == 0 && sizeof(T) == Std140<T>::size, "std140 array elements are 16 byte aligned, use 16 byte elements (glm::vec4, glm::mat4)");
+};
+
+struct UniformBlockMember
+{
+	const char*	name;		// in the shader
+	std::size_t	offset;		// in the C++ struct
+	std::size_t	alignment;	// std140
+	std::size_t	size;
+};
+
+#define UNIFORM_BLOCK_MEMBER(Struct, member) \
+	UniformBlockMember{ #member, offsetof(Struct, member), Std140<decltype(Struct::member)>::alignment, Std140<decltype(Struct::member)>::size }
+
+// true if every member is where std140 puts it after the ones before it
+template <std::size_t N>
+constexpr bool MatchesStd140(const std::array<UniformBlockMember, N>& members)
+{
+	std::size_t end = 0;
+	for (std::size_t i = 0; i < N; ++i)
+	{
+		const std::size_t offset = (end + members[i].alignment - 1) / members[i].alignment * members[i].alignment;
+		if (members[i].offset != offset)
+			return false;
+		end = offset + members[i].size;
+	}
+	return true;
+}
@@ -5,10 +5,23 @@
 
 #include "GLconversions.hpp"
 #include "BufferObject.h"
+#include "GLCaps.h"
 
 #include <initializer_list>
 #include <utility>
 
+// size in bytes of one component of the given vertex attribute type
+inline GLsizei AttributeTypeSize(GLenum type)
+{
+	switch (type)
+	{
+	case GL_BYTE: case GL_UNSIGNED_BYTE:						return 1;
+	case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT:	return 2;
+	case GL_DOUBLE:												return 8;
+	}
+	return 4;
+}
+
 struct AttributeData
 {
 	AttributeData(GLuint pIndex, GLint pSize, GLenum pType, GLboolean pNormalized, GLsizei pStride, void* pPtr) : index(pIndex), size(pSize), type(pType), normalized(pNormalized), stride(pStride), ptr(pPtr) 
@@ -20,6 +33,15 @@ struct AttributeData
 		glVertexAttribPointer(index, size, type, normalized, stride, ptr);
 	}
 
+	// the direct state access version: the attribute reads buffer through the binding point of the same index
+	void Apply(GLuint vao, GLuint buffer)
+	{
+		glEnableVertexArrayAttrib(vao, index);
+		glVertexArrayVertexBuffer(vao, index, buffer, reinterpret_cast<GLintptr>(ptr), stride != 0 ? stride : size * AttributeTypeSize(type));
+		glVertexArrayAttribFormat(vao, index, size, type, normalized, 0);
+		glVertexArrayAttribBinding(vao, index, index);
+	}
+
 	GLuint		index{};
 	GLint		size{};
 	GLenum		type{};
@@ -0,0 +1,480 @@
+#include "VirtualTexture.h"
+#include "GLCaps.h"
+#include "GLState.h"
+#include "MipGenerator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+
+namespace
+{
+	const uint32_t VERSION = 1;
+
+	// the feedback read backs on the way at most; the later frames skip theirs
+	const size_t MAX_PENDING_FEEDBACK = 3;
+	// pages read or decoded at a time at most, the coarse ones are asked for first
+	const size_t MAX_LOADING = 64;
+
+	int PositiveModulo(int a, int b)
+	{
+		return (a % b + b) % b;
+	}
+
+	bool IsPowerOfTwo(int value)
+	{
+		return value > 0 && (value & (value - 1)) == 0;
+	}
+
+	// a size x size RGBA8 texture with levels, its texels undefined
+	GLuint CreateTexture(GLsizei levels, GLsizei size)
+	{
+		GLuint texture = 0;
+		if (GLCaps::Get().directStateAccess)
+		{
+			glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+			glTextureStorage2D(texture, levels, GL_RGBA8, size, size);
+			return texture;
+		}
+
+		glGenTextures(1, &texture);
+		GLState::BindTexture(GL_TEXTURE_2D, texture);
+		if (GLCaps::Get().textureStorage)
+			glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGBA8, size, size);
+		else
+		{
+			GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			for (GLsizei level = 0; level < levels; ++level)
+				glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, std::max(1, size >> level), std::max(1, size >> level), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		}
+		return texture;
+	}
+}
+
+VirtualTexture::VirtualTexture(GLsizei cachePages, GLsizeiptr budget, unsigned workers)
+	: m_cachePages(std::min(256, std::max(1, cachePages))), m_ring(budget), m_budget(budget)
+{
+	if (workers == 0)
+		workers = std::min(4u, std::max(1u, std::thread::hardware_concurrency()) - 1);
+	for (unsigned i = 0; i < std::max(1u, workers); ++i)
+		m_workers.emplace_back(&VirtualTexture::Work, this);
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+		m_jobs.clear();
+	}
+	m_wake.notify_all();
+	for (std::thread& worker : m_workers)
+		worker.join();
+
+	Clean();
+}
+
+void VirtualTexture::Clean()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.clear();
+		m_decoded.clear();
+	}
+	// the pages the workers are busy with are dropped when they arrive
+	++m_generation;
+
+	if (m_pageTable != 0)
+		GLState::DeleteTextures(1, &m_pageTable);
+	if (m_cache != 0)
+		GLState::DeleteTextures(1, &m_cache);
+	m_pageTable = m_cache = 0;
+
+	m_filename.clear();
+	m_header = Header();
+	m_slots.clear();
+	m_resident.clear();
+	m_loading.clear();
+	m_uploads.clear();
+	m_table.clear();
+	m_stats = Stats();
+}
+
+bool VirtualTexture::Cook(const std::string& image, const std::string& cooked, int repeat, GLsizei pageSize, GLsizei border, BlockFormat format)
+{
+	const MipLevel source = MipGenerator::FromFile(image);
+	if (source.rgba.empty())
+	{
+		std::cerr << "[VirtualTexture] Error loading image file " << image << std::endl;
+		return false;
+	}
+
+	const GLsizei size = source.width * std::max(1, repeat), slotSize = pageSize + 2 * border;
+	if (source.width != source.height || pageSize <= 0 || size % pageSize != 0 || !IsPowerOfTwo(size / pageSize) || size / pageSize > 256
+		|| slotSize % 4 != 0 || !BlockCompression::CanEncode(format))
+	{
+		std::cerr << "[VirtualTexture] " << image << " x " << repeat << " is not a square of a power of two pages of " << pageSize
+			<< " (with a border of " << border << ", a multiple of 4 texels across)" << std::endl;
+		return false;
+	}
+
+	uint32_t levels = 0;
+	while ((size / pageSize) >> levels)
+		++levels;
+
+	std::ofstream file(cooked, std::ios::binary | std::ios::trunc);
+	const Header header{ { 'V', 'T', 'E', 'X' }, VERSION, uint32_t(size), uint32_t(pageSize), uint32_t(border), levels, uint32_t(format), uint32_t(std::max(1, repeat)) };
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	// level k of the repeated image is level k of the image repeated, down to 1x1; then the same color
+	const std::vector<MipLevel> imageLevels = MipGenerator::Generate(source, MipFilter::Kaiser);
+	std::vector<unsigned char> page(size_t(slotSize) * slotSize * 4);
+	for (uint32_t level = 0; level < levels; ++level)
+	{
+		const MipLevel& texels = imageLevels[std::min<size_t>(level, imageLevels.size() - 1)];
+		const int levelSize = size >> level, pagesAcross = levelSize / pageSize;
+		for (int py = 0; py < pagesAcross; ++py)
+			for (int px = 0; px < pagesAcross; ++px)
+			{
+				// the border comes from the other side of the texture at its edges: the texture repeats
+				for (int y = 0; y < slotSize; ++y)
+				{
+					const int sourceY = PositiveModulo(py * pageSize + y - border, levelSize) % texels.height;
+					for (int x = 0; x < slotSize; ++x)
+					{
+						const int sourceX = PositiveModulo(px * pageSize + x - border, levelSize) % texels.width;
+						const unsigned char* texel = &texels.rgba[(size_t(sourceY) * texels.width + sourceX) * 4];
+						std::copy(texel, texel + 4, &page[(size_t(y) * slotSize + x) * 4]);
+					}
+				}
+				const std::vector<unsigned char> blocks = BlockCompression::Encode(page.data(), slotSize, slotSize, format);
+				file.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+			}
+	}
+	if (!file)
+	{
+		std::cerr << "[VirtualTexture] Error writing " << cooked << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+bool VirtualTexture::Load(const std::string& image, int repeat, GLsizei pageSize, GLsizei border)
+{
+	const size_t dot = image.find_last_of('.');
+	const std::string cooked = image.substr(0, dot == std::string::npos || image.find_first_of("/\\", dot) != std::string::npos ? image.size() : dot) + ".vtex";
+
+	const auto readHeader = [&](Header& header) {
+		std::ifstream file(cooked, std::ios::binary);
+		return file.read(reinterpret_cast<char*>(&header), sizeof(header)) && std::memcmp(header.magic, "VTEX", 4) == 0 && header.version == VERSION
+			&& header.repeat == uint32_t(std::max(1, repeat)) && header.pageSize == uint32_t(pageSize) && header.border == uint32_t(border);
+	};
+
+	Header header{};
+	if (!readHeader(header) && !(Cook(image, cooked, repeat, pageSize, border) && readHeader(header)))
+		return false;
+
+	Clean();
+	m_filename	= cooked;
+	m_header	= header;
+	m_slotSize	= pageSize + 2 * border;
+	if (GLsizeiptr(m_slotSize) * m_slotSize * 4 > m_budget)
+	{
+		std::cerr << "[VirtualTexture] a page of " << cooked << " is over the budget of a frame" << std::endl;
+		Clean();
+		return false;
+	}
+
+	// the textures are specified from client memory
+	GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	m_cache		= CreateTexture(1, m_cachePages * m_slotSize);
+	m_pageTable	= CreateTexture(Levels(), PagesAcross(0));
+
+	m_slots.assign(size_t(m_cachePages) * m_cachePages, Slot{ 0, 0, false });
+	m_table.resize(Levels());
+	for (int level = 0; level < Levels(); ++level)
+	{
+		m_table[level].assign(size_t(PagesAcross(level)) * PagesAcross(level) * 4, 0);
+		m_stats.pages += unsigned(PagesAcross(level) * PagesAcross(level));
+	}
+	m_stats.slots		= unsigned(m_slots.size());
+	m_stats.cacheBytes	= size_t(m_cachePages * m_slotSize) * (m_cachePages * m_slotSize) * 4;
+	m_tableDirty = true;
+
+	// the root of every fallback, before any feedback asks for it
+	Request(Key(Levels() - 1, 0, 0));
+	return true;
+}
+
+glm::vec4 VirtualTexture::Params() const
+{
+	return glm::vec4(IsLoaded() ? PagesAcross(0) : 1, m_header.pageSize, m_header.border, m_cachePages * m_slotSize);
+}
+
+uint64_t VirtualTexture::PageOffset(PageKey page) const
+{
+	const int level = int(page >> 16), y = int((page >> 8) & 255), x = int(page & 255);
+
+	// the pages are stored level by level, the finest first, row by row
+	uint64_t index = 0;
+	for (int finer = 0; finer < level; ++finer)
+		index += uint64_t(PagesAcross(finer)) * PagesAcross(finer);
+	index += uint64_t(y) * PagesAcross(level) + x;
+	return sizeof(Header) + index * PageBytes();
+}
+
+void VirtualTexture::RequestFeedback(GPUReadback& readback, GLuint framebuffer, GLenum readBuffer, GLsizei width, GLsizei height)
+{
+	if (!IsLoaded() || m_feedback.size() >= MAX_PENDING_FEEDBACK)
+		return;
+
+	const GPUReadback::Handle handle = readback.ReadPixels(framebuffer, readBuffer, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE);
+	if (handle != GPUReadback::INVALID_HANDLE)
+		m_feedback.push_back(handle);
+}
+
+void VirtualTexture::Work()
+{
+	// every worker reads with its own stream, opened again when the file changes
+	std::ifstream file;
+	std::string opened;
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+			if (m_stop)
+				return;
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+
+		// the slow part, with no lock and no GL
+		if (opened != job.filename)
+		{
+			file.close();
+			file.open(job.filename, std::ios::binary);
+			opened = job.filename;
+		}
+		file.clear();
+		std::vector<unsigned char> blocks(BlockCompression::ImageSize(job.format, job.size, job.size));
+		file.seekg(std::streamoff(job.offset));
+		Decoded decoded{ job.generation, job.page, {} };
+		if (file.read(reinterpret_cast<char*>(blocks.data()), blocks.size()))
+			decoded.rgba = BlockCompression::Decode(blocks.data(), job.size, job.size, job.format);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_decoded.push_back(std::move(decoded));
+	}
+}
+
+void VirtualTexture::Request(PageKey page)
+{
+	if (m_loading.size() >= MAX_LOADING || !m_loading.insert(page).second)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back({ m_generation, page, m_filename, PageOffset(page), m_slotSize, BlockFormat(m_header.format) });
+	}
+	m_wake.notify_one();
+}
+
+void VirtualTexture::ProcessFeedback(const std::vector<unsigned char>& pixels)
+{
+	// the distinct pages; alpha 0 is a pixel without the virtual texture
+	std::unordered_set<PageKey> pages;
+	for (size_t i = 0; i + 3 < pixels.size(); i += 4)
+	{
+		if (pixels[i + 3] == 0)
+			continue;
+		const int level = std::min(int(pixels[i + 2]), Levels() - 1);
+		if (pixels[i] < PagesAcross(level) && pixels[i + 1] < PagesAcross(level))
+			pages.insert(Key(level, pixels[i], pixels[i + 1]));
+	}
+	m_lastFeedback = m_frame;
+	m_stats.requested = unsigned(pages.size());
+
+	// their ancestors are in use too: they are what the shader falls back to while a page loads
+	std::unordered_set<PageKey> seen;
+	std::vector<PageKey> wanted;
+	for (PageKey page : pages)
+		for (int level = int(page >> 16), y = int((page >> 8) & 255), x = int(page & 255); level < Levels(); ++level, x /= 2, y /= 2)
+		{
+			if (!seen.insert(Key(level, x, y)).second)
+				break;	// and so are the ones above it
+			wanted.push_back(Key(level, x, y));
+		}
+
+	// the coarse pages first (the level is the high bits of the key): they cover the most pixels
+	std::sort(wanted.begin(), wanted.end(), std::greater<PageKey>());
+	for (PageKey page : wanted)
+	{
+		const auto resident = m_resident.find(page);
+		if (resident != m_resident.end())
+			m_slots[resident->second].lastUsed = m_frame;
+		else
+			Request(page);
+	}
+}
+
+bool VirtualTexture::FindSlot(unsigned& slot)
+{
+	bool found = false;
+	for (unsigned i = 0; i < unsigned(m_slots.size()); ++i)
+	{
+		const Slot& candidate = m_slots[i];
+		if (!candidate.used)
+		{
+			slot = i;
+			return true;
+		}
+		// the coarsest level is never evicted, nor what the last feedback asked for
+		if (int(candidate.page >> 16) == Levels() - 1 || candidate.lastUsed >= m_lastFeedback)
+			continue;
+		if (!found || candidate.lastUsed < m_slots[slot].lastUsed)
+		{
+			slot = i;
+			found = true;
+		}
+	}
+	if (!found)
+		return false;
+
+	m_resident.erase(m_slots[slot].page);
+	m_slots[slot].used = false;
+	++m_stats.evictionsLastFrame;
+	m_tableDirty = true;
+	return true;
+}
+
+void VirtualTexture::Update(GPUReadback& readback)
+{
+	if (!IsLoaded())
+		return;
+
+	m_ring.BeginFrame();
+	m_stats.uploadsLastFrame	= 0;
+	m_stats.evictionsLastFrame	= 0;
+	++m_frame;
+
+	// the feedback of the earlier frames that arrived, the oldest first
+	std::vector<unsigned char> pixels;
+	while (!m_feedback.empty() && readback.Get(m_feedback.front(), pixels))
+	{
+		m_feedback.pop_front();
+		ProcessFeedback(pixels);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_uploads.insert(m_uploads.end(), std::make_move_iterator(m_decoded.begin()), std::make_move_iterator(m_decoded.end()));
+		m_decoded.clear();
+	}
+	// the coarse pages first, as they were asked for
+	std::stable_sort(m_uploads.begin(), m_uploads.end(), [](const Decoded& a, const Decoded& b) { return a.page > b.page; });
+
+	GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_ring.Buffer());
+	size_t done = 0;
+	for (; done < m_uploads.size(); ++done)
+	{
+		const Decoded& page = m_uploads[done];
+		if (page.generation != m_generation)
+			continue;	// of a file loaded before
+		if (page.rgba.empty())
+		{
+			std::cerr << "[VirtualTexture] Error reading page " << (page.page & 255) << ", " << ((page.page >> 8) & 255) << " of level " << (page.page >> 16)
+				<< " of " << m_filename << std::endl;
+			m_loading.erase(page.page);
+			continue;
+		}
+		if (m_ring.Available(4) < GLsizeiptr(page.rgba.size()))
+			break;	// the budget of the frame is spent
+
+		unsigned slot = 0;
+		if (FindSlot(slot))
+			Upload(page, slot);
+		else
+			++m_stats.dropped;	// asked for again by the next feedback if it is still needed
+		m_loading.erase(page.page);
+	}
+	m_uploads.erase(m_uploads.begin(), m_uploads.begin() + done);
+	// the page table and the other uploads pass client memory
+	GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (m_tableDirty)
+		UpdatePageTable();
+
+	m_ring.EndFrame();
+	m_stats.bytesLastFrame	= m_ring.BytesLastFrame();
+	m_stats.resident		= unsigned(m_resident.size());
+	m_stats.loading			= unsigned(m_loading.size());
+}
+
+void VirtualTexture::Upload(const Decoded& page, unsigned slot)
+{
+	const StreamRingBuffer::Chunk chunk = m_ring.Allocate(GLsizeiptr(page.rgba.size()), 4);
+	std::memcpy(chunk.data, page.rgba.data(), page.rgba.size());
+	m_ring.Commit(chunk);
+
+	// the pointer is an offset into the bound unpack buffer
+	const void* offset = reinterpret_cast<const void*>(chunk.offset);
+	const GLint x = GLint(slot % m_cachePages) * m_slotSize, y = GLint(slot / m_cachePages) * m_slotSize;
+	if (GLCaps::Get().directStateAccess)
+		glTextureSubImage2D(m_cache, 0, x, y, m_slotSize, m_slotSize, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+	else
+	{
+		GLState::BindTexture(GL_TEXTURE_2D, m_cache);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, m_slotSize, m_slotSize, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+	}
+
+	m_slots[slot] = { page.page, m_frame, true };
+	m_resident[page.page] = slot;
+	++m_stats.uploadsLastFrame;
+	m_tableDirty = true;
+}
+
+void VirtualTexture::UpdatePageTable()
+{
+	// from the coarsest level down: a page that is not resident takes the entry of its parent
+	for (int level = Levels() - 1; level >= 0; --level)
+	{
+		const int pages = PagesAcross(level);
+		std::vector<unsigned char>& entries = m_table[level];
+		for (int y = 0; y < pages; ++y)
+			for (int x = 0; x < pages; ++x)
+			{
+				unsigned char* entry = &entries[(size_t(y) * pages + x) * 4];
+				const auto resident = m_resident.find(Key(level, x, y));
+				if (resident != m_resident.end())
+				{
+					entry[0] = static_cast<unsigned char>(resident->second % m_cachePages);
+					entry[1] = static_cast<unsigned char>(resident->second / m_cachePages);
+					entry[2] = static_cast<unsigned char>(level);
+					entry[3] = 255;
+				}
+				else if (level + 1 < Levels())
+				{
+					const unsigned char* parent = &m_table[level + 1][(size_t(y / 2) * (pages / 2) + x / 2) * 4];
+					std::copy(parent, parent + 4, entry);
+				}
+				else
+					std::fill(entry, entry + 4, 0);	// nothing yet, the shader shows grey
+			}
+
+		if (GLCaps::Get().directStateAccess)
+			glTextureSubImage2D(m_pageTable, level, 0, 0, pages, pages, GL_RGBA, GL_UNSIGNED_BYTE, entries.data());
+		else
+		{
+			GLState::BindTexture(GL_TEXTURE_2D, m_pageTable);
+			glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, pages, pages, GL_RGBA, GL_UNSIGNED_BYTE, entries.data());
+		}
+	}
+	m_tableDirty = false;
+}
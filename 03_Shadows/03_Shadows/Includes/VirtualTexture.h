@@ -0,0 +1,185 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "BlockCompression.h"
+#include "GPUReadback.h"
+#include "StreamRingBuffer.h"
+
+/*
+
+	VirtualTexture is a software virtual texture: a texture far bigger than what is kept on the
+	GPU, of which only the pages the frame samples are resident. It needs no sparse texture
+	extension, only plain 2D textures, texelFetch and a pixel read back.
+
+	- The texture is cooked into a tiled file (.vtex): its mip levels cut into square pages of
+	  pageSize texels, each with a border of its neighbours' texels so bilinear filtering does
+	  not cross into other pages, stored block compressed (BlockCompression) at fixed offsets.
+	- The physical cache is one RGBA8 texture of cachePages x cachePages page slots.
+	- The page table is an RGBA8 texture with a texel per page of each level (its mip levels):
+	  the slot of the page in the cache and the level of what is in there. A page that is not
+	  resident points to the slot of its closest resident ancestor, so the shader always finds
+	  something, only blurrier.
+	- The shader writes the page it wanted into a feedback target (x, y, level, 255). The app
+	  reads a low resolution copy of it back with GPUReadback (RequestFeedback), and Update()
+	  turns it into requests a frame or two later; worker threads read and decode the pages, and
+	  Update() copies them into the cache through a StreamRingBuffer, within the upload budget,
+	  replacing the least recently used pages when the cache is full.
+
+		virtualTexture.Load("Assets/terrain.png");			// cooks Assets/terrain.vtex the first time
+		...
+		virtualTexture.Update(readback);					// every frame, before the draws
+		program.SetTexture("vtPageTable"_uniform, 1, virtualTexture.PageTable(), SamplerDesc::Nearest());
+		program.SetTexture("vtCache"_uniform, 2, virtualTexture.Cache(), SamplerDesc::Linear());
+		program.SetUniform("vtParams"_uniform, virtualTexture.Params());
+		...
+		virtualTexture.RequestFeedback(readback, framebuffer, GL_COLOR_ATTACHMENT0, width, height);
+
+	The texture is square, a power of two of pages across, at most 256; the coarsest level is a
+	single page, which is always resident.
+
+*/
+class VirtualTexture final
+{
+public:
+	struct Stats
+	{
+		unsigned	pages{};				// of every level, in the file
+		unsigned	resident{};
+		unsigned	slots{};				// of the cache
+		unsigned	requested{};			// distinct pages in the last feedback
+		unsigned	loading{};				// decoded on the workers or waiting for upload
+		unsigned	uploadsLastFrame{};
+		unsigned	evictionsLastFrame{};
+		unsigned	dropped{};				// decoded pages with no slot to go to: every page was in use
+		GLsizeiptr	bytesLastFrame{};
+		size_t		cacheBytes{};
+	};
+
+	// cachePages: the slots across the cache; budget: the bytes uploaded in a frame at most;
+	// workers: reading and decoding threads, 0 for one less than the cores (at most 4)
+	explicit VirtualTexture(GLsizei cachePages = 16, GLsizeiptr budget = 1 << 20, unsigned workers = 0);
+	~VirtualTexture();
+
+	VirtualTexture(const VirtualTexture&)				= delete;
+	VirtualTexture& operator=(const VirtualTexture&)	= delete;
+
+	// image repeated repeat x repeat times, from its .vtex file if it was cooked with the same
+	// parameters already, otherwise Cook() it now; false if neither works
+	bool	Load(const std::string& image, int repeat = 1, GLsizei pageSize = 128, GLsizei border = 4);
+	// cuts the mip chain (MipGenerator) of image repeated repeat x repeat times into pages and saves them to cooked
+	static bool	Cook(const std::string& image, const std::string& cooked, int repeat = 1, GLsizei pageSize = 128, GLsizei border = 4, BlockFormat format = BlockFormat::BC1);
+	void	Clean();
+
+	// reads the feedback of the frame back: a width x height readBuffer of framebuffer, RGBA8;
+	// skipped while earlier requests are still on the way
+	void	RequestFeedback(GPUReadback& readback, GLuint framebuffer, GLenum readBuffer, GLsizei width, GLsizei height);
+	// the feedback that arrived, the decoded pages and the page table; on the render thread, once per frame
+	void	Update(GPUReadback& readback);
+
+	GLuint		PageTable() const { return m_pageTable; }
+	GLuint		Cache() const { return m_cache; }
+	// x: the pages across level 0, y: the page size, z: the border, w: the size of the cache, in texels
+	glm::vec4	Params() const;
+	bool		IsLoaded() const { return m_cache != 0; }
+	const Stats&	GetStats() const { return m_stats; }
+
+private:
+	using PageKey = uint32_t;	// level << 16 | y << 8 | x
+
+	struct Header
+	{
+		char		magic[4];
+		uint32_t	version;
+		uint32_t	size;		// of level 0, in texels
+		uint32_t	pageSize;	// without the border
+		uint32_t	border;
+		uint32_t	levels;
+		uint32_t	format;		// BlockFormat of the pages
+		uint32_t	repeat;		// of the source image
+	};
+
+	struct Slot
+	{
+		PageKey		page;
+		unsigned	lastUsed;	// the frame of the last feedback that asked for it
+		bool		used;		// holds a page
+	};
+
+	struct Job
+	{
+		unsigned	generation;
+		PageKey		page;
+		std::string	filename;
+		uint64_t	offset;
+		GLsizei		size;		// of the page with its border
+		BlockFormat	format;
+	};
+
+	struct Decoded
+	{
+		unsigned					generation;
+		PageKey						page;
+		std::vector<unsigned char>	rgba;	// empty if it could not be read
+	};
+
+	// only the render thread touches these
+	std::string			m_filename;
+	Header				m_header{};
+	GLsizei				m_cachePages;
+	GLsizei				m_slotSize{};		// pageSize + 2 * border
+	GLuint				m_pageTable{};
+	GLuint				m_cache{};
+	StreamRingBuffer	m_ring;
+	GLsizeiptr			m_budget;
+	std::vector<Slot>	m_slots;
+	std::unordered_map<PageKey, unsigned>	m_resident;		// the slot of each resident page
+	std::unordered_set<PageKey>				m_loading;
+	std::vector<Decoded>					m_uploads;		// decoded, waiting for the budget of a frame
+	std::vector<std::vector<unsigned char>>	m_table;		// the levels of the page table, RGBA8
+	bool				m_tableDirty{};
+	std::deque<GPUReadback::Handle>	m_feedback;
+	unsigned			m_frame{};
+	unsigned			m_lastFeedback{};	// the frame the last feedback arrived in: its pages are not evicted
+	unsigned			m_generation{};		// of the loaded file, the pages of an earlier one are dropped
+	Stats				m_stats;
+
+	// shared with the workers, under m_mutex
+	std::mutex					m_mutex;
+	std::condition_variable		m_wake;
+	std::deque<Job>				m_jobs;
+	std::vector<Decoded>		m_decoded;
+	bool						m_stop{};
+
+	std::vector<std::thread>	m_workers;
+
+	void	Work();
+
+	int		Levels() const { return int(m_header.levels); }
+	int		PagesAcross(int level) const { return int(m_header.size / m_header.pageSize) >> level; }
+	size_t	PageBytes() const { return BlockCompression::ImageSize(BlockFormat(m_header.format), m_slotSize, m_slotSize); }
+	uint64_t	PageOffset(PageKey page) const;
+
+	static PageKey	Key(int level, int x, int y) { return PageKey(level) << 16 | PageKey(y) << 8 | PageKey(x); }
+
+	// the pages of a feedback read back: marks them used and queues the missing ones
+	void	ProcessFeedback(const std::vector<unsigned char>& pixels);
+	void	Request(PageKey page);
+	// a slot for a new page: a free one or the least recently used; false if the last feedback uses every page
+	bool	FindSlot(unsigned& slot);
+	void	Upload(const Decoded& page, unsigned slot);
+	void	UpdatePageTable();
+};
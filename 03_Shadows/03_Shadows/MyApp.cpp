@@ -7,72 +7,75 @@
 #include <tuple>
 
 #include "imgui/imgui.h"
+#include "Includes/ProgramBinaryCache.h"
 
 #include "Includes/ObjParser_OGL3.h"
 
-CMyApp::CMyApp(void){}
+CMyApp::CMyApp(void) :
+	m_scenePrograms({	//Shader for drawing geometries
+		{ GL_VERTEX_SHADER, "Shaders/myVert.vert" },
+		{ GL_FRAGMENT_SHADER, "Shaders/myFrag.frag" }
+	},{
+		{ 0, "vs_in_pos" },		// VAO index 0 will be vs_in_pos
+		{ 1, "vs_in_normal" },	// VAO index 1 will be vs_in_normal
+		{ 2, "vs_out_tex0" },	// VAO index 2 will be vs_in_tex0
+	})
+{}
 
 
 CMyApp::~CMyApp(void){}
 
 bool CMyApp::Init()
 {
+	m_initStart = std::chrono::steady_clock::now();
 	glClearColor(0.2f, 0.4f, 0.7f, 1);	// Clear color will be white
-	glEnable(GL_CULL_FACE);				// Drop faces looking backwards
-	glEnable(GL_DEPTH_TEST);			// Enable depth test
 
-	m_program.Init({	//Shader for drawing geometries
-		{ GL_VERTEX_SHADER, "Shaders/myVert.vert" },
-		{ GL_FRAGMENT_SHADER, "Shaders/myFrag.frag" }
-	},{
-		{ 0, "vs_in_pos" },		// VAO index 0 will be vs_in_pos
-		{ 1, "vs_in_normal" },	// VAO index 1 will be vs_in_normal
-		{ 2, "vs_out_tex0" },	// VAO index 2 will be vs_in_tex0
+	// The programs are compiled and linked by the driver while the rest is loaded;
+	// the passes skip their draws until they are ready (see GLState::Apply)
+	m_scenePrograms.SetSetup([](ProgramObject& program) {
+		program.SetUniformBlock<PerObject>("PerObject", PER_OBJECT_BINDING);
+		program.SetUniformBlock<PerFrame>("PerFrame", PER_FRAME_BINDING);
 	});
+	// every variant the UI can switch to, so that toggling a feature does not wait for the compiler
+	for (bool shadows : { true, false })
+		for (bool specular : { true, false })
+			m_scenePrograms.Prepare(SceneDefines(shadows, specular));
 		
-	m_programPostprocess.Init({ // Shadow shader
+	m_programPostprocess.InitAsync({ // Shadow shader
 		{ GL_VERTEX_SHADER,		"Shaders/shadow_map.vert" },
 		{ GL_FRAGMENT_SHADER,	"Shaders/shadow_map.frag" }
 	},{
 		{ 0, "vs_in_pos" }		// Only Position is needed here
 	});
 
-	// Creating VBOs for 
-	ArrayBuffer positions(std::vector<glm::vec3>{
-		glm::vec3(-20, 0, -20), glm::vec3(-20, 0, 20), glm::vec3(20, 0, -20), glm::vec3(20, 0, 20)
-	});
-	ArrayBuffer normals(std::vector<glm::vec3>{
-		glm::vec3(0, 1, 0),     glm::vec3(0, 1, 0),    glm::vec3(0, 1, 0),    glm::vec3(0, 1, 0)
-	});
-	ArrayBuffer texture(std::vector<glm::vec2>{
-		glm::vec2(0, 0),        glm::vec2(0, 1),       glm::vec2(1, 0),       glm::vec2(1, 1)
-	});
-	IndexBuffer indices(std::vector<uint16_t>{0, 1, 2,  2, 1, 3});
+	m_programPostprocess.SetUniformBlock<PerObject>("PerObject", PER_OBJECT_BINDING);
 
-	m_vao.Bind();
-	m_vao.AddAttribute(CreateAttribute<  0, glm::vec3, 0, sizeof(glm::vec3)>, positions);
-	m_vao.AddAttribute(CreateAttribute<  1, glm::vec3, 0, sizeof(glm::vec3)>, normals);
-	m_vao.AddAttribute(CreateAttribute<  2, glm::vec2, 0, sizeof(glm::vec2)>, texture);
-	m_vao.SetIndices(indices);
-	m_vao.Unbind();
+	// Both passes drop faces looking backwards and use the depth test (the defaults of PipelineState)
+	m_shadowPass = PipelineState({ &m_programPostprocess, Mesh::SharedHeap() });
 
-	m_textureMetal.FromFile("Assets/texture.png"); // Load a texture
+	m_textureMetal = m_textures.Request("Assets/texture.png"); // Load a texture, a grey placeholder until it is uploaded
+
+	// The same texture block compressed (cooked to Assets/texture.dds the first time), next to the streamed one
+	if (BlockCompression::IsSupported(BlockFormat::BC1))
+		m_metalBC1 = CompressedTexture::LoadOrCook("Assets/texture.png", BlockFormat::BC1);
+	if (m_metalBC1.IsEmpty() || !m_textureMetalBC1.AttachCompressed(m_metalBC1))
+		m_textureMetalBC1.FromFile("Assets/texture.png");
 
 	m_mesh = ObjParser::parse("Assets/Suzanne.obj"); // Load the monkey mesh
 
-	m_camera.SetProj(45.0f, m_width / m_height, 0.01f, 1000.0f); //Set the camer projection (fow, aspect ratio, near and far clipping distance)
+	BuildStaticScene();
 
-	CreateFrameBuffer(1024, 1024);
+	m_shaderWatcher.Watch("Shaders");
+
+	m_camera.SetProj(45.0f, m_width / m_height, 0.01f, 1000.0f); //Set the camer projection (fow, aspect ratio, near and far clipping distance)
 
 	return true;
 }
 
 void CMyApp::Clean()
 {
-	if (m_frameBufferCreated)	{
-		glDeleteTextures(1, &m_shadow_texture);
-		glDeleteFramebuffers(1, &m_frameBuffer);
-	}
+	m_frameGraph.Clear();
+	SamplerCache::Clear();
 }
 
 void CMyApp::Update()
@@ -81,77 +84,165 @@ void CMyApp::Update()
 	float delta_time = (SDL_GetTicks() - last_time) / 1000.0f;
 	m_camera.Update(delta_time);
 
+	// programs whose files were saved are rebuilt in the background and switched to once they link
+	ProgramObject::ReloadFiles(m_shaderWatcher.Poll());
+
 	last_time = SDL_GetTicks();
 }
 
+// Suzanne (i, j) of the wall swings back and forth, unless i*j == 0
+static glm::mat4 SuzanneWorld(int i, int j, float t)
+{
+	return glm::translate(glm::vec3(4 * i, 4 * (j + 1), sinf(t * 2 * M_PI * i * j)));
+}
+
+void CMyApp::BuildStaticScene()
+{
+	m_staticBatch.Clean();
+
+	// The plane underneath
+	std::vector<Mesh::Vertex> groundVertices = {
+		{ glm::vec3(-20, 0, -20), glm::vec3(0, 1, 0), glm::vec2(0, 0), glm::vec4(1, 0, 0, 1) },
+		{ glm::vec3(-20, 0,  20), glm::vec3(0, 1, 0), glm::vec2(0, 1), glm::vec4(1, 0, 0, 1) },
+		{ glm::vec3( 20, 0, -20), glm::vec3(0, 1, 0), glm::vec2(1, 0), glm::vec4(1, 0, 0, 1) },
+		{ glm::vec3( 20, 0,  20), glm::vec3(0, 1, 0), glm::vec2(1, 1), glm::vec4(1, 0, 0, 1) }
+	};
+	m_staticBatch.Add(groundVertices, { 0, 1, 2,  2, 1, 3 }, glm::mat4(1), { glm::vec4(0.1, 0.9, 0.3, 1), m_textureMetal });
+
+	// The middle row and column of the Suzanne wall do not move
+	for (int i = -1; i <= 1; ++i)
+		for (int j = -1; j <= 1; ++j)
+			if (i * j == 0)
+				m_staticBatch.Add(*m_mesh, SuzanneWorld(i, j, 0), { glm::vec4(1, 0.3, 0.3, 1), m_textureMetal });
+
+	m_staticBatch.Build();
+}
+
+ShaderDefines CMyApp::SceneDefines(bool shadows, bool specular) const
+{
+	ShaderDefines defines;
+	if (shadows)
+		defines.push_back({ "SHADOWS", "" });	// the lookup into the shadow map
+	if (specular)
+		defines.push_back({ "SPECULAR", "" });	// the specular term of the light
+	return defines;
+}
+
+void CMyApp::SetPerObject(const glm::mat4& viewProj, const glm::mat4& world, const glm::vec4& Kd)
+{
+	PerObject data{ viewProj * world, world, glm::transpose(glm::inverse(world)), Kd };
+	m_streamBuffer.BindUniformBlock(PER_OBJECT_BINDING, data);
+}
+
 void CMyApp::DrawScene(const glm::mat4 &viewProj, ProgramObject& program, bool shadowProgram = false)
 {
 	program.Use();
 
-	if (!shadowProgram) {
-		program.SetTexture("textureShadow", 1, m_shadow_texture); // depth values
-		program.SetTexture("texImage", 0, m_textureMetal);
-		program.SetUniform("shadowVP", m_light_mvp); //so we can read the shadow map
-		program.SetUniform("toLight", -m_light_dir);
+	if (!shadowProgram && m_shadows) {
+		const RenderTargetPool::Target& shadowMap = m_frameGraph.GetTarget(m_shadowMap);
+		program.SetTexture("textureShadow"_uniform, 1, shadowMap.texture, SamplerDesc::Nearest()); // depth values
+		program.SetUniform("shadowScale"_uniform, glm::vec2(shadowMap.ScaleX(), shadowMap.ScaleY())); // the pool may give a bigger texture
 	}
 
-	// Drawing the plane underneath
+	// Static objects: already in world space, one draw call per material
 
-	program.SetUniform("MVP", viewProj * glm::mat4(1));
-	if (!shadowProgram) {
-		program.SetUniform("world",   glm::mat4(1));
-		program.SetUniform("worldIT", glm::mat4(1));
-		program.SetUniform("Kd", glm::vec4(0.1, 0.9, 0.3, 1));
-	}
+	m_staticBatch.Draw(viewProj, [&](const StaticBatch::Material& material) {
+		SetPerObject(viewProj, glm::mat4(1), material.Kd);
+		if (!shadowProgram)
+			program.SetTexture("texImage"_uniform, 0, m_textures.Get(material.texture), SamplerDesc::Trilinear(8));
+	});
 
-	m_vao.Bind();
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);	//Draws exactly the same but uses index buffer:
-	//glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr);
-	m_vao.Unbind();
+	// Moving part of the Suzanne wall
 
-	// Suzanne wall
+	if (!shadowProgram)
+		program.SetTexture("texImage"_uniform, 0, m_textureMetalBC1, SamplerDesc::Trilinear(8));
 
 	float t = SDL_GetTicks() / 1000.f;
 	for (int i = -1; i <= 1; ++i)
 		for (int j = -1; j <= 1; ++j)
 		{
-			glm::mat4 suzanneWorld = glm::translate(glm::vec3(4 * i, 4 * (j + 1), sinf(t * 2 * M_PI * i * j)));
-			program.SetUniform("MVP", viewProj * suzanneWorld);
-			if (!shadowProgram) {
-				program.SetUniform("world", suzanneWorld);
-				program.SetUniform("worldIT", glm::transpose(glm::inverse(suzanneWorld)));	// <- how could we simplify this?
-				program.SetUniform("Kd", glm::vec4(1, 0.3, 0.3, 1));
-			}
+			if (i * j == 0)
+				continue; // these are in m_staticBatch
+
+			SetPerObject(viewProj, SuzanneWorld(i, j, t), glm::vec4(1, 0.3, 0.3, 1));
 			m_mesh->draw();
 		}
-	program.Unuse();
+	// no Unuse(): the next DrawScene switches programs anyway
 }
 
 void CMyApp::Render()
 	
 {
-	// 1.
-	// Draw scene to shadow map
-	static glm::ivec2 wh = glm::ivec2(1024);
-	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);	// FBO that has the shadow map attached to it
-	glViewport(0, 0, wh.x, wh.y);						// Set which pixels to render to within this fbo.
-	glClear(GL_DEPTH_BUFFER_BIT);						// Clear depth values
+	m_streamBuffer.BeginFrame();	// waits if the GPU still reads the region of this frame
+	m_textures.Update();			// the decoded textures, as much of them as the upload budget allows
+
 	glm::mat4 light_proj = glm::ortho<float>(-10, 10, -10, 10, -10, 10);
 	glm::mat4 light_view = glm::lookAt<float>(glm::vec3(0,0,0), m_light_dir, glm::vec3(0, 1, 0));
 	m_light_mvp = light_proj * light_view; // This matrix will tell us how to read the distances in the shadow map
-	DrawScene(m_light_mvp, m_programPostprocess, true);
+
+	// The camera and the light, for every pass of the frame
+	PerFrame perFrame;
+	perFrame.shadowVP	= m_light_mvp; //so we can read the shadow map
+	perFrame.eye_pos	= m_camera.GetEye();
+	perFrame.toLight	= -m_light_dir;
+	perFrame.La			= glm::vec4(0.1f, 0.1f, 0.1f, 1);
+	perFrame.Ld			= glm::vec4(0.75f, 0.75f, 0.75f, 1);
+	perFrame.Ls			= glm::vec4(1, 1, 1, 1);
+	m_streamBuffer.BindUniformBlock(PER_FRAME_BINDING, perFrame);
+
+	// How sharp the textures of the frame have to be, from how near their surfaces are: the
+	// streamer brings those levels in and evicts the others first when it is over its budget
+	m_textures.Require(m_textureMetal, m_camera, glm::vec3(0), 28.3f, 1 / 40.0f, m_height);	// the ground, one repeat over 40 units
+	const float t = SDL_GetTicks() / 1000.f;
+	for (int i = -1; i <= 1; ++i)
+		for (int j = -1; j <= 1; ++j)
+			m_textures.Require(m_textureMetal, m_camera, glm::vec3(SuzanneWorld(i, j, t)[3]), 1.5f, 0.5f, m_height);
+
+	// The variant of the scene program with the features of the UI
+	m_program = &m_scenePrograms.Get(SceneDefines(m_shadows, m_specular));
+	if (m_scenePass.GetDesc().program != m_program)
+		m_scenePass = PipelineState({ m_program, Mesh::SharedHeap() });
+
+	// The passes declare what they read and write; the frame graph allocates the shadow map
+	// and binds the framebuffer and sets the viewport of each pass before running it
+	m_frameGraph.Reset();
+	const FrameGraph::Resource backbuffer = m_frameGraph.ImportBackbuffer(m_width, m_height); // default framebuffer
+
+	// 1.
+	// Draw scene to shadow map
+	m_frameGraph.AddPass("Shadow", [&](FrameGraph::Builder& builder) {
+		// only depth values, no color output
+		m_shadowMap = builder.Write(builder.Create("shadow map", { GL_DEPTH_COMPONENT24, m_shadowSize.x, m_shadowSize.y }), GL_DEPTH_ATTACHMENT);
+	}, [&]() {
+		if (!GLState::Apply(m_shadowPass))	// before the clear: glClear respects the depth mask
+			return;							// the program is still being linked
+		glClear(GL_DEPTH_BUFFER_BIT);	// Clear depth values
+		DrawScene(m_light_mvp, m_programPostprocess, true);
+	});
 
 	// 2.
 	// Draw mesh to screen
+	m_frameGraph.AddPass("Scene", [&](FrameGraph::Builder& builder) {
+		if (m_shadows)
+			builder.Read(m_shadowMap);	// otherwise nobody reads the shadow map and its pass is culled
+		builder.Write(backbuffer, GL_BACK);
+	}, [&]() {
+		const bool ready = GLState::Apply(m_scenePass);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);	// clearing the default fbo
+		if (ready)	// otherwise the program is still being linked: the clear color only
+			DrawScene(m_camera.GetViewProj(),*m_program);
+	});
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);				// default framebuffer (the backbuffer)
-	glViewport(0, 0, m_width, m_height);				// We need to set the render area back
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);	// clearing the default fbo
-	DrawScene(m_camera.GetViewProj(),m_program);
+	m_frameGraph.Compile();
+	m_frameGraph.Execute();
+
+	m_streamBuffer.EndFrame();
 
 	// 3.
 	// User Interface
 
+	SamplerCache::Unbind(0); // ImGui draws its textures on unit 0 and relies on their own parameters
+
 	ImGui::ShowTestWindow(); // Demo of all ImGui commands. See its implementation for details.
 	// It's worth browsing imgui.h, as well as reading the FAQ at the beginning of imgui.cpp.
 	// There is no regular documentation, but the things mentioned above should be sufficient.
@@ -162,11 +253,84 @@ void CMyApp::Render()
 		//ImGui::SliderFloat("t", &m_filterWeight, 0, 1);
 		ImGui::SliderFloat3("light_dir", &m_light_dir.x, -1.f, 1.f);
 		m_light_dir = glm::normalize(m_light_dir); // This needs to remain a normalized direction
-		ImGui::Image((ImTextureID)m_shadow_texture, ImVec2(256, 256));
-		if (ImGui::SliderInt("Resolution x", &wh.x, 4, 8096)) {
+		const RenderTargetPool::Target& shadowMap = m_frameGraph.GetTarget(m_shadowMap);
+		ImGui::Image((ImTextureID)shadowMap.texture, ImVec2(256, 256), ImVec2(0, 0), ImVec2(shadowMap.ScaleX(), shadowMap.ScaleY()));
+		ImGui::SliderInt("Resolution x", &m_shadowSize.x, 4, 8096); // the frame graph asks for the new size in the next frame
+		ImGui::Checkbox("Shadows", &m_shadows);		// the next frame uses another variant of the scene program
+		ImGui::Checkbox("Specular", &m_specular);
+	}
+	ImGui::End();
 
-			CreateFrameBuffer(wh.x, wh.y);
+	// the start up ends when the last program is ready: InitAsync() only submits them
+	const double sinceInit = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_initStart).count();
+	if (m_startupMs < 0 && ProgramObject::GetBuildStats().pending == 0)
+		m_startupMs = sinceInit;
+
+	ImGui::Begin("GL state");
+	{
+		const GLState::Counters& counters = GLState::LastFrame();
+		ImGui::Text("Issued: %u, elided: %u, stalls: %u", counters.issued, counters.elided, counters.stalls);
+		ImGui::Text("Uniforms: %u uploaded, %u unchanged", counters.uniformsIssued, counters.uniformsSkipped);
+		const ProgramObject::BuildStats& buildStats = ProgramObject::GetBuildStats();
+		ImGui::Text("Programs: %u linked, %u failed, %u pending, %.0f ms compile wall time, %u reloaded", buildStats.linked, buildStats.failed,
+			buildStats.pending, buildStats.wallMs, buildStats.reloaded);
+		const ProgramBinaryCache::Stats& binaries = ProgramBinaryCache::GetStats();
+		ImGui::Text("Start up: %.0f ms %s, %u programs loaded from binaries, %u built from source (%s, %u refused)",
+			m_startupMs < 0 ? sinceInit : m_startupMs, m_startupMs < 0 ? "so far" : "until every program was ready", binaries.hits, binaries.misses,
+			!ProgramBinaryCache::IsAvailable() ? "no binary cache" : binaries.misses == 0 ? "warm cache" : "cold cache", binaries.rejected);
+		bool validate = GLState::IsValidating();
+		if (ImGui::Checkbox("Validate with glGet", &validate))
+			GLState::SetValidation(validate);
+		if (validate)
+			ImGui::Text("Mismatches: %u", counters.mismatches);
+
+		std::shared_ptr<GeometryHeap> heap = Mesh::SharedHeap();
+		const GeometryHeap::Stats stats = heap->GetStats();
+		ImGui::Separator();
+		ImGui::Text("Geometry heap: %u allocations, %.1f MB", (unsigned)stats.vertices.allocations, (stats.vertexBufferBytes + stats.indexBufferBytes) / 1048576.0);
+		ImGui::Text("Vertices: %u of %u used (%u in blocks), fragmentation %.2f", (unsigned)stats.vertices.requested, (unsigned)stats.vertices.capacity, (unsigned)stats.vertices.allocated, stats.vertexFragmentation);
+		ImGui::Text("Indices: %u of %u used (%u in blocks), fragmentation %.2f", (unsigned)stats.indices.requested, (unsigned)stats.indices.capacity, (unsigned)stats.indices.allocated, stats.indexFragmentation);
+		ImGui::Text("Grown %u times, defragmented %u times", stats.grows, stats.defragmentations);
+		if (ImGui::Button("Defragment"))
+			heap->Defragment();
+
+		ImGui::Separator();
+		const FrameContext::Timing& timing = FrameContext::Average();
+		ImGui::Text("Frames in flight: %u, the CPU waits %.2f ms of %.2f ms%s", FrameContext::FramesInFlight(),
+			timing.waitMs, timing.frameMs, FrameContext::IsGpuBound() ? " (GPU bound)" : "");
+
+		ImGui::Text("Stream buffer (%s%s): %u bytes, %u waits", m_streamBuffer.IsPersistent() ? "persistent" : "orphaning",
+			m_streamBuffer.IsPaced() ? ", per frame" : "", (unsigned)m_streamBuffer.BytesLastFrame(), m_streamBuffer.WaitsLastFrame());
+		const TextureStreamer::Stats& textureStats = m_textures.GetStats();
+		ImGui::Text("Textures: %u of %u resident, %u failed, %u uploads (%u KB) last frame", textureStats.resident, textureStats.requested,
+			textureStats.failed, textureStats.uploadsLastFrame, unsigned(textureStats.bytesLastFrame / 1024));
+		ImGui::Text("Texture memory: %.1f of %.0f MB resident, streaming %.1f MB/s, %u levels (%u KB) evicted, %u starved",
+			textureStats.residentBytes / 1048576.0, textureStats.residentBudget / 1048576.0, textureStats.bytesLastFrame * ImGui::GetIO().Framerate / 1048576.0,
+			textureStats.evictionsLastFrame, unsigned(textureStats.evictedBytesLastFrame / 1024), textureStats.starved);
+		ImGui::Text("Metal texture: level %d resident, level %d needed", m_textures.ResidentLevel(m_textureMetal), m_textures.RequiredLevel(m_textureMetal));
+		if (m_metalBC1.IsEmpty())
+			ImGui::Text("Metal texture, BC1: not supported, the moving Suzannes use the image");
+		else
+		{
+			ImGui::Text("Metal texture, BC1: %d x %d, %u levels, %u KB (%.1f : 1 to RGBA8),", m_metalBC1.levels[0].width, m_metalBC1.levels[0].height,
+				(unsigned)m_metalBC1.levels.size(), unsigned(m_metalBC1.Bytes() / 1024), m_metalBC1.Ratio());
+			ImGui::SameLine();
+			if (m_metalBC1.psnr > 0)
+				ImGui::Text("PSNR %.1f dB", m_metalBC1.psnr);
+			else
+				ImGui::Text("PSNR unknown"); // a .dds that was not cooked here
 		}
+		int textureBudget = int(textureStats.residentBudget >> 20);
+		if (ImGui::SliderInt("Texture budget (MB)", &textureBudget, 0, 256)) // a small one shows the eviction
+			m_textures.SetResidentBudget(size_t(textureBudget) << 20);
+
+		const RenderTargetPool::Stats targetStats = m_frameGraph.Pool().GetStats();
+		ImGui::Text("Render targets: %u (%u in use), %.1f MB, %.0f%% of the texels in use rendered", targetStats.targets, targetStats.inUse,
+			targetStats.bytes / 1048576.0, targetStats.occupancy * 100);
+		if (ImGui::CollapsingHeader("Frame graph"))
+			ImGui::TextUnformatted(m_frameGraph.Dump().c_str());
+		if (ImGui::CollapsingHeader("Scene program variants"))
+			ImGui::TextUnformatted(m_scenePrograms.Dump().c_str());
 	}
 	ImGui::End();
 }
@@ -201,60 +365,11 @@ void CMyApp::MouseWheel(SDL_MouseWheelEvent& wheel)
 // _w and _h are the width and height of the window's size
 void CMyApp::Resize(int _w, int _h)
 {
-	glViewport(0, 0, _w, _h );
+	GLState::Viewport(0, 0, _w, _h );
 
 	m_camera.Resize(_w, _h);
 	m_width = _w;
 	m_height = _h;
 
 	//CreateFrameBuffer(_w, _h); // This FBO has a fixed size!
-}
-
-inline void setTexture2DParameters(GLenum magfilter = GL_LINEAR, GLenum minfilter = GL_LINEAR, GLenum wrap_s = GL_CLAMP_TO_EDGE, GLenum wrap_t = GL_CLAMP_TO_EDGE)
-{
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magfilter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minfilter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
-}
-
-void CMyApp::CreateFrameBuffer(int width, int height)
-{
-	// Clear if the function is not being called for the first time
-	if (m_frameBufferCreated) {
-		glDeleteTextures(1, &m_shadow_texture);
-		glDeleteFramebuffers(1, &m_frameBuffer);
-	}
-
-	glGenFramebuffers(1, &m_frameBuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
-
-	glGenTextures(1, &m_shadow_texture); // Create texture holding the depth components
-	glBindTexture(GL_TEXTURE_2D, m_shadow_texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
-	setTexture2DParameters(GL_NEAREST, GL_NEAREST); //so its shorter
-
-	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_shadow_texture, 0);
-	if (glGetError() != GL_NO_ERROR) {
-		std::cout << "Error creating depth attachment" << std::endl;
-		exit(1);
-	}
-
-	glDrawBuffer(GL_NONE); // No need for any color output!
-	   		
-	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER); // -- Completeness check
-	if (status != GL_FRAMEBUFFER_COMPLETE)	{
-		std::cout << "Incomplete framebuffer (";
-		switch (status) {
-		case GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT:			std::cout << "GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT";		break;
-		case GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT:	std::cout << "GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT";break;
-		case GL_FRAMEBUFFER_UNSUPPORTED:					std::cout << "GL_FRAMEBUFFER_UNSUPPORTED";					break;
-		}
-		std::cout << ")" << std::endl;
-		char ch;std::cin >> ch;
-		exit(1);
-	}
-	
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);	// -- Unbind framebuffer
-	m_frameBufferCreated = true;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 // C++ includes
+#include <chrono>
 #include <memory>
 
 // GLEW
@@ -16,11 +17,21 @@
 #include <glm/gtx/transform2.hpp>
 
 #include "Includes/ProgramObject.h"
+#include "Includes/ShaderWatcher.h"
+#include "Includes/TextureStreamer.h"
+#include "Includes/ProgramPermutations.h"
 #include "Includes/BufferObject.h"
 #include "Includes/VertexArrayObject.h"
 #include "Includes/TextureObject.h"
+#include "Includes/GLState.h"
+#include "Includes/GLCaps.h"
+#include "Includes/StreamRingBuffer.h"
+#include "Includes/FrameContext.h"
+#include "Includes/PipelineState.h"
+#include "Includes/FrameGraph.h"
 
 #include "Includes/Mesh_OGL3.h"
+#include "Includes/StaticBatch.h"
 #include "Includes/gCamera.h"
 
 class CMyApp
@@ -46,28 +57,83 @@ protected:
 	
 	// This function defines the scene now
 	void DrawScene(const glm::mat4& viewProj, ProgramObject& program, bool shadowProgram);
-	
-	// FBO creating function
-	void CreateFrameBuffer(int width, int height);
+
+	// The PerObject uniform block of the shaders (std140)
+	struct PerObject
+	{
+		glm::mat4 MVP;
+		glm::mat4 world;
+		glm::mat4 worldIT;
+		glm::vec4 Kd;
+
+		static constexpr std::array<UniformBlockMember, 4> UniformBlockMembers()
+		{
+			return {{ UNIFORM_BLOCK_MEMBER(PerObject, MVP), UNIFORM_BLOCK_MEMBER(PerObject, world),
+				UNIFORM_BLOCK_MEMBER(PerObject, worldIT), UNIFORM_BLOCK_MEMBER(PerObject, Kd) }};
+		}
+	};
+	static const GLuint PER_OBJECT_BINDING = 0;
+
+	// The PerFrame uniform block of the scene shaders (std140): the camera and the light
+	struct PerFrame
+	{
+		glm::mat4 shadowVP;
+		glm::vec3 eye_pos;	float _pad0;
+		glm::vec3 toLight;	float _pad1;
+		glm::vec4 La;
+		glm::vec4 Ld;
+		glm::vec4 Ls;
+
+		static constexpr std::array<UniformBlockMember, 6> UniformBlockMembers()
+		{
+			return {{ UNIFORM_BLOCK_MEMBER(PerFrame, shadowVP), UNIFORM_BLOCK_MEMBER(PerFrame, eye_pos), UNIFORM_BLOCK_MEMBER(PerFrame, toLight),
+				UNIFORM_BLOCK_MEMBER(PerFrame, La), UNIFORM_BLOCK_MEMBER(PerFrame, Ld), UNIFORM_BLOCK_MEMBER(PerFrame, Ls) }};
+		}
+	};
+	static const GLuint PER_FRAME_BINDING = 1;
+
+	// Streams the PerObject block of the next draw
+	void SetPerObject(const glm::mat4& viewProj, const glm::mat4& world, const glm::vec4& Kd);
+
+	// Collects the objects that never move into m_staticBatch
+	void BuildStaticScene();
+
+	// The defines of the scene program with the features switched on in the UI
+	ShaderDefines SceneDefines(bool shadows, bool specular) const;
 
 	// variables for shaders
-	ProgramObject		m_program;				// basic program for shaders
+	ProgramPermutations	m_scenePrograms;		// basic program for shaders, a variant per feature set
+	ProgramObject*		m_program = nullptr;	// the variant of this frame, see Render
 	ProgramObject		m_programPostprocess;	// posprocess shaderek program
 
-	Texture2D			m_textureMetal;
-	VertexArrayObject	m_vao;
+	PipelineState		m_shadowPass;			// the state of the passes, see Init
+	PipelineState		m_scenePass;
+
+	TextureStreamer		m_textures;				// decodes on worker threads, uploads a few MB per frame and keeps the levels the frame needs, see Render
+	TextureStreamer::Handle	m_textureMetal{};	// the materials of m_staticBatch hold handles of m_textures too
+	CompressedTexture	m_metalBC1;				// the metal texture through CompressedTexture::LoadOrCook, its size and PSNR are in the GL state window
+	Texture2D			m_textureMetalBC1;		// the moving Suzannes: m_metalBC1, or the image itself if BC1 is not supported
 	
 	std::unique_ptr<Mesh>	m_mesh;
+	StaticBatch			m_staticBatch;			// the ground and the Suzannes that stand still
+	StreamRingBuffer	m_streamBuffer;			// per frame data: the PerFrame and PerObject blocks
+	FrameGraph			m_frameGraph;			// the passes of the frame and the shadow map between them, see Render
+	ShaderWatcher		m_shaderWatcher;		// the shader files saved while the app runs, see Update
+	std::chrono::steady_clock::time_point	m_initStart;	// the start up lasts until every program is ready
+	double				m_startupMs = -1;		// -1 while a program is still being built
 
 	gCamera				m_camera;
 	int	m_width = 640, m_height = 480;
 
 	glm::mat4 m_light_mvp;
 	glm::vec3 m_light_dir = glm::normalize(glm::vec3(0,-1,-1));
-		
-	// stuffs for the FBO
-	bool m_frameBufferCreated{ false };
-	GLuint m_shadow_texture;
-	GLuint m_frameBuffer;
+
+	// the shadow map of the current frame, a transient of m_frameGraph
+	glm::ivec2				m_shadowSize{ 1024 };
+	FrameGraph::Resource	m_shadowMap{ FrameGraph::INVALID_RESOURCE };
+
+	// the features of the scene program; switched off, they are not compiled into it
+	bool	m_shadows = true;
+	bool	m_specular = true;
 };
 
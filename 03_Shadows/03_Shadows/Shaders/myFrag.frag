@@ -1,10 +1,12 @@
-#version 130
+#version 140
 
 // per-fragment attributes coming from the pipeline
 in vec3 vs_out_pos;
 in vec3 vs_out_normal;
 in vec2 vs_out_tex0;
+#ifdef SHADOWS
 in vec4 vs_out_lightspace_pos;
+#endif
 
 // output value - the color of the fragment
 out vec4 fs_out_col;
@@ -13,23 +15,19 @@ out vec4 fs_out_col;
 // uniform variables
 //
 
-// scene properties
-uniform vec3 eye_pos = vec3(0, 15, 15);
+#include "per_frame.glsl"
 
-// light properties
-uniform vec3 toLight =normalize(vec3( 0, 20, 20 ));
-
-uniform vec4 La = vec4(0.1f, 0.1f, 0.1f, 1);
-uniform vec4 Ld = vec4(0.75f, 0.75f, 0.75f, 1);
-uniform vec4 Ls = vec4(1, 1, 1, 1);
+#include "per_object.glsl"
 
 // material properties
 uniform vec4 Ka = vec4(1, 1, 1, 0);
-uniform vec4 Kd = vec4(0.75f, 0.25f, 0.125f, 1);
 uniform vec4 Ks = vec4(0, 1, 0, 0);
 uniform float specular_power = 32;
 uniform sampler2D texImage;
+#ifdef SHADOWS
 uniform sampler2D textureShadow;
+uniform vec2 shadowScale = vec2(1); // the used part of the shadow map texture
+#endif
 
 void main()
 {
@@ -62,6 +60,7 @@ void main()
 	*/
 	vec4 specular = vec4(0);
 
+#ifdef SPECULAR
 	if ( di > 0 )
 	{
 		vec3 e = normalize( eye_pos - vs_out_pos );
@@ -69,8 +68,10 @@ void main()
 		float si = pow( clamp( dot(e, r), 0.0f, 1.0f ), specular_power );
 		specular = Ls*Ks*si;
 	}
+#endif
 	vec4 col = (ambient + diffuse + specular ) * texture(texImage, vs_out_tex0.st).rgba;
 
+#ifdef SHADOWS
 	vec3 lightcoords = (0.5*vs_out_lightspace_pos.xyz+0.5)/vs_out_lightspace_pos.w;
 	//vec2 lightuv = 0.5 * lightcoords.xy + 0.5;
 	vec2 lightuv = lightcoords.xy;
@@ -79,7 +80,7 @@ void main()
 	
 	if ( lightuv == clamp(lightuv,0,1))
 	{
-		float nearestToLight = texture(textureShadow, lightuv).x;
+		float nearestToLight = texture(textureShadow, lightuv * shadowScale).x;
 
 		if ( nearestToLight + bias >= lightcoords.z )
 			fs_out_col = col;
@@ -88,5 +89,7 @@ void main()
 	}
 	else
 		fs_out_col = vec4(1,0,0,1);
-
+#else
+	fs_out_col = col;
+#endif
 }
\ No newline at end of file
@@ -1,4 +1,4 @@
-#version 130
+#version 140
 
 in vec3 vs_in_pos;
 in vec3 vs_in_normal;
@@ -7,12 +7,13 @@ in vec2 vs_in_tex0;
 out vec3 vs_out_pos;
 out vec3 vs_out_normal;
 out vec2 vs_out_tex0;
-out vec4 vs_out_lightspace_pos;
+#ifdef SHADOWS
+out vec4 vs_out_lightspace_pos;
+#endif
 
-uniform mat4 world;
-uniform mat4 worldIT;
-uniform mat4 MVP;
-uniform mat4 shadowVP;
+#include "per_object.glsl"
+
+#include "per_frame.glsl"
 
 void main()
 {
@@ -20,5 +21,7 @@ void main()
 	vs_out_pos     = (world   * vec4( vs_in_pos,   1)).xyz;
 	vs_out_normal  = (worldIT * vec4(vs_in_normal, 0)).xyz;
 	vs_out_tex0    = vs_in_tex0;
+#ifdef SHADOWS
 	vs_out_lightspace_pos	  = shadowVP*vec4(vs_out_pos, 1);
+#endif
 }
\ No newline at end of file
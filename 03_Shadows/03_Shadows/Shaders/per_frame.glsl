@@ -0,0 +1,10 @@
+// the camera and the light, streamed by the application once per frame
+layout(std140) uniform PerFrame
+{
+	mat4 shadowVP;
+	vec3 eye_pos;
+	vec3 toLight;
+	vec4 La;
+	vec4 Ld;
+	vec4 Ls;
+};
@@ -0,0 +1,8 @@
+// per object data, streamed by the application through a ring buffer
+layout(std140) uniform PerObject
+{
+	mat4 MVP;
+	mat4 world;
+	mat4 worldIT;
+	vec4 Kd;
+};
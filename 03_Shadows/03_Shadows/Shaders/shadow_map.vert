@@ -1,7 +1,7 @@
-#version 130
+#version 140
 
 in vec3 vs_in_pos;
-uniform mat4 MVP;
+#include "per_object.glsl"
 
 void main()
 {
@@ -15,6 +15,8 @@
 
 // In this project
 #include "Includes/GLDebugMessageCallback.h"
+#include "Includes/GLState.h"
+#include "Includes/FrameContext.h"
 #include "MyApp.h"
 
 void exitProgram()
@@ -149,6 +151,9 @@ int main(int argc, char* args[])
 	//Imgui init
 	ImGui_ImplSdlGL3_Init(win);
 
+	// The CPU may record this many frames before it waits for the GPU
+	FrameContext::Init(2);
+
 	//
 	// Step 4: Start the event loop
 	// 
@@ -217,11 +222,15 @@ int main(int argc, char* args[])
 
 			}
 			ImGui_ImplSdlGL3_NewFrame(win); //After this we can call imgui commands until ImGui::Render()
+			FrameContext::BeginFrame();		// waits if the GPU is FramesInFlight() frames behind
+			GLState::NewFrame();			// the counters of the frame, the cache is kept
 
 			app.Update();
 			app.Render();
 			ImGui::Render();
+			GLState::InvalidateDrawState();	// ImGui changed GL state behind the cache
 
+			FrameContext::EndFrame();
 			SDL_GL_SwapWindow(win);
 		}
 
@@ -232,6 +241,7 @@ int main(int argc, char* args[])
 	//
 	// Step 4: exit
 	// 
+	FrameContext::Shutdown();
 	ImGui_ImplSdlGL3_Shutdown();
 	SDL_GL_DeleteContext(context);
 	SDL_DestroyWindow(win);
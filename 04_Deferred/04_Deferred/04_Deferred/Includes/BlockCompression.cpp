@@ -0,0 +1,446 @@
+#include "BlockCompression.h"
+#include "GLCaps.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define BLOCKCOMPRESSION_SSE2
+#endif
+
+namespace
+{
+	const size_t BLOCK_ROWS_PER_TASK = 4;
+
+	// the 16 texels of a block, channel by channel (structure of arrays), 0..255
+	struct Block
+	{
+		alignas(16) float r[16];
+		alignas(16) float g[16];
+		alignas(16) float b[16];
+		alignas(16) float a[16];
+	};
+
+	// the block at (bx, by) in blocks; the texels outside the image repeat the edge ones
+	void LoadBlock(const unsigned char* rgba, int width, int height, int bx, int by, Block& block)
+	{
+		for (int y = 0; y < 4; ++y)
+			for (int x = 0; x < 4; ++x)
+			{
+				const int sx = std::min(bx * 4 + x, width - 1);
+				const int sy = std::min(by * 4 + y, height - 1);
+				const unsigned char* texel = rgba + (size_t(sy) * width + sx) * 4;
+				block.r[y * 4 + x] = texel[0];
+				block.g[y * 4 + x] = texel[1];
+				block.b[y * 4 + x] = texel[2];
+				block.a[y * 4 + x] = texel[3];
+			}
+	}
+
+	std::uint16_t To565(float r, float g, float b)
+	{
+		auto quantize = [](float value, int maximum) { return unsigned(std::lround(std::min(255.0f, std::max(0.0f, value)) * maximum / 255.0f)); };
+		return std::uint16_t((quantize(r, 31) << 11) | (quantize(g, 63) << 5) | quantize(b, 31));
+	}
+
+	void From565(std::uint16_t color, float rgb[3])
+	{
+		const unsigned r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+		rgb[0] = float((r << 3) | (r >> 2));
+		rgb[1] = float((g << 2) | (g >> 4));
+		rgb[2] = float((b << 3) | (b >> 2));
+	}
+
+	// the four colors of a block in 4 color mode: the endpoints, then 2/3 and 1/3 of the way from c0
+	void Palette(std::uint16_t c0, std::uint16_t c1, float palette[4][3])
+	{
+		From565(c0, palette[0]);
+		From565(c1, palette[1]);
+		for (int c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+	}
+
+	// the nearest palette color of every texel; returns the sum of the squared errors
+	float PickIndices(const Block& block, const float palette[4][3], unsigned char indices[16])
+	{
+#ifdef BLOCKCOMPRESSION_SSE2
+		__m128 total = _mm_setzero_ps();
+		for (int i = 0; i < 16; i += 4)
+		{
+			const __m128 r = _mm_load_ps(block.r + i), g = _mm_load_ps(block.g + i), b = _mm_load_ps(block.b + i);
+			__m128 best = _mm_set1_ps(1e30f);
+			__m128i bestIndex = _mm_setzero_si128();
+			for (int p = 0; p < 4; ++p)
+			{
+				const __m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[p][0]));
+				const __m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[p][1]));
+				const __m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[p][2]));
+				const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+				const __m128i closer = _mm_castps_si128(_mm_cmplt_ps(distance, best));
+				best = _mm_min_ps(distance, best);
+				bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(p)), _mm_andnot_si128(closer, bestIndex));
+			}
+			total = _mm_add_ps(total, best);
+
+			alignas(16) std::int32_t lanes[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(lanes), bestIndex);
+			for (int lane = 0; lane < 4; ++lane)
+				indices[i + lane] = static_cast<unsigned char>(lanes[lane]);
+		}
+		alignas(16) float sums[4];
+		_mm_store_ps(sums, total);
+		return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+		float total = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			float best = 1e30f;
+			for (int p = 0; p < 4; ++p)
+			{
+				const float dr = block.r[i] - palette[p][0], dg = block.g[i] - palette[p][1], db = block.b[i] - palette[p][2];
+				const float distance = dr * dr + dg * dg + db * db;
+				if (distance < best)
+				{
+					best = distance;
+					indices[i] = static_cast<unsigned char>(p);
+				}
+			}
+			total += best;
+		}
+		return total;
+#endif
+	}
+
+	float Evaluate(const Block& block, std::uint16_t c0, std::uint16_t c1, unsigned char indices[16])
+	{
+		float palette[4][3];
+		Palette(c0, c1, palette);
+		return PickIndices(block, palette, indices);
+	}
+
+	// the endpoints that fit the texels best with the given indices (least squares); false if they cannot be solved for
+	bool Refit(const Block& block, const unsigned char indices[16], float e0[3], float e1[3])
+	{
+		static const float WEIGHT[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };	// of c0, per index
+
+		float aa = 0, ab = 0, bb = 0, ax[3] = {}, bx[3] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			const float w = WEIGHT[indices[i]], v = 1 - w;
+			const float texel[3] = { block.r[i], block.g[i], block.b[i] };
+			aa += w * w;
+			ab += w * v;
+			bb += v * v;
+			for (int c = 0; c < 3; ++c)
+			{
+				ax[c] += w * texel[c];
+				bx[c] += v * texel[c];
+			}
+		}
+
+		const float determinant = aa * bb - ab * ab;
+		if (std::fabs(determinant) < 1e-6f)
+			return false;
+		for (int c = 0; c < 3; ++c)
+		{
+			e0[c] = (bb * ax[c] - ab * bx[c]) / determinant;
+			e1[c] = (aa * bx[c] - ab * ax[c]) / determinant;
+		}
+		return true;
+	}
+
+	// a BC1 color block in 4 color mode, to out[0..7]
+	void EncodeColor(const Block& block, unsigned char out[8])
+	{
+		float mean[3] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			mean[0] += block.r[i] / 16;
+			mean[1] += block.g[i] / 16;
+			mean[2] += block.b[i] / 16;
+		}
+
+		// the principal axis of the colors: power iteration on the covariance matrix
+		float covariance[6] = {};	// rr rg rb gg gb bb
+		for (int i = 0; i < 16; ++i)
+		{
+			const float r = block.r[i] - mean[0], g = block.g[i] - mean[1], b = block.b[i] - mean[2];
+			covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+			covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+		}
+		float axis[3] = { 1, 1, 1 };
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			const float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+			const float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+			const float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+			const float length = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+			if (length < 1e-6f)
+				break; // a flat block: any axis will do
+			axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+		}
+		const float axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		for (float& component : axis)
+			component /= axisLength;
+
+		float lowest = 1e30f, highest = -1e30f;
+		for (int i = 0; i < 16; ++i)
+		{
+			const float t = (block.r[i] - mean[0]) * axis[0] + (block.g[i] - mean[1]) * axis[1] + (block.b[i] - mean[2]) * axis[2];
+			lowest = std::min(lowest, t);
+			highest = std::max(highest, t);
+		}
+		// the extremes are rarely hit exactly: pull the endpoints in a little
+		const float inset = (highest - lowest) / 16;
+		highest -= inset;
+		lowest += inset;
+
+		std::uint16_t c0 = To565(mean[0] + axis[0] * highest, mean[1] + axis[1] * highest, mean[2] + axis[2] * highest);
+		std::uint16_t c1 = To565(mean[0] + axis[0] * lowest, mean[1] + axis[1] * lowest, mean[2] + axis[2] * lowest);
+		unsigned char indices[16];
+		float error = Evaluate(block, c0, c1, indices);
+
+		float e0[3], e1[3];
+		if (Refit(block, indices, e0, e1))
+		{
+			const std::uint16_t r0 = To565(e0[0], e0[1], e0[2]), r1 = To565(e1[0], e1[1], e1[2]);
+			unsigned char refitIndices[16];
+			const float refitError = Evaluate(block, r0, r1, refitIndices);
+			if (refitError < error)
+			{
+				c0 = r0;
+				c1 = r1;
+				error = refitError;
+				std::memcpy(indices, refitIndices, sizeof(indices));
+			}
+		}
+
+		// 4 color mode needs c0 > c1; with c0 == c1 every texel takes c0
+		if (c0 < c1)
+		{
+			std::swap(c0, c1);
+			static const unsigned char SWAPPED[4] = { 1, 0, 3, 2 };
+			for (unsigned char& index : indices)
+				index = SWAPPED[index];
+		}
+		else if (c0 == c1)
+			std::memset(indices, 0, sizeof(indices));
+
+		std::uint32_t bits = 0;
+		for (int i = 0; i < 16; ++i)
+			bits |= std::uint32_t(indices[i]) << (2 * i);
+		out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+		out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+		for (int i = 0; i < 4; ++i)
+			out[4 + i] = (bits >> (8 * i)) & 0xFF;
+	}
+
+	// a BC4 block of 16 values in 8 value mode, to out[0..7]
+	void EncodeChannel(const float values[16], unsigned char out[8])
+	{
+		float lowest = 255, highest = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			lowest = std::min(lowest, values[i]);
+			highest = std::max(highest, values[i]);
+		}
+		const int r0 = int(std::lround(highest)), r1 = int(std::lround(lowest));
+		out[0] = static_cast<unsigned char>(r0);
+		out[1] = static_cast<unsigned char>(r1);
+
+		std::uint64_t bits = 0;
+		if (r0 > r1)
+		{
+			// index 0 and 1 are the endpoints, 2..7 the steps from r0 towards r1
+			float palette[8] = { float(r0), float(r1) };
+			for (int i = 2; i < 8; ++i)
+				palette[i] = ((8 - i) * r0 + (i - 1) * r1) / 7.0f;
+
+			for (int i = 0; i < 16; ++i)
+			{
+				int best = 0;
+				for (int p = 1; p < 8; ++p)
+					if (std::fabs(values[i] - palette[p]) < std::fabs(values[i] - palette[best]))
+						best = p;
+				bits |= std::uint64_t(best) << (3 * i);
+			}
+		}
+		for (int i = 0; i < 6; ++i)
+			out[2 + i] = (bits >> (8 * i)) & 0xFF;
+	}
+
+	void DecodeColor(const unsigned char in[8], bool alwaysFourColors, unsigned char rgba[16][4])
+	{
+		const std::uint16_t c0 = std::uint16_t(in[0] | (in[1] << 8)), c1 = std::uint16_t(in[2] | (in[3] << 8));
+		float palette[4][3];
+		Palette(c0, c1, palette);
+		float alpha[4] = { 255, 255, 255, 255 };
+		if (c0 <= c1 && !alwaysFourColors)
+		{
+			// 3 color mode: the middle and transparent black
+			for (int c = 0; c < 3; ++c)
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+			alpha[3] = 0;
+		}
+
+		const std::uint32_t bits = std::uint32_t(in[4]) | (std::uint32_t(in[5]) << 8) | (std::uint32_t(in[6]) << 16) | (std::uint32_t(in[7]) << 24);
+		for (int i = 0; i < 16; ++i)
+		{
+			const unsigned index = (bits >> (2 * i)) & 3;
+			for (int c = 0; c < 3; ++c)
+				rgba[i][c] = static_cast<unsigned char>(std::lround(palette[index][c]));
+			rgba[i][3] = static_cast<unsigned char>(alpha[index]);
+		}
+	}
+
+	void DecodeChannel(const unsigned char in[8], unsigned char rgba[16][4], int channel)
+	{
+		const int r0 = in[0], r1 = in[1];
+		float palette[8] = { float(r0), float(r1) };
+		if (r0 > r1)
+			for (int i = 2; i < 8; ++i)
+				palette[i] = ((8 - i) * r0 + (i - 1) * r1) / 7.0f;
+		else
+		{
+			for (int i = 2; i < 6; ++i)
+				palette[i] = ((6 - i) * r0 + (i - 1) * r1) / 5.0f;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		std::uint64_t bits = 0;
+		for (int i = 0; i < 6; ++i)
+			bits |= std::uint64_t(in[2 + i]) << (8 * i);
+		for (int i = 0; i < 16; ++i)
+			rgba[i][channel] = static_cast<unsigned char>(std::lround(palette[(bits >> (3 * i)) & 7]));
+	}
+}
+
+size_t BlockCompression::BlockSize(BlockFormat format)
+{
+	return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+size_t BlockCompression::ImageSize(BlockFormat format, int width, int height)
+{
+	return size_t(std::max(1, (width + 3) / 4)) * size_t(std::max(1, (height + 3) / 4)) * BlockSize(format);
+}
+
+GLenum BlockCompression::GLFormat(BlockFormat format, bool srgb)
+{
+	switch (format)
+	{
+	case BlockFormat::BC1:	return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case BlockFormat::BC3:	return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case BlockFormat::BC4:	return GL_COMPRESSED_RED_RGTC1;
+	case BlockFormat::BC5:	return GL_COMPRESSED_RG_RGTC2;
+	case BlockFormat::BC7:	return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+	return GL_NONE;
+}
+
+bool BlockCompression::IsSupported(BlockFormat format)
+{
+	const GLCaps& caps = GLCaps::Get();
+	switch (format)
+	{
+	case BlockFormat::BC1: case BlockFormat::BC3:	return caps.textureCompressionS3TC;
+	case BlockFormat::BC4: case BlockFormat::BC5:	return caps.textureCompressionRGTC;
+	case BlockFormat::BC7:							return caps.textureCompressionBPTC;
+	}
+	return false;
+}
+
+std::vector<unsigned char> BlockCompression::Encode(const unsigned char* rgba, int width, int height, BlockFormat format)
+{
+	if (!CanEncode(format) || width <= 0 || height <= 0)
+		return {};
+
+	const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	const size_t blockSize = BlockSize(format);
+	std::vector<unsigned char> blocks(size_t(blocksX) * blocksY * blockSize);
+
+	ParallelFor(0, size_t(blocksY), BLOCK_ROWS_PER_TASK, [&](size_t first, size_t last) {
+		Block block;
+		for (size_t by = first; by < last; ++by)
+			for (int bx = 0; bx < blocksX; ++bx)
+			{
+				LoadBlock(rgba, width, height, bx, int(by), block);
+				unsigned char* out = blocks.data() + (by * blocksX + bx) * blockSize;
+				switch (format)
+				{
+				case BlockFormat::BC1:	EncodeColor(block, out);									break;
+				case BlockFormat::BC3:	EncodeChannel(block.a, out); EncodeColor(block, out + 8);	break;
+				case BlockFormat::BC4:	EncodeChannel(block.r, out);								break;
+				case BlockFormat::BC5:	EncodeChannel(block.r, out); EncodeChannel(block.g, out + 8);	break;
+				case BlockFormat::BC7:	break;
+				}
+			}
+	});
+	return blocks;
+}
+
+std::vector<unsigned char> BlockCompression::Decode(const unsigned char* blocks, int width, int height, BlockFormat format)
+{
+	std::vector<unsigned char> rgba(size_t(width) * height * 4, 0);
+	if (format == BlockFormat::BC7)
+		return rgba;
+
+	const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	const size_t blockSize = BlockSize(format);
+	for (int by = 0; by < blocksY; ++by)
+		for (int bx = 0; bx < blocksX; ++bx)
+		{
+			const unsigned char* in = blocks + (size_t(by) * blocksX + bx) * blockSize;
+			unsigned char texels[16][4] = {};
+			for (auto& texel : texels)
+				texel[3] = 255;
+			switch (format)
+			{
+			case BlockFormat::BC1:	DecodeColor(in, false, texels);									break;
+			case BlockFormat::BC3:	DecodeColor(in + 8, true, texels); DecodeChannel(in, texels, 3);	break;
+			case BlockFormat::BC4:	DecodeChannel(in, texels, 0);									break;
+			case BlockFormat::BC5:	DecodeChannel(in, texels, 0); DecodeChannel(in + 8, texels, 1);	break;
+			case BlockFormat::BC7:	break;
+			}
+
+			for (int y = 0; y < 4 && by * 4 + y < height; ++y)
+				for (int x = 0; x < 4 && bx * 4 + x < width; ++x)
+					std::memcpy(&rgba[((size_t(by) * 4 + y) * width + bx * 4 + x) * 4], texels[y * 4 + x], 4);
+		}
+	return rgba;
+}
+
+double BlockCompression::PSNR(const unsigned char* rgbaA, const unsigned char* rgbaB, int width, int height, BlockFormat format)
+{
+	int channels = 3;
+	switch (format)
+	{
+	case BlockFormat::BC1:							channels = 3; break;
+	case BlockFormat::BC3: case BlockFormat::BC7:	channels = 4; break;
+	case BlockFormat::BC4:							channels = 1; break;
+	case BlockFormat::BC5:							channels = 2; break;
+	}
+
+	double squaredError = 0;
+	const size_t texels = size_t(width) * height;
+	for (size_t i = 0; i < texels; ++i)
+		for (int c = 0; c < channels; ++c)
+		{
+			const double difference = double(rgbaA[i * 4 + c]) - double(rgbaB[i * 4 + c]);
+			squaredError += difference * difference;
+		}
+
+	const double meanSquaredError = squaredError / (double(texels) * channels);
+	return meanSquaredError > 0 ? 10 * std::log10(255.0 * 255.0 / meanSquaredError) : 99.0;
+}
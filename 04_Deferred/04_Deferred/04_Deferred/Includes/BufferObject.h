@@ -6,6 +6,9 @@
 #include <vector>
 
 #include "GLconversions.hpp"
+#include "GLCaps.h"
+#include "GLState.h"
+#include "GPUReadback.h"
 
 /*
 	BufferType is an enum class that stands for OpenGL bind targets (from https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/glBufferData.xhtml - OpenGL 4.6)
@@ -77,17 +80,25 @@ public:
 	BufferObject& operator=(const T& pArr);
 
 	// returns a read-only copy of the buffer contents as an std::vector
+	// synchronous: waits for the GPU to finish with the buffer, prefer ReadAsync()
 	template <typename T>
 	operator std::vector<T>() const;
 
 	// returns a read-only copy of the buffer contents as an array
+	// synchronous: waits for the GPU to finish with the buffer, prefer ReadAsync()
 	template <typename T, size_t N>
 	operator std::array<T, N>() const;
 
+	// starts copying the buffer contents back, fetch them from readback a few frames later
+	GPUReadback::Handle ReadAsync(GPUReadback& readback) const;
+
 private:
 	GLuint m_id{};
 	GLsizeiptr m_sizeInBytes{};
-	static GLuint g_lastBound;
+
+	// binds for uploads and read backs: these must not change the index buffer of whatever VAO is bound
+	// (not used with direct state access, the buffer is edited by name then)
+	inline void BindForEdit() const;
 };
 
 #include "BufferObject.inl"
@@ -3,13 +3,13 @@
 #include <GL/glew.h>
 #include <GL/gl.h>
 
-template <BufferType target, BufferUsage usage>
-GLuint BufferObject<target, usage>::g_lastBound = 0;
-
 template<BufferType target, BufferUsage usage>
 inline BufferObject<target, usage>::BufferObject()
 {
-	glGenBuffers(1, &m_id);
+	if (GLCaps::Get().directStateAccess)
+		glCreateBuffers(1, &m_id);
+	else
+		glGenBuffers(1, &m_id);
 }
 
 template<BufferType target, BufferUsage usage>
@@ -25,7 +25,7 @@ inline void BufferObject<target, usage>::Clean()
 {
 	if (m_id != 0 && m_sizeInBytes != 0)
 	{
-		glDeleteBuffers(1, &m_id);
+		GLState::DeleteBuffers(1, &m_id);
 	}
 }
 
@@ -54,37 +54,42 @@ inline BufferObject<target, usage> & BufferObject<target, usage>::operator=(Buff
 template<BufferType target, BufferUsage usage>
 inline void BufferObject<target, usage>::BufferData(GLsizeiptr pSize, const GLvoid * pSource)
 {
-	Bind();
-
-	glBufferData(static_cast<GLenum>(target), pSize, pSource, static_cast<GLenum>(usage) );
+	if (GLCaps::Get().directStateAccess)
+		glNamedBufferData(m_id, pSize, pSource, static_cast<GLenum>(usage));
+	else
+	{
+		BindForEdit();
+		glBufferData(static_cast<GLenum>(target), pSize, pSource, static_cast<GLenum>(usage) );
+	}
 	m_sizeInBytes = pSize;
 }
 
 template<BufferType target, BufferUsage usage>
 inline void BufferObject<target, usage>::BufferSubData(GLintptr pOffset, GLsizeiptr pSize, const GLvoid * pSource)
 {
-	Bind();
-
-	glBufferSubData(static_cast<GLenum>(target), pOffset, pSize, pSource);
+	if (GLCaps::Get().directStateAccess)
+		glNamedBufferSubData(m_id, pOffset, pSize, pSource);
+	else
+	{
+		BindForEdit();
+		glBufferSubData(static_cast<GLenum>(target), pOffset, pSize, pSource);
+	}
 	m_sizeInBytes = pSize;
 }
 
-#include <iostream>
-
 template<BufferType target, BufferUsage usage>
 inline void BufferObject<target, usage>::Bind() const
 {
-	glBindBuffer(static_cast<GLenum>(target), m_id);
-	/*
+	GLState::BindBuffer(static_cast<GLenum>(target), m_id);
+}
+
+template<BufferType target, BufferUsage usage>
+inline void BufferObject<target, usage>::BindForEdit() const
+{
 	if (target == BufferType::ElementArray)
-		std::cout << "last = " << g_lastBound << ", mine = " << m_id << "\n";
+		GLState::BindVertexArray(0);
 
-	if (g_lastBound != m_id)
-	{		
-		glBindBuffer(static_cast<GLenum>(target), m_id);
-		g_lastBound = m_id;
-	}
-	*/
+	Bind();
 }
 
 template<BufferType target, BufferUsage usage>
@@ -123,14 +128,20 @@ template<BufferType target, BufferUsage usage>
 template<typename T>
 inline BufferObject<target, usage>::operator std::vector<T>() const
 {
-	Bind();
+	GLState::CountStall();
+	const bool dsa = GLCaps::Get().directStateAccess;
+	if (!dsa)
+		BindForEdit();
 
-	T* ptr = static_cast<T*>(glMapBuffer(static_cast<GLenum>(target), GL_READ_ONLY));
+	T* ptr = static_cast<T*>(dsa ? glMapNamedBuffer(m_id, GL_READ_ONLY) : glMapBuffer(static_cast<GLenum>(target), GL_READ_ONLY));
 
 	std::vector<T> ret{};
 	ret.assign(ptr, ptr + m_sizeInBytes / sizeof(T));
 
-	glUnmapBuffer(static_cast<GLenum>(target));
+	if (dsa)
+		glUnmapNamedBuffer(m_id);
+	else
+		glUnmapBuffer(static_cast<GLenum>(target));
 
 	return ret;
 }
@@ -139,9 +150,12 @@ template<BufferType target, BufferUsage usage>
 template<typename T, size_t N>
 inline BufferObject<target, usage>::operator std::array<T, N>() const
 {
-	Bind();
+	GLState::CountStall();
+	const bool dsa = GLCaps::Get().directStateAccess;
+	if (!dsa)
+		BindForEdit();
 
-	T* ptr = static_cast<T*>(glMapBuffer(static_cast<GLenum>(target), GL_READ_ONLY));
+	T* ptr = static_cast<T*>(dsa ? glMapNamedBuffer(m_id, GL_READ_ONLY) : glMapBuffer(static_cast<GLenum>(target), GL_READ_ONLY));
 
 	std::array<T, N> ret{};
 	const size_t elementCount = m_sizeInBytes / sizeof(T);
@@ -151,7 +165,16 @@ inline BufferObject<target, usage>::operator std::array<T, N>() const
 	else
 		std::copy(ptr, ptr + m_sizeInBytes / sizeof(T), ret.begin());
 
-	glUnmapBuffer(static_cast<GLenum>(target));
+	if (dsa)
+		glUnmapNamedBuffer(m_id);
+	else
+		glUnmapBuffer(static_cast<GLenum>(target));
 
 	return ret;
 }
+
+template<BufferType target, BufferUsage usage>
+inline GPUReadback::Handle BufferObject<target, usage>::ReadAsync(GPUReadback& readback) const
+{
+	return readback.ReadBuffer(m_id, 0, m_sizeInBytes);
+}
@@ -0,0 +1,340 @@
+#include "CompressedTexture.h"
+
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	constexpr std::uint32_t FourCC(char a, char b, char c, char d)
+	{
+		return std::uint32_t(std::uint8_t(a)) | (std::uint32_t(std::uint8_t(b)) << 8) | (std::uint32_t(std::uint8_t(c)) << 16) | (std::uint32_t(std::uint8_t(d)) << 24);
+	}
+
+	// DDS_HEADER after the "DDS " magic, with its DDS_PIXELFORMAT inlined
+	struct DDSHeader
+	{
+		std::uint32_t	size;			// 124
+		std::uint32_t	flags;
+		std::uint32_t	height;
+		std::uint32_t	width;
+		std::uint32_t	pitchOrLinearSize;
+		std::uint32_t	depth;
+		std::uint32_t	mipMapCount;
+		std::uint32_t	reserved1[11];
+		std::uint32_t	pfSize;			// 32
+		std::uint32_t	pfFlags;
+		std::uint32_t	pfFourCC;
+		std::uint32_t	pfRGBBitCount;
+		std::uint32_t	pfMasks[4];
+		std::uint32_t	caps;
+		std::uint32_t	caps2;
+		std::uint32_t	caps3;
+		std::uint32_t	caps4;
+		std::uint32_t	reserved2;
+	};
+	static_assert(sizeof(DDSHeader) == 124, "DDS_HEADER is 124 bytes");
+
+	// DDS_HEADER_DXT10, after DDSHeader when the FourCC is "DX10"
+	struct DDSHeaderDX10
+	{
+		std::uint32_t	dxgiFormat;
+		std::uint32_t	resourceDimension;
+		std::uint32_t	miscFlag;
+		std::uint32_t	arraySize;
+		std::uint32_t	miscFlags2;
+	};
+
+	const std::uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+	const std::uint32_t DDPF_FOURCC = 0x4;
+	const std::uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+	const std::uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE2D = 3;
+
+	// Cook() keeps the PSNR in the last two reserved fields of the header: this tag, then the PSNR in 1/1000 dB
+	const std::uint32_t PSNR_TAG = 0x524e5350;	// "PSNR"
+
+	struct FormatCode
+	{
+		BlockFormat		format;
+		bool			srgb;
+		std::uint32_t	dxgi;		// DXGI_FORMAT
+		std::uint32_t	vulkan;		// VkFormat, the one KTX2 uses
+	};
+
+	const FormatCode FORMAT_CODES[] = {
+		{ BlockFormat::BC1, false,	71, 131 },	// BC1_RGB_UNORM_BLOCK
+		{ BlockFormat::BC1, true,	72, 132 },
+		{ BlockFormat::BC1, false,	71, 133 },	// BC1_RGBA: the same blocks
+		{ BlockFormat::BC1, true,	72, 134 },
+		{ BlockFormat::BC3, false,	77, 137 },
+		{ BlockFormat::BC3, true,	78, 138 },
+		{ BlockFormat::BC4, false,	80, 139 },
+		{ BlockFormat::BC5, false,	83, 141 },
+		{ BlockFormat::BC7, false,	98, 145 },
+		{ BlockFormat::BC7, true,	99, 146 },
+	};
+
+	const char* FormatName(BlockFormat format)
+	{
+		static const char* NAMES[] = { "BC1", "BC3", "BC4", "BC5", "BC7" };
+		return NAMES[static_cast<int>(format)];
+	}
+
+	std::vector<unsigned char> ReadFile(const std::string& filename)
+	{
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		if (!file)
+			return {};
+		std::vector<unsigned char> bytes(size_t(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+		return file ? bytes : std::vector<unsigned char>();
+	}
+
+	// the levels of a width x height texture of format, one after the other from data; false if it is too short
+	bool CutLevels(const unsigned char* data, size_t size, BlockFormat format, GLsizei width, GLsizei height, unsigned levelCount, std::vector<CompressedTexture::Level>& levels)
+	{
+		levels.clear();
+		for (unsigned level = 0; level < std::max(1u, levelCount); ++level)
+		{
+			const GLsizei w = std::max(1, width >> level), h = std::max(1, height >> level);
+			const size_t levelSize = BlockCompression::ImageSize(format, w, h);
+			if (levelSize > size)
+				return false;
+			levels.push_back({ w, h, std::vector<unsigned char>(data, data + levelSize) });
+			data += levelSize;
+			size -= levelSize;
+		}
+		return true;
+	}
+}
+
+size_t CompressedTexture::Bytes() const
+{
+	size_t bytes = 0;
+	for (const Level& level : levels)
+		bytes += level.data.size();
+	return bytes;
+}
+
+double CompressedTexture::Ratio() const
+{
+	size_t rgba = 0;
+	for (const Level& level : levels)
+		rgba += size_t(level.width) * level.height * 4;
+	return levels.empty() ? 0 : double(rgba) / Bytes();
+}
+
+bool CompressedTexture::Load(const std::string& filename)
+{
+	const size_t dot = filename.find_last_of('.');
+	const std::string extension = dot == std::string::npos ? std::string() : filename.substr(dot + 1);
+	if (extension == "dds" || extension == "DDS")
+		return LoadDDS(filename);
+	if (extension == "ktx2" || extension == "KTX2")
+		return LoadKTX2(filename);
+	return false;
+}
+
+bool CompressedTexture::LoadDDS(const std::string& filename)
+{
+	levels.clear();
+	const std::vector<unsigned char> bytes = ReadFile(filename);
+	if (bytes.size() < 4 + sizeof(DDSHeader) || std::memcmp(bytes.data(), "DDS ", 4) != 0)
+		return false;
+
+	DDSHeader header;
+	std::memcpy(&header, bytes.data() + 4, sizeof(header));
+	size_t offset = 4 + sizeof(header);
+
+	bool known = true;
+	srgb = false;
+	if (!(header.pfFlags & DDPF_FOURCC))
+		known = false;
+	else if (header.pfFourCC == FourCC('D', 'X', 'T', '1'))
+		format = BlockFormat::BC1;
+	else if (header.pfFourCC == FourCC('D', 'X', 'T', '5'))
+		format = BlockFormat::BC3;
+	else if (header.pfFourCC == FourCC('A', 'T', 'I', '1') || header.pfFourCC == FourCC('B', 'C', '4', 'U'))
+		format = BlockFormat::BC4;
+	else if (header.pfFourCC == FourCC('A', 'T', 'I', '2') || header.pfFourCC == FourCC('B', 'C', '5', 'U'))
+		format = BlockFormat::BC5;
+	else if (header.pfFourCC == FourCC('D', 'X', '1', '0') && bytes.size() >= offset + sizeof(DDSHeaderDX10))
+	{
+		DDSHeaderDX10 dx10;
+		std::memcpy(&dx10, bytes.data() + offset, sizeof(dx10));
+		offset += sizeof(dx10);
+
+		const FormatCode* code = std::find_if(std::begin(FORMAT_CODES), std::end(FORMAT_CODES), [&](const FormatCode& entry) { return entry.dxgi == dx10.dxgiFormat; });
+		known = code != std::end(FORMAT_CODES) && dx10.resourceDimension == D3D10_RESOURCE_DIMENSION_TEXTURE2D && dx10.arraySize <= 1;
+		if (known)
+		{
+			format = code->format;
+			srgb = code->srgb;
+		}
+	}
+	else
+		known = false;
+
+	if (!known)
+	{
+		std::cerr << "[CompressedTexture] " << filename << ": not a BC1/BC3/BC4/BC5/BC7 2D texture" << std::endl;
+		return false;
+	}
+
+	const unsigned levelCount = (header.flags & DDSD_MIPMAPCOUNT) ? header.mipMapCount : 1;
+	if (!CutLevels(bytes.data() + offset, bytes.size() - offset, format, GLsizei(header.width), GLsizei(header.height), levelCount, levels))
+	{
+		std::cerr << "[CompressedTexture] " << filename << " is cut short" << std::endl;
+		levels.clear();
+		return false;
+	}
+	psnr = header.reserved1[9] == PSNR_TAG ? header.reserved1[10] / 1000.0 : 0;
+	return true;
+}
+
+bool CompressedTexture::LoadKTX2(const std::string& filename)
+{
+	static const unsigned char IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	levels.clear();
+	const std::vector<unsigned char> bytes = ReadFile(filename);
+	const size_t HEADER_SIZE = 80;
+	if (bytes.size() < HEADER_SIZE || std::memcmp(bytes.data(), IDENTIFIER, sizeof(IDENTIFIER)) != 0)
+		return false;
+
+	// vkFormat, typeSize, pixelWidth, pixelHeight, pixelDepth, layerCount, faceCount, levelCount, supercompressionScheme
+	std::uint32_t fields[9];
+	std::memcpy(fields, bytes.data() + 12, sizeof(fields));
+	const std::uint32_t vkFormat = fields[0], width = fields[2], height = fields[3], depth = fields[4];
+	const std::uint32_t layers = fields[5], faces = fields[6], levelCount = std::max(1u, fields[7]), supercompression = fields[8];
+
+	const FormatCode* code = std::find_if(std::begin(FORMAT_CODES), std::end(FORMAT_CODES), [&](const FormatCode& entry) { return entry.vulkan == vkFormat; });
+	if (code == std::end(FORMAT_CODES) || depth > 1 || layers > 1 || faces != 1 || supercompression != 0
+		|| bytes.size() < HEADER_SIZE + levelCount * 24)
+	{
+		std::cerr << "[CompressedTexture] " << filename << ": not a plain BC1/BC3/BC4/BC5/BC7 2D texture" << std::endl;
+		return false;
+	}
+	format = code->format;
+	srgb = code->srgb;
+
+	// the level index: byteOffset, byteLength, uncompressedByteLength for every level, the largest first
+	for (std::uint32_t level = 0; level < levelCount; ++level)
+	{
+		std::uint64_t index[3];
+		std::memcpy(index, bytes.data() + HEADER_SIZE + level * sizeof(index), sizeof(index));
+
+		const GLsizei w = std::max(1, GLsizei(width) >> level), h = std::max(1, GLsizei(height) >> level);
+		if (index[0] + index[1] > bytes.size() || index[1] < BlockCompression::ImageSize(format, w, h))
+		{
+			std::cerr << "[CompressedTexture] " << filename << " is cut short" << std::endl;
+			levels.clear();
+			return false;
+		}
+		const unsigned char* data = bytes.data() + index[0];
+		levels.push_back({ w, h, std::vector<unsigned char>(data, data + BlockCompression::ImageSize(format, w, h)) });
+	}
+	psnr = 0;
+	return true;
+}
+
+bool CompressedTexture::SaveDDS(const std::string& filename) const
+{
+	if (levels.empty())
+		return false;
+
+	DDSHeader header = {};
+	header.size					= sizeof(DDSHeader);
+	header.flags				= DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE | (levels.size() > 1 ? DDSD_MIPMAPCOUNT : 0);
+	header.height				= std::uint32_t(levels[0].height);
+	header.width				= std::uint32_t(levels[0].width);
+	header.pitchOrLinearSize	= std::uint32_t(levels[0].data.size());
+	header.mipMapCount			= std::uint32_t(levels.size());
+	header.pfSize				= 32;
+	header.pfFlags				= DDPF_FOURCC;
+	header.caps					= DDSCAPS_TEXTURE | (levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+	if (psnr > 0)
+	{
+		header.reserved1[9]		= PSNR_TAG;
+		header.reserved1[10]	= std::uint32_t(std::min(psnr, 1e6) * 1000 + 0.5);
+	}
+
+	// the old FourCCs where there is one, readers without DX10 support can open those
+	const bool dx10 = srgb || format == BlockFormat::BC7;
+	switch (format)
+	{
+	case BlockFormat::BC1:	header.pfFourCC = FourCC('D', 'X', 'T', '1'); break;
+	case BlockFormat::BC3:	header.pfFourCC = FourCC('D', 'X', 'T', '5'); break;
+	case BlockFormat::BC4:	header.pfFourCC = FourCC('A', 'T', 'I', '1'); break;
+	case BlockFormat::BC5:	header.pfFourCC = FourCC('A', 'T', 'I', '2'); break;
+	case BlockFormat::BC7:	break;
+	}
+	if (dx10)
+		header.pfFourCC = FourCC('D', 'X', '1', '0');
+
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	file.write("DDS ", 4);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (dx10)
+	{
+		const FormatCode* code = std::find_if(std::begin(FORMAT_CODES), std::end(FORMAT_CODES), [&](const FormatCode& entry) { return entry.format == format && entry.srgb == srgb; });
+		const DDSHeaderDX10 extension = { code->dxgi, D3D10_RESOURCE_DIMENSION_TEXTURE2D, 0, 1, 0 };
+		file.write(reinterpret_cast<const char*>(&extension), sizeof(extension));
+	}
+	for (const Level& level : levels)
+		file.write(reinterpret_cast<const char*>(level.data.data()), level.data.size());
+
+	if (!file)
+	{
+		std::cerr << "[CompressedTexture] cannot write " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+CompressedTexture CompressedTexture::Cook(const std::string& image, const std::string& cooked, BlockFormat format, bool mipmaps, MipFilter filter)
+{
+	CompressedTexture texture;
+	texture.format = format;
+	if (!BlockCompression::CanEncode(format))
+	{
+		std::cerr << "[CompressedTexture] " << FormatName(format) << " cannot be encoded here, " << image << " is not cooked" << std::endl;
+		return texture;
+	}
+
+	MipLevel source = MipGenerator::FromFile(image);
+	if (source.rgba.empty())
+	{
+		std::cerr << "[CompressedTexture] Error loading image file " << image << std::endl;
+		return texture;
+	}
+
+	// color images are sRGB encoded, the two channel and single channel formats hold data (normals, heights)
+	const bool color = format == BlockFormat::BC1 || format == BlockFormat::BC3;
+	const std::vector<MipLevel> mips = mipmaps ? MipGenerator::Generate(source, filter, color) : std::vector<MipLevel>{ std::move(source) };
+	for (const MipLevel& mip : mips)
+		texture.levels.push_back({ mip.width, mip.height, BlockCompression::Encode(mip.rgba.data(), mip.width, mip.height, format) });
+
+	const std::vector<unsigned char> decoded = BlockCompression::Decode(texture.levels[0].data.data(), mips[0].width, mips[0].height, format);
+	texture.psnr = BlockCompression::PSNR(mips[0].rgba.data(), decoded.data(), mips[0].width, mips[0].height, format);
+
+	texture.SaveDDS(cooked);
+	return texture;
+}
+
+CompressedTexture CompressedTexture::LoadOrCook(const std::string& image, BlockFormat format, bool mipmaps, MipFilter filter)
+{
+	const size_t dot = image.find_last_of('.');
+	const std::string cooked = image.substr(0, dot == std::string::npos || image.find_first_of("/\\", dot) != std::string::npos ? image.size() : dot) + ".dds";
+
+	CompressedTexture texture;
+	if (texture.LoadDDS(cooked) && texture.format == format && (texture.levels.size() > 1) == mipmaps)
+		return texture;
+	return Cook(image, cooked, format, mipmaps, filter);
+}
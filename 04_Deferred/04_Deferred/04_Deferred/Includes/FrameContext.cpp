@@ -0,0 +1,131 @@
+#include "FrameContext.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// how long a single glClientWaitSync may block before we check again
+	const GLuint64 WAIT_TIMEOUT_NS = 1000000;
+
+	// the weight of the newest frame in the averages
+	const double AVERAGE_WEIGHT = 0.05;
+
+	// see IsGpuBound()
+	const double GPU_BOUND_WAIT_RATIO = 0.2;
+
+	unsigned				g_framesInFlight = 0;
+	unsigned				g_index = 0;
+	unsigned				g_number = 0;
+	GLsync					g_fences[FrameContext::MAX_FRAMES_IN_FLIGHT] = {};
+
+	Clock::time_point		g_frameStart;
+	FrameContext::Timing	g_lastFrame;
+	FrameContext::Timing	g_average;
+
+	double Milliseconds(Clock::duration duration)
+	{
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
+}
+
+void FrameContext::Init(unsigned framesInFlight)
+{
+	Shutdown();
+	g_framesInFlight = std::max(1u, std::min(framesInFlight, MAX_FRAMES_IN_FLIGHT));
+	g_index = g_framesInFlight - 1;	// the first BeginFrame() moves to slot 0
+	g_number = 0;
+	g_lastFrame = g_average = Timing();
+}
+
+void FrameContext::Shutdown()
+{
+	for (GLsync& fence : g_fences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+		fence = nullptr;
+	}
+	g_framesInFlight = 0;
+}
+
+bool FrameContext::IsInitialized()
+{
+	return g_framesInFlight > 0;
+}
+
+void FrameContext::BeginFrame()
+{
+	if (!IsInitialized())
+		return;
+
+	const Clock::time_point begin = Clock::now();
+	if (g_number > 0)
+		g_lastFrame.frameMs = Milliseconds(begin - g_frameStart);
+	g_frameStart = begin;
+
+	g_index = (g_index + 1) % g_framesInFlight;
+	++g_number;
+
+	GLsync& fence = g_fences[g_index];
+	double waitMs = 0;
+	if (fence)
+	{
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			// the GPU is still on the frame FramesInFlight() ago
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT_NS) == GL_TIMEOUT_EXPIRED)
+				;
+			waitMs = Milliseconds(Clock::now() - begin);
+		}
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+	g_lastFrame.waitMs = waitMs;
+
+	if (g_number <= 2)		// the first frame has no length yet
+		g_average = g_lastFrame;
+	else
+	{
+		g_average.waitMs	+= AVERAGE_WEIGHT * (g_lastFrame.waitMs - g_average.waitMs);
+		g_average.frameMs	+= AVERAGE_WEIGHT * (g_lastFrame.frameMs - g_average.frameMs);
+	}
+}
+
+void FrameContext::EndFrame()
+{
+	if (IsInitialized())
+		g_fences[g_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+unsigned FrameContext::FramesInFlight()
+{
+	return g_framesInFlight;
+}
+
+unsigned FrameContext::Index()
+{
+	return g_index;
+}
+
+unsigned FrameContext::Number()
+{
+	return g_number;
+}
+
+const FrameContext::Timing& FrameContext::LastFrame()
+{
+	return g_lastFrame;
+}
+
+const FrameContext::Timing& FrameContext::Average()
+{
+	return g_average;
+}
+
+bool FrameContext::IsGpuBound()
+{
+	return g_average.frameMs > 0 && g_average.waitMs > GPU_BOUND_WAIT_RATIO * g_average.frameMs;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+/*
+
+	FrameContext paces the CPU against the GPU. Up to FramesInFlight() frames are recorded
+	before the GPU has to finish the oldest one: EndFrame() puts a fence after everything the
+	frame submitted, and BeginFrame() of the frame that reuses the same slot waits on it.
+
+	Every resource the CPU rewrites each frame keeps one copy per slot and uses the copy of
+	Index(); when BeginFrame() returns, the GPU is done with that copy, so it can be written
+	without waiting and without orphaning. StreamRingBuffer does this with its regions.
+
+	The time BeginFrame() spends waiting is measured. A CPU that waits on the fence for a good
+	part of the frame is ahead of the GPU, the frame is GPU bound.
+
+	In the main loop:
+
+		FrameContext::Init(2);		// after glewInit, before the resources that use Index()
+		...
+		FrameContext::BeginFrame();
+		app.Update(); app.Render(); ImGui::Render();
+		FrameContext::EndFrame();
+		SDL_GL_SwapWindow(win);
+		...
+		FrameContext::Shutdown();	// while the context still exists
+
+*/
+class FrameContext final
+{
+public:
+	static const unsigned MAX_FRAMES_IN_FLIGHT = 4;
+
+	struct Timing
+	{
+		double	waitMs{};	// BeginFrame() waiting for the GPU
+		double	frameMs{};	// from one BeginFrame() to the next
+	};
+
+	FrameContext() = delete;
+
+	static void		Init(unsigned framesInFlight = 2);
+	static void		Shutdown();
+	static bool		IsInitialized();
+
+	// waits until the GPU finished the frame that used the slot of this one last
+	static void		BeginFrame();
+	// fences the commands of the frame, call it before swapping the buffers
+	static void		EndFrame();
+
+	static unsigned	FramesInFlight();
+	// the slot of the current frame, in [0, FramesInFlight()): selects the per frame copy of a resource
+	static unsigned	Index();
+	// frames begun so far
+	static unsigned	Number();
+
+	static const Timing&	LastFrame();
+	static const Timing&	Average();		// exponential moving average of the recent frames
+	// the CPU waits for the GPU for more than a fifth of the frame, on average
+	static bool				IsGpuBound();
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "RenderTargetPool.h"
+
+/*
+
+	FrameGraph describes a frame as a list of passes and the textures they read and write. It is
+	built again every frame:
+
+		graph.Reset();
+		FrameGraph::Resource backbuffer = graph.ImportBackbuffer(width, height);
+		graph.AddPass("Shadow", [&](FrameGraph::Builder& builder) {
+			shadowMap = builder.Write(builder.Create("shadow map", { GL_DEPTH_COMPONENT24, 1024, 1024 }), GL_DEPTH_ATTACHMENT);
+		}, [&]() { ... draw ... });
+		...
+		graph.Compile();
+		graph.Execute();
+
+	The setup callback runs right away in AddPass(), the run callback later, in Execute().
+
+	Compile()
+	- culls the passes whose results nobody reads. Passes that write the backbuffer, and the ones
+	  marked with Builder::SideEffect(), are always kept.
+	- computes the lifetime of each transient texture: from the first pass that uses it to the last.
+	- takes the textures from a RenderTargetPool in pass order, giving each back right after its
+	  last pass. A texture whose lifetime ended is handed to a later one of the same format and
+	  size, so textures that are never needed at the same time share the same memory.
+	- finds (or creates) a framebuffer for each pass with the textures it writes attached.
+
+	Execute() binds the framebuffer of each pass and sets the viewport to the size of what it
+	writes before calling it. Clearing is left to the passes: they know their pipeline, and
+	glClear respects the depth mask.
+
+	Transient textures are bigger than asked for when the pool rounds their size up; sample them
+	with texelFetch or scale the texture coordinates (RenderTargetPool::Target::ScaleX/Y).
+	After Execute() their contents stay valid until a later frame reuses them.
+
+*/
+class FrameGraph final
+{
+public:
+	using Resource = unsigned;
+	static const Resource INVALID_RESOURCE = ~0u;
+
+	struct TextureDesc
+	{
+		GLenum	internalFormat{ GL_RGBA8 };
+		GLsizei	width{};
+		GLsizei	height{};
+	};
+
+	// declares what a pass uses, passed to the setup callback of AddPass()
+	class Builder final
+	{
+	public:
+		// a texture that exists only within this frame
+		Resource	Create(const char* name, const TextureDesc& desc);
+		// the pass samples resource
+		Resource	Read(Resource resource);
+		// the pass renders to resource through attachment (GL_COLOR_ATTACHMENTi, GL_DEPTH_ATTACHMENT; ignored for the backbuffer)
+		Resource	Write(Resource resource, GLenum attachment);
+		// the pass has effects the graph does not see (e.g. read backs), never cull it
+		void		SideEffect();
+
+	private:
+		friend class FrameGraph;
+		Builder(FrameGraph& graph, unsigned pass) : m_graph(graph), m_pass(pass) {}
+
+		FrameGraph&	m_graph;
+		unsigned	m_pass;
+	};
+
+	using Setup		= std::function<void(Builder&)>;
+	using Run		= std::function<void()>;
+
+	struct Stats
+	{
+		unsigned	passes{};
+		unsigned	culled{};
+		unsigned	transients{};		// transient textures of the passes that run
+		unsigned	textures{};			// the pool textures they were put in
+		unsigned	framebuffers{};		// cached
+		GLsizeiptr	requestedBytes{};	// if every transient had its own texture
+		GLsizeiptr	allocatedBytes{};	// what they actually take
+
+		GLsizeiptr	SavedBytes() const { return requestedBytes - allocatedBytes; }
+	};
+
+	FrameGraph() = default;
+	~FrameGraph();
+
+	FrameGraph(const FrameGraph&)				= delete;
+	FrameGraph& operator=(const FrameGraph&)	= delete;
+
+	// forgets the passes of the last frame, call it at the start of every frame
+	void		Reset();
+
+	// the default framebuffer; passes that write it are never culled
+	Resource	ImportBackbuffer(GLsizei width, GLsizei height);
+	void		AddPass(const char* name, const Setup& setup, const Run& run);
+
+	void		Compile();
+	void		Execute();
+
+	// the texture of a transient resource, from Compile() until the next Reset(); empty if every user was culled
+	const RenderTargetPool::Target&	GetTarget(Resource resource) const;
+	// the framebuffer of the pass being executed
+	GLuint		CurrentFramebuffer() const { return m_currentFramebuffer; }
+
+	Stats					GetStats() const { return m_stats; }
+	const RenderTargetPool&	Pool() const { return m_pool; }
+	// the passes and resources of the last Compile(), one per line
+	std::string				Dump() const;
+
+	// deletes the framebuffers and the textures, while the context still exists
+	void		Clear();
+
+private:
+	struct ResourceNode
+	{
+		std::string					name;
+		TextureDesc					desc;
+		bool						imported{};
+		RenderTargetPool::Target	target;
+		unsigned					readers{};		// passes that read it and are not culled
+		std::vector<unsigned>		writers;
+		int							firstPass{ -1 };
+		int							lastPass{ -1 };
+	};
+
+	struct Attachment
+	{
+		Resource	resource;
+		GLenum		attachment;
+	};
+
+	struct PassNode
+	{
+		std::string					name;
+		Run							run;
+		std::vector<Resource>		reads;
+		std::vector<Attachment>		writes;
+		bool						sideEffect{};
+		bool						culled{};
+		unsigned					outputs{};		// written resources that are still needed
+		GLuint						framebuffer{};
+		GLsizei						width{};		// the viewport
+		GLsizei						height{};
+	};
+
+	// the attachments are identified by the pool ids of the textures, those are never reused
+	struct CachedFramebuffer
+	{
+		std::vector<std::pair<GLenum, unsigned>>	attachments;
+		GLuint										framebuffer;
+		unsigned									lastUsed;
+	};
+
+	std::vector<PassNode>			m_passes;
+	std::vector<ResourceNode>		m_resources;
+	std::vector<CachedFramebuffer>	m_framebuffers;
+	RenderTargetPool				m_pool;
+
+	GLuint		m_currentFramebuffer{};
+	unsigned	m_frame{};
+	Stats		m_stats;
+
+	void	Cull();
+	void	Allocate();
+	GLuint	Framebuffer(const PassNode& pass);
+};
@@ -0,0 +1,53 @@
+#include "GLCaps.h"
+
+#include <iostream>
+
+namespace
+{
+	GLCaps Query()
+	{
+		GLCaps caps;
+		glGetIntegerv(GL_MAJOR_VERSION, &caps.majorVersion);
+		glGetIntegerv(GL_MINOR_VERSION, &caps.minorVersion);
+
+		caps.bufferStorage = caps.AtLeast(4, 4) || GLEW_ARB_buffer_storage;
+		caps.directStateAccess = caps.AtLeast(4, 5) || GLEW_ARB_direct_state_access;
+		caps.textureStorage = caps.AtLeast(4, 2) || GLEW_ARB_texture_storage;
+		caps.samplerObjects = caps.AtLeast(3, 3) || GLEW_ARB_sampler_objects;
+
+#ifdef GL_KHR_parallel_shader_compile
+		caps.parallelShaderCompile = GLEW_KHR_parallel_shader_compile;
+#endif
+
+		// a driver may support the calls but no format to save in
+		if (caps.AtLeast(4, 1) || GLEW_ARB_get_program_binary)
+		{
+			GLint formats = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+			caps.programBinary = formats > 0;
+		}
+
+		caps.textureCompressionS3TC = GLEW_EXT_texture_compression_s3tc;
+		caps.textureCompressionRGTC = caps.AtLeast(3, 0) || GLEW_ARB_texture_compression_rgtc;
+		caps.textureCompressionBPTC = caps.AtLeast(4, 2) || GLEW_ARB_texture_compression_bptc;
+
+		if (caps.AtLeast(4, 6) || GLEW_EXT_texture_filter_anisotropic)
+			glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &caps.maxAnisotropy);
+
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &caps.uniformBufferOffsetAlignment);
+		glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &caps.maxUniformBlockSize);
+		glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &caps.maxArrayTextureLayers);
+
+		std::cout << "[GLCaps] OpenGL " << caps.majorVersion << "." << caps.minorVersion
+			<< ", buffer storage: " << (caps.bufferStorage ? "yes" : "no")
+			<< ", direct state access: " << (caps.directStateAccess ? "yes" : "no") << std::endl;
+
+		return caps;
+	}
+}
+
+const GLCaps& GLCaps::Get()
+{
+	static const GLCaps caps = Query();
+	return caps;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+/*
+
+	GLState shadows the parts of the OpenGL context state that the wrapper classes change:
+	the program in use, the VAO, the buffer bind targets, the texture units and their samplers,
+	the framebuffers, the viewport and the blend, depth and cull state. Every setter compares
+	the request with the shadowed value and only calls OpenGL if they differ.
+
+	Everything that binds or deletes objects has to go through here, otherwise the shadow copy
+	goes stale. Code outside of our control is handled by Invalidate(): after it, the next call
+	to every setter is issued unconditionally. The cache is kept from frame to frame, so only
+	what that code may have changed is forgotten: InvalidateDrawState() after ImGui::Render().
+	SDL_GL_SwapWindow() leaves the context state alone.
+
+	- The element array binding is part of the VAO state, so it is forgotten on every VAO change.
+	- Binding a range also binds the buffer to the generic binding point of the target.
+	- Deleting an object unbinds it in OpenGL, use the Delete* functions so the cache follows.
+	- Apply() remembers the pipeline it made current; applying it again is a single comparison,
+	  until a setter changes any of the state it covers.
+	- In validation mode every setter first reads the real state back with glGet* and reports
+	  (and fixes) any difference. It is slow, meant for debugging the cache only.
+
+*/
+class PipelineState;
+
+class GLState final
+{
+public:
+	struct Counters
+	{
+		unsigned issued{};		// calls that reached OpenGL
+		unsigned elided{};		// calls that were skipped as redundant
+		unsigned mismatches{};	// validation failures
+		unsigned stalls{};		// synchronous read backs, each one waits for the GPU to finish all work
+		unsigned uniformsIssued{};	// glUniform* calls of ProgramObject that reached OpenGL
+		unsigned uniformsSkipped{};	// values the program had already (see ProgramObject::SetUniform)
+	};
+
+	GLState() = delete;
+
+	// rolls the per frame counters, call it once at the start of every frame
+	static void NewFrame();
+	// forgets everything, e.g. when another context was current
+	static void Invalidate();
+	// forgets what a UI renderer changes: the program, the VAO, the vertex and index buffers, the
+	// active unit and unit 0, the viewport, the enabled capabilities and the blend, depth and cull state
+	static void InvalidateDrawState();
+
+	static const Counters& CurrentFrame();
+	static const Counters& LastFrame();
+
+	static void SetValidation(bool enabled);
+	static bool IsValidating();
+
+	// called by whatever makes the CPU wait on the GPU (glMapBuffer of a buffer in use, glReadPixels, ...)
+	static void CountStall();
+	// called by ProgramObject for every uniform value it is given
+	static void CountUniform(bool issued);
+
+	// objects
+	static void UseProgram(GLuint program);
+	static void BindVertexArray(GLuint vao);
+	static void BindBuffer(GLenum target, GLuint buffer);
+	static void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+	static void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	static void BindTexture(GLenum target, GLuint texture);					// on the active unit
+	static void BindTextureUnit(GLuint unit, GLenum target, GLuint texture);
+	static void ActiveTexture(GLuint unit);									// unit index, not GL_TEXTUREi
+	static void BindSampler(GLuint unit, GLuint sampler);					// 0 samples with the parameters of the texture
+	static void BindFramebuffer(GLenum target, GLuint framebuffer);
+
+	// glVertexArrayElementBuffer, keeps the element array binding right if vao is the one bound
+	static void VertexArrayElementBuffer(GLuint vao, GLuint buffer);
+
+	static void DeletePrograms(GLsizei n, const GLuint* programs);
+	static void DeleteVertexArrays(GLsizei n, const GLuint* vaos);
+	static void DeleteBuffers(GLsizei n, const GLuint* buffers);
+	static void DeleteTextures(GLsizei n, const GLuint* textures);
+	static void DeleteSamplers(GLsizei n, const GLuint* samplers);
+	static void DeleteFramebuffers(GLsizei n, const GLuint* framebuffers);
+
+	// the program, the VAO and the raster, depth and blend state of pipeline; false (and nothing
+	// is changed) while its program is still being linked: skip the draws that need it
+	static bool Apply(const PipelineState& pipeline);
+
+	// fixed function
+	static void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	static void SetEnabled(GLenum capability, bool enabled);				// GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, ...
+	static void Enable(GLenum capability)	{ SetEnabled(capability, true); }
+	static void Disable(GLenum capability)	{ SetEnabled(capability, false); }
+	static void BlendFunc(GLenum sfactor, GLenum dfactor);
+	static void BlendEquation(GLenum mode);
+	static void DepthMask(GLboolean flag);
+	static void DepthFunc(GLenum func);
+	static void CullFace(GLenum mode);
+};
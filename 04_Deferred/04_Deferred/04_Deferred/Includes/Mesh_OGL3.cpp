@@ -1,4 +1,5 @@
 #include "Mesh_OGL3.h"
+#include "MeshProcessing.h"
 
 Mesh::Mesh(void)
 {
@@ -7,45 +8,42 @@ Mesh::Mesh(void)
 Mesh::~Mesh(void)
 {
 	if (inited)
-	{
-		glDeleteVertexArrays(1, &vertexArrayObject);
+		heap->Free(allocation);
+}
 
-		glDeleteBuffers(1, &vertexBuffer);
-		glDeleteBuffers(1, &indexBuffer);
-	}
+std::shared_ptr<GeometryHeap> Mesh::SharedHeap()
+{
+	return GeometryHeap::Shared(sizeof(Vertex), {
+		AttributeData(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position)),
+		AttributeData(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal)),
+		AttributeData(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texcoord)),
+		AttributeData(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, tangent)),
+	});
 }
 
 void Mesh::initBuffers()
 {
-	glGenVertexArrays(1, &vertexArrayObject);
-	glGenBuffers(1, &vertexBuffer);
-	glGenBuffers(1, &indexBuffer);
-
-	glBindVertexArray(vertexArrayObject);
-
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex)*vertices.size(), (void*)&vertices[0], GL_STREAM_DRAW);
-
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texcoord));
-
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int)*indices.size(), (void*)&indices[0], GL_STREAM_DRAW);
+	if (inited)
+		heap->Free(allocation);
 
-	glBindVertexArray(0);
+	heap = SharedHeap();
+	allocation = heap->Allocate(vertices.data(), vertices.size(), indices.data(), indices.size());
 
 	inited = true;
 }
 
-void Mesh::draw()
+void Mesh::generateNormals(float creaseAngleDegrees, const std::vector<bool>& keep)
 {
-	glBindVertexArray(vertexArrayObject);
+	MeshProcessing::GenerateNormals(vertices, indices, creaseAngleDegrees, keep);
+}
 
-	glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
+void Mesh::generateTangents()
+{
+	MeshProcessing::GenerateTangents(vertices, indices);
+}
 
-	glBindVertexArray(0);
-}
\ No newline at end of file
+void Mesh::draw()
+{
+	// the heap's VAO stays bound, so drawing the next mesh costs no rebinding
+	heap->Draw(allocation);
+}
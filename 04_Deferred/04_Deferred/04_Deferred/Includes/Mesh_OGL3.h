@@ -2,9 +2,12 @@
 
 #include <GL/glew.h>
 
+#include <memory>
 #include <vector>
 #include <glm/glm.hpp>
 
+#include "GeometryHeap.h"
+
 class Mesh
 {
 public:
@@ -13,24 +16,40 @@ public:
 		glm::vec3 position;
 		glm::vec3 normal;
 		glm::vec2 texcoord;
+		glm::vec4 tangent; // xyz: tangent, w: handedness of the tangent frame
 	};
 
 	Mesh(void);
 	~Mesh(void);
 
+	Mesh(const Mesh&)				= delete;
+	Mesh& operator=(const Mesh&)	= delete;
+
+	// every Mesh lives in this heap, hence drawing different meshes needs no VAO switch
+	static std::shared_ptr<GeometryHeap> SharedHeap();
+
 	void initBuffers();
 	void draw();
 
+	// load time generation of missing attributes, call them before initBuffers()
+	void generateNormals(float creaseAngleDegrees = 180.0f, const std::vector<bool>& keep = {});
+	void generateTangents();
+
 	void addVertex(const Vertex& vertex) {
 		vertices.push_back(vertex);
 	}
 	void addIndex(unsigned int index) {
 		indices.push_back(index);
 	}
+
+	const std::vector<Vertex>& getVertices() const { return vertices; }
+	const std::vector<unsigned int>& getIndices() const { return indices; }
+
+	// where initBuffers() put the mesh in SharedHeap(), for batching draws
+	GeometryHeap::Handle getAllocation() const { return allocation; }
 private:
-	GLuint vertexArrayObject;
-	GLuint vertexBuffer;
-	GLuint indexBuffer;
+	std::shared_ptr<GeometryHeap> heap;
+	GeometryHeap::Handle allocation = GeometryHeap::INVALID_HANDLE;
 
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
@@ -0,0 +1,284 @@
+#include "MipGenerator.h"
+#include "Parallel.h"
+
+#include <SDL.h>
+#include <SDL_image.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define MIPGENERATOR_SSE2
+#endif
+
+namespace
+{
+	const size_t ROWS_PER_TASK = 16;
+	const float PI = 3.14159265358979f;
+
+	// the half width of the windowed sincs, in texels of the smaller level
+	const float WINDOW_RADIUS = 3.0f;
+	const float KAISER_ALPHA = 4.0f;
+
+	float Sinc(float x)
+	{
+		return x == 0.0f ? 1.0f : std::sin(PI * x) / (PI * x);
+	}
+
+	// the modified Bessel function of the first kind, order 0
+	float BesselI0(float x)
+	{
+		float sum = 1.0f, term = 1.0f;
+		for (int k = 1; k < 32 && term > 1e-7f * sum; ++k)
+		{
+			term *= (x / (2.0f * k)) * (x / (2.0f * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	// the weight of a texel t texels (of the smaller level) from the center of the filter
+	float Weight(MipFilter filter, float t)
+	{
+		t = std::abs(t);
+		if (t >= WINDOW_RADIUS)
+			return 0.0f;
+		if (filter == MipFilter::Lanczos)
+			return Sinc(t) * Sinc(t / WINDOW_RADIUS);
+
+		const float r = t / WINDOW_RADIUS;
+		return Sinc(t) * BesselI0(KAISER_ALPHA * std::sqrt(1.0f - r * r)) / BesselI0(KAISER_ALPHA);
+	}
+
+	// the source texels and their weights for every target texel along one axis, the same number for each
+	struct Kernel
+	{
+		int					taps{};
+		std::vector<int>	source;
+		std::vector<float>	weight;
+
+		Kernel(MipFilter filter, int sourceSize, int targetSize)
+		{
+			const float scale = float(sourceSize) / targetSize;
+			std::vector<std::vector<std::pair<int, float>>> lists(targetSize);
+			for (int i = 0; i < targetSize; ++i)
+			{
+				std::vector<std::pair<int, float>>& list = lists[i];
+				const float begin = i * scale, end = (i + 1) * scale;
+				if (filter == MipFilter::Box)
+				{
+					// the part of each source texel that is under the target one
+					for (int j = int(std::floor(begin)); j < int(std::ceil(end)); ++j)
+						list.emplace_back(j, std::min(end, j + 1.0f) - std::max(begin, float(j)));
+				}
+				else
+				{
+					const float center = (begin + end) / 2, reach = WINDOW_RADIUS * std::max(1.0f, scale);
+					for (int j = int(std::floor(center - reach)); j <= int(std::ceil(center + reach)); ++j)
+					{
+						const float w = Weight(filter, (j + 0.5f - center) / std::max(1.0f, scale));
+						if (w != 0.0f)
+							list.emplace_back(std::min(std::max(j, 0), sourceSize - 1), w);
+					}
+				}
+
+				float sum = 0.0f;
+				for (const std::pair<int, float>& tap : list)
+					sum += tap.second;
+				for (std::pair<int, float>& tap : list)
+					tap.second /= sum;
+				taps = std::max(taps, int(list.size()));
+			}
+
+			// the shorter lists are padded with taps of no weight
+			source.resize(size_t(targetSize) * taps);
+			weight.resize(size_t(targetSize) * taps, 0.0f);
+			for (int i = 0; i < targetSize; ++i)
+				for (int k = 0; k < taps; ++k)
+				{
+					const bool real = k < int(lists[i].size());
+					source[size_t(i) * taps + k] = real ? lists[i][k].first : lists[i][0].first;
+					weight[size_t(i) * taps + k] = real ? lists[i][k].second : 0.0f;
+				}
+		}
+	};
+
+	// target[x] = sum of weight * source[x'] along the rows; 4 floats per texel
+	void FilterRows(const float* source, int sourceWidth, int height, const Kernel& kernel, float* target, int targetWidth)
+	{
+		ParallelFor(0, size_t(height), ROWS_PER_TASK, [&](size_t first, size_t last) {
+			for (size_t y = first; y < last; ++y)
+			{
+				const float* in = source + y * sourceWidth * 4;
+				float* out = target + y * targetWidth * 4;
+				for (int x = 0; x < targetWidth; ++x)
+				{
+					const int* taps = &kernel.source[size_t(x) * kernel.taps];
+					const float* weights = &kernel.weight[size_t(x) * kernel.taps];
+#ifdef MIPGENERATOR_SSE2
+					__m128 sum = _mm_setzero_ps();
+					for (int k = 0; k < kernel.taps; ++k)
+						sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(in + taps[k] * 4)));
+					_mm_storeu_ps(out + x * 4, sum);
+#else
+					float sum[4] = {};
+					for (int k = 0; k < kernel.taps; ++k)
+						for (int c = 0; c < 4; ++c)
+							sum[c] += weights[k] * in[taps[k] * 4 + c];
+					std::memcpy(out + x * 4, sum, sizeof(sum));
+#endif
+				}
+			}
+		});
+	}
+
+	// the same down the columns: every target row is a weighted sum of whole source rows
+	void FilterColumns(const float* source, int width, const Kernel& kernel, float* target, int targetHeight)
+	{
+		const size_t rowFloats = size_t(width) * 4;
+		ParallelFor(0, size_t(targetHeight), ROWS_PER_TASK, [&](size_t first, size_t last) {
+			for (size_t y = first; y < last; ++y)
+			{
+				float* out = target + y * rowFloats;
+				std::fill(out, out + rowFloats, 0.0f);
+				for (int k = 0; k < kernel.taps; ++k)
+				{
+					const float* in = source + size_t(kernel.source[y * kernel.taps + k]) * rowFloats;
+					const float weight = kernel.weight[y * kernel.taps + k];
+					if (weight == 0.0f)
+						continue;
+#ifdef MIPGENERATOR_SSE2
+					const __m128 w = _mm_set1_ps(weight);
+					for (size_t i = 0; i < rowFloats; i += 4)
+						_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(w, _mm_loadu_ps(in + i))));
+#else
+					for (size_t i = 0; i < rowFloats; ++i)
+						out[i] += weight * in[i];
+#endif
+				}
+			}
+		});
+	}
+
+	float SRGBToLinear(float value)
+	{
+		return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	float LinearToSRGB(float value)
+	{
+		return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+	}
+
+	// 8 bit sRGB to linear, and linear (in steps of 1 / (LINEAR_STEPS - 1)) back to 8 bit sRGB
+	const int LINEAR_STEPS = 16384;
+
+	struct ColorTables
+	{
+		float			toLinear[256];
+		unsigned char	toSRGB[LINEAR_STEPS];
+
+		ColorTables()
+		{
+			for (int i = 0; i < 256; ++i)
+				toLinear[i] = SRGBToLinear(i / 255.0f);
+			for (int i = 0; i < LINEAR_STEPS; ++i)
+				toSRGB[i] = static_cast<unsigned char>(std::lround(LinearToSRGB(float(i) / (LINEAR_STEPS - 1)) * 255.0f));
+		}
+	};
+
+	const ColorTables& Tables()
+	{
+		static const ColorTables tables;
+		return tables;
+	}
+
+	unsigned char ToByte(float value, bool srgb)
+	{
+		value = std::min(1.0f, std::max(0.0f, value));
+		return srgb ? Tables().toSRGB[std::lround(value * (LINEAR_STEPS - 1))] : static_cast<unsigned char>(std::lround(value * 255.0f));
+	}
+
+	// RGBA8 to float, the color linearized if srgb (alpha never is)
+	std::vector<float> ToFloat(const MipLevel& image, bool srgb)
+	{
+		std::vector<float> texels(image.rgba.size());
+		ParallelFor(0, size_t(image.height), ROWS_PER_TASK, [&](size_t first, size_t last) {
+			for (size_t i = first * image.width * 4; i < last * image.width * 4; ++i)
+				texels[i] = srgb && i % 4 != 3 ? Tables().toLinear[image.rgba[i]] : image.rgba[i] / 255.0f;
+		});
+		return texels;
+	}
+
+	MipLevel ToBytes(const std::vector<float>& texels, int width, int height, bool srgb)
+	{
+		MipLevel level{ width, height, std::vector<unsigned char>(texels.size()) };
+		ParallelFor(0, size_t(height), ROWS_PER_TASK, [&](size_t first, size_t last) {
+			for (size_t i = first * width * 4; i < last * width * 4; ++i)
+				level.rgba[i] = ToByte(texels[i], srgb && i % 4 != 3);
+		});
+		return level;
+	}
+}
+
+std::vector<MipLevel> MipGenerator::Generate(const MipLevel& image, MipFilter filter, bool srgb)
+{
+	std::vector<MipLevel> levels;
+	if (image.width <= 0 || image.height <= 0 || image.rgba.size() != size_t(image.width) * image.height * 4)
+		return levels;
+	levels.push_back(image);
+
+	std::vector<float> current = ToFloat(image, srgb), rows, next;
+	int width = image.width, height = image.height;
+	while (width > 1 || height > 1)
+	{
+		const int nextWidth = std::max(1, width / 2), nextHeight = std::max(1, height / 2);
+
+		rows.resize(size_t(nextWidth) * height * 4);
+		FilterRows(current.data(), width, height, Kernel(filter, width, nextWidth), rows.data(), nextWidth);
+		next.resize(size_t(nextWidth) * nextHeight * 4);
+		FilterColumns(rows.data(), nextWidth, Kernel(filter, height, nextHeight), next.data(), nextHeight);
+
+		// the next level is filtered from this one in float: no rounding piles up down the chain
+		levels.push_back(ToBytes(next, nextWidth, nextHeight, srgb));
+		current.swap(next);
+		width = nextWidth;
+		height = nextHeight;
+	}
+	return levels;
+}
+
+MipLevel MipGenerator::FromSurface(SDL_Surface* image)
+{
+	SDL_Surface* converted = image ? SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA32, 0) : nullptr;
+	if (converted == nullptr)
+		return {};
+
+	MipLevel level{ converted->w, converted->h, std::vector<unsigned char>(size_t(converted->w) * converted->h * 4) };
+	for (int y = 0; y < converted->h; ++y)
+		std::memcpy(&level.rgba[size_t(y) * converted->w * 4], static_cast<const unsigned char*>(converted->pixels) + size_t(y) * converted->pitch, size_t(converted->w) * 4);
+	SDL_FreeSurface(converted);
+	return level;
+}
+
+MipLevel MipGenerator::FromFile(const std::string& filename)
+{
+	SDL_Surface* loaded = IMG_Load(filename.c_str());
+	MipLevel level = FromSurface(loaded);
+	if (loaded)
+		SDL_FreeSurface(loaded);
+	return level;
+}
+
+const char* MipGenerator::FilterName(MipFilter filter)
+{
+	switch (filter)
+	{
+	case MipFilter::Box:		return "box";
+	case MipFilter::Lanczos:	return "Lanczos";
+	case MipFilter::Kaiser:		return "Kaiser";
+	}
+	return "";
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct SDL_Surface;
+
+// the filter a mip level is reduced with
+enum class MipFilter
+{
+	Box,		// the average of the texels under the smaller one (what glGenerateMipmap does)
+	Lanczos,	// Lanczos 3: sharper, may ring a little at hard edges
+	Kaiser		// sinc with a Kaiser window (alpha 4, 3 texels wide): sharp with little ringing
+};
+
+// an RGBA8 image, its rows tightly packed
+struct MipLevel
+{
+	int							width{};
+	int							height{};
+	std::vector<unsigned char>	rgba;
+};
+
+/*
+
+	A CPU mip chain generator, for textures that are cooked or uploaded with their levels instead
+	of calling glGenerateMipmap at load time.
+
+	Every level is filtered from the one before it, in float and in linear space when the texels
+	are sRGB encoded (color images are, normal and height maps are not), then rounded to 8 bits.
+	The filter is separable: a horizontal pass, then a vertical one, each over rows in parallel
+	(ParallelFor), one texel (4 channels) at a time with SSE2 where it is available. Odd sizes are
+	fine, the texels past the edges repeat the edge ones.
+
+		std::vector<MipLevel> levels = MipGenerator::Generate(MipGenerator::FromSurface(image), MipFilter::Kaiser);
+		for (size_t i = 0; i < levels.size(); ++i)
+			glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, levels[i].width, levels[i].height, GL_RGBA, GL_UNSIGNED_BYTE, levels[i].rgba.data());
+
+*/
+class MipGenerator
+{
+public:
+	// level 0 (a copy of image) and every smaller level down to 1x1
+	static std::vector<MipLevel>	Generate(const MipLevel& image, MipFilter filter = MipFilter::Kaiser, bool srgb = true);
+
+	// the pixels of image as RGBA8, whatever its format; empty if it cannot be converted
+	static MipLevel		FromSurface(SDL_Surface* image);
+	// IMG_Load and FromSurface; empty if the file cannot be read
+	static MipLevel		FromFile(const std::string& filename);
+
+	static const char*	FilterName(MipFilter filter);
+};
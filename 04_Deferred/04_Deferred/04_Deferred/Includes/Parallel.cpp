@@ -0,0 +1,94 @@
+#include "Parallel.h"
+
+namespace
+{
+	thread_local bool t_worker = false;
+}
+
+ThreadPool& ThreadPool::Shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+ThreadPool::ThreadPool()
+{
+	const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned i = 1; i < cores; ++i)
+		m_threads.emplace_back(&ThreadPool::Work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& thread : m_threads)
+		thread.join();
+}
+
+void ThreadPool::MarkWorkerThread()
+{
+	t_worker = true;
+}
+
+bool ThreadPool::IsWorkerThread()
+{
+	return t_worker;
+}
+
+void ThreadPool::Run(size_t count, const std::function<void(size_t)>& task)
+{
+	if (count == 0)
+		return;
+	if (count == 1 || m_threads.empty() || t_worker)
+	{
+		for (size_t i = 0; i < count; ++i)
+			task(i);
+		return;
+	}
+
+	// the job lives on this stack: it is only touched under the lock, and this waits until the last task is done
+	Job job{ &task, count, 0, 0 };
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_jobs.push_back(&job);
+	m_wake.notify_all();
+
+	while (RunNext(job, lock))
+		;
+	m_finished.wait(lock, [&job]() { return job.done == job.count; });
+}
+
+bool ThreadPool::RunNext(Job& job, std::unique_lock<std::mutex>& lock)
+{
+	if (job.next == job.count)
+		return false;
+
+	const size_t index = job.next++;
+	if (job.next == job.count)
+		m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), &job));
+
+	lock.unlock();
+	(*job.task)(index);
+	lock.lock();
+
+	if (++job.done == job.count)
+		m_finished.notify_all();
+	return true;
+}
+
+void ThreadPool::Work()
+{
+	t_worker = true;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		m_wake.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+		if (m_stop)
+			return;
+		RunNext(*m_jobs.front(), lock);
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ProgramObject.h"
+#include "ShaderObject.h"
+
+/*
+
+	ProgramPermutations is one set of shader files compiled with different defines. The program
+	of a set of defines is created by the first Get() that asks for it, with
+	ProgramObject::InitAsync(), so it becomes usable a few frames later; Prepare() does the same
+	ahead of time, e.g. in Init for the variants known to be needed.
+
+		ProgramPermutations scene({ { GL_VERTEX_SHADER, "Shaders/myVert.vert" }, { GL_FRAGMENT_SHADER, "Shaders/myFrag.frag" } });
+		scene.SetSetup([](ProgramObject& program) { program.SetUniformBlock<PerObject>("PerObject", 0); });
+		ProgramObject& program = scene.Get({ { "SHADOWS", "" } });
+
+	The key is the sorted list of defines, so their order does not matter. The programs live as
+	long as the set: the references Get() returns stay valid.
+
+*/
+class ProgramPermutations final
+{
+public:
+	using Stage		= std::pair<GLenum, std::string>;	// the type and the file of a shader
+	using Setup		= std::function<void(ProgramObject&)>;
+
+	ProgramPermutations(std::initializer_list<Stage> stages, std::initializer_list<ProgramObject::Binding> attribLocations = {},
+		std::initializer_list<ProgramObject::Binding> fragDataLocations = {});
+
+	ProgramPermutations(const ProgramPermutations&)				= delete;
+	ProgramPermutations& operator=(const ProgramPermutations&)	= delete;
+
+	// runs on every program right after it was created (uniform block bindings, ...), also on the existing ones
+	void			SetSetup(const Setup& setup);
+
+	// the program of defines, created now if it does not exist yet
+	ProgramObject&	Get(const ShaderDefines& defines);
+	void			Prepare(const ShaderDefines& defines) { Get(defines); }
+
+	size_t			Count() const { return m_programs.size(); }
+	// "A B=1" for every program, one per line
+	std::string		Dump() const;
+
+	// the defines in the order of the key: sorted by name, no duplicates
+	static ShaderDefines	Canonical(const ShaderDefines& defines);
+
+private:
+	std::vector<Stage>			m_stages;
+	std::vector<std::string>	m_names;		// owns the strings the bindings below point to
+	std::vector<ProgramObject::Binding>	m_attribLocations;
+	std::vector<ProgramObject::Binding>	m_fragDataLocations;
+	Setup						m_setup;
+
+	std::map<ShaderDefines, std::unique_ptr<ProgramObject>>	m_programs;
+};
@@ -0,0 +1,209 @@
+#include "RenderTargetPool.h"
+#include "GLCaps.h"
+#include "GLState.h"
+
+#include <algorithm>
+
+namespace
+{
+	bool IsDepthFormat(GLenum internalFormat)
+	{
+		switch (internalFormat)
+		{
+		case GL_DEPTH_COMPONENT16:
+		case GL_DEPTH_COMPONENT24:
+		case GL_DEPTH_COMPONENT32:
+		case GL_DEPTH_COMPONENT32F:
+			return true;
+		default:
+			return false;
+		}
+	}
+}
+
+RenderTargetPool::RenderTargetPool(GLsizei bucket, unsigned stableFrames, unsigned evictFrames)
+	: m_bucket(std::max<GLsizei>(bucket, 1)), m_stableFrames(stableFrames), m_evictFrames(std::max(evictFrames, 1u))
+{
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+	Clear();
+}
+
+GLsizei RenderTargetPool::RoundUp(GLsizei size, GLsizei bucket)
+{
+	return std::max<GLsizei>(1, (size + bucket - 1) / bucket) * bucket;
+}
+
+GLsizeiptr RenderTargetPool::BytesPerTexel(GLenum internalFormat)
+{
+	switch (internalFormat)
+	{
+	case GL_R8:					return 1;
+	case GL_RG8:
+	case GL_R16F:
+	case GL_DEPTH_COMPONENT16:	return 2;
+	case GL_RGBA16F:
+	case GL_RG32F:				return 8;
+	case GL_RGBA32F:			return 16;
+	default:					return 4;	// RGBA8, RG16F, R32F, the 24 and 32 bit depth formats
+	}
+}
+
+void RenderTargetPool::NewFrame()
+{
+	++m_frame;
+
+	// forget the sizes that were not asked for in the last frame
+	m_requests.erase(std::remove_if(m_requests.begin(), m_requests.end(), [&](const Request& request) {
+		return request.lastFrame + 1 < m_frame;
+	}), m_requests.end());
+
+	for (auto it = m_entries.begin(); it != m_entries.end(); )
+	{
+		if (!it->inUse && it->lastUsed + m_evictFrames < m_frame)
+		{
+			GLState::DeleteTextures(1, &it->target.texture);
+			it = m_entries.erase(it);
+			++m_evictions;
+		}
+		else
+			++it;
+	}
+}
+
+bool RenderTargetPool::Track(GLenum internalFormat, GLsizei width, GLsizei height)
+{
+	for (Request& request : m_requests)
+	{
+		if (request.internalFormat != internalFormat || request.width != width || request.height != height)
+			continue;
+
+		if (request.lastFrame + 1 < m_frame)
+			request.firstFrame = m_frame;
+		request.lastFrame = m_frame;
+		return m_frame - request.firstFrame >= m_stableFrames;
+	}
+
+	m_requests.push_back({ internalFormat, width, height, m_frame, m_frame });
+	return m_stableFrames == 0;
+}
+
+RenderTargetPool::Target RenderTargetPool::Acquire(GLenum internalFormat, GLsizei width, GLsizei height)
+{
+	const GLsizei bucketWidth  = RoundUp(width, m_bucket);
+	const GLsizei bucketHeight = RoundUp(height, m_bucket);
+	const bool settled = Track(internalFormat, bucketWidth, bucketHeight);
+
+	// the exact bucket, or while the size is not settled yet, the smallest one that is big enough
+	Entry* best = nullptr;
+	for (Entry& entry : m_entries)
+	{
+		const Target& target = entry.target;
+		if (entry.inUse || target.internalFormat != internalFormat || target.width < width || target.height < height)
+			continue;
+
+		if (target.width == bucketWidth && target.height == bucketHeight)
+		{
+			best = &entry;
+			break;
+		}
+		if (!settled && (!best || GLsizeiptr(target.width) * target.height < GLsizeiptr(best->target.width) * best->target.height))
+			best = &entry;
+	}
+
+	if (best)
+	{
+		++m_reuses;
+		if (best->target.width != bucketWidth || best->target.height != bucketHeight)
+			++m_oversized;
+	}
+	else
+	{
+		m_entries.push_back({ Create(internalFormat, bucketWidth, bucketHeight) });
+		best = &m_entries.back();
+		++m_allocations;
+	}
+
+	best->inUse		= true;
+	best->lastUsed	= m_frame;
+	best->target.usedWidth	= width;
+	best->target.usedHeight	= height;
+	return best->target;
+}
+
+void RenderTargetPool::Release(const Target& target)
+{
+	for (Entry& entry : m_entries)
+		if (entry.target.id == target.id)
+		{
+			entry.inUse		= false;
+			entry.lastUsed	= m_frame;
+			return;
+		}
+}
+
+void RenderTargetPool::Clear()
+{
+	for (const Entry& entry : m_entries)
+		GLState::DeleteTextures(1, &entry.target.texture);
+	m_entries.clear();
+	m_requests.clear();
+}
+
+RenderTargetPool::Stats RenderTargetPool::GetStats() const
+{
+	Stats stats;
+	stats.targets		= (unsigned)m_entries.size();
+	stats.allocations	= m_allocations;
+	stats.reuses		= m_reuses;
+	stats.oversized		= m_oversized;
+	stats.evictions		= m_evictions;
+
+	GLsizeiptr usedBytes = 0;
+	for (const Entry& entry : m_entries)
+	{
+		const Target& target = entry.target;
+		const GLsizeiptr texel = BytesPerTexel(target.internalFormat);
+		stats.bytes += texel * target.width * target.height;
+		if (entry.inUse)
+		{
+			++stats.inUse;
+			stats.bytesInUse += texel * target.width * target.height;
+			usedBytes += texel * target.usedWidth * target.usedHeight;
+		}
+	}
+	if (stats.bytesInUse > 0)
+		stats.occupancy = float(usedBytes) / float(stats.bytesInUse);
+	return stats;
+}
+
+// Single level and immutable where possible; sampling state comes from the sampler of the pass that reads it
+RenderTargetPool::Target RenderTargetPool::Create(GLenum internalFormat, GLsizei width, GLsizei height)
+{
+	Target target;
+	target.id				= m_nextId++;
+	target.internalFormat	= internalFormat;
+	target.width			= width;
+	target.height			= height;
+
+	if (GLCaps::Get().directStateAccess)
+	{
+		glCreateTextures(GL_TEXTURE_2D, 1, &target.texture);
+		glTextureStorage2D(target.texture, 1, internalFormat, width, height);
+		return target;
+	}
+
+	glGenTextures(1, &target.texture);
+	GLState::BindTexture(GL_TEXTURE_2D, target.texture);
+	if (GLCaps::Get().textureStorage)
+		glTexStorage2D(GL_TEXTURE_2D, 1, internalFormat, width, height);
+	else
+	{
+		const GLenum format = IsDepthFormat(internalFormat) ? GL_DEPTH_COMPONENT : GL_RGBA;
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_FLOAT, nullptr);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0); // complete without mipmaps
+	}
+	return target;
+}
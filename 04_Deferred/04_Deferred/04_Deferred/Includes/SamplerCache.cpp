@@ -0,0 +1,81 @@
+#include "SamplerCache.h"
+#include "GLCaps.h"
+#include "GLState.h"
+
+#include <algorithm>
+
+namespace
+{
+	struct CachedSampler
+	{
+		SamplerDesc	desc;
+		GLuint		sampler;
+	};
+
+	std::vector<CachedSampler> g_samplers;
+
+	float ClampAnisotropy(float anisotropy)
+	{
+		return std::max(1.0f, std::min(anisotropy, GLCaps::Get().maxAnisotropy));
+	}
+}
+
+GLuint SamplerCache::Get(const SamplerDesc& desc)
+{
+	if (!GLCaps::Get().samplerObjects)
+		return 0;
+
+	for (const CachedSampler& cached : g_samplers)
+		if (cached.desc == desc)
+			return cached.sampler;
+
+	GLuint sampler = 0;
+	if (GLCaps::Get().directStateAccess)
+		glCreateSamplers(1, &sampler);
+	else
+		glGenSamplers(1, &sampler);
+
+	glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, desc.minFilter);
+	glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, desc.magFilter);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, desc.wrapS);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, desc.wrapT);
+	if (GLCaps::Get().maxAnisotropy > 1)
+		glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, ClampAnisotropy(desc.anisotropy));
+
+	g_samplers.push_back({ desc, sampler });
+	return sampler;
+}
+
+void SamplerCache::Bind(GLuint unit, const SamplerDesc& desc)
+{
+	if (GLCaps::Get().samplerObjects)
+		GLState::BindSampler(unit, Get(desc));
+}
+
+void SamplerCache::ApplyToTexture(const SamplerDesc& desc, GLenum target)
+{
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, desc.minFilter);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, desc.magFilter);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, desc.wrapS);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, desc.wrapT);
+	if (GLCaps::Get().maxAnisotropy > 1)
+		glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, ClampAnisotropy(desc.anisotropy));
+}
+
+void SamplerCache::Unbind(GLuint unit)
+{
+	if (GLCaps::Get().samplerObjects)
+		GLState::BindSampler(unit, 0);
+}
+
+size_t SamplerCache::Count()
+{
+	return g_samplers.size();
+}
+
+void SamplerCache::Clear()
+{
+	for (const CachedSampler& cached : g_samplers)
+		GLState::DeleteSamplers(1, &cached.sampler);
+	g_samplers.clear();
+}
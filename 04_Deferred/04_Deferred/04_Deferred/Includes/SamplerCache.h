@@ -0,0 +1,60 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <cstddef>
+#include <vector>
+
+/*
+
+	How a texture is sampled: filtering, wrapping and anisotropy. Bound per texture unit as a
+	sampler object, so the same texture can be read differently by different passes and the
+	textures themselves carry no sampling state.
+
+*/
+struct SamplerDesc
+{
+	GLenum	minFilter{ GL_LINEAR_MIPMAP_LINEAR };
+	GLenum	magFilter{ GL_LINEAR };
+	GLenum	wrapS{ GL_REPEAT };
+	GLenum	wrapT{ GL_REPEAT };
+	float	anisotropy{ 1 };	// clamped to what the context supports
+
+	bool operator==(const SamplerDesc& rhs) const
+	{
+		return minFilter == rhs.minFilter && magFilter == rhs.magFilter && wrapS == rhs.wrapS && wrapT == rhs.wrapT && anisotropy == rhs.anisotropy;
+	}
+
+	// the usual combinations
+	static SamplerDesc Trilinear(float anisotropy = 1)	{ return { GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_REPEAT, GL_REPEAT, anisotropy }; }
+	static SamplerDesc Linear()							{ return { GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, 1 }; }
+	static SamplerDesc Nearest()						{ return { GL_NEAREST, GL_NEAREST, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, 1 }; }
+};
+
+/*
+
+	SamplerCache hands out one sampler object per distinct SamplerDesc. There are only a few
+	kinds in a frame, so a linear search is all it takes. The objects live until Clear(), which
+	has to be called while the context still exists.
+
+	Without sampler objects (before GL 3.3) Get() returns 0, and ApplyToTexture() writes the
+	description into the parameters of the texture instead.
+
+*/
+class SamplerCache final
+{
+public:
+	SamplerCache() = delete;
+
+	static GLuint	Get(const SamplerDesc& desc);
+	// binds the sampler of desc to unit through GLState
+	static void		Bind(GLuint unit, const SamplerDesc& desc);
+	// the fallback: sets desc as the parameters of the texture bound to target on the active unit
+	static void		ApplyToTexture(const SamplerDesc& desc, GLenum target = GL_TEXTURE_2D);
+	// lets the texture on unit use its own parameters again (code that knows nothing of samplers, e.g. ImGui)
+	static void		Unbind(GLuint unit);
+
+	static size_t	Count();
+	static void		Clear();
+};
@@ -1,11 +1,37 @@
 #include "ShaderObject.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 
-ShaderObject::ShaderObject(GLenum pType)
+namespace
+{
+	// the file name of an #include "file" line
+	bool IncludeName(const std::string& line, std::string& name)
+	{
+		const size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+			return false;
+
+		const size_t open = line.find('"', start + 8);
+		const size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+		if (close == std::string::npos)
+			return false;
+
+		name = line.substr(open + 1, close - open - 1);
+		return true;
+	}
+
+	std::string Directory(const std::string& path)
+	{
+		const size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+}
+
+ShaderObject::ShaderObject(GLenum pType) : m_type(pType), m_id(glCreateShader(pType)), m_pending(false)
 {
-	m_id = glCreateShader(pType);
 }
 
 ShaderObject::~ShaderObject()
@@ -19,8 +45,16 @@ ShaderObject::~ShaderObject()
 
 ShaderObject::ShaderObject(ShaderObject &&rhs)
 {
+	m_type = rhs.m_type;
+	m_origin = std::move(rhs.m_origin);
+	m_defines = std::move(rhs.m_defines);
+	m_source = std::move(rhs.m_source);
+	m_files = std::move(rhs.m_files);
+	m_loading = std::move(rhs.m_loading);
 	m_id = rhs.m_id;
+	m_pending = rhs.m_pending;
 	rhs.m_id = 0;
+	rhs.m_pending = false;
 }
 
 ShaderObject & ShaderObject::operator=(ShaderObject &&rhs)
@@ -28,24 +62,93 @@ ShaderObject & ShaderObject::operator=(ShaderObject &&rhs)
 	if (&rhs == this)
 		return *this;
 
+	m_type = rhs.m_type;
+	m_origin = std::move(rhs.m_origin);
+	m_defines = std::move(rhs.m_defines);
+	m_source = std::move(rhs.m_source);
+	m_files = std::move(rhs.m_files);
+	m_loading = std::move(rhs.m_loading);
 	m_id = rhs.m_id;
+	m_pending = rhs.m_pending;
 	rhs.m_id = 0;
+	rhs.m_pending = false;
 
 	return *this;
 }
 
-ShaderObject::ShaderObject(GLenum pType, const std::string &pFilenameOrSource)
+ShaderObject::ShaderObject(GLenum pType, const std::string &pFilenameOrSource, const ShaderDefines& pDefines) : m_type(pType), m_origin(pFilenameOrSource), m_defines(pDefines), m_id(0), m_pending(true)
 {
-	m_id = glCreateShader(pType);
+	// the shaders of a program are read at the same time, while the main thread goes on
+	m_loading = std::async(std::launch::async, [pFilenameOrSource, pDefines]() {
+		Loaded loaded;
+		if (!LoadFile(pFilenameOrSource.c_str(), loaded.source, loaded.files))
+			loaded.source = pFilenameOrSource;
+		InsertDefines(loaded.source, pDefines);
+		return loaded;
+	});
+}
 
-	if (!FromFile(pType, pFilenameOrSource.c_str()))
+ShaderObject::operator unsigned int() const
+{
+	if (m_pending)
 	{
-		if ( !std::ifstream(pFilenameOrSource).good())
-			FromMemory(pType, pFilenameOrSource);
+		m_pending = false;
+		m_id = glCreateShader(m_type);
+
+		// no status query: the driver may still be compiling when the next shader is submitted
+		const char* sourcePointer = Source().c_str();
+		glShaderSource(m_id, 1, &sourcePointer, nullptr);
+		glCompileShader(m_id);
 	}
+	return m_id;
+}
+
+const std::string& ShaderObject::Source() const
+{
+	TakeLoaded();
+	return m_source;
+}
+
+const std::vector<std::string>& ShaderObject::Files() const
+{
+	TakeLoaded();
+	return m_files;
+}
+
+bool ShaderObject::IsLoaded() const
+{
+	return !m_loading.valid() || m_loading.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void ShaderObject::TakeLoaded() const
+{
+	if (!m_loading.valid())
+		return;
+
+	Loaded loaded = m_loading.get();
+	m_source = std::move(loaded.source);
+	m_files = std::move(loaded.files);
 }
 
 bool ShaderObject::FromFile(GLenum _shaderType, const char* _filename)
+{
+	m_loading = std::future<Loaded>();	// the source of the constructor, if any, is replaced
+	m_files.clear();
+	if (!LoadFile(_filename, m_source, m_files))
+		return false;
+
+	m_type = _shaderType;	// the source of the constructor, if any, is replaced
+	m_origin = _filename;
+	m_defines.clear();
+	m_pending = false;
+	if (m_id == 0)
+		m_id = glCreateShader(m_type);
+
+	// trjnk vissza a fordts eredmnyvel
+	return CompileShaderFromMemory(m_id, m_source) > 0;
+}
+
+bool ShaderObject::LoadFile(const char* _filename, std::string& _source, std::vector<std::string>& _files)
 {
 	// _fileName megnyitasa
 	std::ifstream shaderStream(_filename);
@@ -53,23 +156,87 @@ bool ShaderObject::FromFile(GLenum _shaderType, const char* _filename)
 	if (!shaderStream.is_open())
 		return false;
 
+	const bool included = !_files.empty();
+	const int fileIndex = int(_files.size());
+	_files.push_back(_filename);
+
 	// shaderkod betoltese _fileName fajlbol
 	std::string shaderCode = "";
 
 	// file tartalmanak betoltese a shaderCode string-be
 	std::string line = "";
+	std::string includeName;
+	int lineNumber = 0;
 	while (std::getline(shaderStream, line))
-		shaderCode += line + "\n";
+	{
+		++lineNumber;
+		if (!IncludeName(line, includeName))
+		{
+			shaderCode += line + "\n";
+			continue;
+		}
+
+		const std::string path = Directory(_filename) + includeName;
+		if (std::find(_files.begin(), _files.end(), path) != _files.end())
+		{
+			shaderCode += "\n";	// once only
+			continue;
+		}
+
+		std::string includedCode;
+		if (!LoadFile(path.c_str(), includedCode, _files))
+		{
+			std::cerr << "[ShaderObject] " << _filename << "(" << lineNumber << "): cannot include " << path << std::endl;
+			shaderCode += "\n";
+			continue;
+		}
+		shaderCode += includedCode + "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+	}
 
 	shaderStream.close();
 
-	// trjnk vissza a fordts eredmnyvel
-	return CompileShaderFromMemory(m_id, shaderCode) > 0;
+	// an included file starts with its own numbering
+	_source = included ? "#line 1 " + std::to_string(fileIndex) + "\n" + shaderCode : shaderCode;
+	return true;
+}
+
+void ShaderObject::InsertDefines(std::string& _source, const ShaderDefines& _defines)
+{
+	if (_defines.empty())
+		return;
+
+	// #version has to come first: the defines go right after it
+	size_t position = 0;
+	int versionLine = 0;
+	const size_t version = _source.find("#version");
+	if (version != std::string::npos)
+	{
+		position = _source.find('\n', version);
+		position = position == std::string::npos ? _source.size() : position + 1;
+		versionLine = int(std::count(_source.begin(), _source.begin() + position, '\n'));
+	}
+
+	std::string defines;
+	for (const auto& define : _defines)
+		defines += "#define " + define.first + " " + define.second + "\n";
+	defines += "#line " + std::to_string(versionLine + 1) + " 0\n";
+
+	_source.insert(position, defines);
 }
 
 bool ShaderObject::FromMemory(GLenum _shaderType, const std::string& _source)
 {
-	CompileShaderFromMemory(m_id, _source);
+	m_type = _shaderType;
+	m_origin = _source;
+	m_defines.clear();
+	m_source = _source;
+	m_loading = std::future<Loaded>();
+	m_files.clear();
+	m_pending = false;
+	if (m_id == 0)
+		m_id = glCreateShader(m_type);
+
+	CompileShaderFromMemory(m_id, m_source);
 	if (m_id != 0)
 		return true;
 	else
@@ -85,6 +252,11 @@ GLuint ShaderObject::CompileShaderFromMemory(const GLuint _shaderObject, const s
 	// shader leforditasa
 	glCompileShader(_shaderObject);
 
+	return CheckCompileStatus(_shaderObject) ? _shaderObject : 0;
+}
+
+bool ShaderObject::CheckCompileStatus(GLuint _shaderObject)
+{
 	// ellenorizzuk, h minden rendben van-e
 	GLint result = GL_FALSE;
 	int infoLogLength;
@@ -102,8 +274,8 @@ GLuint ShaderObject::CompileShaderFromMemory(const GLuint _shaderObject, const s
 
 		delete[] error;
 
-		return 0;
+		return false;
 	}
 
-	return _shaderObject;
+	return true;
 }
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "StaticBatch.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+
+namespace
+{
+	// frustum planes (Gribb-Hartmann) of a view-projection matrix, pointing inwards
+	std::array<glm::vec4, 6> ExtractFrustumPlanes(const glm::mat4& m)
+	{
+		glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+		glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+		glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+		glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+		return { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2 };
+	}
+
+	bool IsVisible(const std::array<glm::vec4, 6>& planes, const StaticBatch::Bounds& b)
+	{
+		for (const glm::vec4& p : planes)
+		{
+			// the corner of the box that lies furthest along the plane normal
+			glm::vec3 corner(p.x >= 0 ? b.max.x : b.min.x,
+							 p.y >= 0 ? b.max.y : b.min.y,
+							 p.z >= 0 ? b.max.z : b.min.z);
+			if (glm::dot(glm::vec3(p.x, p.y, p.z), corner) + p.w < 0)
+				return false;
+		}
+		return true;
+	}
+}
+
+StaticBatch::~StaticBatch()
+{
+	Clean();
+}
+
+std::shared_ptr<GeometryHeap> StaticBatch::SharedHeap()
+{
+	return GeometryHeap::Shared(sizeof(Vertex), {
+		AttributeData(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, mesh) + offsetof(Mesh::Vertex, position))),
+		AttributeData(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, mesh) + offsetof(Mesh::Vertex, normal))),
+		AttributeData(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, mesh) + offsetof(Mesh::Vertex, texcoord))),
+		AttributeData(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(offsetof(Vertex, mesh) + offsetof(Mesh::Vertex, tangent))),
+		AttributeData(MATERIAL_ATTRIBUTE, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, material)),
+	});
+}
+
+void StaticBatch::Clean()
+{
+	for (Batch& batch : m_batches)
+		if (batch.allocation != GeometryHeap::INVALID_HANDLE)
+			m_heap->Free(batch.allocation);
+	m_batches.clear();
+	m_materials.clear();
+	m_objectCount = 0;
+}
+
+StaticBatch::Batch& StaticBatch::FindOrCreateBatch(const Material& material)
+{
+	if (std::find(m_materials.begin(), m_materials.end(), material) == m_materials.end())
+		m_materials.push_back(material);
+
+	// indexed materials share a batch if only their index differs: the callback sees one material per batch
+	for (Batch& batch : m_batches)
+	{
+		const bool sameIndex = material.index >= 0 ? batch.material.index >= 0 : batch.material.index == material.index;
+		if (sameIndex && batch.material.texture == material.texture && batch.material.Kd == material.Kd)
+			return batch;
+	}
+
+	m_batches.emplace_back();
+	m_batches.back().material = material;
+	return m_batches.back();
+}
+
+void StaticBatch::Add(const Mesh& mesh, const glm::mat4& world, const Material& material)
+{
+	Add(mesh.getVertices(), mesh.getIndices(), world, material);
+}
+
+void StaticBatch::Add(const std::vector<Mesh::Vertex>& vertices, const std::vector<GLuint>& indices, const glm::mat4& world, const Material& material)
+{
+	Batch& batch = FindOrCreateBatch(material);
+
+	const glm::mat4 worldIT = glm::transpose(glm::inverse(world));
+	const GLuint baseVertex = (GLuint)batch.vertices.size();
+	const GLfloat materialIndex = GLfloat(std::max(0, material.index));
+
+	Object object;
+	object.firstIndex = batch.indices.size();
+	object.indexCount = (GLsizei)indices.size();
+	object.bounds.min = glm::vec3(std::numeric_limits<float>::max());
+	object.bounds.max = glm::vec3(-std::numeric_limits<float>::max());
+
+	// pre-transform into world space
+	for (const Mesh::Vertex& v : vertices)
+	{
+		Mesh::Vertex w = v;
+		w.position = glm::vec3(world * glm::vec4(v.position, 1));
+		w.normal   = glm::vec3(worldIT * glm::vec4(v.normal, 0));
+		if (glm::dot(w.normal, w.normal) > 0)
+			w.normal = glm::normalize(w.normal);
+
+		// tangents follow the surface, so they are transformed like positions (handedness is kept)
+		const glm::vec3 tangent = glm::mat3(world) * glm::vec3(v.tangent);
+		if (glm::dot(tangent, tangent) > 0)
+			w.tangent = glm::vec4(glm::normalize(tangent), v.tangent.w);
+
+		object.bounds.min = glm::min(object.bounds.min, w.position);
+		object.bounds.max = glm::max(object.bounds.max, w.position);
+
+		batch.vertices.push_back({ w, materialIndex });
+	}
+
+	for (GLuint index : indices)
+		batch.indices.push_back(baseVertex + index);
+
+	batch.objects.push_back(object);
+	++m_objectCount;
+}
+
+void StaticBatch::Build()
+{
+	if (!m_heap)
+		m_heap = SharedHeap();
+
+	for (Batch& batch : m_batches)
+	{
+		if (batch.vertices.empty() || batch.indices.empty())
+			continue;
+
+		if (batch.allocation != GeometryHeap::INVALID_HANDLE)
+			m_heap->Free(batch.allocation);
+		batch.allocation = m_heap->Allocate(batch.vertices.data(), batch.vertices.size(), batch.indices.data(), batch.indices.size());
+
+		batch.drawCounts.reserve(batch.objects.size());
+		batch.drawOffsets.reserve(batch.objects.size());
+		batch.drawBaseVertices.reserve(batch.objects.size());
+
+		// the CPU copy stays until Clean(): a later Build() uploads the whole batch again, with the
+		// ranges of its objects unchanged
+	}
+}
+
+void StaticBatch::Draw(const glm::mat4& viewProj, const std::function<void(const Material&)>& setMaterial)
+{
+	const std::array<glm::vec4, 6> planes = ExtractFrustumPlanes(viewProj);
+
+	m_culledLastDraw = 0;
+	for (Batch& batch : m_batches)
+	{
+		if (batch.allocation == GeometryHeap::INVALID_HANDLE)
+			continue;
+
+		// the heap may have moved the batch since the last frame
+		const GeometryHeap::Allocation& allocation = m_heap->Get(batch.allocation);
+
+		// collect the visible objects, merging neighbouring index ranges
+		batch.drawCounts.clear();
+		batch.drawOffsets.clear();
+		batch.drawBaseVertices.clear();
+		size_t rangeEnd = std::numeric_limits<size_t>::max();
+		for (const Object& object : batch.objects)
+		{
+			if (!IsVisible(planes, object.bounds))
+			{
+				++m_culledLastDraw;
+				continue;
+			}
+
+			if (object.firstIndex == rangeEnd)
+				batch.drawCounts.back() += object.indexCount;
+			else
+			{
+				batch.drawCounts.push_back(object.indexCount);
+				batch.drawOffsets.push_back((const void*)((allocation.firstIndex + object.firstIndex) * sizeof(GLuint)));
+				batch.drawBaseVertices.push_back(allocation.baseVertex);
+			}
+			rangeEnd = object.firstIndex + object.indexCount;
+		}
+
+		if (batch.drawCounts.empty())
+			continue;
+
+		setMaterial(batch.material);
+
+		m_heap->Bind();
+		if (batch.drawCounts.size() == 1)
+			glDrawElementsBaseVertex(GL_TRIANGLES, batch.drawCounts[0], GL_UNSIGNED_INT, batch.drawOffsets[0], batch.drawBaseVertices[0]);
+		else
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES, batch.drawCounts.data(), GL_UNSIGNED_INT, batch.drawOffsets.data(), (GLsizei)batch.drawCounts.size(), batch.drawBaseVertices.data());
+	}
+}
@@ -0,0 +1,174 @@
+#include "StreamRingBuffer.h"
+#include "GLCaps.h"
+#include "GLState.h"
+#include "FrameContext.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	const GLbitfield PERSISTENT_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	// how long a single glClientWaitSync may block before we check again
+	const GLuint64 WAIT_TIMEOUT_NS = 1000000;
+}
+
+StreamRingBuffer::StreamRingBuffer(GLsizeiptr regionSize, unsigned regionCount)
+	: m_regionSize(regionSize), m_regionCount(regionCount)
+{
+	if (m_regionCount == 0)
+		m_regionCount = FrameContext::IsInitialized() ? FrameContext::FramesInFlight() : 3;
+	m_fences.resize(m_regionCount, nullptr);
+
+	const GLsizeiptr totalSize = m_regionSize * m_regionCount;
+
+	if (GLCaps::Get().directStateAccess)
+	{
+		glCreateBuffers(1, &m_buffer);
+		if (GLCaps::Get().bufferStorage)
+		{
+			glNamedBufferStorage(m_buffer, totalSize, nullptr, PERSISTENT_FLAGS);
+			m_mapped = static_cast<unsigned char*>(glMapNamedBufferRange(m_buffer, 0, totalSize, PERSISTENT_FLAGS));
+		}
+	}
+	else
+	{
+		glGenBuffers(1, &m_buffer);
+		GLState::BindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		if (GLCaps::Get().bufferStorage)
+		{
+			glBufferStorage(GL_COPY_WRITE_BUFFER, totalSize, nullptr, PERSISTENT_FLAGS);
+			m_mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalSize, PERSISTENT_FLAGS));
+		}
+	}
+
+	if (m_mapped == nullptr)
+	{
+		Orphan();
+		m_staging.resize(m_regionSize);
+	}
+}
+
+StreamRingBuffer::~StreamRingBuffer()
+{
+	for (GLsync fence : m_fences)
+		if (fence)
+			glDeleteSync(fence);
+
+	if (m_buffer == 0)
+		return;
+
+	if (m_mapped && GLCaps::Get().directStateAccess)
+		glUnmapNamedBuffer(m_buffer);
+	else if (m_mapped)
+	{
+		GLState::BindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	}
+	GLState::DeleteBuffers(1, &m_buffer);
+}
+
+void StreamRingBuffer::BeginFrame()
+{
+	// the fence of the frame context already covers the region of its slot
+	m_paced = FrameContext::IsInitialized() && FrameContext::FramesInFlight() <= m_regionCount;
+
+	m_region = m_paced ? FrameContext::Index() : (m_region + 1) % m_regionCount;
+	m_head = 0;
+
+	GLsync& fence = m_fences[m_region];
+	if (fence)
+	{
+		GLenum result = glClientWaitSync(fence, 0, 0);
+		if (result == GL_TIMEOUT_EXPIRED)
+		{
+			// the GPU is still reading this region: we are more than regionCount frames ahead
+			++m_waits;
+			do
+				result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_TIMEOUT_NS);
+			while (result == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	// orphaning: the driver hands out fresh storage, the old one lives on while the GPU needs it
+	if (!m_mapped)
+		Orphan();
+}
+
+void StreamRingBuffer::Orphan()
+{
+	if (GLCaps::Get().directStateAccess)
+		glNamedBufferData(m_buffer, m_regionSize * m_regionCount, nullptr, GL_STREAM_DRAW);
+	else
+	{
+		GLState::BindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, m_regionSize * m_regionCount, nullptr, GL_STREAM_DRAW);
+	}
+}
+
+void StreamRingBuffer::EndFrame()
+{
+	if (m_mapped && !m_paced)
+		m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	m_bytesLastFrame = m_head;
+	m_waitsLastFrame = m_waits;
+	m_waits = 0;
+}
+
+StreamRingBuffer::Chunk StreamRingBuffer::Allocate(GLsizeiptr size, GLsizeiptr alignment)
+{
+	const GLintptr regionStart = m_region * m_regionSize;
+	if (alignment < 1)
+		alignment = 1;
+
+	// align the absolute offset, that is what glBindBufferRange checks
+	const GLintptr offset = (regionStart + m_head + alignment - 1) / alignment * alignment;
+	if (offset + size > regionStart + m_regionSize)
+	{
+		if (!m_overflowReported)
+			std::cerr << "[StreamRingBuffer] frame region of " << m_regionSize << " bytes is full" << std::endl;
+		m_overflowReported = true;
+		return Chunk();
+	}
+	m_head = offset + size - regionStart;
+
+	Chunk chunk;
+	chunk.offset = offset;
+	chunk.size = size;
+	chunk.data = m_mapped ? m_mapped + offset : m_staging.data() + (offset - regionStart);
+	return chunk;
+}
+
+GLsizeiptr StreamRingBuffer::Available(GLsizeiptr alignment) const
+{
+	const GLintptr regionStart = m_region * m_regionSize;
+	if (alignment < 1)
+		alignment = 1;
+
+	const GLintptr offset = (regionStart + m_head + alignment - 1) / alignment * alignment;
+	return std::max<GLsizeiptr>(0, regionStart + m_regionSize - offset);
+}
+
+void StreamRingBuffer::Commit(const Chunk& chunk)
+{
+	if (m_mapped || !chunk)
+		return;
+
+	if (GLCaps::Get().directStateAccess)
+		glNamedBufferSubData(m_buffer, chunk.offset, chunk.size, chunk.data);
+	else
+	{
+		GLState::BindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, chunk.offset, chunk.size, chunk.data);
+	}
+}
+
+void StreamRingBuffer::BindRange(GLenum target, GLuint index, const Chunk& chunk)
+{
+	Commit(chunk);
+	GLState::BindBufferRange(target, index, m_buffer, chunk.offset, chunk.size);
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include "GLCaps.h"
+
+#include <cstring>
+#include <vector>
+
+/*
+
+	StreamRingBuffer is a buffer object for data that is rewritten every frame (per object
+	uniforms, instance data, dynamic vertices). It is split into regionCount regions of
+	regionSize bytes, one per frame: the CPU writes the region of the current frame while the GPU
+	may still read the previous ones. A fence at the end of every frame tells when a region can
+	be reused. With a FrameContext that fence is the one of the frame: there is a region per
+	frame in flight, the frame's Index() selects it, and BeginFrame() never waits on its own.
+
+	The storage is allocated with glBufferStorage and mapped once, persistently and coherently,
+	so Allocate() returns a pointer straight into GPU visible memory. On contexts without buffer
+	storage it falls back to orphaning: Allocate() returns CPU side memory, which is uploaded
+	with glBufferSubData by Commit() (BindRange() commits too), and the buffer is orphaned at the
+	start of every frame.
+
+	Per frame: BeginFrame(), any number of Allocate() / BindRange(), EndFrame().
+
+*/
+class StreamRingBuffer final
+{
+public:
+	struct Chunk
+	{
+		void*		data{};		// write the contents here
+		GLintptr	offset{};	// from the start of Buffer()
+		GLsizeiptr	size{};
+
+		explicit operator bool() const { return data != nullptr; }
+	};
+
+	// regionCount 0: one region per frame in flight of FrameContext, 3 without one
+	explicit StreamRingBuffer(GLsizeiptr regionSize = 1 << 20, unsigned regionCount = 0);
+	~StreamRingBuffer();
+
+	StreamRingBuffer(const StreamRingBuffer&)				= delete;
+	StreamRingBuffer& operator=(const StreamRingBuffer&)	= delete;
+
+	// waits until the GPU is done with the next region, then makes it current
+	void	BeginFrame();
+	// fences the region of the frame
+	void	EndFrame();
+
+	// an empty chunk if the region of the frame is full
+	Chunk	Allocate(GLsizeiptr size, GLsizeiptr alignment = 16);
+	// the bytes an Allocate() with alignment could still get in the region of the frame
+	GLsizeiptr	Available(GLsizeiptr alignment = 16) const;
+
+	// copies value into a new chunk
+	template <typename T>
+	Chunk	Push(const T& value, GLsizeiptr alignment = 16);
+
+	// makes the chunk visible to the GPU; only does something in the orphaning fallback
+	void	Commit(const Chunk& chunk);
+	// glBindBufferRange of the chunk to an indexed target (GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER, ...)
+	void	BindRange(GLenum target, GLuint index, const Chunk& chunk);
+	// Push() with the offset alignment of uniform buffers, then BindRange() to binding: the only GL call
+	// (two in the fallback) to set a whole uniform block. False if the region is full.
+	template <typename T>
+	bool	BindUniformBlock(GLuint binding, const T& block);
+
+	GLuint	Buffer()		const { return m_buffer; }
+	bool	IsPersistent()	const { return m_mapped != nullptr; }
+
+	// statistics of the last completed frame
+	GLsizeiptr	BytesLastFrame()	const { return m_bytesLastFrame; }
+	unsigned	WaitsLastFrame()	const { return m_waitsLastFrame; }	// times BeginFrame() had to wait for the GPU
+	// the regions follow FrameContext, which does the waiting
+	bool		IsPaced()			const { return m_paced; }
+
+private:
+	GLsizeiptr				m_regionSize;
+	unsigned				m_regionCount;
+	unsigned				m_region{};
+	GLsizeiptr				m_head{};
+
+	GLuint					m_buffer{};
+	unsigned char*			m_mapped{};		// the persistent mapping, null in the fallback
+	std::vector<unsigned char> m_staging;	// the fallback's CPU copy of the current region
+	std::vector<GLsync>		m_fences;
+
+	GLsizeiptr				m_bytesLastFrame{};
+	unsigned				m_waitsLastFrame{};
+	unsigned				m_waits{};
+	bool					m_overflowReported{};
+	bool					m_paced{};
+
+	// the fallback's glBufferData with no data
+	void	Orphan();
+};
+
+template <typename T>
+StreamRingBuffer::Chunk StreamRingBuffer::Push(const T& value, GLsizeiptr alignment)
+{
+	Chunk chunk = Allocate(sizeof(T), alignment);
+	if (chunk)
+		std::memcpy(chunk.data, &value, sizeof(T));
+	return chunk;
+}
+
+template <typename T>
+bool StreamRingBuffer::BindUniformBlock(GLuint binding, const T& block)
+{
+	const Chunk chunk = Push(block, GLCaps::Get().uniformBufferOffsetAlignment);
+	if (chunk)
+		BindRange(GL_UNIFORM_BUFFER, binding, chunk);
+	return bool(chunk);
+}
@@ -0,0 +1,279 @@
+#include "TextureAtlas.h"
+#include "GLCaps.h"
+#include "GLState.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	// a bottom-left skyline packer over a square of size x size cells
+	class Skyline
+	{
+	public:
+		explicit Skyline(int size) : m_size(size), m_segments{ { 0, 0 } } {}
+
+		// the lowest (then leftmost) place of a width x height rectangle; false if it does not fit
+		bool Insert(int width, int height, glm::ivec2& position)
+		{
+			int bestY = m_size, bestX = -1;
+			for (size_t i = 0; i < m_segments.size(); ++i)
+			{
+				const int x = m_segments[i].x;
+				if (x + width > m_size)
+					break;
+
+				// the rectangle rests on the highest segment under it
+				int y = 0;
+				for (size_t j = i; j < m_segments.size() && m_segments[j].x < x + width; ++j)
+					y = std::max(y, m_segments[j].y);
+				if (y + height <= m_size && y < bestY)
+				{
+					bestY = y;
+					bestX = x;
+				}
+			}
+			if (bestX < 0)
+				return false;
+
+			position = glm::ivec2(bestX, bestY);
+			Raise(bestX, width, bestY + height);
+			return true;
+		}
+
+	private:
+		int						m_size;
+		std::vector<glm::ivec2>	m_segments;		// x where a segment starts, y its height; it ends where the next one starts
+
+		void Raise(int x, int width, int y)
+		{
+			// the height of the skyline just right of the rectangle
+			const int end = x + width;
+			int heightAtEnd = 0;
+			for (const glm::ivec2& segment : m_segments)
+				if (segment.x <= end)
+					heightAtEnd = segment.y;
+
+			std::vector<glm::ivec2> segments;
+			for (const glm::ivec2& segment : m_segments)
+				if (segment.x < x)
+					segments.push_back(segment);
+			segments.push_back({ x, y });
+			if (end < m_size)
+				segments.push_back({ end, heightAtEnd });
+			for (const glm::ivec2& segment : m_segments)
+				if (segment.x > end)
+					segments.push_back(segment);
+
+			// neighbours of the same height are one segment
+			m_segments.clear();
+			for (const glm::ivec2& segment : segments)
+				if (m_segments.empty() || m_segments.back().y != segment.y)
+					m_segments.push_back(segment);
+		}
+	};
+
+	struct Placement
+	{
+		size_t		image;
+		glm::ivec2	cells;		// the size with the gutter, in cells of padding x padding texels
+		int			page;
+		glm::ivec2	position;	// in cells
+	};
+
+	int PositiveModulo(int a, int b)
+	{
+		return (a % b + b) % b;
+	}
+}
+
+TextureAtlas::TextureAtlas(GLsizei layerSize, GLsizei padding)
+	: m_layerSize(layerSize), m_padding(std::max(1, padding))
+{
+}
+
+TextureAtlas::~TextureAtlas()
+{
+	Clean();
+}
+
+void TextureAtlas::Clean()
+{
+	if (m_texture != 0)
+		GLState::DeleteTextures(1, &m_texture);
+	m_texture = 0;
+	m_images.clear();
+	m_regions.clear();
+	m_stats = Stats();
+}
+
+TextureAtlas::Handle TextureAtlas::Add(const std::string& filename)
+{
+	MipLevel image = MipGenerator::FromFile(filename);
+	if (image.rgba.empty())
+	{
+		std::cerr << "[TextureAtlas] Error loading image file " << filename << std::endl;
+		return INVALID_HANDLE;
+	}
+	return Add(std::move(image));
+}
+
+TextureAtlas::Handle TextureAtlas::Add(MipLevel image)
+{
+	m_images.push_back(std::move(image));
+	m_regions.emplace_back();
+	return Handle(m_images.size() - 1);
+}
+
+bool TextureAtlas::Build()
+{
+	if (m_images.empty())
+		return false;
+
+	const int fullLevels = int(std::log2(m_layerSize)) + 1;
+	const int packedLevels = std::min(fullLevels, int(std::log2(m_padding)) + 1);
+	const int cellsPerLayer = m_layerSize / m_padding;
+	const GLsizei largest = m_layerSize - 2 * m_padding;
+
+	// the textures bigger than a layer are replaced by the first level that fits
+	m_stats.textures = unsigned(m_images.size());
+	for (MipLevel& image : m_images)
+	{
+		const bool full = image.width == m_layerSize && image.height == m_layerSize;
+		if (full || (image.width <= largest && image.height <= largest))
+			continue;
+		const std::vector<MipLevel> levels = MipGenerator::Generate(image);
+		image = *std::find_if(levels.begin(), levels.end(), [&](const MipLevel& level) {
+			return (level.width == m_layerSize && level.height == m_layerSize) || (level.width <= largest && level.height <= largest);
+		});
+		++m_stats.shrunk;
+	}
+
+	// the full size textures first, one layer each
+	std::vector<size_t> full, packed;
+	for (size_t i = 0; i < m_images.size(); ++i)
+		(m_images[i].width == m_layerSize && m_images[i].height == m_layerSize ? full : packed).push_back(i);
+
+	// the rest into the pages after them, the tallest first
+	std::vector<Placement> placements;
+	for (size_t i : packed)
+	{
+		const MipLevel& image = m_images[i];
+		placements.push_back({ i, glm::ivec2((image.width + 2 * m_padding + m_padding - 1) / m_padding, (image.height + 2 * m_padding + m_padding - 1) / m_padding), 0, glm::ivec2(0) });
+	}
+	std::stable_sort(placements.begin(), placements.end(), [](const Placement& a, const Placement& b) {
+		return a.cells.y != b.cells.y ? a.cells.y > b.cells.y : a.cells.x > b.cells.x;
+	});
+
+	std::vector<Skyline> pages;
+	size_t usedCells = 0;
+	for (Placement& placement : placements)
+	{
+		placement.page = -1;
+		for (size_t page = 0; page < pages.size() && placement.page < 0; ++page)
+			if (pages[page].Insert(placement.cells.x, placement.cells.y, placement.position))
+				placement.page = int(page);
+		if (placement.page < 0)
+		{
+			pages.emplace_back(cellsPerLayer);
+			pages.back().Insert(placement.cells.x, placement.cells.y, placement.position);
+			placement.page = int(pages.size() - 1);
+		}
+		usedCells += size_t(placement.cells.x) * placement.cells.y;
+	}
+
+	const GLsizei layers = GLsizei(full.size() + pages.size());
+	if (layers > GLCaps::Get().maxArrayTextureLayers)
+	{
+		std::cerr << "[TextureAtlas] " << layers << " layers are more than the " << GLCaps::Get().maxArrayTextureLayers << " of the context" << std::endl;
+		return false;
+	}
+	CreateStorage(fullLevels, layers);
+
+	for (size_t layer = 0; layer < full.size(); ++layer)
+	{
+		UploadLayer(GLint(layer), MipGenerator::Generate(m_images[full[layer]], MipFilter::Kaiser));
+		m_regions[full[layer]] = { GLint(layer), glm::vec4(0, 0, 1, 1), float(fullLevels - 1) };
+	}
+
+	const float layerSize = float(m_layerSize);
+	for (size_t page = 0; page < pages.size(); ++page)
+	{
+		// the textures and their gutters, which repeat them
+		MipLevel texels{ m_layerSize, m_layerSize, std::vector<unsigned char>(size_t(m_layerSize) * m_layerSize * 4, 0) };
+		for (const Placement& placement : placements)
+		{
+			if (placement.page != int(page))
+				continue;
+
+			const MipLevel& image = m_images[placement.image];
+			const glm::ivec2 corner = placement.position * m_padding;
+			for (int y = 0; y < placement.cells.y * m_padding; ++y)
+			{
+				const int sourceY = PositiveModulo(y - m_padding, image.height);
+				for (int x = 0; x < placement.cells.x * m_padding; ++x)
+				{
+					const int sourceX = PositiveModulo(x - m_padding, image.width);
+					const unsigned char* source = &image.rgba[(size_t(sourceY) * image.width + sourceX) * 4];
+					std::copy(source, source + 4, &texels.rgba[(size_t(corner.y + y) * m_layerSize + corner.x + x) * 4]);
+				}
+			}
+
+			const glm::vec4 rect = glm::vec4(corner.x + m_padding, corner.y + m_padding, image.width, image.height) / layerSize;
+			m_regions[placement.image] = { GLint(full.size() + page), rect, float(packedLevels - 1) };
+		}
+
+		// box filtered: a texel of level k covers 2^k x 2^k texels at a multiple of 2^k, so up to
+		// log2(padding) the levels of a texture only see the texture and its gutter
+		UploadLayer(GLint(full.size() + page), MipGenerator::Generate(texels, MipFilter::Box));
+	}
+
+	m_stats.fullLayers		= unsigned(full.size());
+	m_stats.packedLayers	= unsigned(pages.size());
+	m_stats.packedUsage		= pages.empty() ? 0.0f : float(usedCells) / (float(pages.size()) * cellsPerLayer * cellsPerLayer);
+	m_stats.bytes			= size_t(layers) * m_layerSize * m_layerSize * 4 * 4 / 3;
+
+	// the GPU has its own copy now
+	m_images = std::vector<MipLevel>();
+	return true;
+}
+
+void TextureAtlas::CreateStorage(GLsizei levels, GLsizei layers)
+{
+	// the levels come from client memory
+	GLState::BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (GLCaps::Get().directStateAccess)
+	{
+		glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &m_texture);
+		glTextureStorage3D(m_texture, levels, GL_RGBA8, m_layerSize, m_layerSize, layers);
+		return;
+	}
+
+	glGenTextures(1, &m_texture);
+	GLState::BindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+	if (GLCaps::Get().textureStorage)
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, m_layerSize, m_layerSize, layers);
+	else
+	{
+		for (GLsizei level = 0; level < levels; ++level)
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, std::max(1, m_layerSize >> level), std::max(1, m_layerSize >> level), layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	}
+}
+
+void TextureAtlas::UploadLayer(GLint layer, const std::vector<MipLevel>& levels)
+{
+	for (size_t level = 0; level < levels.size(); ++level)
+	{
+		const MipLevel& texels = levels[level];
+		if (GLCaps::Get().directStateAccess)
+			glTextureSubImage3D(m_texture, GLint(level), 0, 0, layer, texels.width, texels.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, texels.rgba.data());
+		else
+		{
+			GLState::BindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, GLint(level), 0, 0, layer, texels.width, texels.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, texels.rgba.data());
+		}
+	}
+}
@@ -3,8 +3,14 @@
 #include <GL/glew.h>
 #include <GL/gl.h>
 
+#include <algorithm>
 #include <string>
 
+#include "CompressedTexture.h"
+#include "GLCaps.h"
+#include "GLState.h"
+#include "MipGenerator.h"
+
 enum class TextureType
 {
 	Texture1D					= GL_TEXTURE_1D, 
@@ -19,6 +25,15 @@ enum class TextureType
 	Texture2DMultisampleArray	= GL_TEXTURE_2D_MULTISAMPLE_ARRAY
 };
 
+// levels of a full mip chain down to 1x1
+inline GLsizei MipLevelCount(GLsizei width, GLsizei height)
+{
+	GLsizei levels = 1;
+	for (GLsizei size = std::max(width, height); size > 1; size /= 2)
+		++levels;
+	return levels;
+}
+
 template <TextureType type = TextureType::Texture2D>
 class TextureObject final
 {
@@ -35,7 +50,11 @@ public:
 
 	TextureObject& operator=(const std::string& s);
 
+	// .dds and .ktx2 files are uploaded as they are (AttachCompressed), other images are decoded by SDL_image
+	// and get their mip chain from MipGenerator (Kaiser, in linear space)
 	void AttachFromFile(const std::string&, bool generateMipMap = true, GLuint role = static_cast<GLuint>(type));
+	// every level of the texture, no mipmaps are generated; false if the context cannot sample its format
+	bool AttachCompressed(const CompressedTexture& texture);
 	void FromFile(const std::string&);
 
 	operator unsigned int() const { return m_id; }
@@ -44,6 +63,9 @@ public:
 
 private:
 	GLuint m_id{};
+	bool m_immutable{};	// has glTexStorage2D storage, which cannot be respecified
+
+	void Create();
 };
 
 #include "TextureObject.inl"
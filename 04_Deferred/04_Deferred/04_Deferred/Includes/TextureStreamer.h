@@ -0,0 +1,171 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "MipGenerator.h"
+#include "StreamRingBuffer.h"
+
+class gCamera;
+
+/*
+
+	TextureStreamer loads 2D textures without stalling the frame. Request() queues the file for
+	a pool of worker threads, which decode it with IMG_Load and filter its mip chain
+	(MipGenerator, serially on each worker); Update(), once per frame, copies the decoded rows into a StreamRingBuffer and
+	uploads them from there with glTexSubImage2D, level by level (the buffer is bound to
+	GL_PIXEL_UNPACK_BUFFER, so the copy to the texture is the driver's).
+	The ring region of a frame is the upload budget: an image bigger than that is uploaded in
+	bands of rows over several frames, and the frame never waits for the decoder.
+
+		TextureStreamer::Handle wood = streamer.Request("Assets/wood.png");
+		...
+		streamer.Update();									// every frame
+		streamer.Require(wood, camera, center, radius, uvPerWorldUnit, height);	// the surfaces drawn with it
+		program.SetTexture("texImage", 0, streamer.Get(wood));	// the placeholder until it is resident
+
+	The levels are uploaded from the smallest one up, so a texture is usable (Get() returns it
+	instead of a 1x1 grey placeholder) once its 1x1 level is in; GL_TEXTURE_BASE_LEVEL is the
+	finest level on the GPU. The textures belong to the streamer and live as long as it does.
+
+	Residency: the GPU memory of the textures is kept under a budget. Every frame Require() tells
+	the finest level a texture needs from the screen space footprint of the surfaces that use it,
+	and Update() streams the finer levels in, finest last, evicting when it needs room: first the
+	levels finer than their textures need, the least recently used textures first, down to the
+	TAIL_SIZE levels, which stay. An evicted level is specified again with no texels, after
+	GL_TEXTURE_BASE_LEVEL moved past it. That needs mutable storage (glTexImage2D per level), the
+	one place where the wrappers do not use glTexStorage2D; the CPU keeps the whole mip chain to
+	stream the levels in again. A texture that is never given to Require() keeps every level.
+
+*/
+class TextureStreamer final
+{
+public:
+	using Handle = unsigned;
+
+	// the levels up to this size are never evicted
+	static const GLsizei TAIL_SIZE = 64;
+
+	struct Stats
+	{
+		unsigned	requested{};
+		unsigned	resident{};				// at least one level on the GPU
+		unsigned	failed{};
+		unsigned	uploadsLastFrame{};		// glTexSubImage2D calls
+		GLsizeiptr	bytesLastFrame{};		// the streaming bandwidth
+		size_t		residentBytes{};		// of every level on the GPU
+		size_t		residentBudget{};
+		unsigned	evictionsLastFrame{};	// levels
+		size_t		evictedBytesLastFrame{};
+		unsigned	starved{};				// textures without the level they need, for lack of budget
+	};
+
+	// budget: the bytes uploaded in a frame at most; workers: decoding threads, 0 for one less than the cores (at most 4);
+	// residentBudget: the bytes of the levels on the GPU at most
+	explicit TextureStreamer(GLsizeiptr budget = 4 << 20, unsigned workers = 0, size_t residentBudget = 256 << 20);
+	~TextureStreamer();
+
+	TextureStreamer(const TextureStreamer&)				= delete;
+	TextureStreamer& operator=(const TextureStreamer&)	= delete;
+
+	Handle	Request(const std::string& filename, bool generateMipMap = true);
+
+	// the texture to bind for handle: the placeholder until it is resident (or if it failed to load)
+	GLuint	Get(Handle handle) const;
+	bool	IsResident(Handle handle) const;
+	// every requested texture is resident or failed
+	bool	IsIdle() const { return m_stats.resident + m_stats.failed == m_stats.requested; }
+
+	// a surface drawn with handle in this frame, its texture coordinates changing by uvPerPixel across a pixel
+	void	Require(Handle handle, float uvPerPixel);
+	// the same for a surface within radius of center, seen by camera on a viewport viewportHeight pixels
+	// high, that has uvPerWorldUnit texture coordinates per world unit (1 / the size of one repeat)
+	void	Require(Handle handle, gCamera& camera, const glm::vec3& center, float radius, float uvPerWorldUnit, int viewportHeight);
+	// the finest level of handle on the GPU, and the one it needs
+	int		ResidentLevel(Handle handle) const { return m_textures[handle].residentBase; }
+	int		RequiredLevel(Handle handle) const { return m_textures[handle].requiredLevel; }
+
+	void	SetResidentBudget(size_t bytes) { m_stats.residentBudget = bytes; }
+
+	// the uploads and evictions of the frame, within the budgets; on the render thread, once per frame
+	void	Update();
+
+	GLuint			Placeholder()	const { return m_placeholder; }
+	const Stats&	GetStats()		const { return m_stats; }
+
+private:
+	enum class State
+	{
+		Decoding,
+		Uploading,
+		Resident,
+		Failed
+	};
+
+	struct Texture
+	{
+		std::string		filename;
+		bool			generateMipMap;
+		State			state;
+		GLuint			id;
+		std::vector<MipLevel>	levels;		// RGBA8, kept to stream evicted levels in again
+		int				residentBase;	// levels [residentBase, levels.size()) are on the GPU
+		int				uploading;		// the level being uploaded, -1 if none
+		int				nextRow;		// the rows of uploading above this one are uploaded
+		int				requiredLevel;	// the finest level it needs, from the Require() calls of the last frame
+		float			uvPerPixel;		// the smallest of the Require() calls of this frame
+		unsigned		lastUsed;		// the frame of the last Require()
+		bool			managed;		// Require() was called: its levels may be evicted
+	};
+
+	struct Job
+	{
+		Handle			handle;
+		std::string		filename;
+		bool			generateMipMap;
+	};
+
+	struct Decoded
+	{
+		Handle			handle;
+		std::vector<MipLevel>	levels;		// empty if the file could not be loaded
+	};
+
+	// only the render thread touches these
+	std::vector<Texture>	m_textures;
+	StreamRingBuffer		m_ring;
+	GLsizeiptr				m_budget;
+	GLuint					m_placeholder{};
+	unsigned				m_frame{};		// of the Require() calls
+	Stats					m_stats;
+
+	// shared with the workers, under m_mutex
+	std::mutex					m_mutex;
+	std::condition_variable		m_wake;
+	std::deque<Job>				m_jobs;
+	std::vector<Decoded>		m_decoded;
+	bool						m_stop{};
+
+	std::vector<std::thread>	m_workers;
+
+	void	Work();
+	// the first level of texture that is never evicted
+	int		TailLevel(const Texture& texture) const;
+	// evicts levels of the textures other than except until bytes more fit in the budget; false if they do not
+	bool	MakeRoom(size_t bytes, const Texture* except);
+	// frees the finest resident level of texture
+	void	Evict(Texture& texture);
+	// (re)specifies level of texture with no texels: width x height, or 0 x 0 to free it
+	void	SpecifyLevel(Texture& texture, int level, GLsizei width, GLsizei height);
+	// uploads the next rows of texture that fit in the ring; false if it ran out of budget
+	bool	UploadRows(Texture& texture);
+};
@@ -2,14 +2,17 @@
 
 VertexArrayObject::VertexArrayObject()
 {
-	glGenVertexArrays(1, &m_id);
+	if (GLCaps::Get().directStateAccess)
+		glCreateVertexArrays(1, &m_id);
+	else
+		glGenVertexArrays(1, &m_id);
 }
 
 VertexArrayObject::~VertexArrayObject()
 {
 	if (m_id != 0)
 	{
-		glDeleteVertexArrays(1, &m_id);
+		GLState::DeleteVertexArrays(1, &m_id);
 		m_id = 0;
 	}
 }
@@ -36,24 +39,37 @@ VertexArrayObject & VertexArrayObject::operator=(VertexArrayObject && rhs)
 
 VertexArrayObject& VertexArrayObject::Bind()
 {
-	glBindVertexArray(m_id);
+	GLState::BindVertexArray(m_id);
 	return *this;
 }
 
 void VertexArrayObject::Unbind()
 {
-	glBindVertexArray(0);
+	GLState::BindVertexArray(0);
 }
 
 VertexArrayObject& VertexArrayObject::SetIndices(const IndexBuffer& pIndexBuffer)
 {
-	Bind();
-	pIndexBuffer.Bind();
+	if (GLCaps::Get().directStateAccess)
+		GLState::VertexArrayElementBuffer(m_id, pIndexBuffer);
+	else
+	{
+		Bind();
+		pIndexBuffer.Bind();
+	}
 	return *this;
 }
 
 void VertexArrayObject::Init(std::initializer_list<std::pair<AttributeData, const ArrayBuffer&>> pDataBuffers)
 {
+	// direct state access: set up by name, the VAO does not even have to be bound
+	if (GLCaps::Get().directStateAccess)
+	{
+		for (auto val : pDataBuffers)
+			val.first.Apply(m_id, val.second);
+		return;
+	}
+
 	Bind();
 	for (auto val : pDataBuffers)
 	{
@@ -65,6 +81,12 @@ void VertexArrayObject::Init(std::initializer_list<std::pair<AttributeData, cons
 void VertexArrayObject::Init(std::initializer_list<std::pair<AttributeData, const ArrayBuffer&>> pDataBuffers, const IndexBuffer& pIndexBuffer)
 {
 	Init(pDataBuffers);
+	if (GLCaps::Get().directStateAccess)
+	{
+		GLState::VertexArrayElementBuffer(m_id, pIndexBuffer);
+		return;
+	}
+
 	pIndexBuffer.Bind();
 	Unbind();
 }
\ No newline at end of file
@@ -1,8 +1,13 @@
 template<BufferType type, BufferUsage usage>
 inline VertexArrayObject & VertexArrayObject::AddAttribute(AttributeData& pAttrib, BufferObject<type, usage>& pBuffer)
 {
-	pBuffer.Bind();
-	pAttrib.Apply();
+	if (GLCaps::Get().directStateAccess)
+		pAttrib.Apply(m_id, pBuffer);
+	else
+	{
+		pBuffer.Bind();
+		pAttrib.Apply();
+	}
 
 	return *this;
 }
\ No newline at end of file
@@ -4,10 +4,12 @@
 #include <vector>
 
 #include <array>
+#include <iostream>
 #include <list>
 #include <tuple>
 
 #include "imgui/imgui.h"
+#include "Includes/ProgramBinaryCache.h"
 #include "Includes/ObjParser_OGL3.h"
 
 CMyApp::CMyApp(void){}
@@ -16,62 +18,79 @@ CMyApp::~CMyApp(void){}
 
 bool CMyApp::Init()
 {
+	m_initStart = std::chrono::steady_clock::now();
 	glClearColor(0.2, 0.4, 0.7, 1);	// Clear color is bluish
-	glEnable(GL_CULL_FACE);			// Drop faces looking backwards
-	glEnable(GL_DEPTH_TEST);		// Enable depth test
 
-	m_program.Init({			// Shader for drawing geometries
-		{ GL_VERTEX_SHADER,   "Shaders/myVert.vert" },
-		{ GL_FRAGMENT_SHADER, "Shaders/myFrag.frag" }
+	// Both programs are compiled and linked by the driver while the rest is loaded;
+	// the passes skip their draws until they are ready (see GLState::Apply)
+	const ShaderDefines materials = { { "MAX_MATERIALS", std::to_string(MAX_MATERIALS) } };	// the size of the Materials block
+	m_program.InitAsync({			// Shader for drawing geometries
+		{ GL_VERTEX_SHADER,   "Shaders/myVert.vert", materials },
+		{ GL_FRAGMENT_SHADER, "Shaders/myFrag.frag", materials }
 	}/*,{						// This part is now shader defined!!
 		{ 0, "vs_in_pos"	},	// VAO index 0 will be vs_in_pos
 		{ 1, "vs_in_normal" },	// VAO index 1 will be vs_in_normal
 		{ 2, "vs_out_tex0"	},	// VAO index 2 will be vs_in_tex0
 	}*/);
 
-	m_deferredPointlight.Init({ // A deferred shader for point lights
+	m_deferredPointlight.InitAsync({ // A deferred shader for point lights
 		{ GL_VERTEX_SHADER,		"Shaders/deferredPoint.vert" },
 		{ GL_FRAGMENT_SHADER,	"Shaders/deferredPoint.frag" }
 	});
 
-	// Creating VBOs for the quad
-	ArrayBuffer positions(std::vector<glm::vec3>{glm::vec3(-20, 0, -20), glm::vec3(-20, 0, 20), glm::vec3(20, 0, -20), glm::vec3(20, 0, 20)});
-	ArrayBuffer normals(std::vector<glm::vec3>{glm::vec3(0, 1, 0), glm::vec3(0, 1, 0), glm::vec3(0, 1, 0), glm::vec3(0, 1, 0)});
-	ArrayBuffer texture(std::vector<glm::vec2>{glm::vec2(0, 0), glm::vec2(0, 1), glm::vec2(1, 0), glm::vec2(1, 1)});
-	IndexBuffer indices(std::vector<uint16_t>{0, 1, 2, 2, 1, 3});
+	m_feedbackProgram.InitAsync({	// A full screen quad too, one pixel per block of the feedback target
+		{ GL_VERTEX_SHADER,		"Shaders/deferredPoint.vert" },
+		{ GL_FRAGMENT_SHADER,	"Shaders/feedback.frag" }
+	});
+
+	m_program.SetUniformBlock<PerObject>("PerObject", PER_OBJECT_BINDING);
+	m_program.SetUniformBlock<Materials>("Materials", MATERIALS_BINDING);
+	m_deferredPointlight.SetUniformBlock<PointLight>("PointLight", POINT_LIGHT_BINDING);
+
+	// The geometry pass drops faces looking backwards and uses the depth test (the defaults of PipelineState)
+	m_geometryPass = PipelineState({ &m_program, Mesh::SharedHeap() });
+
+	// The light pass draws a full screen quad per light, its vertices come from gl_VertexID
+	// Depth test is not performed and depth values are not written -- all fragments should add color:
+	// instead of overwriting pixels we perform addition for each pixel and thus
+	// summing the contribution of each light source. The depth mask stays on for the clear of the
+	// back buffer, without the test the fragments do not write depth anyway
+	m_lightPass = PipelineState({ &m_deferredPointlight, nullptr, RasterState(), DepthState{ false, true, GL_LESS }, BlendState::Additive() });
 
-	m_vao.Bind();
-	m_vao.AddAttribute(CreateAttribute<  0, glm::vec3, 0, sizeof(glm::vec3)>, positions);
-	m_vao.AddAttribute(CreateAttribute<  1, glm::vec3, 0, sizeof(glm::vec3)>, normals);
-	m_vao.AddAttribute(CreateAttribute<  2, glm::vec2, 0, sizeof(glm::vec2)>, texture);
-	m_vao.SetIndices(indices);
-	m_vao.Unbind();
+	// The feedback pass overwrites every pixel of its small target, no depth either
+	m_feedbackPass = PipelineState({ &m_feedbackProgram, nullptr, RasterState(), DepthState::Disabled() });
 
-	// Loading texture
-	m_textureMetal.FromFile("Assets/texture.png");
+	// Loading textures: packed into one texture array, so every material is drawn without a bind
+	m_textureMetal = m_atlas.Add("Assets/texture.png");
+	m_textureGround = m_atlas.Add("Assets/texture.bmp");
+	m_atlas.Build();
+	if (m_atlas.GetStats().textures > MAX_MATERIALS)
+		std::cerr << "[MyApp] " << m_atlas.GetStats().textures << " textures in the atlas, the Materials block holds "
+			<< MAX_MATERIALS << ": the rest are drawn with the last one" << std::endl;
+
+	// The ground texture repeated 16 x 16 times as one 4096 x 4096 virtual texture (cooked to
+	// Assets/texture.vtex the first time); the atlas region stays the fallback if it fails
+	m_virtualTexture.Load("Assets/texture.bmp", 16);
 
 	// Loading mesh
 	m_mesh = ObjParser::parse("Assets/Suzanne.obj");
 
+	// Merging the static part of the scene
+	BuildStaticScene();
+
 	// Camera
-	m_camera.SetProj(45.0f, 640.0f / 480.0f, 0.01f, 1000.0f);
+	m_shaderWatcher.Watch("Shaders");
 
-	// FBO - initial
-	CreateFrameBuffer(640, 480);
+	m_camera.SetProj(45.0f, 640.0f / 480.0f, 0.01f, 1000.0f);
 
 	return true;
 }
 
 void CMyApp::Clean()
 {
-	if (m_frameBufferCreated)
-	{
-		glDeleteTextures(1, &m_diffuseBuffer);
-		glDeleteTextures(1, &m_normalBuffer);
-		glDeleteTextures(1, &m_position_Buffer);
-		glDeleteRenderbuffers(1, &m_depthBuffer);
-		glDeleteFramebuffers(1, &m_frameBuffer);
-	}
+	m_frameGraph.Clear();
+	m_virtualTexture.Clean();
+	SamplerCache::Clear();
 }
 
 void CMyApp::Update()
@@ -81,101 +100,210 @@ void CMyApp::Update()
 
 	m_camera.Update(delta_time);
 
+	// programs whose files were saved are rebuilt in the background and switched to once they link
+	ProgramObject::ReloadFiles(m_shaderWatcher.Poll());
+
 	last_time = SDL_GetTicks();
 }
 
+// Suzanne (i, j) of the wall swings back and forth, unless i*j == 0
+static glm::mat4 SuzanneWorld(int i, int j, float t)
+{
+	return glm::translate(glm::vec3(4 * i, 4 * (j + 1), sinf(t * 2 * M_PI * i * j)));
+}
+
+void CMyApp::BuildStaticScene()
+{
+	m_staticBatch.Clean();
+
+	// The plane underneath
+	std::vector<Mesh::Vertex> groundVertices = {
+		{ glm::vec3(-20, 0, -20), glm::vec3(0, 1, 0), glm::vec2(0, 0), glm::vec4(1, 0, 0, 1) },
+		{ glm::vec3(-20, 0,  20), glm::vec3(0, 1, 0), glm::vec2(0, 1), glm::vec4(1, 0, 0, 1) },
+		{ glm::vec3( 20, 0, -20), glm::vec3(0, 1, 0), glm::vec2(1, 0), glm::vec4(1, 0, 0, 1) },
+		{ glm::vec3( 20, 0,  20), glm::vec3(0, 1, 0), glm::vec2(1, 1), glm::vec4(1, 0, 0, 1) }
+	};
+	m_staticBatch.Add(groundVertices, { 0, 1, 2,  2, 1, 3 }, glm::mat4(1), { glm::vec4(1), m_atlas.Texture(), GLint(m_textureGround) });
+
+	// The middle row and column of the Suzanne wall do not move
+	for (int i = -1; i <= 1; ++i)
+		for (int j = -1; j <= 1; ++j)
+			if (i * j == 0)
+				m_staticBatch.Add(*m_mesh, SuzanneWorld(i, j, 0), { glm::vec4(1), m_atlas.Texture(), GLint(m_textureMetal) });
+
+	m_staticBatch.Build();
+}
+
+void CMyApp::SetPerObject(const glm::mat4& viewProj, const glm::mat4& world)
+{
+	PerObject data{ viewProj * world, world, glm::transpose(glm::inverse(world)), glm::vec4(1) };
+	m_streamBuffer.BindUniformBlock(PER_OBJECT_BINDING, data);
+}
+
 void CMyApp::DrawScene(const glm::mat4& viewProj, ProgramObject& program)
 {
 	program.Use();
 	
 	// Only texture information is needed, no lights.
-	program.SetTexture("texImage", 0, m_textureMetal);
 	
-	// Drawing the plane underneath
+	// Every material samples its region of the atlas: one bind for the whole pass
+
+	Materials materials{};
+	for (unsigned i = 0; i < m_atlas.GetStats().textures && i < MAX_MATERIALS; ++i)
+	{
+		const TextureAtlas::Region& region = m_atlas.Get(i);
+		materials.rects[i] = region.rect;
+		const bool isVirtual = i == m_textureGround && m_virtualTexture.IsLoaded();
+		materials.layers[i] = glm::vec4(float(region.layer), region.maxLod, isVirtual ? 1 : 0, 0);
+	}
+	m_streamBuffer.BindUniformBlock(MATERIALS_BINDING, materials);
+	program.SetTextureArray("texAtlas"_uniform, 0, m_atlas.Texture(), SamplerDesc::Trilinear(8));
 
-	program.SetUniform("MVP", viewProj * glm::mat4(1));
-	program.SetUniform("world", glm::mat4(1));
-	program.SetUniform("worldIT", glm::mat4(1));
+	// The virtual texture: the page table is read with texelFetch, the cache has no mip levels
+	program.SetTexture("vtPageTable"_uniform, 1, m_virtualTexture.PageTable(), SamplerDesc::Nearest());
+	program.SetTexture("vtCache"_uniform, 2, m_virtualTexture.Cache(), SamplerDesc::Linear());
+	program.SetUniform("vtParams"_uniform, m_virtualTexture.Params());
 
+	// Static objects: already in world space, one draw call for the materials of the atlas
 
-	m_vao.Bind();
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);	//Draws exactly the same but uses index buffer:
-	//glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr);
-	m_vao.Unbind();
+	m_staticBatch.Draw(viewProj, [&](const StaticBatch::Material&) {
+		SetPerObject(viewProj, glm::mat4(1));
+	});
 
-	// Suzanne wall
+	// Moving part of the Suzanne wall: the mesh has no material attribute, its current value is used
+
+	glVertexAttrib1f(StaticBatch::MATERIAL_ATTRIBUTE, GLfloat(m_textureMetal));
 
 	float t = SDL_GetTicks() / 1000.f;
 	for (int i = -1; i <= 1; ++i)
 		for (int j = -1; j <= 1; ++j)
 		{
-			glm::mat4 suzanneWorld = glm::translate(glm::vec3(4 * i, 4 * (j + 1), sinf(t * 2 * M_PI * i * j)));
-			program.SetUniform("MVP", viewProj * suzanneWorld);
-			program.SetUniform("world", suzanneWorld);
-			program.SetUniform("worldIT", glm::transpose(glm::inverse(suzanneWorld)));
+			if (i * j == 0)
+				continue; // these are in m_staticBatch
+
+			SetPerObject(viewProj, SuzanneWorld(i, j, t));
 			m_mesh->draw();
 		}
-	program.Unuse();
+	// no Unuse(): the light pass switches programs anyway
+}
+
+void CMyApp::PickPosition()
+{
+	// the request of an earlier frame, usually done by now
+	if (m_pickRequest != GPUReadback::INVALID_HANDLE)
+	{
+		if (!m_readback.IsReady(m_pickRequest))
+			return;
+		m_readback.Read(m_pickRequest, &m_pickedPosition, sizeof(m_pickedPosition));
+		m_pickRequest = GPUReadback::INVALID_HANDLE;
+	}
+
+	// OpenGL counts rows from the bottom
+	m_pickRequest = m_readback.ReadPixels(m_frameGraph.CurrentFramebuffer(), GL_COLOR_ATTACHMENT2, m_mouse.x, m_height - 1 - m_mouse.y, 1, 1, GL_RGB, GL_FLOAT);
 }
 
 void CMyApp::Render()
 {
+	m_streamBuffer.BeginFrame();	// waits if the GPU still reads the region of this frame
+	m_virtualTexture.Update(m_readback);	// the pages the feedback of earlier frames asked for, within the upload budget
+
+	// The passes declare what they read and write, the frame graph allocates the G-buffer
+	// from its pool and binds the framebuffer and the viewport of each pass before running it
+	m_frameGraph.Reset();
+	const FrameGraph::Resource backbuffer = m_frameGraph.ImportBackbuffer(m_width, m_height);
+	FrameGraph::Resource diffuse, normal, position, feedback;
+	const GLsizei feedbackWidth = (m_width + FEEDBACK_SCALE - 1) / FEEDBACK_SCALE, feedbackHeight = (m_height + FEEDBACK_SCALE - 1) / FEEDBACK_SCALE;
 
 	// 1.
 	// Render to the framebuffer
 
-	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	DrawScene(m_camera.GetViewProj(), m_program);
+	m_frameGraph.AddPass("G-buffer", [&](FrameGraph::Builder& builder) {
+		// G-buffer formats: 8 bits are plenty for colors, half floats for unit normals,
+		// positions need full floats. All four channel: GL_RGB32F does not have to be renderable.
+		diffuse  = builder.Write(builder.Create("diffuse" , { GL_RGBA8  , m_width, m_height }), GL_COLOR_ATTACHMENT0);
+		normal   = builder.Write(builder.Create("normal"  , { GL_RGBA16F, m_width, m_height }), GL_COLOR_ATTACHMENT1);
+		position = builder.Write(builder.Create("position", { GL_RGBA32F, m_width, m_height }), GL_COLOR_ATTACHMENT2);
+		feedback = builder.Write(builder.Create("feedback", { GL_RGBA8  , m_width, m_height }), GL_COLOR_ATTACHMENT3);
+		builder.Write(builder.Create("depth", { GL_DEPTH_COMPONENT24, m_width, m_height }), GL_DEPTH_ATTACHMENT);
+	}, [&]() {
+		if (!GLState::Apply(m_geometryPass))	// before the clear: glClear respects the depth mask
+			return;								// the program is still being linked
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		const GLfloat noPage[4] = { 0, 0, 0, 0 };		// alpha 0: no virtual texture under the pixel
+		glClearBufferfv(GL_COLOR, 3, noPage);
+
+		DrawScene(m_camera.GetViewProj(), m_program);
+
+		PickPosition();
+	});
 
 	// 2.
-	// Draw Lights by additions
-	
-	//2.1. Setting up the blending
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glClearColor(0, 0, 0, 1);		//Clear to black
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// Scale the feedback down and read it back, the virtual texture gets it in a later frame
+
+	m_frameGraph.AddPass("Feedback", [&](FrameGraph::Builder& builder) {
+		builder.Read(feedback);
+		builder.Write(builder.Create("feedback (small)", { GL_RGBA8, feedbackWidth, feedbackHeight }), GL_COLOR_ATTACHMENT0);
+		builder.SideEffect();	// the read back
+	}, [&]() {
+		if (!m_virtualTexture.IsLoaded() || !GLState::Apply(m_feedbackPass))
+			return;
+
+		// a different pixel of each block every frame, all 64 of them in turn (37 is coprime to 64)
+		const unsigned pixel = (m_feedbackFrame++ * 37) % (FEEDBACK_SCALE * FEEDBACK_SCALE);
+		m_feedbackProgram.SetTexture("feedbackTexture"_uniform, 0, m_frameGraph.GetTarget(feedback).texture, SamplerDesc::Nearest());
+		m_feedbackProgram.SetUniform("feedbackScale"_uniform, GLint(FEEDBACK_SCALE));
+		m_feedbackProgram.SetUniform("feedbackOffset"_uniform, glm::ivec2(pixel % FEEDBACK_SCALE, pixel / FEEDBACK_SCALE));
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+		m_virtualTexture.RequestFeedback(m_readback, m_frameGraph.CurrentFramebuffer(), GL_COLOR_ATTACHMENT0, feedbackWidth, feedbackHeight);
+	});
 
-	glDisable(GL_DEPTH_TEST);		// Depth test is not performed -- all fragments should add color
-	glDepthMask(GL_FALSE);			// Depth values are not need to be written
+	// 3.
+	// Draw Lights by additions
 
-	glEnable(GL_BLEND);				// Instead of overwriting pixels in the FBO we
-	glBlendEquation(GL_FUNC_ADD);	// perform addition for each pixel and thus
-	glBlendFunc(GL_ONE, GL_ONE);	// summing the contribution of each light source
+	m_frameGraph.AddPass("Lights", [&](FrameGraph::Builder& builder) {
+		builder.Read(diffuse);
+		builder.Read(normal);
+		builder.Read(position);
+		builder.Write(backbuffer, GL_BACK);
+	}, [&]() {
+		//3.1. Setting up the blending
+		const bool ready = GLState::Apply(m_lightPass);	// before the clear: glClear respects the depth mask
+		const GLfloat black[4] = { 0, 0, 0, 1 }, farthest = 1;	// the lights add up from black, the clear color of Init stays
+		glClearBufferfv(GL_COLOR, 0, black);
+		glClearBufferfv(GL_DEPTH, 0, &farthest);
 
-	// 2.2. Light program setup
+		if (!ready)			// additive blending, no depth test (see Init)
+			return;			// the program is still being linked
 
-	m_deferredPointlight.Use();
-	m_deferredPointlight.SetTexture("diffuseTexture" , 0, m_diffuseBuffer);
-	m_deferredPointlight.SetTexture("normalTexture"  , 1, m_normalBuffer);
-	m_deferredPointlight.SetTexture("positionTexture", 2, m_position_Buffer);
-	
-	// 2.3. Draw point lights
+		// 3.2. Light program setup
 
-	m_deferredPointlight.SetUniform("lightPos", m_light_pos);
-	m_deferredPointlight.SetUniform("Ld", glm::vec4(1,0.0,0.0,1));
-	(GL_TRIANGLE_STRIP, 0, 4); // First light
+		m_deferredPointlight.SetTexture("diffuseTexture"_uniform , 0, m_frameGraph.GetTarget(diffuse).texture , SamplerDesc::Nearest());
+		m_deferredPointlight.SetTexture("normalTexture"_uniform  , 1, m_frameGraph.GetTarget(normal).texture  , SamplerDesc::Nearest());
+		m_deferredPointlight.SetTexture("positionTexture"_uniform, 2, m_frameGraph.GetTarget(position).texture, SamplerDesc::Nearest());
 
-	
-	
-	float t = SDL_GetTicks() / 1000.f;
-	m_deferredPointlight.SetUniform("lightPos", 10.f*glm::vec3(cosf(t),0.5,sinf(t)));
-	m_deferredPointlight.SetUniform("Ld", glm::vec4(0.0, 1, 0.0, 1));
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); // Second light
+		// 3.3. Draw point lights
 
+		m_streamBuffer.BindUniformBlock(POINT_LIGHT_BINDING, PointLight{ m_light_pos, 0, glm::vec4(1,0.0,0.0,1) });
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); // First light
 
+		float t = SDL_GetTicks() / 1000.f;
+		m_streamBuffer.BindUniformBlock(POINT_LIGHT_BINDING, PointLight{ 10.f*glm::vec3(cosf(t),0.5,sinf(t)), 0, glm::vec4(0.0, 1, 0.0, 1) });
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); // Second light
 
+		// 3.4. No need to undo the blending options: the next pass applies its own pipeline
+	});
 
-	// 2.4. Undo the blending options
+	m_frameGraph.Compile();
+	m_frameGraph.Execute();
 
-	glEnable(GL_DEPTH_TEST);
-	glDepthMask(GL_TRUE);
-	glDisable(GL_BLEND);
+	m_streamBuffer.EndFrame();
 
-	// 3.
+	// 4.
 	// User Interface
 
+	SamplerCache::Unbind(0); // ImGui draws its textures on unit 0 and relies on their own parameters
+
 	ImGui::ShowTestWindow(); // Demo of all ImGui commands. See its implementation for details.
 		// It's worth browsing imgui.h, as well as reading the FAQ at the beginning of imgui.cpp.
 		// There is no regular documentation, but the things mentioned above should be sufficient.
@@ -184,12 +312,84 @@ void CMyApp::Render()
 	if(ImGui::Begin("Test window")) // Note that ImGui returns false when window is collapsed so we can early-out
 	{
 		ImGui::SliderFloat3("light_pos", &m_light_pos.x, -10.f, 10.f);
-		ImGui::Image((ImTextureID)m_diffuseBuffer  , ImVec2(256, 256), ImVec2(0,1), ImVec2(1,0));
-		ImGui::Image((ImTextureID)m_normalBuffer   , ImVec2(256, 256), ImVec2(0,1), ImVec2(1,0));
-		ImGui::Image((ImTextureID)m_position_Buffer, ImVec2(256, 256), ImVec2(0,1), ImVec2(1,0));
+		ImGui::Text("Under the mouse: (%.2f, %.2f, %.2f)", m_pickedPosition.x, m_pickedPosition.y, m_pickedPosition.z);
+		// only the used part of the (possibly bigger) targets, upside down
+		const RenderTargetPool::Target& target = m_frameGraph.GetTarget(diffuse);
+		const ImVec2 uv0(0, target.ScaleY()), uv1(target.ScaleX(), 0);
+		ImGui::Image((ImTextureID)m_frameGraph.GetTarget(diffuse).texture , ImVec2(256, 256), uv0, uv1);
+		ImGui::Image((ImTextureID)m_frameGraph.GetTarget(normal).texture  , ImVec2(256, 256), uv0, uv1);
+		ImGui::Image((ImTextureID)m_frameGraph.GetTarget(position).texture, ImVec2(256, 256), uv0, uv1);
 	}
 	ImGui::End(); // In either case, ImGui::End() needs to be called for ImGui::Begin().
 		// Note that other commands may work differently and may not need an End* if Begin* returned false.
+
+	// the start up ends when the last program is ready: InitAsync() only submits them
+	const double sinceInit = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_initStart).count();
+	if (m_startupMs < 0 && ProgramObject::GetBuildStats().pending == 0)
+		m_startupMs = sinceInit;
+
+	if (ImGui::Begin("GL state"))
+	{
+		const GLState::Counters& counters = GLState::LastFrame();
+		ImGui::Text("Issued: %u, elided: %u, stalls: %u", counters.issued, counters.elided, counters.stalls);
+		ImGui::Text("Uniforms: %u uploaded, %u unchanged", counters.uniformsIssued, counters.uniformsSkipped);
+		const ProgramObject::BuildStats& buildStats = ProgramObject::GetBuildStats();
+		ImGui::Text("Programs: %u linked, %u failed, %u pending, %.0f ms compile wall time, %u reloaded", buildStats.linked, buildStats.failed,
+			buildStats.pending, buildStats.wallMs, buildStats.reloaded);
+		const ProgramBinaryCache::Stats& binaries = ProgramBinaryCache::GetStats();
+		ImGui::Text("Start up: %.0f ms %s, %u programs loaded from binaries, %u built from source (%s, %u refused)",
+			m_startupMs < 0 ? sinceInit : m_startupMs, m_startupMs < 0 ? "so far" : "until every program was ready", binaries.hits, binaries.misses,
+			!ProgramBinaryCache::IsAvailable() ? "no binary cache" : binaries.misses == 0 ? "warm cache" : "cold cache", binaries.rejected);
+		bool validate = GLState::IsValidating();
+		if (ImGui::Checkbox("Validate with glGet", &validate))
+			GLState::SetValidation(validate);
+		if (validate)
+			ImGui::Text("Mismatches: %u", counters.mismatches);
+
+		std::shared_ptr<GeometryHeap> heap = Mesh::SharedHeap();
+		const GeometryHeap::Stats stats = heap->GetStats();
+		ImGui::Separator();
+		ImGui::Text("Geometry heap: %u allocations, %.1f MB", (unsigned)stats.vertices.allocations, (stats.vertexBufferBytes + stats.indexBufferBytes) / 1048576.0);
+		ImGui::Text("Vertices: %u of %u used (%u in blocks), fragmentation %.2f", (unsigned)stats.vertices.requested, (unsigned)stats.vertices.capacity, (unsigned)stats.vertices.allocated, stats.vertexFragmentation);
+		ImGui::Text("Indices: %u of %u used (%u in blocks), fragmentation %.2f", (unsigned)stats.indices.requested, (unsigned)stats.indices.capacity, (unsigned)stats.indices.allocated, stats.indexFragmentation);
+		ImGui::Text("Grown %u times, defragmented %u times", stats.grows, stats.defragmentations);
+		if (ImGui::Button("Defragment"))
+			heap->Defragment();
+
+		ImGui::Separator();
+		const FrameContext::Timing& timing = FrameContext::Average();
+		ImGui::Text("Frames in flight: %u, the CPU waits %.2f ms of %.2f ms%s", FrameContext::FramesInFlight(),
+			timing.waitMs, timing.frameMs, FrameContext::IsGpuBound() ? " (GPU bound)" : "");
+
+		ImGui::Text("Stream buffer (%s%s): %u bytes, %u waits", m_streamBuffer.IsPersistent() ? "persistent" : "orphaning",
+			m_streamBuffer.IsPaced() ? ", per frame" : "", (unsigned)m_streamBuffer.BytesLastFrame(), m_streamBuffer.WaitsLastFrame());
+
+		const GPUReadback::Stats readbackStats = m_readback.GetStats();
+		ImGui::Text("Readback: %u pending, %u done, %u stalls", readbackStats.pending, readbackStats.completed, readbackStats.stalls);
+
+		const RenderTargetPool::Stats targetStats = m_frameGraph.Pool().GetStats();
+		ImGui::Text("Render targets: %u (%u in use), %.1f MB, %.0f%% of the texels in use rendered", targetStats.targets, targetStats.inUse,
+			targetStats.bytes / 1048576.0, targetStats.occupancy * 100);
+		ImGui::Text("Allocated %u, reused %u (%u oversized), evicted %u", targetStats.allocations, targetStats.reuses, targetStats.oversized, targetStats.evictions);
+
+		const VirtualTexture::Stats& virtualStats = m_virtualTexture.GetStats();
+		ImGui::Text("Virtual texture: %u of %u pages resident in %u slots (%.1f MB), %u wanted, %u loading", virtualStats.resident, virtualStats.pages,
+			virtualStats.slots, virtualStats.cacheBytes / 1048576.0, virtualStats.requested, virtualStats.loading);
+		ImGui::Text("Pages last frame: %u uploaded (%u KB), %u evicted; %u dropped in total", virtualStats.uploadsLastFrame,
+			unsigned(virtualStats.bytesLastFrame / 1024), virtualStats.evictionsLastFrame, virtualStats.dropped);
+		if (m_virtualTexture.IsLoaded() && ImGui::CollapsingHeader("Virtual texture cache"))
+			ImGui::Image((ImTextureID)m_virtualTexture.Cache(), ImVec2(256, 256));
+
+		const TextureAtlas::Stats& atlasStats = m_atlas.GetStats();
+		ImGui::Text("Texture atlas: %u textures in %u + %u layers (packed %.0f%% full), %.1f MB", atlasStats.textures, atlasStats.fullLayers,
+			atlasStats.packedLayers, atlasStats.packedUsage * 100, atlasStats.bytes / 1048576.0);
+		ImGui::Text("Static batch: %u materials in %u batches, %u merged through the atlas", (unsigned)m_staticBatch.MaterialCount(),
+			(unsigned)m_staticBatch.BatchCount(), (unsigned)(m_staticBatch.MaterialCount() - m_staticBatch.BatchCount()));
+
+		if (ImGui::CollapsingHeader("Frame graph"))
+			ImGui::TextUnformatted(m_frameGraph.Dump().c_str());
+	}
+	ImGui::End();
 }
 
 void CMyApp::KeyboardDown(SDL_KeyboardEvent& key)
@@ -205,6 +405,7 @@ void CMyApp::KeyboardUp(SDL_KeyboardEvent& key)
 void CMyApp::MouseMove(SDL_MouseMotionEvent& mouse)
 {
 	m_camera.MouseMove(mouse);
+	m_mouse = glm::ivec2(mouse.x, mouse.y);
 }
 
 void CMyApp::MouseDown(SDL_MouseButtonEvent& mouse)
@@ -222,102 +423,10 @@ void CMyApp::MouseWheel(SDL_MouseWheelEvent& wheel)
 // _w and _h are the width and height of the window's size
 void CMyApp::Resize(int _w, int _h)
 {
-	glViewport(0, 0, _w, _h );
+	GLState::Viewport(0, 0, _w, _h );
 
 	m_camera.Resize(_w, _h);
-
-	CreateFrameBuffer(_w, _h);
+	m_width  = _w;
+	m_height = _h;
+	// the G-buffer follows in the next frame, the frame graph asks for the window size
 }
-
-inline void setTexture2DParameters(GLenum magfilter = GL_LINEAR, GLenum minfilter = GL_LINEAR, GLenum wrap_s = GL_CLAMP_TO_EDGE, GLenum wrap_t = GL_CLAMP_TO_EDGE)
-{
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magfilter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minfilter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t);
-}
-
-void CMyApp::CreateFrameBuffer(int width, int height)
-{
-	// Clear if the function is not being called for the first time
-	if (m_frameBufferCreated)
-	{
-		glDeleteTextures(1, &m_diffuseBuffer);
-		glDeleteTextures(1, &m_normalBuffer);
-		glDeleteTextures(1, &m_position_Buffer);
-		glDeleteRenderbuffers(1, &m_depthBuffer);
-		glDeleteFramebuffers(1, &m_frameBuffer);
-	}
-
-	glGenFramebuffers(1, &m_frameBuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
-
-	// 1.  Diffuse colors
-	glGenTextures(1, &m_diffuseBuffer);
-	glBindTexture(GL_TEXTURE_2D, m_diffuseBuffer);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB, GL_FLOAT, nullptr);
-	setTexture2DParameters(GL_NEAREST, GL_NEAREST);
-
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + 0, GL_TEXTURE_2D, m_diffuseBuffer, 0);
-	if (glGetError() != GL_NO_ERROR) {
-		std::cout << "Error creating color attachment 0" << std::endl;		
-		exit(1);
-	}
-
-	// 2.  Normal vectors
-	glGenTextures(1, &m_normalBuffer);
-	glBindTexture(GL_TEXTURE_2D, m_normalBuffer);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB, GL_FLOAT, nullptr);
-	setTexture2DParameters(GL_NEAREST, GL_NEAREST);
-
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + 1, GL_TEXTURE_2D, m_normalBuffer, 0);
-	if (glGetError() != GL_NO_ERROR) {
-		std::cout << "Error creating color attachment 1" << std::endl;
-		exit(1);
-	}
-
-	// 3.  Word-space positions
-	glGenTextures(1, &m_position_Buffer);
-	glBindTexture(GL_TEXTURE_2D, m_position_Buffer);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, width, height, 0, GL_RGB, GL_FLOAT, nullptr);
-	setTexture2DParameters(GL_NEAREST, GL_NEAREST);
-
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + 2, GL_TEXTURE_2D, m_position_Buffer, 0);
-	if (glGetError() != GL_NO_ERROR) {
-		std::cout << "Error creating color attachment 2" << std::endl;
-		exit(1);
-	}
-
-	// 4. Depth renderbuffer
-	glGenRenderbuffers(1, &m_depthBuffer);
-	glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
-	if (glGetError() != GL_NO_ERROR) {
-		std::cout << "Error creating depth attachment" << std::endl;
-		exit(1);
-	}
-
-	//Specifying which color outputs are active
-	GLenum drawBuffers[3] = {GL_COLOR_ATTACHMENT0,
-							 GL_COLOR_ATTACHMENT1,
-							 GL_COLOR_ATTACHMENT2 };
-	glDrawBuffers(3, drawBuffers);
-
-	// -- Completeness check
-	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-	if (status != GL_FRAMEBUFFER_COMPLETE) {
-		std::cout << "Incomplete framebuffer (";
-		switch (status) {
-		case GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT:			std::cout << "GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT";		break;
-		case GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT:	std::cout << "GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT"; break;
-		case GL_FRAMEBUFFER_UNSUPPORTED:					std::cout << "GL_FRAMEBUFFER_UNSUPPORTED";					break;
-		}
-		std::cout << ")" << std::endl;
-		exit(1);
-	}
-
-	// -- Unbind framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	m_frameBufferCreated = true;
-}
\ No newline at end of file
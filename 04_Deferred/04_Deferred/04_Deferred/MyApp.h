@@ -1,6 +1,7 @@
 #pragma once
 
 // C++ includes
+#include <chrono>
 #include <memory>
 
 // GLEW
@@ -16,11 +17,22 @@
 #include <glm/gtx/transform2.hpp>
 
 #include "Includes/ProgramObject.h"
+#include "Includes/ShaderWatcher.h"
 #include "Includes/BufferObject.h"
 #include "Includes/VertexArrayObject.h"
 #include "Includes/TextureObject.h"
+#include "Includes/TextureAtlas.h"
+#include "Includes/VirtualTexture.h"
+#include "Includes/GLState.h"
+#include "Includes/GLCaps.h"
+#include "Includes/StreamRingBuffer.h"
+#include "Includes/FrameContext.h"
+#include "Includes/GPUReadback.h"
+#include "Includes/PipelineState.h"
+#include "Includes/FrameGraph.h"
 
 #include "Includes/Mesh_OGL3.h"
+#include "Includes/StaticBatch.h"
 #include "Includes/gCamera.h"
 
 class CMyApp
@@ -43,30 +55,95 @@ public:
 	void MouseWheel(SDL_MouseWheelEvent&);
 	void Resize(int, int);
 protected:
-	// FBO creating function
-	void CreateFrameBuffer(int width, int height);
 	void DrawScene(const glm::mat4& viewProj, ProgramObject& program);
 
+	// The PerObject uniform block of the shaders (std140)
+	struct PerObject
+	{
+		glm::mat4 MVP;
+		glm::mat4 world;
+		glm::mat4 worldIT;
+		glm::vec4 Kd;
+
+		static constexpr std::array<UniformBlockMember, 4> UniformBlockMembers()
+		{
+			return {{ UNIFORM_BLOCK_MEMBER(PerObject, MVP), UNIFORM_BLOCK_MEMBER(PerObject, world),
+				UNIFORM_BLOCK_MEMBER(PerObject, worldIT), UNIFORM_BLOCK_MEMBER(PerObject, Kd) }};
+		}
+	};
+	static const GLuint PER_OBJECT_BINDING = 0;
+
+	// The PointLight uniform block of the light pass (std140)
+	struct PointLight
+	{
+		glm::vec3 lightPos;	float _pad0;
+		glm::vec4 Ld;
+
+		static constexpr std::array<UniformBlockMember, 2> UniformBlockMembers()
+		{
+			return {{ UNIFORM_BLOCK_MEMBER(PointLight, lightPos), UNIFORM_BLOCK_MEMBER(PointLight, Ld) }};
+		}
+	};
+	static const GLuint POINT_LIGHT_BINDING = 1;
+
+	// The Materials uniform block of the geometry pass (std140): the atlas region of each material index
+	static const int MAX_MATERIALS = 16;
+	struct Materials
+	{
+		glm::vec4 rects[MAX_MATERIALS];		// xy: the corner in the layer, zw: the size
+		glm::vec4 layers[MAX_MATERIALS];	// x: the layer, y: the largest level of detail, z: 1 for the virtual texture
+
+		static constexpr std::array<UniformBlockMember, 2> UniformBlockMembers()
+		{
+			return {{ UNIFORM_BLOCK_MEMBER(Materials, rects), UNIFORM_BLOCK_MEMBER(Materials, layers) }};
+		}
+	};
+	static const GLuint MATERIALS_BINDING = 2;
+
+	// The feedback of the virtual texture is read back at 1 / FEEDBACK_SCALE of the G-buffer size
+	static const GLsizei FEEDBACK_SCALE = 8;
+
+	// Streams the PerObject block of the next draw
+	void SetPerObject(const glm::mat4& viewProj, const glm::mat4& world);
+	// Collects the objects that never move into m_staticBatch
+	void BuildStaticScene();
+	// Fetches the last world position read back from under the mouse, and requests the next one
+	void PickPosition();
+
 	// variables for shaders
 	ProgramObject		m_program;				// basic program for shaders
 	ProgramObject		m_deferredPointlight;	// A deffered shader program to draw point lightsources
+	ProgramObject		m_feedbackProgram;		// scales the feedback target of the G-buffer down for the read back
+
+	PipelineState		m_geometryPass;			// the state of the passes, see Init
+	PipelineState		m_lightPass;
+	PipelineState		m_feedbackPass;
 
-	Texture2D			m_textureMetal;
+	TextureAtlas		m_atlas{ 512 };			// the material textures, in the layers of one texture array
+	TextureAtlas::Handle	m_textureMetal{};	// the material indices of the scene
+	TextureAtlas::Handle	m_textureGround{};
+	VirtualTexture		m_virtualTexture;		// the ground: its texture repeated over the plane, paged in by the feedback of the G-buffer
+	unsigned			m_feedbackFrame{};		// picks the pixel of each block the feedback reads
 
-	VertexArrayObject	m_vao;
 	std::unique_ptr<Mesh>	m_mesh;
+	StaticBatch			m_staticBatch;			// the ground and the Suzannes that stand still
+	StreamRingBuffer	m_streamBuffer;			// per frame data: the PerObject and PointLight blocks
+	GPUReadback			m_readback;				// G-buffer reads, e.g. the position under the mouse
+	FrameGraph			m_frameGraph;			// the passes of the frame and the G-buffer they share, see Render
+	ShaderWatcher		m_shaderWatcher;		// the shader files saved while the app runs, see Update
+	std::chrono::steady_clock::time_point	m_initStart;	// the start up lasts until every program is ready
+	double				m_startupMs = -1;		// -1 while a program is still being built
 
 	gCamera				m_camera;
 
 	glm::vec3 m_light_pos = glm::vec3(0, 10, 0);
 	float	m_filterWeight{};
 
-	// stuffs for the FBO
-	bool m_frameBufferCreated{ false };
-	GLuint m_frameBuffer;
-	GLuint m_diffuseBuffer;
-	GLuint m_normalBuffer;
-	GLuint m_position_Buffer;
-	GLuint m_depthBuffer;
+	// picking
+	glm::ivec2	m_mouse{};
+	int			m_width{ 640 };
+	int			m_height{ 480 };
+	GPUReadback::Handle m_pickRequest{ GPUReadback::INVALID_HANDLE };
+	glm::vec3	m_pickedPosition{};
 };
 
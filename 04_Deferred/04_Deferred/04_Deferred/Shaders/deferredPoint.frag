@@ -1,6 +1,4 @@
-#version 130
-
-in vec2 vs_out_tex;
+#version 140
 
 out vec4 fs_out_col;
 
@@ -8,17 +6,24 @@ uniform sampler2D diffuseTexture;
 uniform sampler2D normalTexture;
 uniform sampler2D positionTexture;
 
-uniform vec3 lightPos = vec3(0,-1,0);
-uniform vec4 Ld = vec4(0.5,0.5,0.5,1);
+// one light per draw, streamed by the application through a ring buffer
+layout(std140) uniform PointLight
+{
+	vec3 lightPos;
+	vec4 Ld;
+};
 
 void main()
 {
-	vec3 pos = texture(positionTexture, vs_out_tex).rgb;
+	// the G-buffer can be bigger than the screen, it is addressed in pixels
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+
+	vec3 pos = texelFetch(positionTexture, texel, 0).rgb;
 
 	vec3 lightDir = normalize(lightPos - pos);
 
-	vec4 Kd = texture( diffuseTexture, vs_out_tex );
-	vec3 n = normalize( texture( normalTexture, vs_out_tex ).rgb );
+	vec4 Kd = texelFetch( diffuseTexture, texel, 0 );
+	vec3 n = normalize( texelFetch( normalTexture, texel, 0 ).rgb );
 
 	fs_out_col = Ld*Kd*clamp(dot(n, lightDir), 0, 1);
 }
\ No newline at end of file
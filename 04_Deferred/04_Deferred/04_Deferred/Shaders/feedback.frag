@@ -0,0 +1,18 @@
+#version 140
+
+out vec4 fs_out_feedback;
+
+// the feedback target of the G-buffer: the page of the virtual texture each pixel wants
+uniform sampler2D feedbackTexture;
+
+// every pixel of this pass stands for a block of feedbackScale x feedbackScale pixels, and reads
+// the one at feedbackOffset in it: the offset changes every frame, so every pixel is read in time
+uniform int feedbackScale;
+uniform ivec2 feedbackOffset;
+
+void main()
+{
+	// the last row and column of blocks are cut short when the target is not a multiple of feedbackScale
+	ivec2 texel = min(ivec2(gl_FragCoord.xy) * feedbackScale + feedbackOffset, textureSize(feedbackTexture, 0) - 1);
+	fs_out_feedback = texelFetch(feedbackTexture, texel, 0);
+}
\ No newline at end of file
@@ -4,17 +4,73 @@
 in vec3 vs_out_pos;
 in vec3 vs_out_normal;
 in vec2 vs_out_tex0;
+flat in int vs_out_material;
 
 // multiple outputs are directed into different color textures by the FBO
 layout(location=0) out vec4 fs_out_diffuse;
 layout(location=1) out vec3 fs_out_normal;
 layout(location=2) out vec4 fs_out_position;
+layout(location=3) out vec4 fs_out_feedback;	// the page of the virtual texture the pixel wants: x, y, level, 255
 
-// Different geometries may be drawn with different textures attached
-uniform sampler2D texImage;
+// Different materials are different regions of the layers of one texture array (TextureAtlas)
+uniform sampler2DArray texAtlas;
+
+layout(std140) uniform Materials
+{
+	vec4 rects[MAX_MATERIALS];		// xy: the corner of the region in its layer, zw: its size; MAX_MATERIALS is defined by the application
+	vec4 layers[MAX_MATERIALS];		// x: the layer, y: the largest level of detail that stays inside the region, z: 1 for the virtual texture
+};
+
+// The virtual texture (VirtualTexture): a texel of the page table per page of each level holds the
+// slot of the page in the cache and the level that is there (a coarser one while it loads)
+uniform sampler2D vtPageTable;
+uniform sampler2D vtCache;
+uniform vec4 vtParams;	// x: the pages across level 0, y: the page size, z: its border, w: the size of the cache, in texels
+
+// dx, dy: the derivatives of texcoord
+vec4 SampleVirtual(vec2 texcoord, vec2 dx, vec2 dy)
+{
+	int pages = int(vtParams.x);
+	float pageSize = vtParams.y, border = vtParams.z;
+
+	// the level of detail in texels of level 0, nearest level
+	dx *= pages * pageSize;
+	dy *= pages * pageSize;
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy)));
+	int level = int(clamp(lod, 0, log2(float(pages))));
+
+	vec2 uv = fract(texcoord);
+	ivec2 page = min(ivec2(uv * (pages >> level)), (pages >> level) - 1);
+	fs_out_feedback = vec4(page, level, 255) / 255;
+
+	ivec4 entry = ivec4(texelFetch(vtPageTable, page, level) * 255 + 0.5);
+	if (entry.a == 0)
+		return vec4(0.5, 0.5, 0.5, 1);	// not even the coarsest page is in yet
+
+	// where uv is in the page that is resident, at its own level
+	vec2 inPage = fract(uv * (pages >> entry.z));
+	vec2 texel = entry.xy * (pageSize + 2 * border) + border + inPage * pageSize;
+	return textureLod(vtCache, texel / vtParams.w, 0);
+}
 
 void main(void) {
 	fs_out_position = vec4(vs_out_pos,1);
-	fs_out_diffuse = vec4(texture(texImage, vs_out_tex0).xyz, 1);
 	fs_out_normal = normalize(vs_out_normal);
+	fs_out_feedback = vec4(0);
+
+	// the derivatives before the branch on the material: they need every pixel of the 2x2 quad
+	vec4 rect = rects[vs_out_material];
+	// the level of detail of the unwrapped coordinates: fract() jumps at the seams of the tiling
+	float lod = min(textureQueryLod(texAtlas, vs_out_tex0 * rect.zw).y, layers[vs_out_material].y);
+	vec2 dx = dFdx(vs_out_tex0), dy = dFdy(vs_out_tex0);
+
+	if (layers[vs_out_material].z > 0.5)
+	{
+		fs_out_diffuse = vec4(SampleVirtual(vs_out_tex0, dx, dy).xyz, 1);
+		return;
+	}
+
+	vec3 uv = vec3(rect.xy + fract(vs_out_tex0) * rect.zw, layers[vs_out_material].x);
+
+	fs_out_diffuse = vec4(textureLod(texAtlas, uv, lod).xyz, 1);
 }
\ No newline at end of file
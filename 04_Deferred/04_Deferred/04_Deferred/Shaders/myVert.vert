@@ -5,16 +5,22 @@
 layout(location=0) in vec3 vs_in_pos;
 layout(location=1) in vec3 vs_in_normal;
 layout(location=2) in vec2 vs_in_tex0;
+layout(location=4) in float vs_in_material;	// StaticBatch::MATERIAL_ATTRIBUTE, the current value for the other meshes
 
 // values that are forwarded on the pipeline
 out vec3 vs_out_pos;
 out vec3 vs_out_normal;
 out vec2 vs_out_tex0;
+flat out int vs_out_material;
 
-// transformation this shader need to perform
-uniform mat4 world;
-uniform mat4 worldIT;
-uniform mat4 MVP;
+// transformation this shader need to perform, streamed by the application through a ring buffer
+layout(std140) uniform PerObject
+{
+	mat4 MVP;
+	mat4 world;
+	mat4 worldIT;
+	vec4 Kd;
+};
 
 void main()
 {
@@ -22,4 +28,5 @@ void main()
 	vs_out_pos    = (world * vec4( vs_in_pos, 1 )).xyz;
 	vs_out_normal = (worldIT * vec4(vs_in_normal, 0)).xyz;
 	vs_out_tex0   = vs_in_tex0;
+	vs_out_material = min(int(vs_in_material + 0.5), MAX_MATERIALS - 1);	// the size of the Materials block, defined by the application
 }
\ No newline at end of file